@@ -0,0 +1,211 @@
+/*
+ * IPv4LPM and IPv6LPM lookup benchmark.
+ *
+ * Usage: bench_lpm [number of subnets] [number of lookups]
+ *
+ * Subnets are random with prefix length distribution resembling
+ * full routing tables:
+ *   IPv4: mostly /24, some /16../23, few longer ones;
+ *   IPv6: mostly /48, some /32../47, few /49../64, clustered under
+ *         random /32 allocations in 2000::/3.
+ */
+
+#define NUM_IPV6_ALLOCATIONS  16384
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "include/uw.h"
+#include "include/uw_lpm.h"
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint32_t random32()
+{
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (uint32_t) ((rng_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static uint64_t random64()
+{
+    return ((uint64_t) random32() << 32) | random32();
+}
+
+static unsigned random_ipv4_prefix_len()
+{
+    unsigned r = random32() % 100;
+    if (r < 60) {
+        return 24;
+    }
+    if (r < 95) {
+        return 16 + random32() % 8;
+    }
+    return 25 + random32() % 8;
+}
+
+static unsigned random_ipv6_prefix_len()
+{
+    unsigned r = random32() % 100;
+    if (r < 50) {
+        return 48;
+    }
+    if (r < 90) {
+        return 32 + random32() % 16;
+    }
+    return 49 + random32() % 16;
+}
+
+static IPv6address random_ipv6_address()
+{
+    // global unicast 2000::/3
+    IPv6address addr = {
+        .hi = (random64() >> 3) | 0x2000'0000'0000'0000ULL,
+        .lo = random64()
+    };
+    return addr;
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int bench_ipv4(unsigned num_subnets, unsigned num_lookups)
+{
+    UwValue lpm = uw_create_ipv4_lpm();
+    if (uw_error(&lpm)) {
+        uw_dump(stderr, &lpm);
+        return 1;
+    }
+
+    double start = now();
+    for (unsigned i = 0; i < num_subnets; i++) {
+        unsigned prefix_len = random_ipv4_prefix_len();
+        IPv4subnet subnet;
+        subnet.netmask = 0xFFFFFFFF << (32 - prefix_len);
+        subnet.subnet = random32() & subnet.netmask;
+        UwValue key = UwUnsigned(subnet.value);
+        UwValue value = UwUnsigned(i);
+        UwValue status = uw_ipv4_lpm_insert(&lpm, &key, &value);
+        if (uw_error(&status)) {
+            uw_dump(stderr, &status);
+            return 1;
+        }
+    }
+    double elapsed = now() - start;
+    printf("IPv4: inserted %u subnets in %.3f s\n", uw_ipv4_lpm_length(&lpm), elapsed);
+
+    uint32_t* addrs = malloc(num_lookups * sizeof(uint32_t));
+    uint32_t* value_ids = malloc(num_lookups * sizeof(uint32_t));
+    if (!addrs || !value_ids) {
+        fputs("OOM\n", stderr);
+        return 1;
+    }
+    for (unsigned i = 0; i < num_lookups; i++) {
+        addrs[i] = random32();
+    }
+
+    unsigned found = 0;
+    start = now();
+    for (unsigned i = 0; i < num_lookups; i++) {
+        found += uw_ipv4_lpm_find(&lpm, addrs[i]) != 0;
+    }
+    elapsed = now() - start;
+    printf("IPv4 find:       %.1f M lookups/sec, %u matched\n", num_lookups / elapsed / 1e6, found);
+
+    start = now();
+    uw_ipv4_lpm_find_batch(&lpm, addrs, value_ids, num_lookups);
+    elapsed = now() - start;
+    found = 0;
+    for (unsigned i = 0; i < num_lookups; i++) {
+        found += value_ids[i] != 0;
+    }
+    printf("IPv4 find_batch: %.1f M lookups/sec, %u matched\n", num_lookups / elapsed / 1e6, found);
+
+    free(addrs);
+    free(value_ids);
+    return 0;
+}
+
+static int bench_ipv6(unsigned num_subnets, unsigned num_lookups)
+{
+    UwValue lpm = uw_create_ipv6_lpm();
+    if (uw_error(&lpm)) {
+        uw_dump(stderr, &lpm);
+        return 1;
+    }
+
+    // look up addresses from inserted subnets, random addresses in 2000::/3 would rarely match
+    IPv6address* addrs = malloc(num_lookups * sizeof(IPv6address));
+    uint32_t* value_ids = malloc(num_lookups * sizeof(uint32_t));
+    IPv6address* subnets = malloc(num_subnets * sizeof(IPv6address));
+    if (!addrs || !value_ids || !subnets) {
+        fputs("OOM\n", stderr);
+        return 1;
+    }
+
+    IPv6address allocations[NUM_IPV6_ALLOCATIONS];
+    for (unsigned i = 0; i < NUM_IPV6_ALLOCATIONS; i++) {
+        allocations[i] = random_ipv6_address();
+    }
+
+    double start = now();
+    for (unsigned i = 0; i < num_subnets; i++) {
+        IPv6address* allocation = &allocations[random32() % NUM_IPV6_ALLOCATIONS];
+        subnets[i].hi = (allocation->hi & 0xFFFF'FFFF'0000'0000ULL) | random32();
+        subnets[i].lo = random64();
+        UwValue key = uw_create_ipv6(&subnets[i], random_ipv6_prefix_len());
+        UwValue value = UwUnsigned(i);
+        UwValue status = uw_ipv6_lpm_insert(&lpm, &key, &value);
+        if (uw_error(&status)) {
+            uw_dump(stderr, &status);
+            return 1;
+        }
+    }
+    double elapsed = now() - start;
+    printf("IPv6: inserted %u subnets in %.3f s\n", uw_ipv6_lpm_length(&lpm), elapsed);
+
+    for (unsigned i = 0; i < num_lookups; i++) {
+        addrs[i] = subnets[random32() % num_subnets];
+        addrs[i].lo = random64();
+    }
+
+    unsigned found = 0;
+    start = now();
+    for (unsigned i = 0; i < num_lookups; i++) {
+        found += uw_ipv6_lpm_find(&lpm, &addrs[i]) != 0;
+    }
+    elapsed = now() - start;
+    printf("IPv6 find:       %.1f M lookups/sec, %u matched\n", num_lookups / elapsed / 1e6, found);
+
+    start = now();
+    uw_ipv6_lpm_find_batch(&lpm, addrs, value_ids, num_lookups);
+    elapsed = now() - start;
+    found = 0;
+    for (unsigned i = 0; i < num_lookups; i++) {
+        found += value_ids[i] != 0;
+    }
+    printf("IPv6 find_batch: %.1f M lookups/sec, %u matched\n", num_lookups / elapsed / 1e6, found);
+
+    free(addrs);
+    free(value_ids);
+    free(subnets);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned num_subnets = (argc > 1)? (unsigned) atol(argv[1]) : 500'000;
+    unsigned num_lookups = (argc > 2)? (unsigned) atol(argv[2]) : 10'000'000;
+
+    if (bench_ipv4(num_subnets, num_lookups)) {
+        return 1;
+    }
+    return bench_ipv6(num_subnets, num_lookups);
+}
@@ -0,0 +1,1328 @@
+/*
+ * Micro and macro benchmarks.
+ *
+ * Usage: uw_bench [-j] [-t milliseconds] [-r repeats]
+ *                 [-w baseline.json] [-b baseline.json [-T percent]]
+ *                 [name filter...]
+ *
+ * Each benchmark runs with the number of iterations growing until
+ * a single run takes at least the given time (default 200 ms),
+ * then it is repeated (default 5 times, 9 with -w or -b) and
+ * the median time and median absolute deviation (MAD) are reported.
+ *
+ * Output is tab-separated, one line per benchmark:
+ *
+ *   name  ns/op  mad ns/op  bytes/op  allocs/op  iterations
+ *
+ * or JSON lines with -j option. Bytes and allocations are counted
+ * by wrapping default allocator, so they include reallocations
+ * and do not include memory allocated by malloc directly.
+ *
+ * Data is generated from fixed seed so the results are reproducible.
+ *
+ * With -w each benchmark runs three times and the median run is saved
+ * to baseline file along with description of the host: CPU model,
+ * number of CPUs, compiler, and refcount mode.
+ *
+ * With -b results are compared with baseline file and the report
+ * is printed after results. Time regresses when it exceeds baseline
+ * by more than threshold (default 20%) and the difference is greater
+ * than three MADs, so noisy benchmarks do not fail spuriously.
+ * Time is compared only if the baseline was recorded on the same host.
+ * Benchmarks that look slower are run up to three times more, each
+ * after a pause, and the fastest run is taken, so a host that is busy
+ * for a while does not fail the check.
+ * Bytes and allocations are deterministic and regress when they
+ * exceed baseline by more than threshold. Exit status is 1 if any
+ * benchmark regressed.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "include/uw.h"
+#include "include/uw_csv.h"
+#include "include/uw_frozen_map.h"
+#include "include/uw_json.h"
+#include "include/uw_netutils.h"
+
+/****************************************************************
+ * Allocation accounting
+ */
+
+static Allocator orig_allocator;
+
+static uint64_t num_allocs = 0;
+static uint64_t num_bytes = 0;
+
+static void* counting_allocate(unsigned nbytes, bool clean)
+{
+    num_allocs++;
+    num_bytes += nbytes;
+    return orig_allocator.allocate(nbytes, clean);
+}
+
+static bool counting_reallocate(void** addr_ptr, unsigned old_nbytes, unsigned new_nbytes, bool clean, void* unused)
+{
+    num_allocs++;
+    if (new_nbytes > old_nbytes) {
+        num_bytes += new_nbytes - old_nbytes;
+    }
+    return orig_allocator.reallocate(addr_ptr, old_nbytes, new_nbytes, clean, unused);
+}
+
+static void install_counting_allocator()
+{
+    orig_allocator = default_allocator;
+    default_allocator.allocate = counting_allocate;
+    default_allocator.reallocate = counting_reallocate;
+}
+
+/****************************************************************
+ * Timer
+ */
+
+typedef struct {
+    uint64_t ns;
+    uint64_t allocs;
+    uint64_t bytes;
+    uint64_t start_ns;
+    uint64_t start_allocs;
+    uint64_t start_bytes;
+} BenchTimer;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000'000'000ULL + ts.tv_nsec;
+}
+
+static void start_timer(BenchTimer* timer)
+{
+    timer->start_allocs = num_allocs;
+    timer->start_bytes = num_bytes;
+    timer->start_ns = now_ns();
+}
+
+static void stop_timer(BenchTimer* timer)
+{
+    timer->ns += now_ns() - timer->start_ns;
+    timer->allocs += num_allocs - timer->start_allocs;
+    timer->bytes += num_bytes - timer->start_bytes;
+}
+
+/*
+ * Benchmark function runs `n` operations.
+ * The timer is started before the call and stopped after it.
+ * Benchmarks stop the timer for the setup that should not be measured.
+ */
+typedef void (*BenchFunc)(BenchTimer* timer, unsigned n);
+
+static void bench_error(UwValuePtr status)
+{
+    uw_dump(stderr, status);
+    exit(1);
+}
+
+/****************************************************************
+ * Data
+ */
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint32_t random32()
+{
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (uint32_t) ((rng_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static char* words[] = {
+    "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel",
+    "india", "juliett", "kilo", "lima", "mike", "november", "oscar", "papa"
+};
+
+#define NUM_WORDS  (sizeof(words) / sizeof(words[0]))
+
+// number of items in collections for container benchmarks
+#define NUM_ITEMS  4096
+
+#define NUM_LINES  4096
+
+static UwResult make_text()
+/*
+ * Return NUM_LINES lines of random words.
+ */
+{
+    UwValue text = uw_create_empty_string(NUM_LINES * 64, 1);
+    if (uw_error(&text)) {
+        return uw_move(&text);
+    }
+    for (unsigned i = 0; i < NUM_LINES; i++) {
+        unsigned num_words = 4 + random32() % 8;
+        for (unsigned j = 0; j < num_words; j++) {
+            if (j) {
+                uw_string_append(&text, ' ');
+            }
+            uw_string_append(&text, words[random32() % NUM_WORDS]);
+        }
+        uw_string_append(&text, '\n');
+    }
+    return uw_move(&text);
+}
+
+/****************************************************************
+ * Strings
+ */
+
+static void bench_string_create(BenchTimer* timer, unsigned n)
+{
+    for (unsigned i = 0; i < n; i++) {
+        UwValue s = uw_create_string("The quick brown fox jumps over the lazy dog");
+    }
+}
+
+static void bench_string_append(BenchTimer* timer, unsigned n)
+/*
+ * One operation is building 256-character string from 8-character pieces.
+ */
+{
+    for (unsigned i = 0; i < n; i++) {
+        UwValue s = uw_create_string("");
+        for (unsigned j = 0; j < 32; j++) {
+            uw_string_append(&s, "abcdefgh");
+        }
+    }
+}
+
+static void bench_string_width_promotion(BenchTimer* timer, unsigned n)
+/*
+ * One operation is appending non-BMP character to 64-character ASCII string.
+ */
+{
+    for (unsigned i = 0; i < n; i++) {
+        UwValue s = uw_create_string("0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef");
+        uw_string_append(&s, U"\U0001F600");
+    }
+}
+
+static void bench_string_split(BenchTimer* timer, unsigned n)
+{
+    stop_timer(timer);
+    UwValue s = uw_create_string("");
+    for (unsigned i = 0; i < NUM_WORDS; i++) {
+        if (i) {
+            uw_string_append(&s, ' ');
+        }
+        uw_string_append(&s, words[i]);
+    }
+    start_timer(timer);
+
+    for (unsigned i = 0; i < n; i++) {
+        UwValue parts = uw_string_split_chr(&s, ' ');
+    }
+}
+
+static void bench_list_join(BenchTimer* timer, unsigned n)
+{
+    stop_timer(timer);
+    UwValue list = UwList();
+    for (unsigned i = 0; i < NUM_WORDS; i++) {
+        uw_list_append(&list, words[i]);
+    }
+    start_timer(timer);
+
+    for (unsigned i = 0; i < n; i++) {
+        UwValue s = uw_list_join(' ', &list);
+    }
+}
+
+static void bench_hash_string(BenchTimer* timer, unsigned n)
+{
+    stop_timer(timer);
+    UwValue s = uw_create_string("0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef");
+    UwType_Hash h = 0;
+    start_timer(timer);
+
+    for (unsigned i = 0; i < n; i++) {
+        h += uw_hash(&s);
+    }
+    asm volatile ("" :: "r"(h));
+}
+
+static void bench_hash_int(BenchTimer* timer, unsigned n)
+{
+    UwType_Hash h = 0;
+    for (unsigned i = 0; i < n; i++) {
+        UwValue v = UwSigned(i);
+        h += uw_hash(&v);
+    }
+    asm volatile ("" :: "r"(h));
+}
+
+/****************************************************************
+ * Containers
+ */
+
+static void bench_map_insert(BenchTimer* timer, unsigned n)
+/*
+ * Insert integer keys to map, starting new one after NUM_ITEMS keys.
+ */
+{
+    UwValue map = UwNull();
+    for (unsigned i = 0; i < n; i++) {
+        if (i % NUM_ITEMS == 0) {
+            uw_destroy(&map);
+            map = UwMap();
+        }
+        UwValue key = UwSigned(i);
+        UwValue value = UwSigned(i);
+        if (!uw_map_update(&map, &key, &value)) {
+            exit(1);
+        }
+    }
+}
+
+static void bench_map_lookup(BenchTimer* timer, unsigned n)
+{
+    stop_timer(timer);
+    UwValue map = UwMap();
+    for (unsigned i = 0; i < NUM_ITEMS; i++) {
+        UwValue key = UwSigned(i);
+        uw_map_update(&map, &key, &key);
+    }
+    start_timer(timer);
+
+    for (unsigned i = 0; i < n; i++) {
+        UwValue v = uw_map_get(&map, (int) (i % NUM_ITEMS));
+    }
+}
+
+static void bench_map_lookup_string(BenchTimer* timer, unsigned n)
+{
+    stop_timer(timer);
+    UwValue map = UwMap();
+    UwValue keys = UwList();
+    for (unsigned i = 0; i < NUM_ITEMS; i++) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%s-%u", words[i % NUM_WORDS], i);
+        UwValue key = uw_create_string(buf);
+        uw_map_update(&map, &key, &key);
+        uw_list_append(&keys, &key);
+    }
+    start_timer(timer);
+
+    for (unsigned i = 0; i < n; i++) {
+        UwValue key = uw_list_item(&keys, i % NUM_ITEMS);
+        UwValue v = uw_map_get(&map, &key);
+    }
+}
+
+static void bench_frozen_map_get(BenchTimer* timer, unsigned n)
+/*
+ * Same as map_lookup_string for frozen map image with string values.
+ */
+{
+    stop_timer(timer);
+    UwValue map = UwMap();
+    UwValue keys = UwList();
+    for (unsigned i = 0; i < NUM_ITEMS; i++) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%s-%u", words[i % NUM_WORDS], i);
+        UwValue key = uw_create_string(buf);
+        snprintf(buf, sizeof(buf), "value of %s-%u", words[i % NUM_WORDS], i);
+        UwValue value = uw_create_string(buf);
+        uw_map_update(&map, &key, &value);
+        uw_list_append(&keys, &key);
+    }
+    char filename[] = "/tmp/uw-bench-XXXXXX";
+    int fd = mkstemp(filename);
+    if (fd == -1) {
+        perror("mkstemp");
+        exit(1);
+    }
+    unlink(filename);
+    UwValue file = uw_create_file();
+    UwValue status = uw_file_set_fd(&file, fd);
+    if (uw_error(&status)) {
+        bench_error(&status);
+    }
+    UwValue freeze_status = uw_freeze_map(&map, &file);
+    if (uw_error(&freeze_status)) {
+        bench_error(&freeze_status);
+    }
+    UwValue frozen_map = uw_open_frozen_map(&file);
+    if (uw_error(&frozen_map)) {
+        bench_error(&frozen_map);
+    }
+    start_timer(timer);
+
+    for (unsigned i = 0; i < n; i++) {
+        UwValue key = uw_list_item(&keys, i % NUM_ITEMS);
+        UwValue v = uw_frozen_map_get(&frozen_map, &key);
+    }
+}
+
+static void bench_map_delete(BenchTimer* timer, unsigned n)
+{
+    UwValue map = UwNull();
+    for (unsigned i = 0; i < n; i++) {
+        if (i % NUM_ITEMS == 0) {
+            stop_timer(timer);
+            uw_destroy(&map);
+            map = UwMap();
+            for (unsigned j = 0; j < NUM_ITEMS; j++) {
+                UwValue key = UwSigned(j);
+                uw_map_update(&map, &key, &key);
+            }
+            start_timer(timer);
+        }
+        uw_map_del(&map, (int) (i % NUM_ITEMS));
+    }
+}
+
+static void bench_list_append(BenchTimer* timer, unsigned n)
+{
+    UwValue list = UwNull();
+    for (unsigned i = 0; i < n; i++) {
+        if (i % NUM_ITEMS == 0) {
+            uw_destroy(&list);
+            list = UwList();
+        }
+        uw_list_append(&list, i);
+    }
+}
+
+static void bench_list_slice(BenchTimer* timer, unsigned n)
+/*
+ * One operation is slicing 512 items from the middle of list.
+ */
+{
+    stop_timer(timer);
+    UwValue list = UwList();
+    for (unsigned i = 0; i < 1024; i++) {
+        uw_list_append(&list, i);
+    }
+    start_timer(timer);
+
+    for (unsigned i = 0; i < n; i++) {
+        UwValue slice = uw_list_slice(&list, 256, 768);
+    }
+}
+
+static void bench_compound_adopt_abandon(BenchTimer* timer, unsigned n)
+/*
+ * One operation is appending compound value to list and deleting it.
+ */
+{
+    stop_timer(timer);
+    UwValue parent = UwList();
+    UwValue child = UwList(UwSigned(1), UwSigned(2), UwSigned(3));
+    start_timer(timer);
+
+    for (unsigned i = 0; i < n; i++) {
+        uw_list_append(&parent, &child);
+        uw_list_del(&parent, 0, 1);
+    }
+}
+
+/****************************************************************
+ * Line readers
+ */
+
+static char text_filename[] = "/tmp/uw-bench-XXXXXX";
+
+static _UwValue text = {};
+
+static bool make_text_file()
+{
+    text = make_text();
+    if (uw_error(&text)) {
+        bench_error(&text);
+    }
+    int fd = mkstemp(text_filename);
+    if (fd == -1) {
+        perror("mkstemp");
+        return false;
+    }
+    UwValue file = uw_create_file();
+    UwValue status = uw_file_set_fd(&file, fd);
+    if (uw_error(&status)) {
+        bench_error(&status);
+    }
+    UwValue write_status = uw_file_write_string(&file, &text);
+    if (uw_error(&write_status)) {
+        bench_error(&write_status);
+    }
+    return true;
+}
+
+static void read_lines(BenchTimer* timer, unsigned n, bool from_file)
+{
+    UwValue reader = UwNull();
+    UwValue line = uw_create_string("");
+    for (unsigned i = 0; i < n; i++) {
+        if (i % NUM_LINES == 0) {
+            stop_timer(timer);
+            uw_destroy(&reader);
+            if (from_file) {
+                reader = uw_file_open(text_filename, O_RDONLY, 0);
+            } else {
+                reader = uw_create_string_io(&text);
+            }
+            if (uw_error(&reader)) {
+                bench_error(&reader);
+            }
+            UwValue status = uw_start_read_lines(&reader);
+            if (uw_error(&status)) {
+                bench_error(&status);
+            }
+            start_timer(timer);
+        }
+        UwValue status = uw_read_line_inplace(&reader, &line);
+        if (uw_error(&status)) {
+            bench_error(&status);
+        }
+    }
+}
+
+static void bench_file_read_lines(BenchTimer* timer, unsigned n)
+{
+    read_lines(timer, n, true);
+}
+
+static void bench_string_io_read_lines(BenchTimer* timer, unsigned n)
+{
+    read_lines(timer, n, false);
+}
+
+static UwResult make_csv()
+/*
+ * Return NUM_LINES rows of eight fields: words, numbers,
+ * and quoted fields with delimiters and escaped quotes.
+ */
+{
+    UwValue csv = uw_create_empty_string(NUM_LINES * 80, 1);
+    if (uw_error(&csv)) {
+        return uw_move(&csv);
+    }
+    char buf[32];
+    for (unsigned i = 0; i < NUM_LINES; i++) {
+        for (unsigned j = 0; j < 8; j++) {
+            if (j) {
+                uw_string_append(&csv, ',');
+            }
+            switch (j % 4) {
+                case 0:
+                case 1:
+                    uw_string_append(&csv, words[random32() % NUM_WORDS]);
+                    break;
+                case 2:
+                    snprintf(buf, sizeof(buf), "%u", random32() % 100'000);
+                    uw_string_append(&csv, buf);
+                    break;
+                case 3:
+                    uw_string_append(&csv, '"');
+                    uw_string_append(&csv, words[random32() % NUM_WORDS]);
+                    uw_string_append(&csv, (random32() & 1)? ", \"\"" : " ");
+                    uw_string_append(&csv, words[random32() % NUM_WORDS]);
+                    uw_string_append(&csv, '"');
+                    break;
+            }
+        }
+        uw_string_append(&csv, '\n');
+    }
+    return uw_move(&csv);
+}
+
+static void bench_csv_parse(BenchTimer* timer, unsigned n)
+/*
+ * One operation is reading a row of eight fields from StringIO.
+ */
+{
+    stop_timer(timer);
+    UwValue csv = make_csv();
+    if (uw_error(&csv)) {
+        bench_error(&csv);
+    }
+    UwValue reader = UwNull();
+    UwValue row = UwList();
+    start_timer(timer);
+
+    for (unsigned i = 0; i < n; i++) {
+        if (i % NUM_LINES == 0) {
+            stop_timer(timer);
+            uw_destroy(&reader);
+            UwValue sio = uw_create_string_io(&csv);
+            if (uw_error(&sio)) {
+                bench_error(&sio);
+            }
+            reader = uw_create_csv_reader(&sio, ',');
+            if (uw_error(&reader)) {
+                bench_error(&reader);
+            }
+            start_timer(timer);
+        }
+        UwValue status = uw_csv_read_row(&reader, &row);
+        if (uw_error(&status)) {
+            bench_error(&status);
+        }
+    }
+}
+
+/****************************************************************
+ * Network utilities
+ */
+
+static void bench_ipv4_parse(BenchTimer* timer, unsigned n)
+{
+    stop_timer(timer);
+    UwValue addrs = UwList();
+    for (unsigned i = 0; i < 256; i++) {
+        uint32_t a = random32();
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%u.%u.%u.%u", a >> 24, (a >> 16) & 255, (a >> 8) & 255, a & 255);
+        uw_list_append(&addrs, buf);
+    }
+    start_timer(timer);
+
+    for (unsigned i = 0; i < n; i++) {
+        UwValue addr = uw_list_item(&addrs, i % 256);
+        UwValue result = uw_parse_ipv4_address(&addr);
+    }
+}
+
+static void bench_ipv4_parse_subnet(BenchTimer* timer, unsigned n)
+{
+    stop_timer(timer);
+    UwValue subnets = UwList();
+    for (unsigned i = 0; i < 256; i++) {
+        uint32_t a = random32();
+        char buf[24];
+        snprintf(buf, sizeof(buf), "%u.%u.%u.%u/%u",
+                 a >> 24, (a >> 16) & 255, (a >> 8) & 255, a & 255, 8 + random32() % 25);
+        uw_list_append(&subnets, buf);
+    }
+    UwValue netmask = UwNull();
+    start_timer(timer);
+
+    for (unsigned i = 0; i < n; i++) {
+        UwValue subnet = uw_list_item(&subnets, i % 256);
+        UwValue result = uw_parse_ipv4_subnet(&subnet, &netmask);
+    }
+}
+
+/****************************************************************
+ * Macro benchmarks
+ */
+
+static void bench_word_count(BenchTimer* timer, unsigned n)
+/*
+ * One operation is reading line from StringIO, splitting it
+ * and counting words in map.
+ */
+{
+    UwValue reader = UwNull();
+    UwValue counts = UwMap();
+    UwValue line = uw_create_string("");
+    for (unsigned i = 0; i < n; i++) {
+        if (i % NUM_LINES == 0) {
+            stop_timer(timer);
+            uw_destroy(&reader);
+            reader = uw_create_string_io(&text);
+            start_timer(timer);
+        }
+        UwValue status = uw_read_line_inplace(&reader, &line);
+        if (uw_error(&status)) {
+            bench_error(&status);
+        }
+        uw_string_trim(&line);
+        UwValue line_words = uw_string_split_chr(&line, ' ');
+        unsigned num_words = uw_list_length(&line_words);
+        for (unsigned j = 0; j < num_words; j++) {
+            UwValue word = uw_list_item(&line_words, j);
+            UwValue count = uw_map_get(&counts, &word);
+            UwValue new_count = UwSigned(uw_is_signed(&count)? count.signed_value + 1 : 1);
+            uw_map_update(&counts, &word, &new_count);
+        }
+    }
+}
+
+/****************************************************************
+ * Cross-thread handoff
+ *
+ * Producer sends values to consumer thread through a ring buffer,
+ * consumer looks up a key and destroys the value.
+ * Sharing clones is safe only with UW_ATOMIC_REFCOUNT, otherwise
+ * values have to be deeply copied or frozen.
+ */
+
+typedef enum {
+    HANDOFF_DEEPCOPY,
+    HANDOFF_CLONE,
+    HANDOFF_FROZEN  // clone of frozen value
+} HandoffMode;
+
+#define HANDOFF_QUEUE_SIZE  64  // must be power of two
+
+typedef struct {
+    _UwValue items[HANDOFF_QUEUE_SIZE];
+    unsigned head;  // written by producer
+    unsigned tail;  // written by consumer
+} HandoffQueue;
+
+static void* handoff_consumer(void* arg)
+{
+    HandoffQueue* queue = arg;
+    unsigned tail = 0;
+    for (;;) {
+        while (__atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) == tail) {
+            sched_yield();
+        }
+        UwValuePtr item = &queue->items[tail & (HANDOFF_QUEUE_SIZE - 1)];
+        if (uw_is_null(item)) {
+            // end of data
+            break;
+        }
+        UwValue value = uw_map_get(item, "key-7");
+        if (!uw_is_string(&value)) {
+            bench_error(&value);
+        }
+        uw_destroy(item);
+        __atomic_store_n(&queue->tail, ++tail, __ATOMIC_RELEASE);
+    }
+    return nullptr;
+}
+
+static void handoff(BenchTimer* timer, unsigned n, HandoffMode mode)
+/*
+ * One operation is sending a map of 32 strings to another thread.
+ */
+{
+    stop_timer(timer);
+    UwValue arena = uw_create_freeze_arena();
+    UwValue map = UwMap();
+    for (unsigned i = 0; i < 32; i++) {
+        char key[32];
+        char value[64];
+        snprintf(key, sizeof(key), "key-%u", i);
+        snprintf(value, sizeof(value), "a value long enough to be allocated, %s", words[i % NUM_WORDS]);
+        UwValue k = uw_create_string(key);
+        UwValue v = uw_create_string(value);
+        uw_map_update(&map, &k, &v);
+    }
+    if (mode == HANDOFF_FROZEN) {
+        UwValue status = uw_freeze_into(&arena, &map);
+        if (uw_error(&status)) {
+            bench_error(&status);
+        }
+    }
+    HandoffQueue* queue = calloc(1, sizeof(HandoffQueue));
+    pthread_t consumer;
+    if (!queue || pthread_create(&consumer, nullptr, handoff_consumer, queue)) {
+        fputs("Cannot start consumer thread\n", stderr);
+        exit(1);
+    }
+    start_timer(timer);
+
+    unsigned head = 0;
+    for (unsigned i = 0; i <= n; i++) {
+        while (head - __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) == HANDOFF_QUEUE_SIZE) {
+            sched_yield();
+        }
+        UwValuePtr item = &queue->items[head & (HANDOFF_QUEUE_SIZE - 1)];
+        if (i == n) {
+            *item = UwNull();
+        } else {
+            *item = (mode == HANDOFF_DEEPCOPY)? uw_deepcopy(&map) : uw_clone(&map);
+            if (uw_error(item)) {
+                bench_error(item);
+            }
+        }
+        __atomic_store_n(&queue->head, ++head, __ATOMIC_RELEASE);
+    }
+    pthread_join(consumer, nullptr);
+
+    stop_timer(timer);
+    free(queue);
+    start_timer(timer);
+}
+
+static void bench_handoff_deepcopy(BenchTimer* timer, unsigned n)
+{
+    handoff(timer, n, HANDOFF_DEEPCOPY);
+}
+
+#ifdef UW_ATOMIC_REFCOUNT
+static void bench_handoff_clone(BenchTimer* timer, unsigned n)
+{
+    handoff(timer, n, HANDOFF_CLONE);
+}
+#endif
+
+static void bench_handoff_frozen(BenchTimer* timer, unsigned n)
+{
+    handoff(timer, n, HANDOFF_FROZEN);
+}
+
+static void bench_clone_destroy(BenchTimer* timer, unsigned n)
+/*
+ * One operation is cloning and destroying allocated string,
+ * i.e. reference count increment and decrement.
+ */
+{
+    stop_timer(timer);
+    UwValue str = uw_create_string("a string long enough not to be embedded in the value itself");
+    start_timer(timer);
+
+    for (unsigned i = 0; i < n; i++) {
+        UwValue clone = uw_clone(&str);
+    }
+}
+
+static void bench_clone_destroy_frozen(BenchTimer* timer, unsigned n)
+/*
+ * Same as clone_destroy for frozen string, reference count is not touched.
+ */
+{
+    stop_timer(timer);
+    UwValue arena = uw_create_freeze_arena();
+    UwValue str = uw_create_string("a string long enough not to be embedded in the value itself");
+    UwValue status = uw_freeze_into(&arena, &str);
+    if (uw_error(&status)) {
+        bench_error(&status);
+    }
+    start_timer(timer);
+
+    for (unsigned i = 0; i < n; i++) {
+        UwValue clone = uw_clone(&str);
+    }
+}
+
+/****************************************************************
+ * Runner
+ */
+
+typedef struct {
+    char* name;
+    BenchFunc func;
+} Benchmark;
+
+static Benchmark benchmarks[] = {
+    { "string_create",            bench_string_create },
+    { "string_append",            bench_string_append },
+    { "string_width_promotion",   bench_string_width_promotion },
+    { "string_split",             bench_string_split },
+    { "list_join",                bench_list_join },
+    { "hash_string",              bench_hash_string },
+    { "hash_int",                 bench_hash_int },
+    { "map_insert",               bench_map_insert },
+    { "map_lookup",               bench_map_lookup },
+    { "map_lookup_string",        bench_map_lookup_string },
+    { "frozen_map_get",           bench_frozen_map_get },
+    { "map_delete",               bench_map_delete },
+    { "list_append",              bench_list_append },
+    { "list_slice",               bench_list_slice },
+    { "compound_adopt_abandon",   bench_compound_adopt_abandon },
+    { "file_read_lines",          bench_file_read_lines },
+    { "string_io_read_lines",     bench_string_io_read_lines },
+    { "csv_parse",                bench_csv_parse },
+    { "ipv4_parse",               bench_ipv4_parse },
+    { "ipv4_parse_subnet",        bench_ipv4_parse_subnet },
+    { "word_count",               bench_word_count },
+    { "clone_destroy",            bench_clone_destroy },
+    { "clone_destroy_frozen",     bench_clone_destroy_frozen },
+#ifdef UW_ATOMIC_REFCOUNT
+    { "handoff_clone",            bench_handoff_clone },
+#endif
+    { "handoff_frozen",           bench_handoff_frozen },
+    { "handoff_deepcopy",         bench_handoff_deepcopy }
+};
+
+#define NUM_BENCHMARKS  (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+#define MAX_REPEATS    32
+#define CONFIRM_RUNS   3  // reruns of benchmark that looks regressed
+#define CONFIRM_PAUSE  1  // seconds to wait before each rerun
+#define BASELINE_RUNS  3  // runs of each benchmark for baseline
+#define BASELINE_REPEATS  9  // default repeats when writing or comparing baseline
+
+static BenchTimer run_benchmark(Benchmark* bench, unsigned n)
+{
+    BenchTimer timer = {};
+    start_timer(&timer);
+    bench->func(&timer, n);
+    stop_timer(&timer);
+    return timer;
+}
+
+static int compare_uint64(const void* a, const void* b)
+{
+    uint64_t x = *(uint64_t*) a;
+    uint64_t y = *(uint64_t*) b;
+    return (x > y) - (x < y);
+}
+
+static bool selected(char* name, int num_filters, char** filters)
+{
+    if (num_filters == 0) {
+        return true;
+    }
+    for (int i = 0; i < num_filters; i++) {
+        if (strstr(name, filters[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+typedef struct {
+    char* name;
+    Benchmark* bench;
+    double ns_per_op;
+    double mad_ns_per_op;
+    double bytes_per_op;
+    double allocs_per_op;
+    unsigned iterations;
+} BenchResult;
+
+static BenchResult measure(Benchmark* bench, uint64_t min_time_ns, unsigned repeats)
+{
+    // find the number of iterations
+    unsigned n = 1;
+    BenchTimer timer;
+    for (;;) {
+        timer = run_benchmark(bench, n);
+        if (timer.ns >= min_time_ns || n >= 1000'000'000U) {
+            break;
+        }
+        // aim slightly above min_time but grow no more than 100 times
+        uint64_t next_n = timer.ns? n * min_time_ns * 6 / 5 / timer.ns : n * 100ULL;
+        if (next_n > n * 100ULL) {
+            next_n = n * 100ULL;
+        }
+        if (next_n <= n) {
+            next_n = n + 1;
+        }
+        if (next_n > 1000'000'000U) {
+            next_n = 1000'000'000U;
+        }
+        n = (unsigned) next_n;
+    }
+    uint64_t times[MAX_REPEATS];
+    times[0] = timer.ns;
+    for (unsigned r = 1; r < repeats; r++) {
+        times[r] = run_benchmark(bench, n).ns;
+    }
+    qsort(times, repeats, sizeof(uint64_t), compare_uint64);
+    uint64_t median = times[repeats / 2];
+
+    // median absolute deviation
+    uint64_t deviations[MAX_REPEATS];
+    for (unsigned r = 0; r < repeats; r++) {
+        deviations[r] = (times[r] > median)? times[r] - median : median - times[r];
+    }
+    qsort(deviations, repeats, sizeof(uint64_t), compare_uint64);
+
+    return (BenchResult) {
+        .name          = bench->name,
+        .bench         = bench,
+        .ns_per_op     = (double) median / n,
+        .mad_ns_per_op = (double) deviations[repeats / 2] / n,
+        .bytes_per_op  = (double) timer.bytes / n,
+        .allocs_per_op = (double) timer.allocs / n,
+        .iterations    = n
+    };
+}
+
+static BenchResult measure_typical(Benchmark* bench, uint64_t min_time_ns, unsigned repeats)
+/*
+ * Measure benchmark BASELINE_RUNS times and return the median run,
+ * so the baseline is neither a lucky nor an unlucky one.
+ */
+{
+    BenchResult runs[BASELINE_RUNS];
+    for (unsigned i = 0; i < BASELINE_RUNS; i++) {
+        runs[i] = measure(bench, min_time_ns, repeats);
+    }
+    // insertion sort by time
+    for (unsigned i = 1; i < BASELINE_RUNS; i++) {
+        BenchResult run = runs[i];
+        unsigned j = i;
+        for (; j && runs[j - 1].ns_per_op > run.ns_per_op; j--) {
+            runs[j] = runs[j - 1];
+        }
+        runs[j] = run;
+    }
+    return runs[BASELINE_RUNS / 2];
+}
+
+/****************************************************************
+ * Baseline
+ */
+
+#if defined(__clang__)
+#   define COMPILER  __VERSION__
+#elif defined(__GNUC__)
+#   define COMPILER  "gcc " __VERSION__
+#else
+#   define COMPILER  "unknown"
+#endif
+
+static UwResult host_info()
+/*
+ * Return description of the host and build timings depend on.
+ */
+{
+    char cpu[256] = "unknown";
+    FILE* fp = fopen("/proc/cpuinfo", "r");
+    if (fp) {
+        char line[512];
+        while (fgets(line, sizeof(line), fp)) {
+            char* colon = strchr(line, ':');
+            if (colon && strncmp(line, "model name", 10) == 0) {
+                snprintf(cpu, sizeof(cpu), "%s", colon + 2);
+                cpu[strcspn(cpu, "\n")] = 0;
+                break;
+            }
+        }
+        fclose(fp);
+    }
+#ifdef UW_ATOMIC_REFCOUNT
+    bool atomic_refcount = true;
+#else
+    bool atomic_refcount = false;
+#endif
+    return UwMap(
+        UwCharPtr("cpu"),             UwCharPtr(cpu),
+        UwCharPtr("cpus"),            UwSigned(sysconf(_SC_NPROCESSORS_ONLN)),
+        UwCharPtr("compiler"),        UwCharPtr(COMPILER),
+        UwCharPtr("atomic_refcount"), UwBool(atomic_refcount)
+    );
+}
+
+static void print_host(char* title, UwValuePtr host)
+{
+    UwValue cpu = uw_map_get(host, "cpu");
+    UwValue cpus = uw_map_get(host, "cpus");
+    UwValue compiler = uw_map_get(host, "compiler");
+    UwValue atomic_refcount = uw_map_get(host, "atomic_refcount");
+
+    CString cpu_str = uw_is_string(&cpu)? uw_string_to_cstring(&cpu) : nullptr;
+    CString compiler_str = uw_is_string(&compiler)? uw_string_to_cstring(&compiler) : nullptr;
+    printf("%s: %s, %lld CPUs, compiler %s, %s refcount\n", title,
+           cpu_str? cpu_str : "unknown",
+           uw_is_signed(&cpus)? (long long) cpus.signed_value : 0LL,
+           compiler_str? compiler_str : "unknown",
+           (uw_is_bool(&atomic_refcount) && atomic_refcount.bool_value)? "atomic" : "plain");
+}
+
+static bool write_baseline(char* filename, BenchResult* results, unsigned num_results)
+{
+    UwValue baseline = UwMap();
+    if (uw_error(&baseline)) {
+        return false;
+    }
+    // benchmark names do not start with underscore
+    UwValue host = host_info();
+    if (uw_error(&host)) {
+        return false;
+    }
+    UwValue host_key = uw_create_string("_host");
+    if (!uw_map_update(&baseline, &host_key, &host)) {
+        return false;
+    }
+    for (unsigned i = 0; i < num_results; i++) {
+        BenchResult* r = &results[i];
+        UwValue item = UwMap(
+            UwCharPtr("ns_per_op"),     UwFloat(r->ns_per_op),
+            UwCharPtr("mad_ns_per_op"), UwFloat(r->mad_ns_per_op),
+            UwCharPtr("bytes_per_op"),  UwFloat(r->bytes_per_op),
+            UwCharPtr("allocs_per_op"), UwFloat(r->allocs_per_op)
+        );
+        if (uw_error(&item)) {
+            return false;
+        }
+        UwValue name = uw_create_string(r->name);
+        if (!uw_map_update(&baseline, &name, &item)) {
+            return false;
+        }
+    }
+    UwValue file = uw_file_open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (uw_error(&file)) {
+        uw_dump(stderr, &file);
+        return false;
+    }
+    UwValue status = uw_json_write(&baseline, &file, 2);
+    if (uw_error(&status)) {
+        uw_dump(stderr, &status);
+        return false;
+    }
+    unsigned bytes_written;
+    UwValue status2 = uw_file_write(&file, "\n", 1, &bytes_written);
+    if (uw_error(&status2)) {
+        uw_dump(stderr, &status2);
+        return false;
+    }
+    return true;
+}
+
+static UwResult read_baseline(char* filename)
+{
+    UwValue file = uw_file_open(filename, O_RDONLY, 0);
+    if (uw_error(&file)) {
+        return uw_move(&file);
+    }
+    UwValue content = uw_file_read_all(&file);
+    if (uw_error(&content)) {
+        return uw_move(&content);
+    }
+    CStringPtr text = uw_string_to_cstring(&content);
+    if (!text) {
+        return UwOOM();
+    }
+    UwValue baseline = uw_json_parse((char8_t*) text, strlen(text));
+    if (uw_error(&baseline)) {
+        return uw_move(&baseline);
+    }
+    if (!uw_is_map(&baseline)) {
+        UwValue error = UwError(UW_ERROR_BAD_JSON);
+        _uw_set_status_desc(&error, "Baseline must be a JSON object");
+        return uw_move(&error);
+    }
+    return uw_move(&baseline);
+}
+
+static double get_number(UwValuePtr map, char* key)
+/*
+ * Get number from baseline item, return -1 if missing.
+ */
+{
+    UwValue value = uw_map_get(map, key);
+    if (uw_is_float(&value)) {
+        return value.float_value;
+    } else if (uw_is_signed(&value)) {
+        return (double) value.signed_value;
+    } else if (uw_is_unsigned(&value)) {
+        return (double) value.unsigned_value;
+    }
+    return -1;
+}
+
+static bool exceeds(double current, double base, double threshold, double slack)
+/*
+ * Amortized growth makes allocations per op depend slightly on
+ * the number of iterations, `slack` absorbs that.
+ */
+{
+    return current > base * (1.0 + threshold / 100.0) + slack;
+}
+
+static bool time_regressed(BenchResult* r, double base_ns, double base_mad, double threshold)
+{
+    double noise = 3.0 * (base_mad > r->mad_ns_per_op ? base_mad : r->mad_ns_per_op);
+    return exceeds(r->ns_per_op, base_ns, threshold, 0) && r->ns_per_op - base_ns > noise;
+}
+
+static unsigned compare_with_baseline(UwValuePtr baseline, BenchResult* results, unsigned num_results,
+                                      double threshold, uint64_t min_time_ns, unsigned repeats)
+/*
+ * Print comparison report and return the number of regressions.
+ */
+{
+    unsigned num_regressions = 0;
+
+    // timings are comparable only on the same host with the same build
+    UwValue base_host = uw_map_get(baseline, "_host");
+    UwValue host = host_info();
+    bool compare_time = uw_is_map(&base_host) && uw_equal(&base_host, &host);
+
+    printf("\nComparison with baseline, threshold %.1f%%:\n\n", threshold);
+    if (!compare_time) {
+        if (uw_is_map(&base_host)) {
+            print_host("baseline host", &base_host);
+        } else {
+            printf("baseline host: not recorded\n");
+        }
+        print_host("this host", &host);
+        printf("time is not compared, only bytes and allocations\n\n");
+    }
+    printf("%-28s %12s %12s %8s  %s\n", "name", "base ns/op", "ns/op", "change", "status");
+    for (unsigned i = 0; i < num_results; i++) {
+        BenchResult* r = &results[i];
+        UwValue item = uw_map_get(baseline, r->name);
+        if (!uw_is_map(&item)) {
+            printf("%-28s %12s %12.2f %8s  new\n", r->name, "-", r->ns_per_op, "-");
+            continue;
+        }
+        double base_ns = get_number(&item, "ns_per_op");
+        double base_mad = get_number(&item, "mad_ns_per_op");
+        double base_bytes = get_number(&item, "bytes_per_op");
+        double base_allocs = get_number(&item, "allocs_per_op");
+        if (base_ns <= 0) {
+            printf("%-28s %12s %12.2f %8s  bad baseline\n", r->name, "-", r->ns_per_op, "-");
+            continue;
+        }
+        bool slower = compare_time && time_regressed(r, base_ns, base_mad, threshold);
+
+        // the host may be busy for a while, confirm slowdown
+        // by running benchmark again after a pause and take the fastest run
+        for (unsigned n = 0; slower && n < CONFIRM_RUNS; n++) {
+            sleep(CONFIRM_PAUSE);
+            BenchResult rerun = measure(r->bench, min_time_ns, repeats);
+            if (rerun.ns_per_op < r->ns_per_op) {
+                r->ns_per_op = rerun.ns_per_op;
+                r->mad_ns_per_op = rerun.mad_ns_per_op;
+            }
+            slower = time_regressed(r, base_ns, base_mad, threshold);
+        }
+        double change = (r->ns_per_op - base_ns) * 100.0 / base_ns;
+        double noise = 3.0 * (base_mad > r->mad_ns_per_op ? base_mad : r->mad_ns_per_op);
+
+        char status[128] = "ok";
+        char* p = status;
+        bool regressed = false;
+        if (slower) {
+            p = stpcpy(status, "REGRESSION: time");
+            regressed = true;
+        }
+        if (base_bytes >= 0 && exceeds(r->bytes_per_op, base_bytes, threshold, 1.0)) {
+            p += sprintf(p, "%s bytes/op %.2f -> %.2f", regressed? "," : "REGRESSION:", base_bytes, r->bytes_per_op);
+            regressed = true;
+        }
+        if (base_allocs >= 0 && exceeds(r->allocs_per_op, base_allocs, threshold, 0.05)) {
+            sprintf(p, "%s allocs/op %.2f -> %.2f", regressed? "," : "REGRESSION:", base_allocs, r->allocs_per_op);
+            regressed = true;
+        }
+        if (regressed) {
+            num_regressions++;
+        } else if (compare_time && -change > threshold && base_ns - r->ns_per_op > noise) {
+            strcpy(status, "faster");
+        }
+        printf("%-28s %12.2f %12.2f %+7.1f%%  %s\n", r->name, base_ns, r->ns_per_op, change, status);
+    }
+    if (num_regressions) {
+        printf("\n%u benchmark%s regressed\n", num_regressions, (num_regressions == 1)? "" : "s");
+    } else {
+        printf("\nno regressions\n");
+    }
+    return num_regressions;
+}
+
+static void usage()
+{
+    fputs("Usage: uw_bench [-j] [-t milliseconds] [-r repeats]\n"
+          "                [-w baseline.json] [-b baseline.json [-T percent]]\n"
+          "                [name filter...]\n", stderr);
+    exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+    bool json = false;
+    uint64_t min_time_ns = 200'000'000ULL;
+    unsigned repeats = 0;
+    char* baseline_filename = nullptr;
+    char* write_filename = nullptr;
+    double threshold = 20.0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "jt:r:b:w:T:")) != -1) {
+        switch (opt) {
+            case 'j':
+                json = true;
+                break;
+            case 't':
+                min_time_ns = strtoull(optarg, nullptr, 10) * 1000'000ULL;
+                break;
+            case 'r':
+                repeats = strtoul(optarg, nullptr, 10);
+                if (repeats == 0 || repeats > MAX_REPEATS) {
+                    usage();
+                }
+                break;
+            case 'b':
+                baseline_filename = optarg;
+                break;
+            case 'w':
+                write_filename = optarg;
+                break;
+            case 'T':
+                threshold = strtod(optarg, nullptr);
+                break;
+            default:
+                usage();
+        }
+    }
+
+    if (repeats == 0) {
+        repeats = (baseline_filename || write_filename)? BASELINE_REPEATS : 5;
+    }
+
+    // read baseline before running benchmarks to fail early
+    UwValue baseline = UwNull();
+    if (baseline_filename) {
+        baseline = read_baseline(baseline_filename);
+        if (uw_error(&baseline)) {
+            fprintf(stderr, "Cannot read %s\n", baseline_filename);
+            uw_dump(stderr, &baseline);
+            return 1;
+        }
+    }
+
+    install_counting_allocator();
+
+    if (!make_text_file()) {
+        return 1;
+    }
+
+    if (!json) {
+        printf("name\tns/op\tmad ns/op\tbytes/op\tallocs/op\titerations\n");
+    }
+    BenchResult results[NUM_BENCHMARKS];
+    unsigned num_results = 0;
+
+    for (unsigned b = 0; b < NUM_BENCHMARKS; b++) {
+        Benchmark* bench = &benchmarks[b];
+        if (!selected(bench->name, argc - optind, &argv[optind])) {
+            continue;
+        }
+        BenchResult* result = &results[num_results++];
+        if (write_filename) {
+            *result = measure_typical(bench, min_time_ns, repeats);
+        } else {
+            *result = measure(bench, min_time_ns, repeats);
+        }
+        if (json) {
+            printf("{\"name\": \"%s\", \"ns_per_op\": %.2f, \"mad_ns_per_op\": %.2f, "
+                   "\"bytes_per_op\": %.2f, \"allocs_per_op\": %.2f, \"iterations\": %u}\n",
+                   result->name, result->ns_per_op, result->mad_ns_per_op,
+                   result->bytes_per_op, result->allocs_per_op, result->iterations);
+        } else {
+            printf("%s\t%.2f\t%.2f\t%.2f\t%.2f\t%u\n", result->name, result->ns_per_op, result->mad_ns_per_op,
+                   result->bytes_per_op, result->allocs_per_op, result->iterations);
+        }
+        fflush(stdout);
+    }
+
+    int exit_code = 0;
+    if (write_filename && !write_baseline(write_filename, results, num_results)) {
+        fprintf(stderr, "Cannot write %s\n", write_filename);
+        exit_code = 1;
+    } else if (baseline_filename && compare_with_baseline(&baseline, results, num_results, threshold, min_time_ns, repeats)) {
+        // confirmation runs of line reading benchmarks need the text file
+        exit_code = 1;
+    }
+    uw_destroy(&text);
+    unlink(text_filename);
+    return exit_code;
+}
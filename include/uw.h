@@ -5,6 +5,8 @@
  */
 
 #include <uw_base.h>
+#include <uw_alloc_stats.h>
+#include <uw_cpu.h>
 #include <uw_list.h>
 #include <uw_map.h>
 #include <uw_string.h>
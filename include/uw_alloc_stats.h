@@ -0,0 +1,59 @@
+#pragma once
+
+/*
+ * Allocation accounting.
+ *
+ * When enabled, all allocations made through UwType.allocator
+ * are counted per type id. Lists of parents of compound values
+ * are allocated from default_allocator and are counted separately
+ * under UW_PARENTS_ALLOC_STATS id.
+ *
+ * Memory allocated by types directly with malloc is not counted.
+ *
+ * When disabled, the overhead is a single check of global flag
+ * per allocator call.
+ *
+ * Counters are not atomic, same as the rest of the library
+ * they are not thread-safe.
+ */
+
+#include <uw_base.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Null values never allocate, so this id is used for lists of parents
+#define UW_PARENTS_ALLOC_STATS  UwTypeId_Null
+
+typedef struct {
+    uint64_t allocs;
+    uint64_t reallocs;
+    uint64_t frees;
+    int64_t  live_bytes;  // can be negative if blocks allocated before enabling were freed
+    int64_t  peak_bytes;
+} UwAllocStats;
+
+void uw_enable_alloc_stats(bool enable);
+/*
+ * Start or stop counting. Counters are not reset.
+ */
+
+void uw_reset_alloc_stats();
+/*
+ * Zero all counters.
+ */
+
+UwAllocStats uw_alloc_stats(UwTypeId type_id);
+/*
+ * Return counters for type id.
+ */
+
+void uw_dump_alloc_stats(FILE* fp);
+/*
+ * Print counters for all types that allocated anything.
+ */
+
+#ifdef __cplusplus
+}
+#endif
@@ -66,6 +66,69 @@ typedef struct {
     unsigned refcount;
 } _UwExtraData;
 
+/*
+ * Reference count operations.
+ *
+ * With UW_ATOMIC_REFCOUNT defined they are atomic, so values can be
+ * cloned, destroyed, and strings can be modified (copy on write)
+ * concurrently in different threads. Compound values can be shared
+ * for reading, but adding the same compound value to containers
+ * in different threads is not thread-safe because of the list of parents.
+ *
+ * Without UW_ATOMIC_REFCOUNT they are plain increments and decrements.
+ *
+ * Frozen values (see uw_freeze) have immortal refcount which is never
+ * written, so they are shared by threads in either mode.
+ */
+
+#define _UW_REFCOUNT_FROZEN  UINT_MAX
+
+static inline bool _uw_refcount_frozen(unsigned* refcount)
+{
+#ifdef UW_ATOMIC_REFCOUNT
+    return __atomic_load_n(refcount, __ATOMIC_RELAXED) == _UW_REFCOUNT_FROZEN;
+#else
+    return *refcount == _UW_REFCOUNT_FROZEN;
+#endif
+}
+
+static inline void _uw_refcount_inc(unsigned* refcount)
+{
+    if (_uw_refcount_frozen(refcount)) {
+        return;
+    }
+#ifdef UW_ATOMIC_REFCOUNT
+    __atomic_fetch_add(refcount, 1, __ATOMIC_RELAXED);
+#else
+    (*refcount)++;
+#endif
+}
+
+static inline unsigned _uw_refcount_dec(unsigned* refcount)
+/*
+ * Return new value.
+ */
+{
+    if (_uw_refcount_frozen(refcount)) {
+        return _UW_REFCOUNT_FROZEN;
+    }
+#ifdef UW_ATOMIC_REFCOUNT
+    // release our writes to the data, acquire others' before freeing it
+    return __atomic_sub_fetch(refcount, 1, __ATOMIC_ACQ_REL);
+#else
+    return --(*refcount);
+#endif
+}
+
+static inline unsigned _uw_refcount_load(unsigned* refcount)
+{
+#ifdef UW_ATOMIC_REFCOUNT
+    return __atomic_load_n(refcount, __ATOMIC_ACQUIRE);
+#else
+    return *refcount;
+#endif
+}
+
 /*
  * Extra data for compound UwValue is a bit more complicated.
  *
@@ -520,6 +583,15 @@ static inline char* _uw_get_type_name_from_value(UwValuePtr value) { return _uw_
 // StringIO errors
 #define UW_ERROR_PUSHBACK_FAILED      14
 
+// non-blocking I/O
+#define UW_ERROR_WOULD_BLOCK          15
+
+// string to number conversion
+#define UW_ERROR_BAD_NUMBER           16
+
+// write made no progress
+#define UW_ERROR_SHORT_WRITE          17
+
 uint16_t uw_define_status(char* status);
 /*
  * Define status in the global table.
@@ -562,6 +634,17 @@ static inline bool uw_eof(UwValuePtr status)
     return status->status_code == UW_ERROR_EOF;
 }
 
+static inline bool uw_would_block(UwValuePtr status)
+{
+    if (!status) {
+        return false;
+    }
+    if (!uw_is_status(status)) {
+        return false;
+    }
+    return status->status_code == UW_ERROR_WOULD_BLOCK;
+}
+
 static inline bool uw_va_end(UwValuePtr status)
 {
     if (!status) {
@@ -578,6 +661,11 @@ UwResult uw_status_desc(UwValuePtr status);
  * Get status description.
  */
 
+UwValuePtr _uw_status_desc_ptr(UwValuePtr status);
+/*
+ * Return pointer to description string stored in status or nullptr.
+ */
+
 void _uw_set_status_desc(UwValuePtr status, char* fmt, ...);
 void _uw_set_status_desc_ap(UwValuePtr status, char* fmt, va_list ap);
 /*
@@ -1040,6 +1128,25 @@ UwType_Hash uw_hash(UwValuePtr value);
  * Calculate hash of value.
  */
 
+typedef struct {
+    size_t exclusive;  // blocks with single reference
+    size_t shared;     // blocks with more than one reference, counted once
+} UwMemSize;
+
+#define UW_MEMSIZE_SHALLOW  1  // do not walk items of lists and maps
+
+UwMemSize uw_memsize(UwValuePtr value, unsigned flags);
+/*
+ * Return memory retained by value, not including the value itself.
+ *
+ * Strings, lists, maps, statuses and lists of parents of compound
+ * values are counted exactly. For other types only the extra data block
+ * is counted.
+ *
+ * A block is shared if it has more than one reference, inside
+ * or outside the value. Each shared block is counted once.
+ */
+
 static inline UwResult uw_deepcopy(UwValuePtr v)
 {
     return uw_call(*v, v, deepcopy);
@@ -1060,6 +1167,67 @@ static inline UwResult uw_to_string(UwValuePtr v)
     return uw_call(UwString(), v, to_string);
 }
 
+/****************************************************************
+ * Frozen values
+ */
+
+bool uw_freeze(UwValuePtr value);
+/*
+ * Make value immutable, recursively for items of lists and maps,
+ * so it can be read by many threads without synchronization.
+ *
+ * Frozen values have immortal refcount: cloning and destroying them
+ * does not touch memory and they are never freed. Data shared with
+ * other values gets frozen too.
+ *
+ * Modifying frozen string makes a copy. Modifying frozen list or map
+ * is a fatal error.
+ *
+ * Only strings, lists, maps and values without extra data can be frozen.
+ * If value contains anything else or if out of memory,
+ * return false and leave value intact.
+ *
+ * Values referred to more than once are visited once,
+ * so freezing takes time linear in the number of distinct values.
+ */
+
+extern UwTypeId UwTypeId_FreezeArena;
+
+static inline UwResult uw_create_freeze_arena()
+{
+    return _uw_create(UwTypeId_FreezeArena);
+}
+/*
+ * Create arena that owns frozen values and frees them when destroyed.
+ */
+
+UwResult uw_freeze_into(UwValuePtr arena, UwValuePtr value);
+/*
+ * Same as uw_freeze, but data frozen by this call is freed
+ * when the arena is destroyed. Data that was frozen already
+ * is not taken by the arena and must outlive it if referred to.
+ *
+ * Destroy the arena only when no thread uses frozen values,
+ * including `value` itself and its clones.
+ *
+ * Return UW_ERROR_INCOMPATIBLE_TYPE if value cannot be frozen
+ * and leave it intact.
+ */
+
+static inline bool uw_is_frozen(UwValuePtr value)
+{
+    if (uw_is_string(value)) {
+        if (value->str_embedded) {
+            return false;
+        }
+    } else if (!uw_is_compound(value)) {
+        return false;
+    }
+    return _uw_refcount_frozen(&value->extra_data->refcount);
+}
+
+#define uw_assert_mutable(value)  uw_assert(!uw_is_frozen(value))
+
 /****************************************************************
  * Compare for equality.
  */
@@ -1246,6 +1414,15 @@ static inline bool _uw_embrace(UwValuePtr parent, UwValuePtr child)
     }
 }
 
+void _uw_destroy_child(_UwCompoundData* parent, UwValuePtr child);
+/*
+ * Destroy item of compound value.
+ *
+ * Compound child is abandoned first. Parent's reference is not counted
+ * in child's refcount (see _uw_adopt), so the child is destroyed only
+ * if nothing else refers to it, otherwise it's just reset to Null.
+ */
+
 UwValuePtr _uw_on_chain(UwValuePtr value, _UwCompoundChain* tail);
 /*
  * Check if value extra_data is on the chain.
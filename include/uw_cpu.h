@@ -0,0 +1,46 @@
+#pragma once
+
+/*
+ * Runtime CPU dispatch.
+ *
+ * The library is built for baseline CPU and selects SIMD variants
+ * of string, UTF-8 and search kernels at startup.
+ *
+ * UW_CPU_LEVEL environment variable forces the level: scalar, sse4.2, or avx2.
+ * Unknown values and levels not supported by CPU are reported on stderr
+ * and the best supported level is used.
+ */
+
+#include <uw_base.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    UW_CPU_SCALAR = 0,
+    UW_CPU_SSE42  = 1,
+    UW_CPU_AVX2   = 2
+} UwCpuLevel;
+
+UwCpuLevel uw_cpu_level();
+/*
+ * Return current level.
+ */
+
+UwCpuLevel uw_cpu_max_level();
+/*
+ * Return the best level supported by CPU.
+ */
+
+UwCpuLevel uw_set_cpu_level(UwCpuLevel level);
+/*
+ * Select kernels for `level` and return the level actually set.
+ * Not thread-safe, intended for testing and benchmarking.
+ */
+
+char* uw_cpu_level_name(UwCpuLevel level);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,48 @@
+#pragma once
+
+/*
+ * Streaming reader of delimited text (CSV, TSV)
+ * on top of LineReader interface.
+ */
+
+#include <uw.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern UwTypeId UwTypeId_CsvReader;
+
+extern uint16_t UW_ERROR_UNTERMINATED_QUOTE;
+
+static inline UwResult uw_create_csv_reader(UwValuePtr line_reader, char32_t delimiter)
+{
+    return _uw_create(UwTypeId_CsvReader, line_reader, delimiter);
+}
+/*
+ * Create CSV reader for any value that implements LineReader
+ * interface, e.g. File or StringIO.
+ *
+ * Delimiter is ',' for CSV, '\t' for TSV, etc.
+ * Fields can be quoted with '"', two quotes in a quoted field
+ * stand for one, quoted fields may span multiple lines.
+ */
+
+UwResult uw_csv_read_row(UwValuePtr reader, UwValuePtr row);
+/*
+ * Read next row into the `row` list.
+ *
+ * String items of `row` are truncated and reused for fields,
+ * new items are appended and extra items deleted as necessary.
+ * Reusing the same row for all reads avoids allocations
+ * once strings have grown large enough.
+ *
+ * Empty line produces an empty row.
+ *
+ * Return UwOK, UW_ERROR_EOF, UW_ERROR_UNTERMINATED_QUOTE,
+ * or error returned by the line reader.
+ */
+
+#ifdef __cplusplus
+}
+#endif
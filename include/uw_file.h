@@ -20,8 +20,12 @@ typedef UwResult (*UwMethodCloseFile)        (UwValuePtr self);
 typedef UwResult (*UwMethodSetFileDescriptor)(UwValuePtr self, int fd);
 typedef UwResult (*UwMethodGetFileName)      (UwValuePtr self);
 typedef UwResult (*UwMethodSetFileName)      (UwValuePtr self, UwValuePtr file_name);
-
-// XXX other fd operation: seek, tell, etc.
+typedef UwResult (*UwMethodSeekFile)         (UwValuePtr self, off_t offset, int whence);
+typedef UwResult (*UwMethodTellFile)         (UwValuePtr self);
+typedef UwResult (*UwMethodGetFileSize)      (UwValuePtr self);
+typedef UwResult (*UwMethodFileAdvise)       (UwValuePtr self, off_t offset, off_t length, int advice);
+typedef UwResult (*UwMethodGetFileDescriptor)(UwValuePtr self);
+typedef UwResult (*UwMethodSetNonBlocking)   (UwValuePtr self, bool nonblocking);
 
 typedef struct {
     UwMethodOpenFile          _open;
@@ -29,6 +33,12 @@ typedef struct {
     UwMethodSetFileDescriptor _set_fd;
     UwMethodGetFileName       _get_name;
     UwMethodSetFileName       _set_name;
+    UwMethodSeekFile          _seek;     // return new position as Unsigned
+    UwMethodTellFile          _tell;     // return current position as Unsigned
+    UwMethodGetFileSize       _size;     // return file size as Unsigned
+    UwMethodFileAdvise        _fadvise;  // advice is one of POSIX_FADV_* constants
+    UwMethodGetFileDescriptor _get_fd;   // return file descriptor as Signed
+    UwMethodSetNonBlocking    _set_nonblocking;
 
 } UwInterface_File;
 
@@ -36,10 +46,12 @@ typedef struct {
  * FileReader interface
  */
 
-typedef UwResult (*UwMethodReadFile)(UwValuePtr self, void* buffer, unsigned buffer_size, unsigned* bytes_read);
+typedef UwResult (*UwMethodReadFile)  (UwValuePtr self, void* buffer, unsigned buffer_size, unsigned* bytes_read);
+typedef UwResult (*UwMethodPreadFile) (UwValuePtr self, void* buffer, unsigned buffer_size, off_t position, unsigned* bytes_read);
 
 typedef struct {
-    UwMethodReadFile _read;
+    UwMethodReadFile  _read;
+    UwMethodPreadFile _pread;  // read at position, file offset is not changed
 
 } UwInterface_FileReader;
 
@@ -47,12 +59,14 @@ typedef struct {
  * FileWriter interface
  */
 
-typedef UwResult (*UwMethodWriteFile)(UwValuePtr self, void* data, unsigned size, unsigned* bytes_written);
+typedef UwResult (*UwMethodWriteFile)  (UwValuePtr self, void* data, unsigned size, unsigned* bytes_written);
+typedef UwResult (*UwMethodPwriteFile) (UwValuePtr self, void* data, unsigned size, off_t position, unsigned* bytes_written);
 
 // XXX truncate
 
 typedef struct {
-    UwMethodWriteFile _write;
+    UwMethodWriteFile  _write;
+    UwMethodPwriteFile _pwrite;  // write at position, file offset is not changed
 
 } UwInterface_FileWriter;
 
@@ -87,6 +101,31 @@ static inline UwResult uw_file_close   (UwValuePtr file)         { return uw_ifc
 static inline UwResult uw_file_set_fd  (UwValuePtr file, int fd) { return uw_ifcall(file, File, set_fd, fd); }
 static inline UwResult uw_file_get_name(UwValuePtr file)         { return uw_ifcall(file, File, get_name); }
 static inline UwResult uw_file_set_name(UwValuePtr file, UwValuePtr file_name)  { return uw_ifcall(file, File, set_name, file_name); }
+static inline UwResult uw_file_seek    (UwValuePtr file, off_t offset, int whence) { return uw_ifcall(file, File, seek, offset, whence); }
+static inline UwResult uw_file_tell    (UwValuePtr file)         { return uw_ifcall(file, File, tell); }
+static inline UwResult uw_file_size    (UwValuePtr file)         { return uw_ifcall(file, File, size); }
+static inline UwResult uw_file_get_fd  (UwValuePtr file)         { return uw_ifcall(file, File, get_fd); }
+
+static inline UwResult uw_file_set_nonblocking(UwValuePtr file, bool nonblocking)
+{
+    return uw_ifcall(file, File, set_nonblocking, nonblocking);
+}
+/*
+ * Set or clear O_NONBLOCK flag.
+ *
+ * In non-blocking mode `read_line_inplace` returns UW_ERROR_WOULD_BLOCK
+ * when no complete line is available yet. The partial line is moved
+ * to the File, leaving `line` empty, and the next call continues it in place,
+ * so the caller can simply retry when the descriptor becomes readable,
+ * see uw_line_poller.h
+ *
+ * Short reads do not mean end of file in this mode, only zero read does.
+ */
+
+static inline UwResult uw_file_fadvise(UwValuePtr file, off_t offset, off_t length, int advice)
+{
+    return uw_ifcall(file, File, fadvise, offset, length, advice);
+}
 
 static inline UwResult uw_file_read(UwValuePtr file, void* buffer, unsigned buffer_size, unsigned* bytes_read)
 {
@@ -98,6 +137,79 @@ static inline UwResult uw_file_write(UwValuePtr file, void* data, unsigned size,
     return uw_ifcall(file, FileWriter, write, data, size, bytes_written);
 }
 
+static inline UwResult uw_file_pread(UwValuePtr file, void* buffer, unsigned buffer_size, off_t position, unsigned* bytes_read)
+{
+    return uw_ifcall(file, FileReader, pread, buffer, buffer_size, position, bytes_read);
+}
+
+static inline UwResult uw_file_pwrite(UwValuePtr file, void* data, unsigned size, off_t position, unsigned* bytes_written)
+{
+    return uw_ifcall(file, FileWriter, pwrite, data, size, position, bytes_written);
+}
+/*
+ * Positional I/O does not use nor change file offset,
+ * so multiple threads can read or write disjoint ranges of the same file.
+ */
+
+/****************************************************************
+ * Output helpers for any value that implements FileWriter
+ */
+
+UwResult uw_file_write_all(UwValuePtr file, void* data, size_t size);
+UwResult uw_file_pwrite_all(UwValuePtr file, void* data, size_t size, off_t position);
+/*
+ * Call `write` or `pwrite` method until all data is written.
+ * Return UW_ERROR_SHORT_WRITE if a call wrote nothing and reported no error,
+ * so writers that make no progress do not loop forever.
+ */
+
+UwResult uw_file_read_all(UwValuePtr file);
+/*
+ * Read file from current position till the end and return content as String.
+ *
+ * If file implements File interface, its size is used to allocate
+ * the buffer at once. The data is then measured and converted to String
+ * of exact length and char size in one go.
+ *
+ * Incomplete UTF-8 sequence at the end of file is dropped.
+ */
+
+UwResult uw_file_copy(UwValuePtr dest, UwValuePtr src, off_t offset, off_t length);
+/*
+ * Copy `length` bytes from `src` starting at `offset` to current position of `dest`.
+ * If `length` is zero, copy till the end of `src`.
+ * File offset of `src` is not changed.
+ *
+ * If both values are Files, copy_file_range is tried first,
+ * then sendfile, so data does not cross into userspace when possible.
+ * Otherwise, or when kernel refuses to copy, the data is copied
+ * with pread/write using FileReader and FileWriter interfaces.
+ *
+ * If `src` is not seekable, i.e. it's a pipe or socket, `offset` must be zero
+ * and data is read sequentially from current position.
+ *
+ * Return the number of bytes copied as Unsigned.
+ */
+
+UwResult uw_file_write_string(UwValuePtr file, UwValuePtr str);
+/*
+ * Write string to file in UTF-8 encoding.
+ *
+ * Strings with char_size 1 that contain ASCII characters only
+ * are written directly from string data.
+ * Other strings are transcoded in fixed-size chunks on the stack,
+ * no memory is allocated.
+ *
+ * Partial writes are retried until all data is written.
+ * If a write makes no progress, UW_ERROR_SHORT_WRITE is returned.
+ */
+
+UwResult uw_file_write_strings(UwValuePtr file, UwValuePtr list);
+/*
+ * Write all strings from the list, without separators.
+ * Return UW_ERROR_INCOMPATIBLE_TYPE if the list contains non-string item.
+ */
+
 #ifdef __cplusplus
 }
 #endif
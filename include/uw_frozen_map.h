@@ -0,0 +1,71 @@
+#pragma once
+
+/*
+ * Frozen maps: immutable map images that are memory-mapped read-only
+ * and accessed without loading the whole map.
+ *
+ * Image layout:
+ *
+ *   header:     "UWF", version byte, 4 reserved bytes,
+ *               uint64 number of items, uint64 hash table capacity
+ *   hash table: capacity entries of uint64 key hash and uint64 offset
+ *               of key-value pair in the image, zero offset means free entry
+ *   items:      keys and values; strings are stored as 0xFE tag,
+ *               zero padding to 8-byte boundary and string in the layout
+ *               of its extra data with frozen refcount, other values
+ *               are serialized, see uw_serialize.h
+ *
+ * All numbers are little-endian.
+ *
+ * Opening the image takes constant time regardless of its size.
+ * Lookup hashes the key, probes the table and compares keys
+ * with the matching hash right in the image. Lists and maps
+ * are deserialized, strings are not copied: the value refers
+ * to the image, which is possible because frozen refcount is never written.
+ * Pages are loaded on demand and shared by all processes that map the image.
+ *
+ * Hashes and string layout must be the same in the process that writes
+ * the image and in processes that read it, i.e. they must use the same
+ * version of the library.
+ */
+
+#include <uw.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern UwTypeId UwTypeId_FrozenMap;
+
+extern uint16_t UW_ERROR_BAD_FROZEN_MAP;
+
+#define UW_FROZEN_MAP_VERSION  2
+
+UwResult uw_freeze_map(UwValuePtr map, UwValuePtr file);
+/*
+ * Write image of map to the file, which must be empty and opened for writing.
+ */
+
+static inline UwResult uw_open_frozen_map(UwValuePtr file)
+{
+    return _uw_create(UwTypeId_FrozenMap, file);
+}
+/*
+ * Map image from file opened for reading.
+ * The file can be closed after that.
+ */
+
+UwResult uw_frozen_map_get(UwValuePtr frozen_map, UwValuePtr key);
+/*
+ * Return value for the key or UW_ERROR_KEY_NOT_FOUND.
+ *
+ * String values are frozen and refer to the image, so they
+ * must not outlive the frozen map. Modifying them makes a copy.
+ * Other values are newly deserialized.
+ */
+
+uint64_t uw_frozen_map_length(UwValuePtr frozen_map);
+
+#ifdef __cplusplus
+}
+#endif
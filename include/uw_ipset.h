@@ -0,0 +1,73 @@
+#pragma once
+
+/*
+ * Sets of IPv4 addresses.
+ *
+ * IPSet keeps sorted array of disjoint non-adjacent ranges.
+ * Overlapping and adjacent ranges are merged when added.
+ *
+ * Membership test is a branchless binary search over range starts
+ * down to a small window which is scanned with a loop the compiler
+ * can vectorize.
+ *
+ * Set operations merge sorted range arrays and take linear time.
+ */
+
+#include <uw.h>
+#include <uw_netutils.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern UwTypeId UwTypeId_IPSet;
+
+#define uw_is_ipset(value)      uw_is_subtype((value), UwTypeId_IPSet)
+#define uw_assert_ipset(value)  uw_assert(uw_is_ipset(value))
+
+static inline UwResult uw_create_ipset()
+{
+    return _uw_create(UwTypeId_IPSet);
+}
+
+UwResult uw_ipset_add_range(UwValuePtr ipset, uint32_t start, uint32_t end);
+/*
+ * Add range of addresses, both ends inclusive.
+ */
+
+UwResult uw_ipset_add(UwValuePtr ipset, UwValuePtr item);
+/*
+ * Add item which is either IPv4subnet in Unsigned value, as returned by uw_parse_ipv4_subnet,
+ * or string containing subnet in CIDR notation, single address, or range of addresses
+ * separated with hyphen, e.g. 10.0.0.1-10.0.0.15
+ */
+
+UwResult uw_ipset_add_list(UwValuePtr ipset, UwValuePtr items);
+/*
+ * Add items from the list.
+ * Items are parsed into ranges, which are sorted and merged at once.
+ * On error the set is left unchanged.
+ */
+
+bool uw_ipset_contains(UwValuePtr ipset, uint32_t addr);
+
+unsigned uw_ipset_length(UwValuePtr ipset);
+/*
+ * Return number of ranges.
+ */
+
+void uw_ipset_range(UwValuePtr ipset, unsigned index, uint32_t* start, uint32_t* end);
+/*
+ * Get range by index.
+ */
+
+UwResult uw_ipset_union(UwValuePtr a, UwValuePtr b);
+UwResult uw_ipset_intersection(UwValuePtr a, UwValuePtr b);
+UwResult uw_ipset_difference(UwValuePtr a, UwValuePtr b);
+/*
+ * Return new set.
+ */
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,63 @@
+#pragma once
+
+/*
+ * JSON support.
+ */
+
+#include <uw.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern uint16_t UW_ERROR_BAD_JSON;
+extern uint16_t UW_ERROR_CYCLIC_REFERENCE;
+
+#define UW_JSON_MAX_DEPTH  1024  // maximal nesting of arrays and objects
+
+UwResult uw_json_parse(char8_t* buffer, unsigned size);
+/*
+ * Parse JSON text from the buffer.
+ * The buffer does not have to be null-terminated.
+ *
+ * Arrays are converted to Lists, objects to Maps, strings to Strings.
+ * Integer numbers are converted to Signed, or to Unsigned if they
+ * do not fit into Signed. Numbers with fraction or exponent,
+ * and integers too large for Unsigned are converted to Float.
+ * Numbers are parsed the same way regardless of the current locale.
+ *
+ * Raw control characters (below U+0020) in strings are errors,
+ * they must be escaped.
+ *
+ * On error return UW_ERROR_BAD_JSON status with description
+ * that contains position in the buffer, or UW_ERROR_OOM.
+ *
+ * The parser works in two stages. First one scans the entire buffer
+ * to match brackets and count items of all arrays and objects.
+ * The second one builds values, allocating Lists and Maps of exact
+ * capacity and Strings of exact length and char size at once.
+ */
+
+UwResult uw_json_write(UwValuePtr value, UwValuePtr writer, unsigned indent);
+/*
+ * Serialize value to JSON and write it to `writer`, which is either
+ * a String to append JSON text to, or any value that implements
+ * FileWriter interface. Output is buffered and written in chunks.
+ *
+ * If `indent` is zero, write compact JSON, otherwise pretty-print
+ * with `indent` spaces per nesting level.
+ *
+ * Floats are written with 15, 16, or 17 significant digits, the first
+ * precision that reads back to the same value. This is not always
+ * the shortest representation, e.g. 5e-324 is written as
+ * 4.94065645841247e-324. NaN and infinities are written
+ * as null.
+ *
+ * Return UW_ERROR_INCOMPATIBLE_TYPE for values that have no JSON
+ * representation and for non-string keys of Maps, and
+ * UW_ERROR_CYCLIC_REFERENCE if a List or Map contains itself.
+ */
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,70 @@
+#pragma once
+
+/*
+ * Epoll-based multiplexer for line-oriented pipes and sockets.
+ *
+ * One thread can serve many connections: files are switched
+ * to non-blocking mode and lines are read only when data is available.
+ */
+
+#include <uw.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern UwTypeId UwTypeId_LinePoller;
+
+typedef UwResult (*UwLineHandler)(UwValuePtr file, UwValuePtr line, void* context);
+/*
+ * Called for each line read from the file.
+ *
+ * When file reaches end or read fails, the handler is called
+ * with the status (EOF or error) instead of line and then
+ * the file is removed from the poller.
+ *
+ * The line is a buffer reused for the next lines from the same file.
+ * Clone or copy it if it has to be kept.
+ *
+ * If handler returns an error, uw_line_poller_wait stops and returns it.
+ */
+
+static inline UwResult uw_create_line_poller()
+{
+    return _uw_create(UwTypeId_LinePoller);
+}
+
+UwResult uw_line_poller_add(UwValuePtr poller, UwValuePtr file, UwLineHandler handler, void* context);
+/*
+ * Set file to non-blocking mode and start watching it.
+ * The file must implement File and LineReader interfaces.
+ * Poller keeps a clone of the file until it is removed.
+ */
+
+UwResult uw_line_poller_remove(UwValuePtr poller, UwValuePtr file);
+/*
+ * Stop watching the file.
+ * Return UW_ERROR_KEY_NOT_FOUND if file is not in the poller.
+ */
+
+unsigned uw_line_poller_count(UwValuePtr poller);
+/*
+ * Return the number of watched files.
+ */
+
+UwResult uw_line_poller_wait(UwValuePtr poller, int timeout);
+/*
+ * Wait at most `timeout` milliseconds (-1 means infinite) until some files
+ * become readable, then read all available lines from them and call handlers.
+ *
+ * Return the number of handled lines as Unsigned, or error.
+ */
+
+UwResult uw_line_poller_run(UwValuePtr poller);
+/*
+ * Call uw_line_poller_wait until all files are removed.
+ */
+
+#ifdef __cplusplus
+}
+#endif
@@ -166,6 +166,33 @@ unsigned uw_map_length(UwValuePtr map);
  * Return the number of items in `map`.
  */
 
+bool uw_map_resize(UwValuePtr map, unsigned desired_capacity);
+/*
+ * Make room for `desired_capacity` items so that
+ * inserting them does not cause reallocations.
+ * Never shrinks the map.
+ *
+ * Return false if OOM.
+ */
+
+UwResult uw_map_stats(UwValuePtr map);
+/*
+ * Return Map with hash table statistics:
+ *
+ *   capacity, items_used, item_size: hash table parameters
+ *   load_factor:     items_used / capacity
+ *   probe_histogram: List of item counts by distance from their home position
+ *   longest_cluster: the longest run of occupied items
+ *   tombstones:      always 0, deletion shifts back the following items
+ *
+ * If the library is built with UW_MAP_PROBE_STATS defined,
+ * lookups are counted and the result also contains:
+ *
+ *   lookups:    number of lookups
+ *   probes:     number of hash table items examined by all lookups
+ *   max_probes: the longest lookup
+ */
+
 bool uw_map_item(UwValuePtr map, unsigned index, UwValuePtr key, UwValuePtr value);
 /*
  * Get key-value pair from the map.
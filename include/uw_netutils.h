@@ -13,7 +13,9 @@ extern uint16_t UW_ERROR_BAD_NETMASK;
 
 UwResult uw_parse_ipv4_address(UwValuePtr addr);
 /*
- * Parse IPv4 address.
+ * Parse IPv4 address in dotted-quad notation.
+ * The address is parsed directly from string of any char size,
+ * memory is allocated only for error status.
  *
  * On success return UwType_Unsigned which contains IP address
  * in low 32 bits in host byte order.
@@ -27,10 +29,20 @@ static inline uint32_t uw_ipv4_address(UwValuePtr addr)
     return (uint32_t) addr->unsigned_value;
 }
 
+UwResult uw_parse_ipv4_addresses(UwValuePtr addrs, uint32_t* result);
+/*
+ * Parse list of IPv4 addresses into `result` array, which must have
+ * room for uw_list_length(addrs) items. Addresses are in host byte order.
+ *
+ * Return UwOK() on success or status value on the first error.
+ * In the latter case the contents of `result` past the failed item is undefined.
+ */
+
 UwResult uw_parse_ipv4_subnet(UwValuePtr subnet, UwValuePtr netmask);
 /*
  * Parse IPv4 subnet.
  * If subnet is in CIDR notation, netmask argument is not used.
+ * CIDR prefix length can be from 0 to 32.
  *
  * On success return UwType_Unsigned which contains IPv4subnet.
  * The helper functions uw_ipv4_subnet() and uw_ipv4_netmask()
@@ -58,6 +70,61 @@ static inline uint32_t uw_ipv4_netmask(UwValuePtr subnet)
     return ((IPv4subnet*) &subnet->unsigned_value)->netmask;
 }
 
+/****************************************************************
+ * IPv6
+ */
+
+typedef struct {
+    // values are in host byte order
+    uint64_t  hi;  // upper 64 bits of address
+    uint64_t  lo;  // lower 64 bits
+} IPv6address;
+
+typedef struct {
+    IPv6address  subnet;
+    unsigned     prefix_len;
+} IPv6subnet;
+
+UwResult uw_parse_ipv6_address(UwValuePtr addr, IPv6address* result);
+/*
+ * Parse IPv6 address in any notation of RFC 4291 section 2.2,
+ * including :: compression and embedded IPv4 address.
+ * The address is parsed directly from string of any char size,
+ * memory is allocated only for error status.
+ *
+ * On success return UwOK().
+ * On error return status value.
+ */
+
+UwResult uw_parse_ipv6_subnet(UwValuePtr subnet, IPv6subnet* result);
+/*
+ * Parse IPv6 subnet in CIDR notation.
+ * Prefix length can be from 0 to 128, host bits are cleared.
+ */
+
+/*
+ * IPv6 values hold IPv6subnet in extra data.
+ * Addresses have prefix length 128.
+ * Such values can be used as map keys and converted to strings.
+ */
+
+extern UwTypeId UwTypeId_IPv6;
+
+#define uw_is_ipv6(value)      uw_is_subtype((value), UwTypeId_IPv6)
+#define uw_assert_ipv6(value)  uw_assert(uw_is_ipv6(value))
+
+UwResult uw_create_ipv6(IPv6address* addr, unsigned prefix_len);
+
+UwResult uw_create_ipv6_from_string(UwValuePtr str);
+/*
+ * Parse IPv6 address or subnet in CIDR notation and return IPv6 value.
+ */
+
+static inline IPv6subnet* uw_ipv6_subnet(UwValuePtr value)
+{
+    return (IPv6subnet*) _uw_get_data_ptr(value, UwTypeId_IPv6);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,66 @@
+#pragma once
+
+/*
+ * Compact binary serialization.
+ *
+ * Format:
+ *
+ *   header: "UWB" and format version byte
+ *   value:  tag byte followed by payload
+ *
+ * Tags are type ids of basic types:
+ *
+ *   Null:     no payload
+ *   Bool:     one byte, 0 or 1
+ *   Signed:   zigzag-encoded LEB128 varint
+ *   Unsigned: LEB128 varint
+ *   Float:    8 bytes
+ *   String:   char size byte, varint length, raw character storage
+ *   List:     varint number of items, items
+ *   Map:      varint number of pairs, keys and values in insertion order
+ *
+ * plus UW_SERIALIZE_BACKREF tag followed by varint index of previously
+ * written String, List, or Map. Indexes are assigned in the order values
+ * are written. This way shared values are written once and cyclic
+ * references are preserved. Map keys are neither indexed nor referred to,
+ * because maps must own their keys.
+ *
+ * Multi-byte numbers and characters are little-endian.
+ */
+
+#include <uw.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern uint16_t UW_ERROR_BAD_SERIALIZED_DATA;
+
+#define UW_SERIALIZE_VERSION    1
+#define UW_SERIALIZE_BACKREF    0xFF
+#define UW_SERIALIZE_MAX_DEPTH  1024  // maximal nesting of lists and maps when deserializing
+
+UwResult uw_serialize(UwValuePtr value, UwValuePtr writer);
+/*
+ * Serialize value and write it to `writer`, which must implement
+ * FileWriter interface. Output is buffered and written in chunks.
+ *
+ * Return UW_ERROR_INCOMPATIBLE_TYPE if value contains types
+ * other than listed above.
+ */
+
+UwResult uw_deserialize(uint8_t* buffer, unsigned size);
+/*
+ * Deserialize value from buffer.
+ *
+ * All lengths are checked against the size of buffer before
+ * allocating anything. Strings are allocated with exact length
+ * and char size and their storage is copied at once.
+ *
+ * On error return UW_ERROR_BAD_SERIALIZED_DATA with description
+ * that contains position in the buffer, or UW_ERROR_OOM.
+ */
+
+#ifdef __cplusplus
+}
+#endif
@@ -94,6 +94,61 @@ void* uw_string_data(UwValuePtr str, unsigned* length);
  * The function is intended for file I/O operations.
  */
 
+/****************************************************************
+ * Copy statistics
+ *
+ * Strings are copied when shared data is about to be modified (COW),
+ * when char size increases, and when string grows beyond embedded
+ * storage or capacity of its header.
+ *
+ * All these copies are made by expand_string, and the enabled flag is
+ * checked there only after a copy is decided, so in-place appends and
+ * edits are not slowed down.
+ *
+ * Promotions are counted apart from COW copies because they are easy
+ * to miss: a single wide char appended to a long ASCII string widens
+ * the whole string, with no sharing involved.
+ *
+ * Counters are plain globals. With UW_ATOMIC_REFCOUNT, COW copies made
+ * by several threads at once may be lost from the counts.
+ */
+
+typedef struct {
+    uint64_t cow_copies;        // copies of shared data, including those that promoted char size
+    uint64_t growth_copies;     // copies made for growing only
+    uint64_t promotions[4][4];  // char size promotions, [old char size - 1][new char size - 1]
+    uint64_t bytes_copied;      // bytes written to new storage by copies and promotions
+} UwStringCopyStats;
+
+typedef struct {
+    bool cow;
+    uint8_t old_char_size;
+    uint8_t new_char_size;
+    unsigned length;
+} UwStringCopyEvent;
+
+typedef void (*UwStringCopyHook)(UwStringCopyEvent* event);
+
+void uw_enable_string_copy_stats(bool enable);
+/*
+ * Start or stop counting. Counters are not reset.
+ */
+
+void uw_reset_string_copy_stats();
+
+UwStringCopyStats uw_string_copy_stats();
+
+void uw_set_string_copy_hook(UwStringCopyHook hook, unsigned sample_period);
+/*
+ * Call `hook` for every `sample_period`-th COW copy or char size promotion
+ * while counting is enabled. The hook may call backtrace(3) to find call sites.
+ * It must not modify strings.
+ *
+ * Pass nullptr to remove the hook.
+ */
+
+void uw_dump_string_copy_stats(FILE* fp);
+
 void _uw_putchar32_utf8(FILE* fp, char32_t codepoint);
 
 unsigned utf8_strlen(char8_t* str);
@@ -177,6 +232,22 @@ unsigned uw_string_skip_chars(UwValuePtr str, unsigned position, char32_t* skipc
  * If no `skipchars` encountered, the length is returned.
  */
 
+UwResult uw_string_to_int(UwValuePtr str);
+/*
+ * Parse decimal integer with optional sign. Leading and trailing spaces are allowed.
+ * Return Signed, or Unsigned if the number is positive and too large for Signed.
+ * On error return UW_ERROR_BAD_NUMBER with description.
+ *
+ * The string is parsed in place regardless of char size.
+ */
+
+UwResult uw_string_to_float(UwValuePtr str);
+/*
+ * Parse floating point number in any format accepted by strtod.
+ * Leading and trailing spaces are allowed.
+ * On error return UW_ERROR_BAD_NUMBER with description.
+ */
+
 /****************************************************************
  * Character classification functions
  */
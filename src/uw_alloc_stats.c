@@ -0,0 +1,111 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/uw_base.h"
+#include "src/uw_alloc_stats_internal.h"
+
+bool _uw_alloc_stats_enabled = false;
+
+// counters indexed by type id, grown on demand
+static UwAllocStats* alloc_stats = nullptr;
+static unsigned alloc_stats_capacity = 0;
+
+static UwAllocStats* get_stats(UwTypeId stats_id)
+/*
+ * Return pointer to counters or nullptr if OOM.
+ */
+{
+    if (stats_id >= alloc_stats_capacity) {
+        unsigned new_capacity = (stats_id + 64) & ~63U;
+        UwAllocStats* new_stats = realloc(alloc_stats, new_capacity * sizeof(UwAllocStats));
+        if (!new_stats) {
+            return nullptr;
+        }
+        memset(&new_stats[alloc_stats_capacity], 0, (new_capacity - alloc_stats_capacity) * sizeof(UwAllocStats));
+        alloc_stats = new_stats;
+        alloc_stats_capacity = new_capacity;
+    }
+    return &alloc_stats[stats_id];
+}
+
+static void add_live_bytes(UwAllocStats* stats, int64_t nbytes)
+{
+    stats->live_bytes += nbytes;
+    if (stats->live_bytes > stats->peak_bytes) {
+        stats->peak_bytes = stats->live_bytes;
+    }
+}
+
+void* _uw_counted_allocate(Allocator* allocator, UwTypeId stats_id, unsigned nbytes, bool clean)
+{
+    void* result = allocator->allocate(nbytes, clean);
+    UwAllocStats* stats = get_stats(stats_id);
+    if (result && stats) {
+        stats->allocs++;
+        add_live_bytes(stats, nbytes);
+    }
+    return result;
+}
+
+bool _uw_counted_reallocate(Allocator* allocator, UwTypeId stats_id, void** addr_ptr,
+                            unsigned old_nbytes, unsigned new_nbytes, bool clean)
+{
+    if (!allocator->reallocate(addr_ptr, old_nbytes, new_nbytes, clean, nullptr)) {
+        return false;
+    }
+    UwAllocStats* stats = get_stats(stats_id);
+    if (stats) {
+        stats->reallocs++;
+        add_live_bytes(stats, (int64_t) new_nbytes - (int64_t) old_nbytes);
+    }
+    return true;
+}
+
+void _uw_counted_release(Allocator* allocator, UwTypeId stats_id, void** addr_ptr, unsigned nbytes)
+{
+    if (*addr_ptr) {
+        UwAllocStats* stats = get_stats(stats_id);
+        if (stats) {
+            stats->frees++;
+            stats->live_bytes -= nbytes;
+        }
+    }
+    allocator->release(addr_ptr, nbytes);
+}
+
+void uw_enable_alloc_stats(bool enable)
+{
+    _uw_alloc_stats_enabled = enable;
+}
+
+void uw_reset_alloc_stats()
+{
+    if (alloc_stats) {
+        memset(alloc_stats, 0, alloc_stats_capacity * sizeof(UwAllocStats));
+    }
+}
+
+UwAllocStats uw_alloc_stats(UwTypeId type_id)
+{
+    if (type_id < alloc_stats_capacity) {
+        return alloc_stats[type_id];
+    }
+    UwAllocStats result = {};
+    return result;
+}
+
+void uw_dump_alloc_stats(FILE* fp)
+{
+    fprintf(fp, "%-20s %12s %12s %12s %14s %14s\n", "type", "allocs", "reallocs", "frees", "live bytes", "peak bytes");
+    for (unsigned i = 0; i < alloc_stats_capacity; i++) {
+        UwAllocStats* stats = &alloc_stats[i];
+        if (stats->allocs == 0 && stats->reallocs == 0 && stats->frees == 0) {
+            continue;
+        }
+        char* name = (i == UW_PARENTS_ALLOC_STATS)? "(compound parents)" : _uw_types[i]->name;
+        fprintf(fp, "%-20s %12llu %12llu %12llu %14lld %14lld\n", name,
+                (unsigned long long) stats->allocs, (unsigned long long) stats->reallocs,
+                (unsigned long long) stats->frees,
+                (long long) stats->live_bytes, (long long) stats->peak_bytes);
+    }
+}
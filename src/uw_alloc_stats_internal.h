@@ -0,0 +1,54 @@
+#pragma once
+
+/*
+ * Allocator calls with optional accounting.
+ *
+ * All allocations for values should go through these functions.
+ */
+
+#include "include/uw_alloc_stats.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef _unlikely_
+#   define _unlikely_(x)  __builtin_expect(!!(x), 0)
+#endif
+
+extern bool _uw_alloc_stats_enabled;
+
+void* _uw_counted_allocate(Allocator* allocator, UwTypeId stats_id, unsigned nbytes, bool clean);
+bool  _uw_counted_reallocate(Allocator* allocator, UwTypeId stats_id, void** addr_ptr,
+                             unsigned old_nbytes, unsigned new_nbytes, bool clean);
+void  _uw_counted_release(Allocator* allocator, UwTypeId stats_id, void** addr_ptr, unsigned nbytes);
+
+static inline void* _uw_allocate(Allocator* allocator, UwTypeId stats_id, unsigned nbytes, bool clean)
+{
+    if (_unlikely_(_uw_alloc_stats_enabled)) {
+        return _uw_counted_allocate(allocator, stats_id, nbytes, clean);
+    }
+    return allocator->allocate(nbytes, clean);
+}
+
+static inline bool _uw_reallocate(Allocator* allocator, UwTypeId stats_id, void** addr_ptr,
+                                  unsigned old_nbytes, unsigned new_nbytes, bool clean)
+{
+    if (_unlikely_(_uw_alloc_stats_enabled)) {
+        return _uw_counted_reallocate(allocator, stats_id, addr_ptr, old_nbytes, new_nbytes, clean);
+    }
+    return allocator->reallocate(addr_ptr, old_nbytes, new_nbytes, clean, nullptr);
+}
+
+static inline void _uw_release(Allocator* allocator, UwTypeId stats_id, void** addr_ptr, unsigned nbytes)
+{
+    if (_unlikely_(_uw_alloc_stats_enabled)) {
+        _uw_counted_release(allocator, stats_id, addr_ptr, nbytes);
+        return;
+    }
+    allocator->release(addr_ptr, nbytes);
+}
+
+#ifdef __cplusplus
+}
+#endif
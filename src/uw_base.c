@@ -2,12 +2,17 @@
 #   define _GNU_SOURCE
 #endif
 
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/mman.h>
 
 #include "include/uw_base.h"
 #include "include/uw_file.h"
 #include "include/uw_string.h"
+#include "src/uw_alloc_stats_internal.h"
 #include "src/uw_charptr_internal.h"
 #include "src/uw_hash_internal.h"
 #include "src/uw_list_internal.h"
@@ -45,7 +50,7 @@ bool _uw_alloc_extra_data(UwValuePtr v)
     UwType* t = _uw_types[v->type_id];
     unsigned memsize = t->data_offset + t->data_size;
     if (memsize) {
-        _UwExtraData* extra_data = t->allocator->allocate(memsize, true);
+        _UwExtraData* extra_data = _uw_allocate(t->allocator, v->type_id, memsize, true);
         if (!extra_data) {
             return false;
         }
@@ -64,7 +69,7 @@ void _uw_free_extra_data(UwValuePtr v)
         UwType* t = _uw_types[v->type_id];
         unsigned memsize = t->data_offset + t->data_size;
         if (memsize) {
-            t->allocator->release((void**) &v->extra_data, memsize);
+            _uw_release(t->allocator, v->type_id, (void**) &v->extra_data, memsize);
         } else {
             uw_dump(stderr, v);
             uw_panic("Extra data is allocated, but memsize evaluates to zero");
@@ -95,7 +100,7 @@ UwResult _uw_default_create(UwTypeId type_id, va_list ap)
 UwResult _uw_default_clone(UwValuePtr self)
 {
     if (self->extra_data) {
-        self->extra_data->refcount++;
+        _uw_refcount_inc(&self->extra_data->refcount);
     }
     return *self;
 }
@@ -107,11 +112,10 @@ void _uw_default_destroy(UwValuePtr self)
     if (!extra_data) {
         return;
     }
-    if (extra_data->refcount) {
-        extra_data->refcount--;
-    }
-    if (extra_data->refcount) {
-        return;
+    if (_uw_refcount_load(&extra_data->refcount)) {
+        if (_uw_refcount_dec(&extra_data->refcount)) {
+            return;
+        }
     }
     if (_uw_types[self->type_id]->compound) {
 
@@ -399,6 +403,92 @@ static UwType bool_type = {
         // [UwInterfaceId_Logic] = &bool_type_logic_interface
 };
 
+/****************************************************************
+ * Number formatting
+ */
+
+static const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+char* _uw_format_unsigned(uint64_t n, char* end)
+{
+    while (n >= 100) {
+        unsigned i = (n % 100) * 2;
+        n /= 100;
+        *--end = digit_pairs[i + 1];
+        *--end = digit_pairs[i];
+    }
+    if (n >= 10) {
+        unsigned i = n * 2;
+        *--end = digit_pairs[i + 1];
+        *--end = digit_pairs[i];
+    } else {
+        *--end = (char) ('0' + n);
+    }
+    return end;
+}
+
+char* _uw_format_signed(int64_t n, char* end)
+{
+    if (n >= 0) {
+        return _uw_format_unsigned((uint64_t) n, end);
+    }
+    char* start = _uw_format_unsigned(0 - (uint64_t) n, end);
+    *--start = '-';
+    return start;
+}
+
+unsigned _uw_format_float(double value, char* buffer)
+{
+    // 15 digits always read back for normal values that need 15 or less,
+    // try more only if they do not
+    // XXX snprintf and strtod depend on locale
+    int n;
+    for (int precision = 15;; precision++) {
+        n = snprintf(buffer, UW_FLOAT_BUFFER_SIZE - 2, "%.*g", precision, value);
+        if (precision == 17 || !isfinite(value) || strtod(buffer, nullptr) == value) {
+            break;
+        }
+    }
+    if (isfinite(value) && !strpbrk(buffer, ".e")) {
+        // make it look like float
+        buffer[n++] = '.';
+        buffer[n++] = '0';
+        buffer[n] = 0;
+    }
+    return n;
+}
+
+static UwResult ascii_to_string(char* chars, unsigned length)
+/*
+ * Make 1-byte String from ASCII characters,
+ * embedded into value if short enough.
+ */
+{
+    if (length <= get_embedded_capacity(1)) {
+        UwValue result = UwString();
+        memcpy(result.str_1, chars, length);
+        result.str_embedded_length = length;
+        return uw_move(&result);
+    }
+    UwValue result = uw_create_empty_string(length, 1);
+    if (uw_error(&result)) {
+        return uw_move(&result);
+    }
+    memcpy(_uw_string_char_ptr(&result, 0), chars, length);
+    _uw_string_set_length(&result, length);
+    return uw_move(&result);
+}
+
 /****************************************************************
  * Abstract Integer type
  */
@@ -419,9 +509,12 @@ static void int_dump(UwValuePtr self, FILE* fp, int first_indent, int next_inden
     fputs(": abstract\n", fp);
 }
 
+// forward declaration
+static UwResult signed_to_string(UwValuePtr self);
+
 static UwResult int_to_string(UwValuePtr self)
 {
-    return UwError(UW_ERROR_NOT_IMPLEMENTED);
+    return signed_to_string(self);
 }
 
 static bool int_is_true(UwValuePtr self)
@@ -496,7 +589,10 @@ static void signed_dump(UwValuePtr self, FILE* fp, int first_indent, int next_in
 
 static UwResult signed_to_string(UwValuePtr self)
 {
-    return UwError(UW_ERROR_NOT_IMPLEMENTED);
+    char buffer[UW_INT_BUFFER_SIZE];
+    char* end = buffer + sizeof(buffer);
+    char* start = _uw_format_signed(self->signed_value, end);
+    return ascii_to_string(start, end - start);
 }
 
 static bool signed_is_true(UwValuePtr self)
@@ -592,7 +688,10 @@ static void unsigned_dump(UwValuePtr self, FILE* fp, int first_indent, int next_
 
 static UwResult unsigned_to_string(UwValuePtr self)
 {
-    return UwError(UW_ERROR_NOT_IMPLEMENTED);
+    char buffer[UW_INT_BUFFER_SIZE];
+    char* end = buffer + sizeof(buffer);
+    char* start = _uw_format_unsigned(self->unsigned_value, end);
+    return ascii_to_string(start, end - start);
 }
 
 static bool unsigned_is_true(UwValuePtr self)
@@ -687,7 +786,9 @@ static void float_dump(UwValuePtr self, FILE* fp, int first_indent, int next_ind
 
 static UwResult float_to_string(UwValuePtr self)
 {
-    return UwError(UW_ERROR_NOT_IMPLEMENTED);
+    char buffer[UW_FLOAT_BUFFER_SIZE];
+    unsigned length = _uw_format_float(self->float_value, buffer);
+    return ascii_to_string(buffer, length);
 }
 
 static bool float_is_true(UwValuePtr self)
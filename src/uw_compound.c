@@ -1,4 +1,6 @@
 #include "include/uw_base.h"
+#include "src/uw_alloc_stats_internal.h"
+#include "src/uw_trace_internal.h"
 
 static inline _UwParentsChunk* get_parents_list(_UwCompoundData* cdata)
 /*
@@ -14,7 +16,7 @@ void _uw_fini_compound_data(_UwCompoundData* cdata)
 {
     if (cdata->using_parents_list) {
         _UwParentsChunk* chunk_ptr = get_parents_list(cdata);
-        default_allocator.release((void**) &chunk_ptr, cdata->num_parents_chunks * sizeof(_UwParentsChunk));
+        _uw_release(&default_allocator, UW_PARENTS_ALLOC_STATS, (void**) &chunk_ptr, cdata->num_parents_chunks * sizeof(_UwParentsChunk));
         cdata->parents[0] = nullptr;
         cdata->parents[1] = nullptr;
     }
@@ -36,9 +38,13 @@ bool _uw_is_embraced(_UwCompoundData* cdata)
 
 bool _uw_adopt(_UwCompoundData* parent, _UwCompoundData* child)
 {
+    if (_uw_refcount_frozen(&child->refcount)) {
+        // frozen values are immortal and do not track parents
+        return true;
+    }
     if (parent == child) {
 success:
-        child->refcount--;
+        _uw_refcount_dec(&child->refcount);
         return true;;
     }
     if (child->using_parents_list) {
@@ -73,7 +79,7 @@ success:
         unsigned old_size = child->num_parents_chunks * sizeof(_UwParentsChunk);
         unsigned new_size = old_size + sizeof(_UwParentsChunk);
         _UwParentsChunk* parents_list = get_parents_list(child);
-        if (!default_allocator.reallocate((void**) &parents_list, old_size, new_size, true, nullptr)) {
+        if (!_uw_reallocate(&default_allocator, UW_PARENTS_ALLOC_STATS, (void**) &parents_list, old_size, new_size, true)) {
             return false;
         }
         child->parents_list = parents_list;
@@ -106,16 +112,22 @@ success:
             child->parents_refcount[1] = 1;
             goto success;
         }
-        // allocate list
-        _UwParentsChunk* chunk_ptr = default_allocator.allocate(sizeof(_UwParentsChunk), true);
+        // allocate list and move embedded parents to it
+        _UwParentsChunk* chunk_ptr = _uw_allocate(&default_allocator, UW_PARENTS_ALLOC_STATS, sizeof(_UwParentsChunk), true);
         if (!chunk_ptr) {
             return false;
         }
+        chunk_ptr->parents[0] = child->parents[0];
+        chunk_ptr->parents_refcount[0] = child->parents_refcount[0];
+        chunk_ptr->parents[1] = child->parents[1];
+        chunk_ptr->parents_refcount[1] = child->parents_refcount[1];
+        chunk_ptr->parents[2] = parent;
+        chunk_ptr->parents_refcount[2] = 1;
         child->parents_list = chunk_ptr;
         child->using_parents_list = true;
         child->num_parents_chunks = 1;
-        chunk_ptr->parents[0] = parent;
-        chunk_ptr->parents_refcount[0] = 1;
+        child->parents_refcount[0] = 0;
+        child->parents_refcount[1] = 0;
         goto success;
     }
 }
@@ -134,10 +146,13 @@ static void shrink_parents_list(_UwCompoundData* child, _UwParentsChunk* chunk_p
             num_items_in_chunk++;
         }
     }
-    if (num_items_in_chunk == 2 && child->num_parents_chunks == 1) {
-        // last chunk with exactly 2 iems --> deallocate list
+    if (num_items_in_chunk <= 2 && child->num_parents_chunks == 1) {
+        // last chunk with no more than 2 items --> move them to embedded list and deallocate list
         _UwParentsChunk* parents_list = get_parents_list(child);
-        child->num_parents_chunks = 0;
+        child->parents[0] = nullptr;  // this also clears using_parents_list flag
+        child->parents[1] = nullptr;
+        child->parents_refcount[0] = 0;
+        child->parents_refcount[1] = 0;
         parent_ptr = parents_list->parents;
         for (unsigned i = 0, j = 0; i < UW_PARENTS_CHUNK_SIZE; i++, parent_ptr++) {
             if (*parent_ptr) {
@@ -146,10 +161,13 @@ static void shrink_parents_list(_UwCompoundData* child, _UwParentsChunk* chunk_p
                 j++;
             }
         }
-        default_allocator.release((void**) &parents_list, sizeof(_UwParentsChunk));  // see above, num_parents_chunks was 1
+        _uw_release(&default_allocator, UW_PARENTS_ALLOC_STATS, (void**) &parents_list, sizeof(_UwParentsChunk));  // see above, num_parents_chunks was 1
+        return;
+    }
+    if (num_items_in_chunk) {
         return;
     }
-    // delete chunk
+    // delete empty chunk
     if (chunks_left) {
         memmove(chunk_ptr, chunk_ptr + 1, chunks_left * sizeof(_UwParentsChunk));
     }
@@ -157,12 +175,17 @@ static void shrink_parents_list(_UwCompoundData* child, _UwParentsChunk* chunk_p
     unsigned old_size = child->num_parents_chunks * sizeof(_UwParentsChunk);
     unsigned new_size = old_size - sizeof(_UwParentsChunk);
     _UwParentsChunk* parents_list = get_parents_list(child);
-    default_allocator.reallocate((void**) &parents_list, old_size, new_size, false, nullptr);
+    _uw_reallocate(&default_allocator, UW_PARENTS_ALLOC_STATS, (void**) &parents_list, old_size, new_size, false);
+    child->parents_list = parents_list;
+    child->using_parents_list = true;
     child->num_parents_chunks--;
 }
 
 bool _uw_abandon(_UwCompoundData* parent, _UwCompoundData* child)
 {
+    if (_uw_refcount_frozen(&child->refcount)) {
+        return true;
+    }
     if (parent == child) {
         return true;
     }
@@ -206,6 +229,20 @@ bool _uw_abandon(_UwCompoundData* parent, _UwCompoundData* child)
     return true;
 }
 
+void _uw_destroy_child(_UwCompoundData* parent, UwValuePtr child)
+{
+    if (_uw_types[child->type_id]->compound) {
+        _UwCompoundData* cdata = (_UwCompoundData*) child->extra_data;
+        _uw_abandon(parent, cdata);
+        if (_uw_refcount_load(&cdata->refcount)) {
+            // still referenced by other values
+            *child = UwNull();
+            return;
+        }
+    }
+    uw_destroy(child);
+}
+
 // bit flags for the result of cyclic reference checker
 #define HAVE_CYCLIC_REFS  1  // cyclic references are present
 #define NONZERO_REFCOUNT  2  // reference count of some data in chain is nonzero
@@ -220,7 +257,7 @@ static unsigned check_parent_link(_UwCompoundData* first, _UwCompoundData* paren
 {
     unsigned result = 0;  // bit flags: HAVE_CYCLIC_REFS and NONZERO_REFCOUNT
 
-    if (parent->refcount) {
+    if (_uw_refcount_load(&parent->refcount)) {
         result |= NONZERO_REFCOUNT;
     }
     if (parent == first) {
@@ -266,7 +303,10 @@ static unsigned check_cyclic_refs(_UwCompoundData* first, _UwCompoundData* cdata
 
 bool _uw_need_break_cyclic_refs(_UwCompoundData* cdata)
 {
-    return check_cyclic_refs(cdata, cdata) == HAVE_CYCLIC_REFS;
+    _uw_trace(cyclic_check_start, cdata);
+    bool result = check_cyclic_refs(cdata, cdata) == HAVE_CYCLIC_REFS;
+    _uw_trace(cyclic_check_done, cdata, result);
+    return result;
 }
 
 void _uw_dump_compound_data(FILE* fp, _UwCompoundData* cdata, int indent)
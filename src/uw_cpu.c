@@ -0,0 +1,436 @@
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#   define UW_CPU_X86
+#   include <immintrin.h>
+#endif
+
+#include "include/uw_base.h"
+#include "src/uw_cpu_internal.h"
+
+/****************************************************************
+ * Scalar kernels
+ *
+ * Helpers are inlined into SIMD kernels to process the tails.
+ * This way AVX2 kernels never call non-VEX code with dirty upper
+ * halves of registers, which costs a lot.
+ */
+
+[[ gnu::always_inline ]]
+static inline unsigned ascii_prefix_from(char8_t* ptr, unsigned i, unsigned size)
+{
+    // skip ASCII characters 8 bytes at a time
+    while (i + sizeof(uint64_t) <= size) {
+        uint64_t chunk;
+        memcpy(&chunk, ptr + i, sizeof(uint64_t));
+        if (chunk & 0x8080'8080'8080'8080ULL) {
+            break;
+        }
+        i += sizeof(uint64_t);
+    }
+    while (i < size && !(ptr[i] & 0x80)) {
+        i++;
+    }
+    return i;
+}
+
+[[ gnu::always_inline ]]
+static inline void widen_u8_u16_from(uint8_t* src, uint16_t* dest, unsigned i, unsigned length)
+{
+    for (; i < length; i++) {
+        dest[i] = src[i];
+    }
+}
+
+[[ gnu::always_inline ]]
+static inline void widen_u8_u32_from(uint8_t* src, uint32_t* dest, unsigned i, unsigned length)
+{
+    for (; i < length; i++) {
+        dest[i] = src[i];
+    }
+}
+
+[[ gnu::always_inline ]]
+static inline uint32_t or_u16_from(uint16_t* ptr, unsigned i, unsigned length)
+{
+    uint32_t result = 0;
+    for (; i < length; i++) {
+        result |= ptr[i];
+    }
+    return result;
+}
+
+[[ gnu::always_inline ]]
+static inline uint32_t or_u32_from(uint32_t* ptr, unsigned i, unsigned length)
+{
+    uint32_t result = 0;
+    for (; i < length; i++) {
+        result |= ptr[i];
+    }
+    return result;
+}
+
+[[ gnu::always_inline ]]
+static inline unsigned count_le_u32_from(uint32_t* items, unsigned i, unsigned n, uint32_t value)
+{
+    unsigned count = 0;
+    for (; i < n; i++) {
+        count += items[i] <= value;
+    }
+    return count;
+}
+
+static unsigned ascii_prefix_scalar(char8_t* ptr, unsigned size)
+{
+    return ascii_prefix_from(ptr, 0, size);
+}
+
+static void widen_u8_u16_scalar(uint8_t* src, uint16_t* dest, unsigned length)
+{
+    widen_u8_u16_from(src, dest, 0, length);
+}
+
+static void widen_u8_u32_scalar(uint8_t* src, uint32_t* dest, unsigned length)
+{
+    widen_u8_u32_from(src, dest, 0, length);
+}
+
+static uint32_t or_u16_scalar(uint16_t* ptr, unsigned length)
+{
+    return or_u16_from(ptr, 0, length);
+}
+
+static uint32_t or_u32_scalar(uint32_t* ptr, unsigned length)
+{
+    return or_u32_from(ptr, 0, length);
+}
+
+static unsigned count_le_u32_scalar(uint32_t* items, unsigned n, uint32_t value)
+{
+    return count_le_u32_from(items, 0, n, value);
+}
+
+#ifdef UW_CPU_X86
+
+/****************************************************************
+ * SSE4.2 kernels
+ *
+ * 128-bit helpers are inlined into AVX2 kernels as well.
+ */
+
+#define SSE42  gnu::target("sse4.2,popcnt")
+#define AVX2   gnu::target("avx2,popcnt")
+
+[[ SSE42, gnu::always_inline ]]
+static inline unsigned ascii_prefix_16(char8_t* ptr, unsigned i, unsigned size)
+{
+    for (; i + 16 <= size; i += 16) {
+        unsigned mask = _mm_movemask_epi8(_mm_loadu_si128((__m128i*) (ptr + i)));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return ascii_prefix_from(ptr, i, size);
+}
+
+[[ SSE42, gnu::always_inline ]]
+static inline void widen_u8_u16_16(uint8_t* src, uint16_t* dest, unsigned i, unsigned length)
+{
+    __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= length; i += 16) {
+        __m128i chars = _mm_loadu_si128((__m128i*) (src + i));
+        _mm_storeu_si128((__m128i*) (dest + i),     _mm_unpacklo_epi8(chars, zero));
+        _mm_storeu_si128((__m128i*) (dest + i + 8), _mm_unpackhi_epi8(chars, zero));
+    }
+    widen_u8_u16_from(src, dest, i, length);
+}
+
+[[ SSE42, gnu::always_inline ]]
+static inline void widen_u8_u32_16(uint8_t* src, uint32_t* dest, unsigned i, unsigned length)
+{
+    for (; i + 16 <= length; i += 16) {
+        __m128i chars = _mm_loadu_si128((__m128i*) (src + i));
+        _mm_storeu_si128((__m128i*) (dest + i),      _mm_cvtepu8_epi32(chars));
+        _mm_storeu_si128((__m128i*) (dest + i + 4),  _mm_cvtepu8_epi32(_mm_srli_si128(chars, 4)));
+        _mm_storeu_si128((__m128i*) (dest + i + 8),  _mm_cvtepu8_epi32(_mm_srli_si128(chars, 8)));
+        _mm_storeu_si128((__m128i*) (dest + i + 12), _mm_cvtepu8_epi32(_mm_srli_si128(chars, 12)));
+    }
+    widen_u8_u32_from(src, dest, i, length);
+}
+
+[[ SSE42, gnu::always_inline ]]
+static inline uint32_t reduce_or_128(__m128i acc)
+{
+    acc = _mm_or_si128(acc, _mm_srli_si128(acc, 8));
+    acc = _mm_or_si128(acc, _mm_srli_si128(acc, 4));
+    return (uint32_t) _mm_cvtsi128_si32(acc);
+}
+
+[[ SSE42, gnu::always_inline ]]
+static inline uint32_t or_u16_16(uint16_t* ptr, unsigned i, unsigned length)
+{
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 8 <= length; i += 8) {
+        acc = _mm_or_si128(acc, _mm_loadu_si128((__m128i*) (ptr + i)));
+    }
+    uint32_t result = reduce_or_128(acc);
+    return (result | (result >> 16) | or_u16_from(ptr, i, length)) & 0xFFFF;
+}
+
+[[ SSE42, gnu::always_inline ]]
+static inline uint32_t or_u32_16(uint32_t* ptr, unsigned i, unsigned length)
+{
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 4 <= length; i += 4) {
+        acc = _mm_or_si128(acc, _mm_loadu_si128((__m128i*) (ptr + i)));
+    }
+    return reduce_or_128(acc) | or_u32_from(ptr, i, length);
+}
+
+[[ SSE42, gnu::always_inline ]]
+static inline unsigned count_le_u32_16(uint32_t* items, unsigned i, unsigned n, uint32_t value)
+{
+    // unsigned a <= b is max(a, b) == b
+    __m128i v = _mm_set1_epi32((int) value);
+    unsigned count = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i a = _mm_loadu_si128((__m128i*) (items + i));
+        __m128i le = _mm_cmpeq_epi32(_mm_max_epu32(a, v), v);
+        count += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(le)));
+    }
+    return count + count_le_u32_from(items, i, n, value);
+}
+
+[[ SSE42 ]]
+static unsigned ascii_prefix_sse42(char8_t* ptr, unsigned size)
+{
+    return ascii_prefix_16(ptr, 0, size);
+}
+
+[[ SSE42 ]]
+static void widen_u8_u16_sse42(uint8_t* src, uint16_t* dest, unsigned length)
+{
+    widen_u8_u16_16(src, dest, 0, length);
+}
+
+[[ SSE42 ]]
+static void widen_u8_u32_sse42(uint8_t* src, uint32_t* dest, unsigned length)
+{
+    widen_u8_u32_16(src, dest, 0, length);
+}
+
+[[ SSE42 ]]
+static uint32_t or_u16_sse42(uint16_t* ptr, unsigned length)
+{
+    return or_u16_16(ptr, 0, length);
+}
+
+[[ SSE42 ]]
+static uint32_t or_u32_sse42(uint32_t* ptr, unsigned length)
+{
+    return or_u32_16(ptr, 0, length);
+}
+
+[[ SSE42 ]]
+static unsigned count_le_u32_sse42(uint32_t* items, unsigned n, uint32_t value)
+{
+    return count_le_u32_16(items, 0, n, value);
+}
+
+/****************************************************************
+ * AVX2 kernels
+ */
+
+[[ AVX2 ]]
+static unsigned ascii_prefix_avx2(char8_t* ptr, unsigned size)
+{
+    unsigned i = 0;
+    for (; i + 32 <= size; i += 32) {
+        unsigned mask = _mm256_movemask_epi8(_mm256_loadu_si256((__m256i*) (ptr + i)));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return ascii_prefix_16(ptr, i, size);
+}
+
+[[ AVX2 ]]
+static void widen_u8_u16_avx2(uint8_t* src, uint16_t* dest, unsigned length)
+{
+    unsigned i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m128i lo = _mm_loadu_si128((__m128i*) (src + i));
+        __m128i hi = _mm_loadu_si128((__m128i*) (src + i + 16));
+        _mm256_storeu_si256((__m256i*) (dest + i),      _mm256_cvtepu8_epi16(lo));
+        _mm256_storeu_si256((__m256i*) (dest + i + 16), _mm256_cvtepu8_epi16(hi));
+    }
+    widen_u8_u16_16(src, dest, i, length);
+}
+
+[[ AVX2 ]]
+static void widen_u8_u32_avx2(uint8_t* src, uint32_t* dest, unsigned length)
+{
+    unsigned i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i chars = _mm_loadu_si128((__m128i*) (src + i));
+        _mm256_storeu_si256((__m256i*) (dest + i),     _mm256_cvtepu8_epi32(chars));
+        _mm256_storeu_si256((__m256i*) (dest + i + 8), _mm256_cvtepu8_epi32(_mm_srli_si128(chars, 8)));
+    }
+    widen_u8_u32_from(src, dest, i, length);
+}
+
+[[ AVX2, gnu::always_inline ]]
+static inline uint32_t reduce_or_256(__m256i acc)
+{
+    return reduce_or_128(_mm_or_si128(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1)));
+}
+
+[[ AVX2 ]]
+static uint32_t or_u16_avx2(uint16_t* ptr, unsigned length)
+{
+    __m256i acc = _mm256_setzero_si256();
+    unsigned i = 0;
+    for (; i + 16 <= length; i += 16) {
+        acc = _mm256_or_si256(acc, _mm256_loadu_si256((__m256i*) (ptr + i)));
+    }
+    uint32_t result = reduce_or_256(acc);
+    return (result | (result >> 16) | or_u16_16(ptr, i, length)) & 0xFFFF;
+}
+
+[[ AVX2 ]]
+static uint32_t or_u32_avx2(uint32_t* ptr, unsigned length)
+{
+    __m256i acc = _mm256_setzero_si256();
+    unsigned i = 0;
+    for (; i + 8 <= length; i += 8) {
+        acc = _mm256_or_si256(acc, _mm256_loadu_si256((__m256i*) (ptr + i)));
+    }
+    return reduce_or_256(acc) | or_u32_16(ptr, i, length);
+}
+
+[[ AVX2 ]]
+static unsigned count_le_u32_avx2(uint32_t* items, unsigned n, uint32_t value)
+{
+    __m256i v = _mm256_set1_epi32((int) value);
+    unsigned count = 0;
+    unsigned i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i a = _mm256_loadu_si256((__m256i*) (items + i));
+        __m256i le = _mm256_cmpeq_epi32(_mm256_max_epu32(a, v), v);
+        count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(le)));
+    }
+    return count + count_le_u32_16(items, i, n, value);
+}
+
+#endif  // UW_CPU_X86
+
+/****************************************************************
+ * Dispatch
+ */
+
+static _UwKernels kernels[] = {
+    [UW_CPU_SCALAR] = {
+        .ascii_prefix = ascii_prefix_scalar,
+        .widen_u8_u16 = widen_u8_u16_scalar,
+        .widen_u8_u32 = widen_u8_u32_scalar,
+        .or_u16       = or_u16_scalar,
+        .or_u32       = or_u32_scalar,
+        .count_le_u32 = count_le_u32_scalar
+    },
+#ifdef UW_CPU_X86
+    [UW_CPU_SSE42] = {
+        .ascii_prefix = ascii_prefix_sse42,
+        .widen_u8_u16 = widen_u8_u16_sse42,
+        .widen_u8_u32 = widen_u8_u32_sse42,
+        .or_u16       = or_u16_sse42,
+        .or_u32       = or_u32_sse42,
+        .count_le_u32 = count_le_u32_sse42
+    },
+    [UW_CPU_AVX2] = {
+        .ascii_prefix = ascii_prefix_avx2,
+        .widen_u8_u16 = widen_u8_u16_avx2,
+        .widen_u8_u32 = widen_u8_u32_avx2,
+        .or_u16       = or_u16_avx2,
+        .or_u32       = or_u32_avx2,
+        .count_le_u32 = count_le_u32_avx2
+    }
+#endif
+};
+
+static char* level_names[] = {
+    [UW_CPU_SCALAR] = "scalar",
+    [UW_CPU_SSE42]  = "sse4.2",
+    [UW_CPU_AVX2]   = "avx2"
+};
+
+// scalar kernels until init_uw_cpu runs
+_UwKernels _uw_kernels = {
+    .ascii_prefix = ascii_prefix_scalar,
+    .widen_u8_u16 = widen_u8_u16_scalar,
+    .widen_u8_u32 = widen_u8_u32_scalar,
+    .or_u16       = or_u16_scalar,
+    .or_u32       = or_u32_scalar,
+    .count_le_u32 = count_le_u32_scalar
+};
+
+static UwCpuLevel cpu_level = UW_CPU_SCALAR;
+static UwCpuLevel max_cpu_level = UW_CPU_SCALAR;
+
+[[ gnu::constructor ]]
+static void init_uw_cpu()
+{
+#ifdef UW_CPU_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt")) {
+        max_cpu_level = UW_CPU_SSE42;
+        if (__builtin_cpu_supports("avx2")) {
+            max_cpu_level = UW_CPU_AVX2;
+        }
+    }
+#endif
+    UwCpuLevel level = max_cpu_level;
+    char* env = getenv("UW_CPU_LEVEL");
+    if (env && *env) {
+        UwCpuLevel i = UW_CPU_SCALAR;
+        while (i <= UW_CPU_AVX2 && strcmp(env, level_names[i]) != 0) {
+            i++;
+        }
+        if (i > UW_CPU_AVX2) {
+            fprintf(stderr, "UW_CPU_LEVEL: unknown level %s, using %s\n", env, level_names[max_cpu_level]);
+        } else if (i > max_cpu_level) {
+            fprintf(stderr, "UW_CPU_LEVEL: %s is not supported by CPU, using %s\n", env, level_names[max_cpu_level]);
+        } else {
+            level = i;
+        }
+    }
+    uw_set_cpu_level(level);
+}
+
+UwCpuLevel uw_cpu_level()
+{
+    return cpu_level;
+}
+
+UwCpuLevel uw_cpu_max_level()
+{
+    return max_cpu_level;
+}
+
+UwCpuLevel uw_set_cpu_level(UwCpuLevel level)
+{
+    if (level > max_cpu_level) {
+        level = max_cpu_level;
+    }
+    cpu_level = level;
+    _uw_kernels = kernels[level];
+    return level;
+}
+
+char* uw_cpu_level_name(UwCpuLevel level)
+{
+    if (level > UW_CPU_AVX2) {
+        return "(unknown)";
+    }
+    return level_names[level];
+}
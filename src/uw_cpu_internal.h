@@ -0,0 +1,42 @@
+#pragma once
+
+/*
+ * SIMD kernels selected at startup, see uw_cpu.h
+ */
+
+#include "include/uw_cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    unsigned (*ascii_prefix)(char8_t* ptr, unsigned size);
+    /*
+     * Return the number of leading ASCII bytes.
+     */
+
+    void (*widen_u8_u16)(uint8_t* src, uint16_t* dest, unsigned length);
+    void (*widen_u8_u32)(uint8_t* src, uint32_t* dest, unsigned length);
+    /*
+     * Zero-extend chars.
+     */
+
+    uint32_t (*or_u16)(uint16_t* ptr, unsigned length);
+    uint32_t (*or_u32)(uint32_t* ptr, unsigned length);
+    /*
+     * Return bitwise OR of all chars. The highest bit of the result
+     * is the highest bit of the widest char, that's enough for char size.
+     */
+
+    unsigned (*count_le_u32)(uint32_t* items, unsigned n, uint32_t value);
+    /*
+     * Return the number of items that are less or equal to `value`.
+     */
+} _UwKernels;
+
+extern _UwKernels _uw_kernels;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,267 @@
+#include "include/uw_csv.h"
+#include "src/uw_list_internal.h"
+
+typedef struct {
+    _UwValue line_reader;
+    _UwValue line;  // reusable line buffer
+    char32_t delimiter;
+} _UwCsvReader;
+
+#define get_data_ptr(value)  ((_UwCsvReader*) _uw_get_data_ptr((value), UwTypeId_CsvReader))
+
+#define CSV_QUOTE  '"'
+
+uint16_t UW_ERROR_UNTERMINATED_QUOTE = 0;
+
+/****************************************************************
+ * Basic interface methods
+ */
+
+static UwResult csv_init(UwValuePtr self, va_list ap)
+{
+    UwValuePtr line_reader = va_arg(ap, UwValuePtr);
+    char32_t   delimiter   = va_arg(ap, char32_t);
+
+    if (!_uw_get_interface(_uw_types[line_reader->type_id], UwInterfaceId_LineReader)) {
+        return UwErrorNoInterface(line_reader, LineReader);
+    }
+    UwValue line = UwString();
+    if (uw_error(&line)) {
+        return uw_move(&line);
+    }
+    _UwCsvReader* csv = get_data_ptr(self);
+    csv->line_reader = uw_clone(line_reader);
+    csv->line = uw_move(&line);
+    csv->delimiter = delimiter;
+    return UwOK();
+}
+
+static void csv_fini(UwValuePtr self)
+{
+    _UwCsvReader* csv = get_data_ptr(self);
+    uw_destroy(&csv->line_reader);
+    uw_destroy(&csv->line);
+}
+
+static void csv_hash(UwValuePtr self, UwHashContext* ctx)
+{
+    _UwCsvReader* csv = get_data_ptr(self);
+
+    _uw_hash_uint64(ctx, self->type_id);
+    _uw_call_hash(&csv->line_reader, ctx);
+    _uw_hash_uint64(ctx, csv->delimiter);
+}
+
+static UwResult csv_deepcopy(UwValuePtr self)
+{
+    return UwError(UW_ERROR_NOT_IMPLEMENTED);
+}
+
+static void csv_dump(UwValuePtr self, FILE* fp, int first_indent, int next_indent, _UwCompoundChain* tail)
+{
+    _UwCsvReader* csv = get_data_ptr(self);
+
+    _uw_dump_start(fp, self, first_indent);
+    _uw_dump_base_extra_data(fp, self->extra_data);
+    fprintf(fp, " delimiter: U+%04X\n", csv->delimiter);
+    _uw_print_indent(fp, next_indent);
+    fputs("Line reader: ", fp);
+    _uw_call_dump(fp, &csv->line_reader, 0, next_indent + 4, tail);
+}
+
+static UwResult csv_to_string(UwValuePtr self)
+{
+    return UwError(UW_ERROR_NOT_IMPLEMENTED);
+}
+
+static bool csv_is_true(UwValuePtr self)
+{
+    // XXX
+    return false;
+}
+
+static bool csv_equal_sametype(UwValuePtr self, UwValuePtr other)
+{
+    // XXX
+    return false;
+}
+
+static bool csv_equal(UwValuePtr self, UwValuePtr other)
+{
+    // XXX
+    return false;
+}
+
+/****************************************************************
+ * CsvReader type
+ */
+
+UwTypeId UwTypeId_CsvReader = 0;
+
+static UwType csv_reader_type = {
+    .id              = 0,
+    .ancestor_id     = UwTypeId_Null,  // no ancestor
+    .name            = "CsvReader",
+    .allocator       = &default_allocator,
+    .data_offset     = sizeof(_UwExtraData),
+    .data_size       = sizeof(_UwCsvReader),
+    .compound        = false,
+    ._create         = _uw_default_create,
+    ._destroy        = _uw_default_destroy,
+    ._init           = csv_init,
+    ._fini           = csv_fini,
+    ._clone          = _uw_default_clone,
+    ._hash           = csv_hash,
+    ._deepcopy       = csv_deepcopy,
+    ._dump           = csv_dump,
+    ._to_string      = csv_to_string,
+    ._is_true        = csv_is_true,
+    ._equal_sametype = csv_equal_sametype,
+    ._equal          = csv_equal
+};
+
+[[ gnu::constructor ]]
+static void init_csv_reader_type()
+{
+    if (UwInterfaceId_LineReader == 0) { UwInterfaceId_LineReader = uw_register_interface(); }
+
+    UW_ERROR_UNTERMINATED_QUOTE = uw_define_status("UNTERMINATED_QUOTE");
+
+    UwTypeId_CsvReader = uw_add_type(&csv_reader_type);
+}
+
+/****************************************************************
+ * Row parser
+ */
+
+static unsigned content_length(UwValuePtr line)
+/*
+ * Return length of line without trailing LF or CR LF.
+ */
+{
+    unsigned length = uw_strlen(line);
+    if (length && uw_char_at(line, length - 1) == '\n') {
+        length--;
+        if (length && uw_char_at(line, length - 1) == '\r') {
+            length--;
+        }
+    }
+    return length;
+}
+
+static UwValuePtr get_field(UwValuePtr row, unsigned index)
+/*
+ * Return pointer to truncated string item of the row,
+ * append new one if necessary.
+ *
+ * Return nullptr if OOM.
+ */
+{
+    _UwList* list = _uw_get_data_ptr(row, UwTypeId_List);
+
+    if (index < _uw_list_length(list)) {
+        UwValuePtr item = _uw_list_item(list, index);
+        if (uw_is_string(item)) {
+            if (!uw_string_truncate(item, 0)) {
+                return nullptr;
+            }
+            return item;
+        }
+        UwValue field = UwString();
+        UwValue status = uw_list_set_item(row, index, &field);
+        if (uw_error(&status)) {
+            return nullptr;
+        }
+    } else {
+        UwValue field = UwString();
+        if (uw_error(&field)) {
+            return nullptr;
+        }
+        if (!uw_list_append(row, &field)) {
+            return nullptr;
+        }
+    }
+    // list items could be reallocated
+    return _uw_list_item(list, index);
+}
+
+UwResult uw_csv_read_row(UwValuePtr self, UwValuePtr row)
+{
+    uw_assert_list(row);
+
+    _UwCsvReader* csv = get_data_ptr(self);
+    UwValuePtr line = &csv->line;
+    char32_t delimiter = csv->delimiter;
+
+    UwValue status = uw_read_line_inplace(&csv->line_reader, line);
+    if (uw_error(&status)) {
+        return uw_move(&status);
+    }
+    unsigned length = content_length(line);
+    unsigned num_fields = 0;
+
+    if (length) {
+        unsigned pos = 0;
+        for (;;) {
+            UwValuePtr field = get_field(row, num_fields++);
+            if (!field) {
+                return UwOOM();
+            }
+            if (pos < length && uw_char_at(line, pos) == CSV_QUOTE) {
+                // quoted field
+                pos++;
+                for (;;) {
+                    unsigned quote_pos;
+                    if (uw_strchr(line, CSV_QUOTE, pos, &quote_pos)) {
+                        if (!uw_string_append_substring(field, line, pos, quote_pos)) {
+                            return UwOOM();
+                        }
+                        pos = quote_pos + 1;
+                        if (pos < length && uw_char_at(line, pos) == CSV_QUOTE) {
+                            // escaped quote
+                            if (!uw_string_append(field, CSV_QUOTE)) {
+                                return UwOOM();
+                            }
+                            pos++;
+                            continue;
+                        }
+                        break;
+                    }
+                    // quoted field continues on the next line
+                    if (!uw_string_append_substring(field, line, pos, UINT_MAX)) {
+                        return UwOOM();
+                    }
+                    UwValue status = uw_read_line_inplace(&csv->line_reader, line);
+                    if (uw_eof(&status)) {
+                        return UwError(UW_ERROR_UNTERMINATED_QUOTE);
+                    }
+                    if (uw_error(&status)) {
+                        return uw_move(&status);
+                    }
+                    length = content_length(line);
+                    pos = 0;
+                }
+            }
+            // unquoted field or garbage after closing quote: take all till delimiter
+            unsigned end_pos;
+            if (!uw_strchr(line, delimiter, pos, &end_pos) || end_pos > length) {
+                end_pos = length;
+            }
+            if (end_pos > pos) {
+                if (!uw_string_append_substring(field, line, pos, end_pos)) {
+                    return UwOOM();
+                }
+            }
+            if (end_pos >= length) {
+                break;
+            }
+            pos = end_pos + 1;  // skip delimiter
+        }
+    }
+    // delete extra items left from previous rows
+    unsigned row_length = uw_list_length(row);
+    if (row_length > num_fields) {
+        uw_list_del(row, num_fields, row_length);
+    }
+    return UwOK();
+}
@@ -1,14 +1,21 @@
 #include <errno.h>
+#include <limits.h>
 #include <string.h>
 #include <unistd.h>
 
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+
 #include "include/uw.h"
 #include "src/uw_charptr_internal.h"
+#include "src/uw_string_internal.h"
+#include "src/uw_trace_internal.h"
 
 typedef struct {
     int fd;               // file descriptor
     bool is_external_fd;  // fd is set by `set_fd` and should not be closed
     int error;            // errno, set by `open`
+    bool nonblocking;     // O_NONBLOCK is set on fd
     _UwValue name;
 
     // line reader data
@@ -19,6 +26,7 @@ typedef struct {
     char8_t  partial_utf8[4];  // UTF-8 sequence may span adjacent reads
     unsigned partial_utf8_len;
     _UwValue pushback;  // for unread_line
+    _UwValue partial_line;  // incomplete line read in non-blocking mode
     unsigned line_number;
 } _UwFile;
 
@@ -26,6 +34,13 @@ typedef struct {
 
 #define LINE_READER_BUFFER_SIZE  4096  // typical filesystem block size
 
+#define WRITE_STRING_CHUNK_SIZE  1024  // stack buffer for transcoding strings to UTF-8
+
+#define FILE_WRITE_CHUNK_SIZE  (1 << 30)  // max bytes per write call of write_all functions
+
+#define FILE_COPY_CHUNK_SIZE   (1 << 30)  // max bytes per copy_file_range/sendfile call
+#define FILE_COPY_BUFFER_SIZE  65536      // buffer for userspace copy
+
 // forward declarations
 static UwResult file_close(UwValuePtr self);
 static UwResult read_line_inplace(UwValuePtr self, UwValuePtr line);
@@ -40,6 +55,7 @@ static UwResult file_init(UwValuePtr self, va_list ap)
     f->fd = -1;
     f->name = UwNull();
     f->pushback = UwNull();
+    f->partial_line = UwNull();
     return UwOK();
 }
 
@@ -139,9 +155,11 @@ static UwResult file_open(UwValuePtr self, UwValuePtr file_name, int flags, mode
     f->name = uw_clone(file_name);
 
     f->is_external_fd = false;
+    f->nonblocking = flags & O_NONBLOCK;
     f->line_number = 0;
 
     uw_destroy(&f->pushback);
+    uw_destroy(&f->partial_line);
 
     return UwOK();
 }
@@ -155,6 +173,7 @@ static UwResult file_close(UwValuePtr self)
     }
     f->fd = -1;
     f->error = 0;
+    f->nonblocking = false;
     uw_destroy(&f->name);
 
     if (f->buffer) {
@@ -162,6 +181,7 @@ static UwResult file_close(UwValuePtr self)
         f->buffer = nullptr;
     }
     uw_destroy(&f->pushback);
+    uw_destroy(&f->partial_line);
     return UwOK();
 }
 
@@ -173,10 +193,16 @@ static UwResult file_set_fd(UwValuePtr self, int fd)
         // fd already set
         return UwError(UW_ERROR_FD_ALREADY_SET);
     }
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == -1) {
+        return UwErrno(errno);
+    }
     f->fd = fd;
     f->is_external_fd = true;
+    f->nonblocking = flags & O_NONBLOCK;
     f->line_number = 0;
     uw_destroy(&f->pushback);
+    uw_destroy(&f->partial_line);
     return UwOK();
 }
 
@@ -202,6 +228,85 @@ static UwResult file_set_name(UwValuePtr self, UwValuePtr file_name)
     return UwOK();
 }
 
+static UwResult file_seek(UwValuePtr self, off_t offset, int whence)
+{
+    _UwFile* f = get_data_ptr(self);
+
+    off_t position = lseek(f->fd, offset, whence);
+    if (position == -1) {
+        return UwErrno(errno);
+    }
+    if (f->buffer) {
+        // discard buffered data, line reader will read next chunk from new position
+        f->position = LINE_READER_BUFFER_SIZE;
+        f->data_size = LINE_READER_BUFFER_SIZE;
+        f->partial_utf8_len = 0;
+        uw_destroy(&f->pushback);
+        uw_destroy(&f->partial_line);
+    }
+    return UwUnsigned(position);
+}
+
+static UwResult file_tell(UwValuePtr self)
+{
+    // XXX this is fd offset, not taking into account data buffered by line reader
+    _UwFile* f = get_data_ptr(self);
+
+    off_t position = lseek(f->fd, 0, SEEK_CUR);
+    if (position == -1) {
+        return UwErrno(errno);
+    }
+    return UwUnsigned(position);
+}
+
+static UwResult file_size(UwValuePtr self)
+{
+    _UwFile* f = get_data_ptr(self);
+
+    struct stat st;
+    if (fstat(f->fd, &st) == -1) {
+        return UwErrno(errno);
+    }
+    return UwUnsigned(st.st_size);
+}
+
+static UwResult file_fadvise(UwValuePtr self, off_t offset, off_t length, int advice)
+{
+    _UwFile* f = get_data_ptr(self);
+
+    // posix_fadvise does not set errno, it returns error number
+    int err = posix_fadvise(f->fd, offset, length, advice);
+    if (err) {
+        return UwErrno(err);
+    }
+    return UwOK();
+}
+
+static UwResult file_get_fd(UwValuePtr self)
+{
+    return UwSigned(get_data_ptr(self)->fd);
+}
+
+static UwResult file_set_nonblocking(UwValuePtr self, bool nonblocking)
+{
+    _UwFile* f = get_data_ptr(self);
+
+    int flags = fcntl(f->fd, F_GETFL);
+    if (flags == -1) {
+        return UwErrno(errno);
+    }
+    if (nonblocking) {
+        flags |= O_NONBLOCK;
+    } else {
+        flags &= ~O_NONBLOCK;
+    }
+    if (fcntl(f->fd, F_SETFL, flags) == -1) {
+        return UwErrno(errno);
+    }
+    f->nonblocking = nonblocking;
+    return UwOK();
+}
+
 /****************************************************************
  * FileReader interface methods
  */
@@ -223,6 +328,23 @@ static UwResult file_read(UwValuePtr self, void* buffer, unsigned buffer_size, u
     }
 }
 
+static UwResult file_pread(UwValuePtr self, void* buffer, unsigned buffer_size, off_t position, unsigned* bytes_read)
+{
+    _UwFile* f = get_data_ptr(self);
+
+    ssize_t result;
+    do {
+        result = pread(f->fd, buffer, buffer_size, position);
+    } while (result < 0 && errno == EINTR);
+
+    if (result < 0) {
+        return UwErrno(errno);
+    } else {
+        *bytes_read = (unsigned) result;
+        return UwOK();
+    }
+}
+
 /****************************************************************
  * FileWriter interface methods
  */
@@ -244,6 +366,23 @@ static UwResult file_write(UwValuePtr self, void* data, unsigned size, unsigned*
     }
 }
 
+static UwResult file_pwrite(UwValuePtr self, void* data, unsigned size, off_t position, unsigned* bytes_written)
+{
+    _UwFile* f = get_data_ptr(self);
+
+    ssize_t result;
+    do {
+        result = pwrite(f->fd, data, size, position);
+    } while (result < 0 && errno == EINTR);
+
+    if (result < 0) {
+        return UwErrno(errno);
+    } else {
+        *bytes_written = (unsigned) result;
+        return UwOK();
+    }
+}
+
 /****************************************************************
  * LineReader interface methods
  */
@@ -253,6 +392,7 @@ static UwResult start_read_lines(UwValuePtr self)
     _UwFile* f = get_data_ptr(self);
 
     uw_destroy(&f->pushback);
+    uw_destroy(&f->partial_line);
 
     if (f->buffer == nullptr) {
         f->buffer = malloc(LINE_READER_BUFFER_SIZE);
@@ -266,8 +406,8 @@ static UwResult start_read_lines(UwValuePtr self)
     f->position = LINE_READER_BUFFER_SIZE;
     f->data_size = LINE_READER_BUFFER_SIZE;
 
-    // reset file position
-    if (lseek(f->fd, 0, SEEK_SET) == -1) {
+    // reset file position, pipes and sockets are not seekable
+    if (lseek(f->fd, 0, SEEK_SET) == -1 && errno != ESPIPE) {
         return UwErrno(errno);
     }
     f->line_number = 0;
@@ -286,6 +426,23 @@ static UwResult read_line(UwValuePtr self)
     return uw_move(&result);
 }
 
+static UwResult would_block(_UwFile* f, UwValuePtr line)
+/*
+ * Keep partial line for the next call of read_line_inplace
+ * and return UW_ERROR_WOULD_BLOCK.
+ *
+ * The line is moved, not copied, and the next call appends to it
+ * in place, so a line that arrives in many chunks is not copied
+ * on each retry. The caller gets an empty string.
+ */
+{
+    if (uw_strlen(line)) {
+        f->partial_line = uw_move(line);
+        *line = UwString();
+    }
+    return UwError(UW_ERROR_WOULD_BLOCK);
+}
+
 static UwResult read_line_inplace(UwValuePtr self, UwValuePtr line)
 {
     _UwFile* f = get_data_ptr(self);
@@ -308,22 +465,37 @@ static UwResult read_line_inplace(UwValuePtr self, UwValuePtr line)
         return UwOK();
     }
 
+    if (uw_is_string(&f->partial_line)) {
+        // continue the line interrupted by UW_ERROR_WOULD_BLOCK
+        uw_destroy(line);
+        *line = uw_move(&f->partial_line);
+    }
+
     do {
         if (f->position == f->data_size) {
 
-            if (f->data_size < LINE_READER_BUFFER_SIZE) {
+            // short read means end of regular file but not of pipe or socket
+            if (f->data_size < LINE_READER_BUFFER_SIZE && !f->nonblocking) {
                 // end of file
-                return UwError(UW_ERROR_EOF);
+                goto eof;
             }
             f->position = 0;
             {
                 UwValue status = file_read(self, f->buffer, LINE_READER_BUFFER_SIZE, &f->data_size);
                 if (uw_error(&status)) {
+                    // force reading next chunk on next call
+                    f->position = LINE_READER_BUFFER_SIZE;
+                    f->data_size = LINE_READER_BUFFER_SIZE;
+                    if (status.status_code == UW_ERROR_ERRNO
+                        && (status.uw_errno == EAGAIN || status.uw_errno == EWOULDBLOCK)) {
+                        return would_block(f, line);
+                    }
                     return uw_move(&status);
                 }
+                _uw_trace(line_reader_refill, f->fd, f->data_size, f->line_number);
                 if (f->data_size == 0) {
                     // XXX warn if f->partial_utf8_len != 0
-                    return UwError(UW_ERROR_EOF);
+                    goto eof;
                 }
             }
 
@@ -333,14 +505,14 @@ static UwResult read_line_inplace(UwValuePtr self, UwValuePtr line)
                 while (f->partial_utf8_len < 4) {
 
                     if (f->position == f->data_size) {
-                        // premature end of file
-                        // XXX warn?
-                        return UwError(UW_ERROR_EOF);
+                        // sequence continues in the next chunk
+                        break;
                     }
 
                     char8_t c = f->buffer[f->position];
                     if (c < 0x80 || ((c & 0xC0) != 0x80)) {
                         // malformed UTF-8 sequence
+                        f->partial_utf8_len = 0;
                         break;
                     }
                     f->position++;
@@ -350,15 +522,22 @@ static UwResult read_line_inplace(UwValuePtr self, UwValuePtr line)
                         return UwOOM();
                     }
                     if (bytes_processed) {
+                        f->partial_utf8_len = 0;
                         break;
                     }
                 }
-                f->partial_utf8_len = 0;
+                if (f->partial_utf8_len == 4) {
+                    // malformed UTF-8 sequence
+                    f->partial_utf8_len = 0;
+                }
+                if (f->position == f->data_size) {
+                    continue;
+                }
             }
         }
 
         char8_t* start = f->buffer + f->position;
-        char8_t* lf = (char8_t*) strchr((char*) start, '\n');
+        char8_t* lf = memchr(start, '\n', f->data_size - f->position);
         if (lf) {
             // found newline, don't care about partial UTF-8
             lf++;
@@ -388,6 +567,14 @@ static UwResult read_line_inplace(UwValuePtr self, UwValuePtr line)
             f->position = f->data_size;
         }
     } while(true);
+
+eof:
+    if (uw_strlen(line)) {
+        // last line without trailing newline
+        f->line_number++;
+        return UwOK();
+    }
+    return UwError(UW_ERROR_EOF);
 }
 
 static UwResult unread_line(UwValuePtr self, UwValuePtr line)
@@ -415,6 +602,7 @@ static UwResult stop_read_lines(UwValuePtr self)
     free(f->buffer);
     f->buffer = nullptr;
     uw_destroy(&f->pushback);
+    uw_destroy(&f->partial_line);
     return UwOK();
 }
 
@@ -429,15 +617,23 @@ static UwInterface_File file_interface = {
     ._close    = file_close,
     ._set_fd   = file_set_fd,
     ._get_name = file_get_name,
-    ._set_name = file_set_name
+    ._set_name = file_set_name,
+    ._seek     = file_seek,
+    ._tell     = file_tell,
+    ._size     = file_size,
+    ._fadvise  = file_fadvise,
+    ._get_fd   = file_get_fd,
+    ._set_nonblocking = file_set_nonblocking
 };
 
 static UwInterface_FileReader file_reader_interface = {
-    ._read = file_read
+    ._read  = file_read,
+    ._pread = file_pread
 };
 
 static UwInterface_FileWriter file_writer_interface = {
-    ._write = file_write
+    ._write  = file_write,
+    ._pwrite = file_pwrite
 };
 
 static UwInterface_LineReader line_reader_interface = {
@@ -524,3 +720,271 @@ UwResult _uw_file_open(UwValuePtr file_name, int flags, mode_t mode)
     }
     return uw_move(&file);
 }
+
+UwResult uw_file_read_all(UwValuePtr file)
+{
+    // get file size, if known
+    size_t capacity = LINE_READER_BUFFER_SIZE;
+    {
+        UwValue size = uw_file_size(file);
+        if (uw_is_unsigned(&size) && size.unsigned_value) {
+            if (size.unsigned_value >= UINT_MAX) {
+                return UwErrno(EFBIG);
+            }
+            // one byte more to hit end of file without reallocation
+            capacity = size.unsigned_value + 1;
+        }
+    }
+    char8_t* buffer = malloc(capacity);
+    if (!buffer) {
+        return UwOOM();
+    }
+    size_t data_size = 0;
+    for (;;) {
+        if (data_size == capacity) {
+            // file grew or its size is unknown
+            capacity *= 2;
+            if (capacity >= UINT_MAX) {
+                free(buffer);
+                return UwErrno(EFBIG);
+            }
+            char8_t* new_buffer = realloc(buffer, capacity);
+            if (!new_buffer) {
+                free(buffer);
+                return UwOOM();
+            }
+            buffer = new_buffer;
+        }
+        unsigned bytes_read;
+        UwValue status = uw_file_read(file, buffer + data_size, capacity - data_size, &bytes_read);
+        if (uw_error(&status)) {
+            free(buffer);
+            return uw_move(&status);
+        }
+        if (bytes_read == 0) {
+            break;
+        }
+        data_size += bytes_read;
+    }
+
+    UwValue result = UwString();
+    if (uw_ok(&result)) {
+        unsigned bytes_processed;
+        if (!uw_string_append_utf8(&result, buffer, data_size, &bytes_processed)) {
+            uw_destroy(&result);
+            result = UwOOM();
+        }
+    }
+    free(buffer);
+    return uw_move(&result);
+}
+
+UwResult uw_file_write_all(UwValuePtr file, void* data, size_t size)
+{
+    uint8_t* ptr = data;
+    while (size) {
+        unsigned chunk_size = (size < FILE_WRITE_CHUNK_SIZE)? size : FILE_WRITE_CHUNK_SIZE;
+        unsigned bytes_written;
+        UwValue status = uw_file_write(file, ptr, chunk_size, &bytes_written);
+        if (uw_error(&status)) {
+            return uw_move(&status);
+        }
+        if (bytes_written == 0) {
+            return UwError(UW_ERROR_SHORT_WRITE);
+        }
+        ptr  += bytes_written;
+        size -= bytes_written;
+    }
+    return UwOK();
+}
+
+UwResult uw_file_pwrite_all(UwValuePtr file, void* data, size_t size, off_t position)
+{
+    uint8_t* ptr = data;
+    while (size) {
+        unsigned chunk_size = (size < FILE_WRITE_CHUNK_SIZE)? size : FILE_WRITE_CHUNK_SIZE;
+        unsigned bytes_written;
+        UwValue status = uw_file_pwrite(file, ptr, chunk_size, position, &bytes_written);
+        if (uw_error(&status)) {
+            return uw_move(&status);
+        }
+        if (bytes_written == 0) {
+            return UwError(UW_ERROR_SHORT_WRITE);
+        }
+        ptr      += bytes_written;
+        size     -= bytes_written;
+        position += bytes_written;
+    }
+    return UwOK();
+}
+
+static inline bool kernel_copy_unsupported(int err)
+/*
+ * Check if copy_file_range or sendfile failed because
+ * they do not support given pair of file descriptors.
+ */
+{
+    return err == EXDEV || err == EINVAL || err == ENOSYS || err == EOPNOTSUPP || err == EBADF
+        || err == ESPIPE;  // sendfile with offset from pipe or socket
+}
+
+UwResult uw_file_copy(UwValuePtr dest, UwValuePtr src, off_t offset, off_t length)
+{
+    off_t remaining = length? length : INT64_MAX;
+    off_t total = 0;
+
+    if (uw_is_subtype(dest, UwTypeId_File) && uw_is_subtype(src, UwTypeId_File)) {
+
+        int fd_in  = get_data_ptr(src)->fd;
+        int fd_out = get_data_ptr(dest)->fd;
+        bool use_copy_file_range = true;
+
+        while (remaining) {
+            size_t chunk_size = (remaining < FILE_COPY_CHUNK_SIZE)? remaining : FILE_COPY_CHUNK_SIZE;
+            ssize_t n;
+            if (use_copy_file_range) {
+                n = copy_file_range(fd_in, &offset, fd_out, nullptr, chunk_size, 0);
+            } else {
+                n = sendfile(fd_out, fd_in, &offset, chunk_size);
+            }
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (!kernel_copy_unsupported(errno)) {
+                    return UwErrno(errno);
+                }
+                if (use_copy_file_range) {
+                    use_copy_file_range = false;
+                    continue;
+                }
+                // sendfile did not work either
+                break;
+            }
+            if (n == 0) {
+                // end of file
+                return UwUnsigned(total);
+            }
+            total += n;
+            remaining -= n;
+        }
+        if (remaining == 0) {
+            return UwUnsigned(total);
+        }
+    }
+
+    // copy data in userspace
+    uint8_t* buffer = malloc(FILE_COPY_BUFFER_SIZE);
+    if (!buffer) {
+        return UwOOM();
+    }
+    bool sequential = false;  // set for sources that are not seekable
+    while (remaining) {
+        unsigned chunk_size = (remaining < FILE_COPY_BUFFER_SIZE)? remaining : FILE_COPY_BUFFER_SIZE;
+        unsigned bytes_read;
+        UwValue status = UwNull();
+        if (sequential) {
+            status = uw_file_read(src, buffer, chunk_size, &bytes_read);
+        } else {
+            status = uw_file_pread(src, buffer, chunk_size, offset, &bytes_read);
+            if (uw_error(&status) && status.status_code == UW_ERROR_ERRNO && status.uw_errno == ESPIPE && total == 0 && offset == 0) {
+                // pipe or socket, read from current position
+                sequential = true;
+                continue;
+            }
+        }
+        if (uw_ok(&status) && bytes_read) {
+            uw_destroy(&status);
+            status = uw_file_write_all(dest, buffer, bytes_read);
+        }
+        if (uw_error(&status)) {
+            free(buffer);
+            return uw_move(&status);
+        }
+        if (bytes_read == 0) {
+            break;
+        }
+        offset    += bytes_read;
+        total     += bytes_read;
+        remaining -= bytes_read;
+    }
+    free(buffer);
+    return UwUnsigned(total);
+}
+
+static bool is_ascii(uint8_t* ptr, unsigned length)
+{
+    // check 8 bytes at a time
+    while (length >= sizeof(uint64_t)) {
+        uint64_t chunk;
+        memcpy(&chunk, ptr, sizeof(uint64_t));
+        if (chunk & 0x8080'8080'8080'8080ULL) {
+            return false;
+        }
+        ptr += sizeof(uint64_t);
+        length -= sizeof(uint64_t);
+    }
+    while (length--) {
+        if (*ptr++ >= 0x80) {
+            return false;
+        }
+    }
+    return true;
+}
+
+UwResult uw_file_write_string(UwValuePtr file, UwValuePtr str)
+{
+    uw_assert_string(str);
+
+    unsigned length = _uw_string_length(str);
+    if (length == 0) {
+        return UwOK();
+    }
+    uint8_t char_size = _uw_string_char_size(str);
+    uint8_t* ptr = _uw_string_char_ptr(str, 0);
+
+    if (char_size == 1 && is_ascii(ptr, length)) {
+        // zero copy
+        return uw_file_write_all(file, ptr, length);
+    }
+
+    // transcode in chunks; leave room for the longest UTF-8 sequence
+    StrMethods* strmeth = get_str_methods(str);
+    char buffer[WRITE_STRING_CHUNK_SIZE];
+    char* buffer_end = buffer + WRITE_STRING_CHUNK_SIZE - 4;
+
+    while (length) {
+        char* out = buffer;
+        while (length && out <= buffer_end) {
+            out = uw_char32_to_utf8(strmeth->get_char(ptr), out);
+            ptr += char_size;
+            length--;
+        }
+        UwValue status = uw_file_write_all(file, buffer, out - buffer);
+        if (uw_error(&status)) {
+            return uw_move(&status);
+        }
+    }
+    return UwOK();
+}
+
+UwResult uw_file_write_strings(UwValuePtr file, UwValuePtr list)
+{
+    uw_assert_list(list);
+
+    unsigned num_items = uw_list_length(list);
+    for (unsigned i = 0; i < num_items; i++) {
+        UwValue item = uw_list_item(list, i);
+        if (!uw_is_string(&item)) {
+            UwValue error = UwError(UW_ERROR_INCOMPATIBLE_TYPE);
+            _uw_set_status_desc(&error, "Bad item %u type for uw_file_write_strings: %u, %s",
+                                i, item.type_id, uw_get_type_name(item.type_id));
+            return uw_move(&error);
+        }
+        UwValue status = uw_file_write_string(file, &item);
+        if (uw_error(&status)) {
+            return uw_move(&status);
+        }
+    }
+    return UwOK();
+}
@@ -0,0 +1,275 @@
+#include <stdlib.h>
+
+#include "include/uw.h"
+#include "src/uw_list_internal.h"
+#include "src/uw_map_internal.h"
+
+static inline _UwList* get_items(UwValuePtr value)
+/*
+ * Return list of items for list or list of key-value pairs for map.
+ */
+{
+    if (uw_is_map(value)) {
+        return &((_UwMap*) _uw_get_data_ptr(value, UwTypeId_Map))->kv_pairs;
+    } else {
+        return _uw_get_data_ptr(value, UwTypeId_List);
+    }
+}
+
+/****************************************************************
+ * Check pass, nothing is modified until the whole value is known to be freezable
+ * except refcounts of visited values, which are restored on failure.
+ */
+
+// temporary refcount that marks visited values,
+// so shared and cyclic references are walked only once
+#define REFCOUNT_VISITED  (_UW_REFCOUNT_FROZEN - 1)
+
+typedef struct {
+    _UwValue value;     // shallow copy
+    unsigned refcount;  // refcount before the value was visited
+} Visited;
+
+typedef struct {
+    Visited* items;
+    unsigned length;
+    unsigned capacity;
+    bool out_of_memory;
+} VisitedList;
+
+static bool mark_visited(UwValuePtr value, VisitedList* visited)
+{
+    if (visited->length == visited->capacity) {
+        unsigned new_capacity = visited->capacity? visited->capacity * 2 : 64;
+        if (new_capacity <= visited->capacity || new_capacity > UINT_MAX / sizeof(Visited)) {
+            visited->out_of_memory = true;
+            return false;
+        }
+        Visited* items = realloc(visited->items, new_capacity * sizeof(Visited));
+        if (!items) {
+            visited->out_of_memory = true;
+            return false;
+        }
+        visited->items = items;
+        visited->capacity = new_capacity;
+    }
+    visited->items[visited->length++] = (Visited) {
+        .value = *value,
+        .refcount = value->extra_data->refcount
+    };
+    value->extra_data->refcount = REFCOUNT_VISITED;
+    return true;
+}
+
+static void unmark_visited(VisitedList* visited)
+{
+    for (unsigned i = 0; i < visited->length; i++) {
+        Visited* v = &visited->items[i];
+        v->value.extra_data->refcount = v->refcount;
+    }
+}
+
+static bool can_freeze(UwValuePtr value, VisitedList* visited)
+/*
+ * Add values to freeze to `visited`, each value once.
+ */
+{
+    if (uw_is_string(value)) {
+        // strings of frozen map images are frozen already and read-only
+        if (value->str_embedded || uw_is_frozen(value) || value->extra_data->refcount == REFCOUNT_VISITED) {
+            return true;
+        }
+        return mark_visited(value, visited);
+    }
+    if (uw_is_list(value) || uw_is_map(value)) {
+        if (uw_is_frozen(value) || value->extra_data->refcount == REFCOUNT_VISITED) {
+            return true;
+        }
+        if (!mark_visited(value, visited)) {
+            return false;
+        }
+        _UwList* list = get_items(value);
+        UwValuePtr item_ptr = list->items;
+        for (unsigned n = list->length; n; n--, item_ptr++) {
+            if (!can_freeze(item_ptr, visited)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    // other types are okay only if they have no extra data
+    UwType* t = _uw_types[value->type_id];
+    return t->allocator == nullptr || value->extra_data == nullptr;
+}
+
+/****************************************************************
+ * Freeze pass
+ */
+
+static void freeze(VisitedList* visited)
+{
+    for (unsigned i = 0; i < visited->length; i++) {
+        UwValuePtr value = &visited->items[i].value;
+        value->extra_data->refcount = _UW_REFCOUNT_FROZEN;
+        if (uw_is_string(value)) {
+            continue;
+        }
+        // frozen values are never destroyed, so they do not need the list of parents
+        _UwCompoundData* cdata = (_UwCompoundData*) value->extra_data;
+        _uw_fini_compound_data(cdata);
+        cdata->parents[0] = nullptr;
+        cdata->parents[1] = nullptr;
+        cdata->parents_refcount[0] = 0;
+        cdata->parents_refcount[1] = 0;
+    }
+}
+
+bool uw_freeze(UwValuePtr value)
+{
+    VisitedList visited = {};
+    bool result = can_freeze(value, &visited);
+    if (result) {
+        freeze(&visited);
+    } else {
+        unmark_visited(&visited);
+    }
+    free(visited.items);
+    return result;
+}
+
+/****************************************************************
+ * FreezeArena type
+ */
+
+typedef struct {
+    _UwValue* values;  // shallow copies of values frozen into the arena
+    unsigned length;
+    unsigned capacity;
+} _UwFreezeArena;
+
+#define get_arena_ptr(value)  ((_UwFreezeArena*) _uw_get_data_ptr((value), UwTypeId_FreezeArena))
+
+static void arena_fini(UwValuePtr self)
+{
+    _UwFreezeArena* arena = get_arena_ptr(self);
+
+    for (unsigned i = 0; i < arena->length; i++) {
+        UwValuePtr value = &arena->values[i];
+        if (!uw_is_string(value)) {
+            // items are either in the arena too or not owned by it,
+            // drop them without destroying
+            get_items(value)->length = 0;
+        }
+        value->extra_data->refcount = 1;
+        uw_destroy(value);
+    }
+    free(arena->values);
+    arena->values = nullptr;
+    arena->length = 0;
+    arena->capacity = 0;
+}
+
+static void arena_hash(UwValuePtr self, UwHashContext* ctx)
+{
+    _uw_hash_uint64(ctx, self->type_id);
+    _uw_hash_uint64(ctx, (uint64_t) self->extra_data);
+}
+
+static UwResult arena_deepcopy(UwValuePtr self)
+{
+    return UwError(UW_ERROR_NOT_IMPLEMENTED);
+}
+
+static void arena_dump(UwValuePtr self, FILE* fp, int first_indent, int next_indent, _UwCompoundChain* tail)
+{
+    _uw_dump_start(fp, self, first_indent);
+    _uw_dump_base_extra_data(fp, self->extra_data);
+    fprintf(fp, " frozen values: %u\n", get_arena_ptr(self)->length);
+}
+
+static UwResult arena_to_string(UwValuePtr self)
+{
+    return UwError(UW_ERROR_NOT_IMPLEMENTED);
+}
+
+static bool arena_is_true(UwValuePtr self)
+{
+    return get_arena_ptr(self)->length;
+}
+
+static bool arena_equal_sametype(UwValuePtr self, UwValuePtr other)
+{
+    return self->extra_data == other->extra_data;
+}
+
+static bool arena_equal(UwValuePtr self, UwValuePtr other)
+{
+    return uw_is_subtype(other, UwTypeId_FreezeArena) && arena_equal_sametype(self, other);
+}
+
+UwTypeId UwTypeId_FreezeArena = 0;
+
+static UwType arena_type = {
+    .id              = 0,
+    .ancestor_id     = UwTypeId_Null,  // no ancestor
+    .name            = "FreezeArena",
+    .allocator       = &default_allocator,
+    .data_offset     = sizeof(_UwExtraData),
+    .data_size       = sizeof(_UwFreezeArena),
+    .compound        = false,
+    ._create         = _uw_default_create,
+    ._destroy        = _uw_default_destroy,
+    ._init           = nullptr,
+    ._fini           = arena_fini,
+    ._clone          = _uw_default_clone,
+    ._hash           = arena_hash,
+    ._deepcopy       = arena_deepcopy,
+    ._dump           = arena_dump,
+    ._to_string      = arena_to_string,
+    ._is_true        = arena_is_true,
+    ._equal_sametype = arena_equal_sametype,
+    ._equal          = arena_equal
+};
+
+[[ gnu::constructor ]]
+static void init_arena_type()
+{
+    UwTypeId_FreezeArena = uw_add_type(&arena_type);
+}
+
+UwResult uw_freeze_into(UwValuePtr arena, UwValuePtr value)
+{
+    _UwFreezeArena* __arena = get_arena_ptr(arena);
+
+    VisitedList visited = {};
+    if (!can_freeze(value, &visited)) {
+        unmark_visited(&visited);
+        free(visited.items);
+        if (visited.out_of_memory) {
+            return UwOOM();
+        }
+        UwValue error = UwError(UW_ERROR_INCOMPATIBLE_TYPE);
+        _uw_set_status_desc(&error, "Value contains data that cannot be frozen");
+        return uw_move(&error);
+    }
+    if (visited.length > __arena->capacity - __arena->length) {
+        unsigned new_capacity = __arena->length + visited.length;
+        _UwValue* values = nullptr;
+        if (new_capacity > __arena->length && new_capacity <= UINT_MAX / sizeof(_UwValue)) {
+            values = realloc(__arena->values, new_capacity * sizeof(_UwValue));
+        }
+        if (!values) {
+            unmark_visited(&visited);
+            free(visited.items);
+            return UwOOM();
+        }
+        __arena->values = values;
+        __arena->capacity = new_capacity;
+    }
+    freeze(&visited);
+    for (unsigned i = 0; i < visited.length; i++) {
+        __arena->values[__arena->length++] = visited.items[i].value;
+    }
+    free(visited.items);
+    return UwOK();
+}
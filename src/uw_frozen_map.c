@@ -0,0 +1,376 @@
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/mman.h>
+
+#include "include/uw_frozen_map.h"
+#include "src/uw_map_internal.h"
+#include "src/uw_serialize_internal.h"
+#include "src/uw_string_internal.h"
+
+typedef struct {
+    char magic[3];
+    uint8_t version;
+    uint32_t reserved;
+    uint64_t length;
+    uint64_t capacity;  // power of two
+} FrozenMapHeader;
+
+typedef struct {
+    uint64_t hash;
+    uint64_t offset;  // zero if entry is free
+} FrozenMapEntry;
+
+typedef struct {
+    uint8_t* data;  // mapped image
+    uint64_t size;
+    uint64_t length;
+    uint64_t capacity;
+    FrozenMapEntry* hash_table;
+} _UwFrozenMap;
+
+#define get_data_ptr(value)  ((_UwFrozenMap*) _uw_get_data_ptr((value), UwTypeId_FrozenMap))
+
+#define FROZEN_MAP_MIN_CAPACITY   8
+
+// tag of string record, does not clash with tags of serialized values
+#define FROZEN_MAP_STRING         0xFE
+#define FROZEN_MAP_STRING_ALIGN   8
+
+// size of string record without characters
+#define FROZEN_MAP_STRING_HEADER  offsetof(struct _UwStringExtraData, str.capU.data)
+
+static inline uint64_t align_string(uint64_t offset)
+{
+    return (offset + FROZEN_MAP_STRING_ALIGN - 1) & ~(uint64_t) (FROZEN_MAP_STRING_ALIGN - 1);
+}
+
+uint16_t UW_ERROR_BAD_FROZEN_MAP = 0;
+
+static UwResult bad_image(char* message)
+{
+    UwValue error = UwError(UW_ERROR_BAD_FROZEN_MAP);
+    _uw_set_status_desc(&error, "%s", message);
+    return uw_move(&error);
+}
+
+/****************************************************************
+ * Basic interface methods
+ */
+
+static UwResult frozen_map_init(UwValuePtr self, va_list ap)
+{
+    UwValuePtr file = va_arg(ap, UwValuePtr);
+
+    UwValue fd_value = uw_file_get_fd(file);
+    if (uw_error(&fd_value)) {
+        return uw_move(&fd_value);
+    }
+    UwValue size_value = uw_file_size(file);
+    if (uw_error(&size_value)) {
+        return uw_move(&size_value);
+    }
+    uint64_t size = size_value.unsigned_value;
+    if (size < sizeof(FrozenMapHeader)) {
+        return bad_image("Image is too short");
+    }
+    uint8_t* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, (int) fd_value.signed_value, 0);
+    if (data == MAP_FAILED) {
+        return UwErrno(errno);
+    }
+    FrozenMapHeader* header = (FrozenMapHeader*) data;
+    char* error = nullptr;
+    if (memcmp(header->magic, "UWF", 3) != 0 || header->version != UW_FROZEN_MAP_VERSION) {
+        error = "Bad header";
+    } else if (header->capacity == 0 || (header->capacity & (header->capacity - 1))
+               || header->capacity > (size - sizeof(FrozenMapHeader)) / sizeof(FrozenMapEntry)
+               || header->length > header->capacity) {
+        error = "Bad hash table size";
+    }
+    if (error) {
+        munmap(data, size);
+        return bad_image(error);
+    }
+    _UwFrozenMap* fmap = get_data_ptr(self);
+    fmap->data       = data;
+    fmap->size       = size;
+    fmap->length     = header->length;
+    fmap->capacity   = header->capacity;
+    fmap->hash_table = (FrozenMapEntry*) (data + sizeof(FrozenMapHeader));
+    return UwOK();
+}
+
+static void frozen_map_fini(UwValuePtr self)
+{
+    _UwFrozenMap* fmap = get_data_ptr(self);
+    if (fmap->data) {
+        munmap(fmap->data, fmap->size);
+        fmap->data = nullptr;
+    }
+}
+
+static void frozen_map_hash(UwValuePtr self, UwHashContext* ctx)
+{
+    _UwFrozenMap* fmap = get_data_ptr(self);
+
+    _uw_hash_uint64(ctx, self->type_id);
+    _uw_hash_uint64(ctx, (uint64_t) fmap->data);
+}
+
+static UwResult frozen_map_deepcopy(UwValuePtr self)
+{
+    return UwError(UW_ERROR_NOT_IMPLEMENTED);
+}
+
+static void frozen_map_dump(UwValuePtr self, FILE* fp, int first_indent, int next_indent, _UwCompoundChain* tail)
+{
+    _UwFrozenMap* fmap = get_data_ptr(self);
+
+    _uw_dump_start(fp, self, first_indent);
+    _uw_dump_base_extra_data(fp, self->extra_data);
+    fprintf(fp, " image %p, size: %llu, items: %llu, hash table capacity: %llu\n",
+            fmap->data, (unsigned long long) fmap->size,
+            (unsigned long long) fmap->length, (unsigned long long) fmap->capacity);
+}
+
+static UwResult frozen_map_to_string(UwValuePtr self)
+{
+    return UwError(UW_ERROR_NOT_IMPLEMENTED);
+}
+
+static bool frozen_map_is_true(UwValuePtr self)
+{
+    return get_data_ptr(self)->length;
+}
+
+static bool frozen_map_equal_sametype(UwValuePtr self, UwValuePtr other)
+{
+    return get_data_ptr(self)->data == get_data_ptr(other)->data;
+}
+
+static bool frozen_map_equal(UwValuePtr self, UwValuePtr other)
+{
+    return uw_is_subtype(other, UwTypeId_FrozenMap) && frozen_map_equal_sametype(self, other);
+}
+
+/****************************************************************
+ * FrozenMap type
+ */
+
+UwTypeId UwTypeId_FrozenMap = 0;
+
+static UwType frozen_map_type = {
+    .id              = 0,
+    .ancestor_id     = UwTypeId_Null,  // no ancestor
+    .name            = "FrozenMap",
+    .allocator       = &default_allocator,
+    .data_offset     = sizeof(_UwExtraData),
+    .data_size       = sizeof(_UwFrozenMap),
+    .compound        = false,
+    ._create         = _uw_default_create,
+    ._destroy        = _uw_default_destroy,
+    ._init           = frozen_map_init,
+    ._fini           = frozen_map_fini,
+    ._clone          = _uw_default_clone,
+    ._hash           = frozen_map_hash,
+    ._deepcopy       = frozen_map_deepcopy,
+    ._dump           = frozen_map_dump,
+    ._to_string      = frozen_map_to_string,
+    ._is_true        = frozen_map_is_true,
+    ._equal_sametype = frozen_map_equal_sametype,
+    ._equal          = frozen_map_equal
+};
+
+[[ gnu::constructor ]]
+static void init_frozen_map_type()
+{
+    UW_ERROR_BAD_FROZEN_MAP = uw_define_status("BAD_FROZEN_MAP");
+
+    UwTypeId_FrozenMap = uw_add_type(&frozen_map_type);
+}
+
+/****************************************************************
+ * FrozenMap functions
+ */
+
+static UwResult write_string(UwValuePtr str, UwValuePtr file, uint64_t* offset)
+/*
+ * Write tag, padding, and string in the layout of its extra data,
+ * with frozen refcount and capacity equal to length.
+ */
+{
+    uint8_t char_size = _uw_string_char_size(str);
+    unsigned length = _uw_string_length(str);
+
+    uint64_t start = align_string(*offset + 1);
+    unsigned prefix_size = (unsigned) (start - *offset);
+
+    struct _UwStringExtraData header;
+    memset(&header, 0, sizeof(header));
+    header.value_data.refcount = _UW_REFCOUNT_FROZEN;
+    header.str.char_size = char_size - 1;  // char_size is stored as 0-based
+    header.str.cap_size = sizeof(unsigned);
+    header.str.capU.capacity = length;
+    header.str.capU.length = length;
+
+    uint8_t buffer[FROZEN_MAP_STRING_ALIGN + FROZEN_MAP_STRING_HEADER] = { FROZEN_MAP_STRING };
+    memcpy(buffer + prefix_size, &header, FROZEN_MAP_STRING_HEADER);
+
+    UwValue status = uw_file_write_all(file, buffer, prefix_size + FROZEN_MAP_STRING_HEADER);
+    if (uw_error(&status)) {
+        return uw_move(&status);
+    }
+    uint64_t data_size = (uint64_t) length * char_size;
+    uw_destroy(&status);
+    status = uw_file_write_all(file, _uw_string_char_ptr(str, 0), data_size);
+    if (uw_error(&status)) {
+        return uw_move(&status);
+    }
+    *offset = start + FROZEN_MAP_STRING_HEADER + data_size;
+    return UwOK();
+}
+
+static UwResult write_item(UwValuePtr value, UwValuePtr file, uint64_t* offset)
+{
+    if (uw_is_string(value)) {
+        return write_string(value, file, offset);
+    } else {
+        return _uw_serialize_value(value, file, offset);
+    }
+}
+
+UwResult uw_freeze_map(UwValuePtr map, UwValuePtr file)
+{
+    uw_assert_map(map);
+
+    _UwMap* __map = _uw_get_data_ptr(map, UwTypeId_Map);
+    unsigned num_items = _uw_list_length(&__map->kv_pairs);
+
+    // keep load factor below 1/2
+    uint64_t capacity = FROZEN_MAP_MIN_CAPACITY;
+    while (capacity < num_items) {
+        capacity <<= 1;
+    }
+    FrozenMapEntry* hash_table = calloc(capacity, sizeof(FrozenMapEntry));
+    if (!hash_table) {
+        return UwOOM();
+    }
+    uint64_t table_size = capacity * sizeof(FrozenMapEntry);
+    uint64_t offset = sizeof(FrozenMapHeader) + table_size;
+
+    // write items after the hash table
+    UwValue status = uw_file_seek(file, (off_t) offset, SEEK_SET);
+    if (uw_error(&status)) {
+        goto out;
+    }
+    for (unsigned i = 0; i < num_items; i += 2) {
+        UwValuePtr key = _uw_list_item(&__map->kv_pairs, i);
+        UwType_Hash hash = uw_hash(key);
+        uint64_t slot = hash & (capacity - 1);
+        while (hash_table[slot].offset) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        hash_table[slot].hash = hash;
+        hash_table[slot].offset = offset;
+
+        uw_destroy(&status);
+        status = write_item(key, file, &offset);
+        if (uw_error(&status)) {
+            goto out;
+        }
+        uw_destroy(&status);
+        status = write_item(_uw_list_item(&__map->kv_pairs, i + 1), file, &offset);
+        if (uw_error(&status)) {
+            goto out;
+        }
+    }
+    // write header and hash table
+    FrozenMapHeader header = {
+        .magic    = { 'U', 'W', 'F' },
+        .version  = UW_FROZEN_MAP_VERSION,
+        .length   = num_items / 2,
+        .capacity = capacity
+    };
+    uw_destroy(&status);
+    status = uw_file_pwrite_all(file, &header, sizeof(header), 0);
+    if (uw_error(&status)) {
+        goto out;
+    }
+    uw_destroy(&status);
+    status = uw_file_pwrite_all(file, hash_table, table_size, sizeof(header));
+
+out:
+    free(hash_table);
+    return uw_move(&status);
+}
+
+static UwResult read_item(_UwFrozenMap* fmap, uint64_t* offset)
+/*
+ * Read key or value at `offset` and advance it.
+ * Strings are not copied, the result refers to the image.
+ */
+{
+    if (*offset >= fmap->size) {
+        return bad_image("Item offset is out of range");
+    }
+    if (fmap->data[*offset] != FROZEN_MAP_STRING) {
+        uint64_t remaining = fmap->size - *offset;
+        unsigned size = (remaining > UINT_MAX)? UINT_MAX : (unsigned) remaining;
+        unsigned position = 0;
+        UwValue result = _uw_deserialize_value(fmap->data + *offset, size, &position);
+        *offset += position;
+        return uw_move(&result);
+    }
+    uint64_t start = align_string(*offset + 1);
+    if (start > fmap->size || fmap->size - start < FROZEN_MAP_STRING_HEADER) {
+        return bad_image("String is out of range");
+    }
+    struct _UwStringExtraData* header = (struct _UwStringExtraData*) (fmap->data + start);
+    unsigned length = header->str.capU.length;
+    uint64_t data_size = (uint64_t) length * (header->str.char_size + 1);
+    if (header->value_data.refcount != _UW_REFCOUNT_FROZEN || header->str.embedded
+        || header->str.cap_size != sizeof(unsigned) || header->str.capU.capacity != length
+        || data_size > fmap->size - start - FROZEN_MAP_STRING_HEADER) {
+        return bad_image("Bad string");
+    }
+    *offset = start + FROZEN_MAP_STRING_HEADER + data_size;
+
+    UwValue result = UwString();
+    result.str_embedded = 0;
+    result.extra_data = &header->value_data;
+    return uw_move(&result);
+}
+
+UwResult uw_frozen_map_get(UwValuePtr self, UwValuePtr key)
+{
+    _UwFrozenMap* fmap = get_data_ptr(self);
+
+    UwType_Hash hash = uw_hash(key);
+    uint64_t mask = fmap->capacity - 1;
+    uint64_t slot = hash & mask;
+    for (uint64_t n = fmap->capacity; n; n--, slot = (slot + 1) & mask) {
+        FrozenMapEntry* entry = &fmap->hash_table[slot];
+        if (entry->offset == 0) {
+            break;
+        }
+        if (entry->hash != hash) {
+            continue;
+        }
+        uint64_t offset = entry->offset;
+        UwValue k = read_item(fmap, &offset);
+        if (uw_error(&k)) {
+            return uw_move(&k);
+        }
+        if (uw_equal(&k, key)) {
+            return read_item(fmap, &offset);
+        }
+    }
+    return UwError(UW_ERROR_KEY_NOT_FOUND);
+}
+
+uint64_t uw_frozen_map_length(UwValuePtr self)
+{
+    return get_data_ptr(self)->length;
+}
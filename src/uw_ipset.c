@@ -0,0 +1,535 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/uw_ipset.h"
+#include "src/uw_cpu_internal.h"
+#include "src/uw_netutils_internal.h"
+#include "src/uw_string_internal.h"
+
+typedef struct {
+    uint32_t* starts;  // range starts and ends are kept in separate arrays
+    uint32_t* ends;    // to make search over starts cache-friendly
+    unsigned length;
+    unsigned capacity;
+} _UwIPSet;
+
+typedef struct {
+    uint32_t start;
+    uint32_t end;
+} IPRange;
+
+#define get_data_ptr(value)  ((_UwIPSet*) _uw_get_data_ptr((value), UwTypeId_IPSet))
+
+// search window that is scanned linearly
+#define IPSET_SCAN_WINDOW  16
+
+/****************************************************************
+ * Basic interface methods
+ */
+
+static void ipset_fini(UwValuePtr self)
+{
+    _UwIPSet* ipset = get_data_ptr(self);
+    free(ipset->starts);
+    free(ipset->ends);
+    ipset->starts = nullptr;
+    ipset->ends = nullptr;
+    ipset->length = 0;
+    ipset->capacity = 0;
+}
+
+static void ipset_hash(UwValuePtr self, UwHashContext* ctx)
+{
+    _UwIPSet* ipset = get_data_ptr(self);
+
+    _uw_hash_uint64(ctx, self->type_id);
+    _uw_hash_uint64(ctx, ipset->length);
+    if (ipset->length) {
+        _uw_hash_buffer(ctx, ipset->starts, ipset->length * sizeof(uint32_t));
+        _uw_hash_buffer(ctx, ipset->ends, ipset->length * sizeof(uint32_t));
+    }
+}
+
+static bool reserve(_UwIPSet* ipset, unsigned capacity)
+{
+    if (capacity <= ipset->capacity) {
+        return true;
+    }
+    unsigned new_capacity = ipset->capacity? ipset->capacity : 16;
+    while (new_capacity < capacity) {
+        if (new_capacity > UINT_MAX / 2) {
+            new_capacity = capacity;
+            break;
+        }
+        new_capacity *= 2;
+    }
+    uint32_t* starts = realloc(ipset->starts, new_capacity * sizeof(uint32_t));
+    if (!starts) {
+        return false;
+    }
+    ipset->starts = starts;
+    uint32_t* ends = realloc(ipset->ends, new_capacity * sizeof(uint32_t));
+    if (!ends) {
+        return false;
+    }
+    ipset->ends = ends;
+    ipset->capacity = new_capacity;
+    return true;
+}
+
+static UwResult ipset_deepcopy(UwValuePtr self)
+{
+    _UwIPSet* ipset = get_data_ptr(self);
+
+    UwValue result = uw_create_ipset();
+    if (uw_error(&result)) {
+        return uw_move(&result);
+    }
+    _UwIPSet* result_ipset = get_data_ptr(&result);
+    if (!reserve(result_ipset, ipset->length)) {
+        return UwOOM();
+    }
+    if (ipset->length) {
+        memcpy(result_ipset->starts, ipset->starts, ipset->length * sizeof(uint32_t));
+        memcpy(result_ipset->ends, ipset->ends, ipset->length * sizeof(uint32_t));
+    }
+    result_ipset->length = ipset->length;
+    return uw_move(&result);
+}
+
+static void ipset_dump(UwValuePtr self, FILE* fp, int first_indent, int next_indent, _UwCompoundChain* tail)
+{
+    _UwIPSet* ipset = get_data_ptr(self);
+
+    _uw_dump_start(fp, self, first_indent);
+    _uw_dump_base_extra_data(fp, self->extra_data);
+    fprintf(fp, " %u ranges\n", ipset->length);
+    for (unsigned i = 0; i < ipset->length; i++) {
+        uint32_t start = ipset->starts[i];
+        uint32_t end = ipset->ends[i];
+        _uw_print_indent(fp, next_indent + 4);
+        fprintf(fp, "%u.%u.%u.%u-%u.%u.%u.%u\n",
+                start >> 24, (start >> 16) & 255, (start >> 8) & 255, start & 255,
+                end >> 24, (end >> 16) & 255, (end >> 8) & 255, end & 255);
+    }
+}
+
+static UwResult ipset_to_string(UwValuePtr self)
+{
+    return UwError(UW_ERROR_NOT_IMPLEMENTED);
+}
+
+static bool ipset_is_true(UwValuePtr self)
+{
+    return get_data_ptr(self)->length;
+}
+
+static bool ipset_equal_sametype(UwValuePtr self, UwValuePtr other)
+{
+    _UwIPSet* a = get_data_ptr(self);
+    _UwIPSet* b = get_data_ptr(other);
+
+    if (a->length != b->length) {
+        return false;
+    }
+    if (a->length == 0) {
+        return true;
+    }
+    return memcmp(a->starts, b->starts, a->length * sizeof(uint32_t)) == 0
+        && memcmp(a->ends, b->ends, a->length * sizeof(uint32_t)) == 0;
+}
+
+static bool ipset_equal(UwValuePtr self, UwValuePtr other)
+{
+    return uw_is_subtype(other, UwTypeId_IPSet) && ipset_equal_sametype(self, other);
+}
+
+/****************************************************************
+ * IPSet type
+ */
+
+UwTypeId UwTypeId_IPSet = 0;
+
+static UwType ipset_type = {
+    .id              = 0,
+    .ancestor_id     = UwTypeId_Null,  // no ancestor
+    .name            = "IPSet",
+    .allocator       = &default_allocator,
+    .data_offset     = sizeof(_UwExtraData),
+    .data_size       = sizeof(_UwIPSet),
+    .compound        = false,
+    ._create         = _uw_default_create,
+    ._destroy        = _uw_default_destroy,
+    ._init           = nullptr,
+    ._fini           = ipset_fini,
+    ._clone          = _uw_default_clone,
+    ._hash           = ipset_hash,
+    ._deepcopy       = ipset_deepcopy,
+    ._dump           = ipset_dump,
+    ._to_string      = ipset_to_string,
+    ._is_true        = ipset_is_true,
+    ._equal_sametype = ipset_equal_sametype,
+    ._equal          = ipset_equal
+};
+
+[[ gnu::constructor ]]
+static void init_ipset_type()
+{
+    UwTypeId_IPSet = uw_add_type(&ipset_type);
+}
+
+/****************************************************************
+ * Helper functions
+ */
+
+static bool append_range(_UwIPSet* ipset, uint32_t start, uint32_t end)
+/*
+ * Append range to the set, merging it with the last one if they overlap or adjoin.
+ * Ranges must be appended in order of their starts.
+ */
+{
+    if (ipset->length) {
+        unsigned last = ipset->length - 1;
+        if (ipset->ends[last] == UINT32_MAX || start <= ipset->ends[last] + 1) {
+            if (end > ipset->ends[last]) {
+                ipset->ends[last] = end;
+            }
+            return true;
+        }
+    }
+    if (!reserve(ipset, ipset->length + 1)) {
+        return false;
+    }
+    ipset->starts[ipset->length] = start;
+    ipset->ends[ipset->length] = end;
+    ipset->length++;
+    return true;
+}
+
+static inline unsigned count_starts_le(_UwIPSet* ipset, uint32_t addr)
+/*
+ * Return the number of ranges that start at or before `addr`.
+ */
+{
+    unsigned n = ipset->length;
+    if (n == 0) {
+        // starts may be null, don't do arithmetic on it
+        return 0;
+    }
+    uint32_t* starts = ipset->starts;
+    unsigned base = 0;
+
+    // branchless binary search, invariant: all starts before `base` are <= addr
+    // and all starts from `base + n` are > addr
+    while (n > IPSET_SCAN_WINDOW) {
+        unsigned half = n / 2;
+        base = (starts[base + half] <= addr)? base + half : base;
+        n -= half;
+    }
+    // scan the rest with SIMD kernel
+    return base + _uw_kernels.count_le_u32(starts + base, n, addr);
+}
+
+static int compare_ranges(const void* a, const void* b)
+{
+    uint32_t start_a = ((IPRange*) a)->start;
+    uint32_t start_b = ((IPRange*) b)->start;
+    return (start_a > start_b) - (start_a < start_b);
+}
+
+static UwResult bad_item(UwValuePtr item)
+{
+    UwValue error = UwError(UW_ERROR_BAD_IP_ADDRESS);
+    if (uw_is_string(item)) {
+        UW_CSTRING_LOCAL(c_item, item);
+        _uw_set_status_desc(&error, "Bad IPv4 address or range %s", c_item);
+    }
+    return uw_move(&error);
+}
+
+static UwResult parse_range(UwValuePtr item, IPRange* range)
+{
+    if (uw_is_unsigned(item)) {
+        IPv4subnet subnet = { .value = item->unsigned_value };
+        uint32_t hostmask = ~subnet.netmask;
+        if (hostmask & (hostmask + 1)) {
+            return UwError(UW_ERROR_BAD_NETMASK);
+        }
+        range->start = subnet.subnet & subnet.netmask;
+        range->end = range->start | hostmask;
+        return UwOK();
+    }
+    if (!uw_is_string(item)) {
+        return UwError(UW_ERROR_INCOMPATIBLE_TYPE);
+    }
+    unsigned length = _uw_string_length(item);
+    unsigned separator;
+    if (uw_strchr(item, '/', 0, &separator)) {
+        uint32_t netmask;
+        if (!_uw_parse_ipv4(item, 0, separator, &range->start)
+            || !_uw_parse_cidr_prefix(item, separator + 1, length, &netmask)) {
+            return bad_item(item);
+        }
+        range->start &= netmask;
+        range->end = range->start | ~netmask;
+    } else if (uw_strchr(item, '-', 0, &separator)) {
+        if (!_uw_parse_ipv4(item, 0, separator, &range->start)
+            || !_uw_parse_ipv4(item, separator + 1, length, &range->end)
+            || range->start > range->end) {
+            return bad_item(item);
+        }
+    } else {
+        if (!_uw_parse_ipv4(item, 0, length, &range->start)) {
+            return bad_item(item);
+        }
+        range->end = range->start;
+    }
+    return UwOK();
+}
+
+/****************************************************************
+ * IPSet functions
+ */
+
+UwResult uw_ipset_add_range(UwValuePtr self, uint32_t start, uint32_t end)
+{
+    uw_assert_ipset(self);
+
+    _UwIPSet* ipset = get_data_ptr(self);
+
+    if (start > end) {
+        return UwError(UW_ERROR_BAD_IP_ADDRESS);
+    }
+    // ranges [lo, hi) overlap or adjoin the new one
+    unsigned lo = (start == 0)? 0 : count_starts_le(ipset, start - 1);
+    if (lo && ipset->ends[lo - 1] >= start - 1) {
+        lo--;
+    }
+    unsigned hi = (end == UINT32_MAX)? ipset->length : count_starts_le(ipset, end + 1);
+
+    if (lo < hi) {
+        // merge ranges into the first one
+        if (ipset->starts[lo] > start) {
+            ipset->starts[lo] = start;
+        }
+        ipset->ends[lo] = (ipset->ends[hi - 1] > end)? ipset->ends[hi - 1] : end;
+        unsigned tail = ipset->length - hi;
+        memmove(&ipset->starts[lo + 1], &ipset->starts[hi], tail * sizeof(uint32_t));
+        memmove(&ipset->ends[lo + 1], &ipset->ends[hi], tail * sizeof(uint32_t));
+        ipset->length -= hi - lo - 1;
+    } else {
+        // insert new range
+        if (!reserve(ipset, ipset->length + 1)) {
+            return UwOOM();
+        }
+        unsigned tail = ipset->length - lo;
+        memmove(&ipset->starts[lo + 1], &ipset->starts[lo], tail * sizeof(uint32_t));
+        memmove(&ipset->ends[lo + 1], &ipset->ends[lo], tail * sizeof(uint32_t));
+        ipset->starts[lo] = start;
+        ipset->ends[lo] = end;
+        ipset->length++;
+    }
+    return UwOK();
+}
+
+UwResult uw_ipset_add(UwValuePtr self, UwValuePtr item)
+{
+    IPRange range;
+    UwValue status = parse_range(item, &range);
+    if (uw_error(&status)) {
+        return uw_move(&status);
+    }
+    return uw_ipset_add_range(self, range.start, range.end);
+}
+
+UwResult uw_ipset_add_list(UwValuePtr self, UwValuePtr items)
+{
+    uw_assert_ipset(self);
+    uw_assert_list(items);
+
+    _UwIPSet* ipset = get_data_ptr(self);
+
+    unsigned num_items = uw_list_length(items);
+    size_t num_ranges = (size_t) ipset->length + num_items;
+    size_t memsize;
+    if (__builtin_mul_overflow(num_ranges, sizeof(IPRange), &memsize)) {
+        return UwOOM();
+    }
+    IPRange* ranges = malloc(memsize);
+    if (!ranges && memsize) {
+        return UwOOM();
+    }
+    for (unsigned i = 0; i < ipset->length; i++) {
+        ranges[i].start = ipset->starts[i];
+        ranges[i].end = ipset->ends[i];
+    }
+    UwValue status = UwOK();
+    for (unsigned i = 0; i < num_items; i++) {
+        UwValue item = uw_list_item(items, i);
+        uw_destroy(&status);
+        status = parse_range(&item, &ranges[ipset->length + i]);
+        if (uw_error(&status)) {
+            goto out;
+        }
+    }
+    qsort(ranges, num_ranges, sizeof(IPRange), compare_ranges);
+
+    // existing ranges are included, build new arrays and replace old ones
+    // only on success, so the set is left intact if out of memory
+    _UwIPSet new_ipset = {};
+    for (size_t i = 0; i < num_ranges; i++) {
+        if (!append_range(&new_ipset, ranges[i].start, ranges[i].end)) {
+            free(new_ipset.starts);
+            free(new_ipset.ends);
+            uw_destroy(&status);
+            status = UwOOM();
+            goto out;
+        }
+    }
+    free(ipset->starts);
+    free(ipset->ends);
+    *ipset = new_ipset;
+
+out:
+    free(ranges);
+    return uw_move(&status);
+}
+
+bool uw_ipset_contains(UwValuePtr self, uint32_t addr)
+{
+    uw_assert_ipset(self);
+
+    _UwIPSet* ipset = get_data_ptr(self);
+
+    unsigned n = count_starts_le(ipset, addr);
+    return n && addr <= ipset->ends[n - 1];
+}
+
+unsigned uw_ipset_length(UwValuePtr self)
+{
+    uw_assert_ipset(self);
+    return get_data_ptr(self)->length;
+}
+
+void uw_ipset_range(UwValuePtr self, unsigned index, uint32_t* start, uint32_t* end)
+{
+    uw_assert_ipset(self);
+
+    _UwIPSet* ipset = get_data_ptr(self);
+
+    uw_assert(index < ipset->length);
+    *start = ipset->starts[index];
+    *end = ipset->ends[index];
+}
+
+UwResult uw_ipset_union(UwValuePtr a, UwValuePtr b)
+{
+    uw_assert_ipset(a);
+    uw_assert_ipset(b);
+
+    _UwIPSet* set_a = get_data_ptr(a);
+    _UwIPSet* set_b = get_data_ptr(b);
+
+    UwValue result = uw_create_ipset();
+    if (uw_error(&result)) {
+        return uw_move(&result);
+    }
+    _UwIPSet* set_r = get_data_ptr(&result);
+    if (!reserve(set_r, set_a->length + set_b->length)) {
+        return UwOOM();
+    }
+    unsigned i = 0;
+    unsigned j = 0;
+    while (i < set_a->length || j < set_b->length) {
+        bool take_a = j == set_b->length || (i < set_a->length && set_a->starts[i] <= set_b->starts[j]);
+        if (take_a) {
+            append_range(set_r, set_a->starts[i], set_a->ends[i]);
+            i++;
+        } else {
+            append_range(set_r, set_b->starts[j], set_b->ends[j]);
+            j++;
+        }
+    }
+    return uw_move(&result);
+}
+
+UwResult uw_ipset_intersection(UwValuePtr a, UwValuePtr b)
+{
+    uw_assert_ipset(a);
+    uw_assert_ipset(b);
+
+    _UwIPSet* set_a = get_data_ptr(a);
+    _UwIPSet* set_b = get_data_ptr(b);
+
+    UwValue result = uw_create_ipset();
+    if (uw_error(&result)) {
+        return uw_move(&result);
+    }
+    _UwIPSet* set_r = get_data_ptr(&result);
+    if (!reserve(set_r, set_a->length + set_b->length)) {
+        return UwOOM();
+    }
+    unsigned i = 0;
+    unsigned j = 0;
+    while (i < set_a->length && j < set_b->length) {
+        uint32_t start = (set_a->starts[i] > set_b->starts[j])? set_a->starts[i] : set_b->starts[j];
+        uint32_t end   = (set_a->ends[i]   < set_b->ends[j])?   set_a->ends[i]   : set_b->ends[j];
+        if (start <= end) {
+            append_range(set_r, start, end);
+        }
+        // advance the range that ends first
+        if (set_a->ends[i] < set_b->ends[j]) {
+            i++;
+        } else {
+            j++;
+        }
+    }
+    return uw_move(&result);
+}
+
+UwResult uw_ipset_difference(UwValuePtr a, UwValuePtr b)
+{
+    uw_assert_ipset(a);
+    uw_assert_ipset(b);
+
+    _UwIPSet* set_a = get_data_ptr(a);
+    _UwIPSet* set_b = get_data_ptr(b);
+
+    UwValue result = uw_create_ipset();
+    if (uw_error(&result)) {
+        return uw_move(&result);
+    }
+    _UwIPSet* set_r = get_data_ptr(&result);
+
+    // each range of b can split one range of a into two
+    if (!reserve(set_r, set_a->length + set_b->length)) {
+        return UwOOM();
+    }
+    unsigned j = 0;
+    for (unsigned i = 0; i < set_a->length; i++) {
+        uint32_t start = set_a->starts[i];
+        uint32_t end = set_a->ends[i];
+
+        // skip ranges of b that end before this range
+        while (j < set_b->length && set_b->ends[j] < start) {
+            j++;
+        }
+        bool empty = false;
+        unsigned k = j;
+        while (k < set_b->length && set_b->starts[k] <= end) {
+            if (set_b->starts[k] > start) {
+                append_range(set_r, start, set_b->starts[k] - 1);
+            }
+            if (set_b->ends[k] >= end) {
+                empty = true;
+                break;
+            }
+            start = set_b->ends[k] + 1;
+            k++;
+        }
+        if (!empty) {
+            append_range(set_r, start, end);
+        }
+    }
+    return uw_move(&result);
+}
@@ -0,0 +1,1003 @@
+#ifndef _GNU_SOURCE
+#   define _GNU_SOURCE
+#endif
+
+#include <locale.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/uw_json.h"
+#include "src/uw_list_internal.h"
+#include "src/uw_map_internal.h"
+#include "src/uw_string_internal.h"
+
+uint16_t UW_ERROR_BAD_JSON = 0;
+uint16_t UW_ERROR_CYCLIC_REFERENCE = 0;
+
+// numbers are parsed in C locale, no matter what the current one is
+static locale_t c_locale = (locale_t) 0;
+
+[[ gnu::constructor ]]
+static void init_json()
+{
+    // init statuses
+    UW_ERROR_BAD_JSON = uw_define_status("BAD_JSON");
+    UW_ERROR_CYCLIC_REFERENCE = uw_define_status("CYCLIC_REFERENCE");
+
+    c_locale = newlocale(LC_ALL_MASK, "C", (locale_t) 0);
+}
+
+static UwResult json_error(unsigned position, char* message)
+{
+    UwValue error = UwError(UW_ERROR_BAD_JSON);
+    _uw_set_status_desc(&error, "%s at position %u", message, position);
+    return uw_move(&error);
+}
+
+/****************************************************************
+ * Parser
+ */
+
+typedef struct {
+    char8_t* buffer;
+    unsigned size;
+    unsigned position;        // current position in the second stage
+
+    unsigned* counts;         // number of items in arrays and objects, in order of opening brackets
+    unsigned num_containers;
+    unsigned capacity;        // of counts
+    unsigned next_container;  // index in counts for the next container in the second stage
+} JsonParser;
+
+#define JSON_COUNTS_INITIAL_CAPACITY  64
+
+static inline bool is_json_space(char8_t c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static inline void skip_spaces(JsonParser* parser)
+{
+    while (parser->position < parser->size && is_json_space(parser->buffer[parser->position])) {
+        parser->position++;
+    }
+}
+
+static inline char8_t peek(JsonParser* parser)
+/*
+ * Return current character or zero at the end of buffer.
+ */
+{
+    return (parser->position < parser->size)? parser->buffer[parser->position] : 0;
+}
+
+static inline unsigned find_closing_quote(char8_t* buffer, unsigned start, unsigned size)
+/*
+ * Find closing quote of a string that starts at `start`, i.e. right after opening quote.
+ * Quote is escaped if preceded by odd number of backslashes.
+ *
+ * Return position of closing quote or UINT_MAX if string is unterminated.
+ */
+{
+    unsigned pos = start;
+    for (;;) {
+        char8_t* quote = memchr(buffer + pos, '"', size - pos);
+        if (!quote) {
+            return UINT_MAX;
+        }
+        pos = quote - buffer;
+        unsigned num_backslashes = 0;
+        while (pos - num_backslashes > start && buffer[pos - num_backslashes - 1] == '\\') {
+            num_backslashes++;
+        }
+        if ((num_backslashes & 1) == 0) {
+            return pos;
+        }
+        pos++;
+    }
+}
+
+static UwResult index_containers(JsonParser* parser)
+/*
+ * First stage: match brackets and count items of arrays and objects
+ * by counting commas at their nesting level.
+ *
+ * Strings are skipped with memchr, the rest is a simple byte loop.
+ */
+{
+    char8_t* buffer = parser->buffer;
+    unsigned size = parser->size;
+
+    unsigned stack[UW_JSON_MAX_DEPTH];     // indexes in counts
+    char8_t  closing[UW_JSON_MAX_DEPTH];   // expected closing brackets
+    bool     has_items[UW_JSON_MAX_DEPTH];
+    unsigned depth = 0;
+
+    for (unsigned pos = 0; pos < size; pos++) {
+        char8_t c = buffer[pos];
+        switch (c) {
+            case ' ':
+            case '\n':
+            case '\r':
+            case '\t':
+                break;
+
+            case '"':
+                if (depth) {
+                    has_items[depth - 1] = true;
+                }
+                pos = find_closing_quote(buffer, pos + 1, size);
+                if (pos == UINT_MAX) {
+                    return json_error(size, "Unterminated string");
+                }
+                break;
+
+            case '[':
+            case '{':
+                if (depth == UW_JSON_MAX_DEPTH) {
+                    return json_error(pos, "Nesting is too deep");
+                }
+                if (depth) {
+                    has_items[depth - 1] = true;
+                }
+                if (parser->num_containers == parser->capacity) {
+                    unsigned new_capacity = parser->capacity? parser->capacity * 2 : JSON_COUNTS_INITIAL_CAPACITY;
+                    unsigned* new_counts = realloc(parser->counts, new_capacity * sizeof(unsigned));
+                    if (!new_counts) {
+                        return UwOOM();
+                    }
+                    parser->counts = new_counts;
+                    parser->capacity = new_capacity;
+                }
+                parser->counts[parser->num_containers] = 0;
+                stack[depth] = parser->num_containers++;
+                closing[depth] = (c == '[')? ']' : '}';
+                has_items[depth] = false;
+                depth++;
+                break;
+
+            case ']':
+            case '}':
+                if (depth == 0 || closing[depth - 1] != c) {
+                    return json_error(pos, "Unexpected closing bracket");
+                }
+                depth--;
+                if (has_items[depth]) {
+                    // the number of items is the number of commas plus one
+                    parser->counts[stack[depth]]++;
+                }
+                break;
+
+            case ',':
+                if (depth) {
+                    parser->counts[stack[depth - 1]]++;
+                }
+                break;
+
+            default:
+                if (depth) {
+                    has_items[depth - 1] = true;
+                }
+                break;
+        }
+    }
+    if (depth) {
+        return json_error(size, "Unterminated array or object");
+    }
+    return UwOK();
+}
+
+static UwResult parse_value(JsonParser* parser);
+
+static inline uint8_t codepoint_char_size(char32_t c)
+{
+    if (c < 256) {
+        return 1;
+    }
+    if (c < 65536) {
+        return 2;
+    }
+    if (c < 16777216) {
+        return 3;
+    }
+    return 4;
+}
+
+static bool read_hex4(char8_t* ptr, char32_t* result)
+{
+    char32_t value = 0;
+    for (unsigned i = 0; i < 4; i++) {
+        char8_t c = ptr[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+            value |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            value |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            value |= c - 'A' + 10;
+        } else {
+            return false;
+        }
+    }
+    *result = value;
+    return true;
+}
+
+static bool decode_escape(char8_t* buffer, unsigned* position, unsigned end, char32_t* codepoint)
+/*
+ * Decode escape sequence at `*position` which points to backslash.
+ * Update `*position`.
+ *
+ * Lone surrogates are replaced with U+FFFD.
+ *
+ * Return false if escape sequence is invalid.
+ */
+{
+    unsigned pos = *position + 1;
+    if (pos >= end) {
+        return false;
+    }
+    char8_t c = buffer[pos++];
+    switch (c) {
+        case '"':  *codepoint = '"';  break;
+        case '\\': *codepoint = '\\'; break;
+        case '/':  *codepoint = '/';  break;
+        case 'b':  *codepoint = '\b'; break;
+        case 'f':  *codepoint = '\f'; break;
+        case 'n':  *codepoint = '\n'; break;
+        case 'r':  *codepoint = '\r'; break;
+        case 't':  *codepoint = '\t'; break;
+        case 'u': {
+            char32_t cp;
+            if (pos + 4 > end || !read_hex4(buffer + pos, &cp)) {
+                return false;
+            }
+            pos += 4;
+            if (cp >= 0xD800 && cp < 0xDC00) {
+                // high surrogate, must be followed by low one
+                char32_t low;
+                if (pos + 6 <= end && buffer[pos] == '\\' && buffer[pos + 1] == 'u'
+                    && read_hex4(buffer + pos + 2, &low) && low >= 0xDC00 && low < 0xE000) {
+
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    pos += 6;
+                } else {
+                    cp = 0xFFFD;
+                }
+            } else if (cp >= 0xDC00 && cp < 0xE000) {
+                cp = 0xFFFD;
+            }
+            *codepoint = cp;
+            break;
+        }
+        default:
+            return false;
+    }
+    *position = pos;
+    return true;
+}
+
+static UwResult decode_string(char8_t* buffer, unsigned start, unsigned end, UwValuePtr dest,
+                              unsigned* length, uint8_t* char_size)
+/*
+ * Decode string with escape sequences.
+ *
+ * If `dest` is nullptr, measure length and char size.
+ * Otherwise append characters to `dest`.
+ */
+{
+    unsigned pos = start;
+    while (pos < end) {
+        char8_t* backslash = memchr(buffer + pos, '\\', end - pos);
+        unsigned run_end = backslash? (unsigned) (backslash - buffer) : end;
+        if (run_end > pos) {
+            unsigned run_size = run_end - pos;
+            if (dest) {
+                if (!uw_string_append_utf8(dest, buffer + pos, run_size, &run_size)) {
+                    return UwOOM();
+                }
+            } else {
+                uint8_t run_char_size;
+                *length += utf8_strlen2_buf(buffer + pos, &run_size, &run_char_size);
+                if (*char_size < run_char_size) {
+                    *char_size = run_char_size;
+                }
+            }
+        }
+        pos = run_end;
+        if (pos < end) {
+            char32_t c;
+            if (!decode_escape(buffer, &pos, end, &c)) {
+                return json_error(pos, "Bad escape sequence");
+            }
+            if (dest) {
+                if (!uw_string_append(dest, c)) {
+                    return UwOOM();
+                }
+            } else {
+                (*length)++;
+                uint8_t c_size = codepoint_char_size(c);
+                if (*char_size < c_size) {
+                    *char_size = c_size;
+                }
+            }
+        }
+    }
+    return UwOK();
+}
+
+static UwResult parse_string(JsonParser* parser)
+{
+    char8_t* buffer = parser->buffer;
+    unsigned start = parser->position + 1;  // skip opening quote
+    unsigned end = find_closing_quote(buffer, start, parser->size);
+    if (end == UINT_MAX) {
+        return json_error(parser->size, "Unterminated string");
+    }
+    parser->position = end + 1;
+
+    for (unsigned pos = start; pos < end; pos++) {
+        if (buffer[pos] < 0x20) {
+            return json_error(pos, "Control character in string");
+        }
+    }
+
+    if (!memchr(buffer + start, '\\', end - start)) {
+        // no escapes: measure and copy UTF-8 data in one go
+        UwValue result = UwString();
+        unsigned bytes_processed;
+        if (!uw_string_append_utf8(&result, buffer + start, end - start, &bytes_processed)) {
+            return UwOOM();
+        }
+        return uw_move(&result);
+    }
+
+    // measure first to allocate string of exact length and char size
+    unsigned length = 0;
+    uint8_t char_size = 1;
+    UwValue status = decode_string(buffer, start, end, nullptr, &length, &char_size);
+    if (uw_error(&status)) {
+        return uw_move(&status);
+    }
+    UwValue result = uw_create_empty_string(length, char_size);
+    if (uw_error(&result)) {
+        return uw_move(&result);
+    }
+    UwValue status2 = decode_string(buffer, start, end, &result, nullptr, nullptr);
+    if (uw_error(&status2)) {
+        return uw_move(&status2);
+    }
+    return uw_move(&result);
+}
+
+static UwResult parse_number(JsonParser* parser)
+{
+    char8_t* buffer = parser->buffer;
+    unsigned size = parser->size;
+    unsigned start = parser->position;
+    unsigned pos = start;
+    bool negative = false;
+    bool is_float = false;
+
+#   define IS_DIGIT(pos)  ((pos) < size && buffer[pos] >= '0' && buffer[pos] <= '9')
+
+    if (buffer[pos] == '-') {
+        negative = true;
+        pos++;
+    }
+    if (!IS_DIGIT(pos)) {
+        return json_error(pos, "Bad number");
+    }
+    if (buffer[pos] == '0') {
+        pos++;
+    } else {
+        while (IS_DIGIT(pos)) {
+            pos++;
+        }
+    }
+    unsigned int_end = pos;
+    if (pos < size && buffer[pos] == '.') {
+        is_float = true;
+        pos++;
+        if (!IS_DIGIT(pos)) {
+            return json_error(pos, "Bad number");
+        }
+        while (IS_DIGIT(pos)) {
+            pos++;
+        }
+    }
+    if (pos < size && (buffer[pos] == 'e' || buffer[pos] == 'E')) {
+        is_float = true;
+        pos++;
+        if (pos < size && (buffer[pos] == '+' || buffer[pos] == '-')) {
+            pos++;
+        }
+        if (!IS_DIGIT(pos)) {
+            return json_error(pos, "Bad number");
+        }
+        while (IS_DIGIT(pos)) {
+            pos++;
+        }
+    }
+#   undef IS_DIGIT
+
+    parser->position = pos;
+
+    if (!is_float) {
+        uint64_t n = 0;
+        bool overflow = false;
+        for (unsigned i = start + negative; i < int_end; i++) {
+            unsigned digit = buffer[i] - '0';
+            if (n > (UINT64_MAX - digit) / 10) {
+                overflow = true;
+                break;
+            }
+            n = n * 10 + digit;
+        }
+        if (!overflow) {
+            if (!negative) {
+                if (n <= (uint64_t) UW_SIGNED_MAX) {
+                    return UwSigned((UwType_Signed) n);
+                }
+                return UwUnsigned(n);
+            }
+            if (n <= (uint64_t) UW_SIGNED_MAX + 1) {
+                return UwSigned((UwType_Signed) (0 - n));
+            }
+        }
+        // too large integer, convert to Float
+    }
+
+    // strtod needs null-terminated string
+    unsigned length = pos - start;
+    char local_buffer[64];
+    char* text = local_buffer;
+    if (length >= sizeof(local_buffer)) {
+        text = malloc(length + 1);
+        if (!text) {
+            return UwOOM();
+        }
+    }
+    memcpy(text, buffer + start, length);
+    text[length] = 0;
+    // C locale can't be created only if out of memory, fall back to the current one
+    UwType_Float value = c_locale? strtod_l(text, nullptr, c_locale) : strtod(text, nullptr);
+    if (text != local_buffer) {
+        free(text);
+    }
+    return UwFloat(value);
+}
+
+static bool match_literal(JsonParser* parser, char* literal, unsigned length)
+{
+    if (parser->size - parser->position < length) {
+        return false;
+    }
+    if (memcmp(parser->buffer + parser->position, literal, length) != 0) {
+        return false;
+    }
+    parser->position += length;
+    return true;
+}
+
+static UwResult parse_array(JsonParser* parser)
+{
+    if (parser->next_container >= parser->num_containers) {
+        return json_error(parser->position, "Internal error: stages mismatch");
+    }
+    unsigned count = parser->counts[parser->next_container++];
+    parser->position++;  // skip opening bracket
+
+    UwValue result = UwList();
+    if (uw_error(&result)) {
+        return uw_move(&result);
+    }
+    if (count && !uw_list_resize(&result, count)) {
+        return UwOOM();
+    }
+    _UwList* list = _uw_get_data_ptr(&result, UwTypeId_List);
+
+    skip_spaces(parser);
+    if (peek(parser) == ']') {
+        parser->position++;
+        return uw_move(&result);
+    }
+    for (;;) {
+        UwValue item = parse_value(parser);
+        if (uw_error(&item)) {
+            return uw_move(&item);
+        }
+        if (!_uw_list_append_item(result.type_id, list, &item, &result)) {
+            return UwOOM();
+        }
+        skip_spaces(parser);
+        char8_t c = peek(parser);
+        if (c == ']') {
+            parser->position++;
+            return uw_move(&result);
+        }
+        if (c != ',') {
+            return json_error(parser->position, "Expected comma or closing bracket");
+        }
+        parser->position++;
+    }
+}
+
+static UwResult parse_object(JsonParser* parser)
+{
+    if (parser->next_container >= parser->num_containers) {
+        return json_error(parser->position, "Internal error: stages mismatch");
+    }
+    unsigned count = parser->counts[parser->next_container++];
+    parser->position++;  // skip opening brace
+
+    UwValue result = UwMap();
+    if (uw_error(&result)) {
+        return uw_move(&result);
+    }
+    if (count && !uw_map_resize(&result, count)) {
+        return UwOOM();
+    }
+
+    skip_spaces(parser);
+    if (peek(parser) == '}') {
+        parser->position++;
+        return uw_move(&result);
+    }
+    for (;;) {
+        skip_spaces(parser);
+        if (peek(parser) != '"') {
+            return json_error(parser->position, "Expected string key");
+        }
+        UwValue key = parse_string(parser);
+        if (uw_error(&key)) {
+            return uw_move(&key);
+        }
+        skip_spaces(parser);
+        if (peek(parser) != ':') {
+            return json_error(parser->position, "Expected colon");
+        }
+        parser->position++;
+
+        UwValue value = parse_value(parser);
+        if (uw_error(&value)) {
+            return uw_move(&value);
+        }
+        // the key is freshly created, no need to make deep copy
+        if (!_uw_map_update_nocopy(&result, &key, &value)) {
+            return UwOOM();
+        }
+        skip_spaces(parser);
+        char8_t c = peek(parser);
+        if (c == '}') {
+            parser->position++;
+            return uw_move(&result);
+        }
+        if (c != ',') {
+            return json_error(parser->position, "Expected comma or closing brace");
+        }
+        parser->position++;
+    }
+}
+
+static UwResult parse_value(JsonParser* parser)
+{
+    skip_spaces(parser);
+    if (parser->position == parser->size) {
+        return json_error(parser->position, "Unexpected end of data");
+    }
+    char8_t c = parser->buffer[parser->position];
+    switch (c) {
+        case '{':
+            return parse_object(parser);
+        case '[':
+            return parse_array(parser);
+        case '"':
+            return parse_string(parser);
+        case 't':
+            if (match_literal(parser, "true", 4)) {
+                return UwBool(true);
+            }
+            break;
+        case 'f':
+            if (match_literal(parser, "false", 5)) {
+                return UwBool(false);
+            }
+            break;
+        case 'n':
+            if (match_literal(parser, "null", 4)) {
+                return UwNull();
+            }
+            break;
+        default:
+            if (c == '-' || (c >= '0' && c <= '9')) {
+                return parse_number(parser);
+            }
+            break;
+    }
+    return json_error(parser->position, "Unexpected character");
+}
+
+UwResult uw_json_parse(char8_t* buffer, unsigned size)
+{
+    JsonParser parser = {
+        .buffer = buffer,
+        .size   = size
+    };
+    UwValue result = index_containers(&parser);
+    if (uw_ok(&result)) {
+        uw_destroy(&result);
+        result = parse_value(&parser);
+        if (uw_ok(&result)) {
+            skip_spaces(&parser);
+            if (parser.position != size) {
+                uw_destroy(&result);
+                result = json_error(parser.position, "Extra data after JSON value");
+            }
+        }
+    }
+    free(parser.counts);
+    return uw_move(&result);
+}
+
+/****************************************************************
+ * Serializer
+ */
+
+#define JSON_WRITE_BUFFER_SIZE  4096
+
+typedef struct {
+    UwValuePtr writer;
+    bool to_string;    // writer is a String
+    unsigned indent;   // zero for compact output
+    unsigned length;   // of data in the buffer
+    char8_t buffer[JSON_WRITE_BUFFER_SIZE];
+} JsonWriter;
+
+// characters of 1-byte strings that cannot be copied as is
+static const bool needs_escape[256] = {
+    [0 ... 0x1F]   = true,
+    ['"']          = true,
+    ['\\']         = true,
+    [0x80 ... 0xFF] = true  // Latin-1, needs UTF-8 encoding
+};
+
+static UwResult flush(JsonWriter* w)
+{
+    if (w->to_string) {
+        unsigned bytes_processed = w->length;
+        if (!uw_string_append_utf8(w->writer, w->buffer, w->length, &bytes_processed)) {
+            return UwOOM();
+        }
+    } else {
+        UwValue status = uw_file_write_all(w->writer, w->buffer, w->length);
+        if (uw_error(&status)) {
+            return uw_move(&status);
+        }
+    }
+    w->length = 0;
+    return UwOK();
+}
+
+#define RESERVE(w, n)  \
+    if ((w)->length + (n) > JSON_WRITE_BUFFER_SIZE) {  \
+        UwValue status = flush(w);  \
+        if (uw_error(&status)) {  \
+            return uw_move(&status);  \
+        }  \
+    }
+
+static UwResult write_bytes(JsonWriter* w, void* data, unsigned size)
+{
+    char8_t* ptr = data;
+    while (size) {
+        RESERVE(w, 1)
+        unsigned n = JSON_WRITE_BUFFER_SIZE - w->length;
+        if (n > size) {
+            n = size;
+        }
+        memcpy(w->buffer + w->length, ptr, n);
+        w->length += n;
+        ptr += n;
+        size -= n;
+    }
+    return UwOK();
+}
+
+static UwResult write_byte(JsonWriter* w, char8_t c)
+{
+    RESERVE(w, 1)
+    w->buffer[w->length++] = c;
+    return UwOK();
+}
+
+static UwResult write_newline(JsonWriter* w, unsigned depth)
+/*
+ * Start new line in pretty mode, do nothing in compact mode.
+ */
+{
+    if (w->indent == 0) {
+        return UwOK();
+    }
+    UwValue status = write_byte(w, '\n');
+    if (uw_error(&status)) {
+        return uw_move(&status);
+    }
+    for (unsigned n = depth * w->indent; n;) {
+        RESERVE(w, 1)
+        unsigned chunk = JSON_WRITE_BUFFER_SIZE - w->length;
+        if (chunk > n) {
+            chunk = n;
+        }
+        memset(w->buffer + w->length, ' ', chunk);
+        w->length += chunk;
+        n -= chunk;
+    }
+    return UwOK();
+}
+
+static UwResult write_char(JsonWriter* w, char32_t c)
+/*
+ * Write character of string, escaped or encoded as necessary.
+ */
+{
+    // longest output is \u00XX or 4-byte UTF-8 sequence
+    RESERVE(w, 6)
+    char8_t* out = w->buffer + w->length;
+    if (c >= 0x80) {
+        w->length = (char8_t*) uw_char32_to_utf8(c, (char*) out) - w->buffer;
+        return UwOK();
+    }
+    char8_t escape;
+    switch (c) {
+        case '"':  escape = '"';  break;
+        case '\\': escape = '\\'; break;
+        case '\b': escape = 'b';  break;
+        case '\f': escape = 'f';  break;
+        case '\n': escape = 'n';  break;
+        case '\r': escape = 'r';  break;
+        case '\t': escape = 't';  break;
+        default:
+            if (c < 0x20) {
+                static const char hex_digits[] = "0123456789abcdef";
+                memcpy(out, "\\u00", 4);
+                out[4] = hex_digits[c >> 4];
+                out[5] = hex_digits[c & 15];
+                w->length += 6;
+            } else {
+                *out = (char8_t) c;
+                w->length++;
+            }
+            return UwOK();
+    }
+    out[0] = '\\';
+    out[1] = escape;
+    w->length += 2;
+    return UwOK();
+}
+
+static UwResult write_string(JsonWriter* w, UwValuePtr str)
+{
+    UwValue status = write_byte(w, '"');
+    if (uw_error(&status)) {
+        return uw_move(&status);
+    }
+    uint8_t char_size = _uw_string_char_size(str);
+    unsigned length = _uw_string_length(str);
+    uint8_t* ptr = _uw_string_char_ptr(str, 0);
+
+    if (char_size == 1) {
+        // fast path: copy runs of characters that need neither escaping nor encoding
+        unsigned i = 0;
+        while (i < length) {
+            unsigned start = i;
+            while (i < length && !needs_escape[ptr[i]]) {
+                i++;
+            }
+            if (i > start) {
+                status = write_bytes(w, ptr + start, i - start);
+                if (uw_error(&status)) {
+                    return uw_move(&status);
+                }
+            }
+            if (i < length) {
+                status = write_char(w, ptr[i++]);
+                if (uw_error(&status)) {
+                    return uw_move(&status);
+                }
+            }
+        }
+    } else {
+        StrMethods* strmeth = get_str_methods(str);
+        for (unsigned i = 0; i < length; i++, ptr += char_size) {
+            status = write_char(w, strmeth->get_char(ptr));
+            if (uw_error(&status)) {
+                return uw_move(&status);
+            }
+        }
+    }
+    return write_byte(w, '"');
+}
+
+static UwResult write_signed(JsonWriter* w, UwType_Signed value)
+{
+    char buffer[UW_INT_BUFFER_SIZE];
+    char* end = buffer + sizeof(buffer);
+    char* start = _uw_format_signed(value, end);
+    return write_bytes(w, start, end - start);
+}
+
+static UwResult write_unsigned(JsonWriter* w, UwType_Unsigned value)
+{
+    char buffer[UW_INT_BUFFER_SIZE];
+    char* end = buffer + sizeof(buffer);
+    char* start = _uw_format_unsigned(value, end);
+    return write_bytes(w, start, end - start);
+}
+
+static UwResult write_float(JsonWriter* w, UwType_Float value)
+{
+    if (!isfinite(value)) {
+        // JSON has no representation for NaN and infinities
+        return write_bytes(w, "null", 4);
+    }
+    char buffer[UW_FLOAT_BUFFER_SIZE];
+    unsigned length = _uw_format_float(value, buffer);
+    return write_bytes(w, buffer, length);
+}
+
+static UwResult write_value(JsonWriter* w, UwValuePtr value, unsigned depth, _UwCompoundChain* tail);
+
+static UwResult cyclic_reference_error(UwValuePtr value)
+{
+    UwValue error = UwError(UW_ERROR_CYCLIC_REFERENCE);
+    _uw_set_status_desc(&error, "%s contains reference to itself", _uw_types[value->type_id]->name);
+    return uw_move(&error);
+}
+
+static UwResult write_list(JsonWriter* w, UwValuePtr value, unsigned depth, _UwCompoundChain* tail)
+{
+    if (_uw_on_chain(value, tail)) {
+        return cyclic_reference_error(value);
+    }
+    _UwCompoundChain this_link = {
+        .prev = tail,
+        .value = value
+    };
+    _UwList* list = _uw_get_data_ptr(value, UwTypeId_List);
+    unsigned length = _uw_list_length(list);
+
+    UwValue status = write_byte(w, '[');
+    if (uw_error(&status)) {
+        return uw_move(&status);
+    }
+    for (unsigned i = 0; i < length; i++) {
+        if (i) {
+            status = write_byte(w, ',');
+            if (uw_error(&status)) {
+                return uw_move(&status);
+            }
+        }
+        status = write_newline(w, depth + 1);
+        if (uw_error(&status)) {
+            return uw_move(&status);
+        }
+        status = write_value(w, _uw_list_item(list, i), depth + 1, &this_link);
+        if (uw_error(&status)) {
+            return uw_move(&status);
+        }
+    }
+    if (length) {
+        status = write_newline(w, depth);
+        if (uw_error(&status)) {
+            return uw_move(&status);
+        }
+    }
+    return write_byte(w, ']');
+}
+
+static UwResult write_map(JsonWriter* w, UwValuePtr value, unsigned depth, _UwCompoundChain* tail)
+{
+    if (_uw_on_chain(value, tail)) {
+        return cyclic_reference_error(value);
+    }
+    _UwCompoundChain this_link = {
+        .prev = tail,
+        .value = value
+    };
+    _UwMap* map = _uw_get_data_ptr(value, UwTypeId_Map);
+    unsigned length = _uw_list_length(&map->kv_pairs);
+
+    UwValue status = write_byte(w, '{');
+    if (uw_error(&status)) {
+        return uw_move(&status);
+    }
+    for (unsigned i = 0; i < length; i += 2) {
+        UwValuePtr key = _uw_list_item(&map->kv_pairs, i);
+        if (!uw_is_string(key)) {
+            UwValue error = UwError(UW_ERROR_INCOMPATIBLE_TYPE);
+            _uw_set_status_desc(&error, "JSON object key must be String, not %s", _uw_types[key->type_id]->name);
+            return uw_move(&error);
+        }
+        if (i) {
+            status = write_byte(w, ',');
+            if (uw_error(&status)) {
+                return uw_move(&status);
+            }
+        }
+        status = write_newline(w, depth + 1);
+        if (uw_error(&status)) {
+            return uw_move(&status);
+        }
+        status = write_string(w, key);
+        if (uw_error(&status)) {
+            return uw_move(&status);
+        }
+        status = w->indent? write_bytes(w, ": ", 2) : write_byte(w, ':');
+        if (uw_error(&status)) {
+            return uw_move(&status);
+        }
+        status = write_value(w, _uw_list_item(&map->kv_pairs, i + 1), depth + 1, &this_link);
+        if (uw_error(&status)) {
+            return uw_move(&status);
+        }
+    }
+    if (length) {
+        status = write_newline(w, depth);
+        if (uw_error(&status)) {
+            return uw_move(&status);
+        }
+    }
+    return write_byte(w, '}');
+}
+
+static UwResult write_value(JsonWriter* w, UwValuePtr value, unsigned depth, _UwCompoundChain* tail)
+{
+    if (uw_is_null(value)) {
+        return write_bytes(w, "null", 4);
+    }
+    if (uw_is_bool(value)) {
+        return value->bool_value? write_bytes(w, "true", 4) : write_bytes(w, "false", 5);
+    }
+    if (uw_is_signed(value)) {
+        return write_signed(w, value->signed_value);
+    }
+    if (uw_is_unsigned(value)) {
+        return write_unsigned(w, value->unsigned_value);
+    }
+    if (uw_is_float(value)) {
+        return write_float(w, value->float_value);
+    }
+    if (uw_is_string(value)) {
+        return write_string(w, value);
+    }
+    if (uw_is_list(value)) {
+        return write_list(w, value, depth, tail);
+    }
+    if (uw_is_map(value)) {
+        return write_map(w, value, depth, tail);
+    }
+    UwValue error = UwError(UW_ERROR_INCOMPATIBLE_TYPE);
+    _uw_set_status_desc(&error, "%s cannot be serialized to JSON", _uw_types[value->type_id]->name);
+    return uw_move(&error);
+}
+
+UwResult uw_json_write(UwValuePtr value, UwValuePtr writer, unsigned indent)
+{
+    bool to_string = uw_is_string(writer);
+    if (!to_string && !_uw_get_interface(_uw_types[writer->type_id], UwInterfaceId_FileWriter)) {
+        return UwErrorNoInterface(writer, FileWriter);
+    }
+    JsonWriter w = {
+        .writer    = writer,
+        .to_string = to_string,
+        .indent    = indent,
+        .length    = 0
+    };
+    UwValue status = write_value(&w, value, 0, nullptr);
+    if (uw_error(&status)) {
+        return uw_move(&status);
+    }
+    return flush(&w);
+}
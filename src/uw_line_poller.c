@@ -0,0 +1,314 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+
+#include "include/uw_line_poller.h"
+
+typedef struct {
+    _UwValue file;  // Null if slot is free
+    _UwValue line;  // reusable line buffer
+    int fd;
+    UwLineHandler handler;
+    void* context;
+} _UwPollerEntry;
+
+typedef struct {
+    int epoll_fd;
+    unsigned num_files;
+    unsigned capacity;
+    _UwPollerEntry* entries;
+} _UwLinePoller;
+
+#define get_data_ptr(value)  ((_UwLinePoller*) _uw_get_data_ptr((value), UwTypeId_LinePoller))
+
+#define LINE_POLLER_INITIAL_CAPACITY  16
+#define LINE_POLLER_MAX_EVENTS        64  // per epoll_wait call
+
+/*
+ * epoll data contains both slot index and fd.
+ * Slot can be freed and reused while processing a batch of events,
+ * fd helps to detect such stale events.
+ */
+#define make_epoll_data(slot, fd)  ((((uint64_t) (slot)) << 32) | (uint32_t) (fd))
+#define epoll_data_slot(data)      ((unsigned) ((data) >> 32))
+#define epoll_data_fd(data)        ((int) (uint32_t) (data))
+
+static void free_entry(_UwLinePoller* poller, unsigned slot)
+{
+    _UwPollerEntry* entry = &poller->entries[slot];
+
+    epoll_ctl(poller->epoll_fd, EPOLL_CTL_DEL, entry->fd, nullptr);
+    uw_destroy(&entry->file);
+    uw_destroy(&entry->line);
+    entry->fd = -1;
+    poller->num_files--;
+}
+
+/****************************************************************
+ * Basic interface methods
+ */
+
+static UwResult poller_init(UwValuePtr self, va_list ap)
+{
+    _UwLinePoller* poller = get_data_ptr(self);
+    poller->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (poller->epoll_fd == -1) {
+        return UwErrno(errno);
+    }
+    return UwOK();
+}
+
+static void poller_fini(UwValuePtr self)
+{
+    _UwLinePoller* poller = get_data_ptr(self);
+    for (unsigned i = 0; i < poller->capacity; i++) {
+        if (!uw_is_null(&poller->entries[i].file)) {
+            free_entry(poller, i);
+        }
+    }
+    free(poller->entries);
+    poller->entries = nullptr;
+    poller->capacity = 0;
+    if (poller->epoll_fd != -1) {
+        close(poller->epoll_fd);
+        poller->epoll_fd = -1;
+    }
+}
+
+static void poller_hash(UwValuePtr self, UwHashContext* ctx)
+{
+    _UwLinePoller* poller = get_data_ptr(self);
+
+    _uw_hash_uint64(ctx, self->type_id);
+    _uw_hash_uint64(ctx, poller->epoll_fd);
+}
+
+static UwResult poller_deepcopy(UwValuePtr self)
+{
+    return UwError(UW_ERROR_NOT_IMPLEMENTED);
+}
+
+static void poller_dump(UwValuePtr self, FILE* fp, int first_indent, int next_indent, _UwCompoundChain* tail)
+{
+    _UwLinePoller* poller = get_data_ptr(self);
+
+    _uw_dump_start(fp, self, first_indent);
+    _uw_dump_base_extra_data(fp, self->extra_data);
+    fprintf(fp, " epoll fd: %d, files: %u, capacity: %u\n", poller->epoll_fd, poller->num_files, poller->capacity);
+}
+
+static UwResult poller_to_string(UwValuePtr self)
+{
+    return UwError(UW_ERROR_NOT_IMPLEMENTED);
+}
+
+static bool poller_is_true(UwValuePtr self)
+{
+    return get_data_ptr(self)->num_files;
+}
+
+static bool poller_equal_sametype(UwValuePtr self, UwValuePtr other)
+{
+    return get_data_ptr(self)->epoll_fd == get_data_ptr(other)->epoll_fd;
+}
+
+static bool poller_equal(UwValuePtr self, UwValuePtr other)
+{
+    return uw_is_subtype(other, UwTypeId_LinePoller) && poller_equal_sametype(self, other);
+}
+
+/****************************************************************
+ * LinePoller type
+ */
+
+UwTypeId UwTypeId_LinePoller = 0;
+
+static UwType line_poller_type = {
+    .id              = 0,
+    .ancestor_id     = UwTypeId_Null,  // no ancestor
+    .name            = "LinePoller",
+    .allocator       = &default_allocator,
+    .data_offset     = sizeof(_UwExtraData),
+    .data_size       = sizeof(_UwLinePoller),
+    .compound        = false,
+    ._create         = _uw_default_create,
+    ._destroy        = _uw_default_destroy,
+    ._init           = poller_init,
+    ._fini           = poller_fini,
+    ._clone          = _uw_default_clone,
+    ._hash           = poller_hash,
+    ._deepcopy       = poller_deepcopy,
+    ._dump           = poller_dump,
+    ._to_string      = poller_to_string,
+    ._is_true        = poller_is_true,
+    ._equal_sametype = poller_equal_sametype,
+    ._equal          = poller_equal
+};
+
+[[ gnu::constructor ]]
+static void init_line_poller_type()
+{
+    UwTypeId_LinePoller = uw_add_type(&line_poller_type);
+}
+
+/****************************************************************
+ * LinePoller functions
+ */
+
+UwResult uw_line_poller_add(UwValuePtr poller_value, UwValuePtr file, UwLineHandler handler, void* context)
+{
+    _UwLinePoller* poller = get_data_ptr(poller_value);
+
+    UwValue fd_value = uw_file_get_fd(file);
+    if (uw_error(&fd_value)) {
+        return uw_move(&fd_value);
+    }
+    int fd = (int) fd_value.signed_value;
+
+    // find free slot
+    unsigned slot = 0;
+    if (poller->num_files == poller->capacity) {
+        unsigned new_capacity = poller->capacity? poller->capacity * 2 : LINE_POLLER_INITIAL_CAPACITY;
+        _UwPollerEntry* new_entries = realloc(poller->entries, new_capacity * sizeof(_UwPollerEntry));
+        if (!new_entries) {
+            return UwOOM();
+        }
+        for (unsigned i = poller->capacity; i < new_capacity; i++) {
+            new_entries[i].file = UwNull();
+            new_entries[i].line = UwNull();
+            new_entries[i].fd = -1;
+        }
+        slot = poller->capacity;
+        poller->entries = new_entries;
+        poller->capacity = new_capacity;
+    } else {
+        while (!uw_is_null(&poller->entries[slot].file)) {
+            slot++;
+        }
+    }
+
+    UwValue line = UwString();
+    if (uw_error(&line)) {
+        return uw_move(&line);
+    }
+    UwValue status = uw_file_set_nonblocking(file, true);
+    if (uw_error(&status)) {
+        return uw_move(&status);
+    }
+    struct epoll_event event = {
+        .events = EPOLLIN,
+        .data.u64 = make_epoll_data(slot, fd)
+    };
+    if (epoll_ctl(poller->epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        return UwErrno(errno);
+    }
+    _UwPollerEntry* entry = &poller->entries[slot];
+    entry->file    = uw_clone(file);
+    entry->line    = uw_move(&line);
+    entry->fd      = fd;
+    entry->handler = handler;
+    entry->context = context;
+    poller->num_files++;
+    return UwOK();
+}
+
+UwResult uw_line_poller_remove(UwValuePtr poller_value, UwValuePtr file)
+{
+    _UwLinePoller* poller = get_data_ptr(poller_value);
+
+    UwValue fd_value = uw_file_get_fd(file);
+    if (uw_error(&fd_value)) {
+        return uw_move(&fd_value);
+    }
+    int fd = (int) fd_value.signed_value;
+
+    for (unsigned i = 0; i < poller->capacity; i++) {
+        _UwPollerEntry* entry = &poller->entries[i];
+        if (entry->fd == fd && !uw_is_null(&entry->file)) {
+            free_entry(poller, i);
+            return UwOK();
+        }
+    }
+    return UwError(UW_ERROR_KEY_NOT_FOUND);
+}
+
+unsigned uw_line_poller_count(UwValuePtr poller)
+{
+    return get_data_ptr(poller)->num_files;
+}
+
+UwResult uw_line_poller_wait(UwValuePtr poller_value, int timeout)
+{
+    _UwLinePoller* poller = get_data_ptr(poller_value);
+
+    struct epoll_event events[LINE_POLLER_MAX_EVENTS];
+    int num_events;
+    do {
+        num_events = epoll_wait(poller->epoll_fd, events, LINE_POLLER_MAX_EVENTS, timeout);
+    } while (num_events == -1 && errno == EINTR);
+
+    if (num_events == -1) {
+        return UwErrno(errno);
+    }
+
+    unsigned num_lines = 0;
+    for (int i = 0; i < num_events; i++) {
+        unsigned slot = epoll_data_slot(events[i].data.u64);
+        int fd = epoll_data_fd(events[i].data.u64);
+
+        for (;;) {
+            // handlers may add or remove files, so get entry by slot on each iteration
+            _UwPollerEntry* entry = &poller->entries[slot];
+            if (entry->fd != fd || uw_is_null(&entry->file)) {
+                // removed by handler
+                break;
+            }
+            UwValue status = uw_read_line_inplace(&entry->file, &entry->line);
+            if (uw_would_block(&status)) {
+                break;
+            }
+            // handler may reallocate entries, keep file and line on the stack while it's running
+            UwValue file = uw_clone(&entry->file);
+            UwValue line = uw_move(&entry->line);
+            UwLineHandler handler = entry->handler;
+            void* context = entry->context;
+
+            bool done = uw_error(&status);
+            UwValue result = handler(&file, done? &status : &line, context);
+
+            entry = &poller->entries[slot];
+            bool alive = entry->fd == fd && !uw_is_null(&entry->file);
+            if (alive) {
+                if (done) {
+                    // end of file or error
+                    free_entry(poller, slot);
+                } else {
+                    entry->line = uw_move(&line);
+                }
+            }
+            if (!done) {
+                num_lines++;
+            }
+            if (uw_error(&result)) {
+                return uw_move(&result);
+            }
+            if (done || !alive) {
+                break;
+            }
+        }
+    }
+    return UwUnsigned(num_lines);
+}
+
+UwResult uw_line_poller_run(UwValuePtr poller)
+{
+    while (uw_line_poller_count(poller)) {
+        UwValue status = uw_line_poller_wait(poller, -1);
+        if (uw_error(&status)) {
+            return uw_move(&status);
+        }
+    }
+    return UwOK();
+}
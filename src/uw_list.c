@@ -1,7 +1,9 @@
 #include "include/uw.h"
+#include "src/uw_alloc_stats_internal.h"
 #include "src/uw_charptr_internal.h"
 #include "src/uw_list_internal.h"
 #include "src/uw_string_internal.h"
+#include "src/uw_trace_internal.h"
 
 #define get_data_ptr(value)  ((_UwList*) _uw_get_data_ptr((value), UwTypeId_List))
 
@@ -182,7 +184,7 @@ bool _uw_alloc_list(UwTypeId type_id, _UwList* list, unsigned capacity)
     list->capacity = round_capacity(capacity);
 
     unsigned memsize = list->capacity * sizeof(_UwValue);
-    list->items = _uw_types[type_id]->allocator->allocate(memsize, true);
+    list->items = _uw_allocate(_uw_types[type_id]->allocator, type_id, memsize, true);
 
     return list->items != nullptr;
 }
@@ -192,14 +194,10 @@ void _uw_destroy_list(UwTypeId type_id, _UwList* list, _UwCompoundData* parent_c
     if (list->items) {
         UwValuePtr item_ptr = list->items;
         for (unsigned n = list->length; n; n--, item_ptr++) {
-            if (_uw_types[item_ptr->type_id]->compound) {
-                _UwCompoundData* child_cdata = (_UwCompoundData*) item_ptr->extra_data;
-                _uw_abandon(parent_cdata, child_cdata);
-            }
-            uw_destroy(item_ptr);
+            _uw_destroy_child(parent_cdata, item_ptr);
         }
         unsigned memsize = list->capacity * sizeof(_UwValue);
-        _uw_types[type_id]->allocator->release((void**) &list->items, memsize);
+        _uw_release(_uw_types[type_id]->allocator, type_id, (void**) &list->items, memsize);
     }
 }
 
@@ -217,7 +215,8 @@ bool _uw_list_resize(UwTypeId type_id, _UwList* list, unsigned desired_capacity)
     unsigned old_memsize = list->capacity * sizeof(_UwValue);
     unsigned new_memsize = new_capacity * sizeof(_UwValue);
 
-    if (!allocator->reallocate((void**) &list->items, old_memsize, new_memsize, true, nullptr)) {
+    _uw_trace(list_resize, list, list->capacity, new_capacity, list->length);
+    if (!_uw_reallocate(allocator, type_id, (void**) &list->items, old_memsize, new_memsize, true)) {
         return false;
     }
     list->capacity = new_capacity;
@@ -227,6 +226,7 @@ bool _uw_list_resize(UwTypeId type_id, _UwList* list, unsigned desired_capacity)
 bool uw_list_resize(UwValuePtr list, unsigned desired_capacity)
 {
     uw_assert_list(list);
+    uw_assert_mutable(list);
     return _uw_list_resize(list->type_id, get_data_ptr(list), desired_capacity);
 }
 
@@ -261,6 +261,7 @@ bool _uw_list_append(UwValuePtr list, UwValuePtr item)
 // XXX this will be an interface method, _uwi_list_append
 {
     uw_assert_list(list);
+    uw_assert_mutable(list);
 
     UwValue v = uw_clone(item);
     if (uw_error(&v)) {
@@ -307,6 +308,7 @@ UwResult _uw_list_append_va(UwValuePtr list, ...)
 UwResult uw_list_append_ap(UwValuePtr dest, va_list ap)
 {
     uw_assert_list(dest);
+    uw_assert_mutable(dest);
 
     UwTypeId type_id = dest->type_id;
     _UwList* list = get_data_ptr(dest);
@@ -371,6 +373,7 @@ UwResult uw_list_item(UwValuePtr self, int index)
 UwResult uw_list_set_item(UwValuePtr self, int index, UwValuePtr item)
 {
     uw_assert_list(self);
+    uw_assert_mutable(self);
 
     _UwList* list = get_data_ptr(self);
 
@@ -383,14 +386,19 @@ UwResult uw_list_set_item(UwValuePtr self, int index, UwValuePtr item)
         return UwError(UW_ERROR_INDEX_OUT_OF_RANGE);
     }
 
-    uw_destroy(&list->items[index]);
-    list->items[index] = uw_clone(item);
+    UwValue new_item = uw_clone(item);
+    if (!_uw_embrace(self, &new_item)) {
+        return UwOOM();
+    }
+    _uw_destroy_child((_UwCompoundData*) self->extra_data, &list->items[index]);
+    list->items[index] = uw_move(&new_item);
     return UwOK();
 }
 
 UwResult uw_list_pop(UwValuePtr self)
 {
     uw_assert_list(self);
+    uw_assert_mutable(self);
     return _uw_list_pop(get_data_ptr(self));
 }
 
@@ -406,10 +414,11 @@ UwResult _uw_list_pop(_UwList* list)
 void uw_list_del(UwValuePtr self, unsigned start_index, unsigned end_index)
 {
     uw_assert_list(self);
-    _uw_list_del(get_data_ptr(self), start_index, end_index);
+    uw_assert_mutable(self);
+    _uw_list_del(get_data_ptr(self), start_index, end_index, (_UwCompoundData*) self->extra_data);
 }
 
-void _uw_list_del(_UwList* list, unsigned start_index, unsigned end_index)
+void _uw_list_del(_UwList* list, unsigned start_index, unsigned end_index, _UwCompoundData* parent_cdata)
 {
     if (list->length == 0) {
         return;
@@ -423,7 +432,7 @@ void _uw_list_del(_UwList* list, unsigned start_index, unsigned end_index)
 
     UwValuePtr item_ptr = &list->items[start_index];
     for (unsigned i = start_index; i < end_index; i++, item_ptr++) {
-        uw_destroy(item_ptr);
+        _uw_destroy_child(parent_cdata, item_ptr);
     }
     unsigned new_length = list->length - (end_index - start_index);
     unsigned tail_length = list->length - end_index;
@@ -617,6 +626,7 @@ bool uw_list_dedent(UwValuePtr lines)
     static char32_t indent_chars[] = {' ', '\t', 0};
 
     unsigned n = uw_list_length(lines);
+    uw_assert_mutable(lines);
 
     // dedent inplace, so access items directly to avoid cloning
     _UwList* list = get_data_ptr(lines);
@@ -58,7 +58,7 @@ bool _uw_list_resize(UwTypeId type_id, _UwList* list, unsigned desired_capacity)
 void _uw_destroy_list(UwTypeId type_id, _UwList* list, _UwCompoundData* parent_cdata);
 /*
  * Call destructor for all items and free the list items.
- * For compound values call _uw_abandon before the destructor.
+ * For compound items call _uw_destroy_child.
  */
 
 bool _uw_list_eq(_UwList* a, _UwList* b);
@@ -76,9 +76,10 @@ UwResult _uw_list_pop(_UwList* list);
  * Pop item from list.
  */
 
-void _uw_list_del(_UwList* list, unsigned start_index, unsigned end_index);
+void _uw_list_del(_UwList* list, unsigned start_index, unsigned end_index, _UwCompoundData* parent_cdata);
 /*
  * Delete items from list.
+ * For compound items call _uw_destroy_child.
  */
 
 #ifdef __cplusplus
@@ -0,0 +1,1223 @@
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "include/uw_lpm.h"
+#include "src/uw_list_internal.h"
+#include "src/uw_netutils_internal.h"
+
+/*
+ * Trie entry is one of:
+ *   zero:                 no match
+ *   odd number:           value id shifted left by one bit, plus one
+ *   even non-zero number: pointer to the node of the next level
+ */
+typedef _Atomic uintptr_t LpmEntry;
+
+#define LPM_NO_MATCH  ((uintptr_t) 0)
+
+#define lpm_is_node(entry)          ((entry) && !((entry) & 1))
+#define lpm_value_entry(value_id)   ((((uintptr_t) (value_id)) << 1) | 1)
+#define lpm_entry_value_id(entry)   ((uint32_t) ((entry) >> 1))
+
+#define LPM_ROOT_BITS   16
+#define LPM_NODE_BITS   8
+#define LPM_ROOT_SIZE   (1 << LPM_ROOT_BITS)
+#define LPM_NODE_SIZE   (1 << LPM_NODE_BITS)
+
+#define LPM_BATCH_SIZE  32
+
+// prefix length at the end of level
+#define lpm_level_end(level)  (LPM_ROOT_BITS + (level) * LPM_NODE_BITS)
+
+typedef struct {
+    LpmEntry entries[LPM_NODE_SIZE];
+    uint8_t prefix_len[LPM_NODE_SIZE];  // length of prefix the entry was set for, not used for node entries
+} LpmNode;
+
+/*
+ * Keys are 128-bit, IPv4 addresses take upper 32 bits.
+ */
+typedef IPv6address LpmKey;
+
+/*
+ * IPv6 trie has the same root and stride nodes, but routes are sparse:
+ * a few subnets under each allocation, diverging deep in the address.
+ * Plain multibit trie would need a node for each 8 bits of such subnet,
+ * so IPv6 trie has two more kinds of children:
+ *
+ *   - leaf holds a single subnet with no other subnets below it;
+ *   - compressed node skips levels that all subnets below it pass
+ *     the same way.
+ *
+ * Both check key against their prefix and give fallback entry if it
+ * does not match. Fallback is what the parent entry would be without
+ * the child. No subnet ends in the skipped bits, so fallback is updated
+ * only by subnets that cover the whole parent entry.
+ *
+ * Pointer to IPv6 child is 64-byte aligned and carries its kind,
+ * so the lookup can index the node without reading its header:
+ *   bit 1:    compressed node, key must be checked against prefix
+ *   bits 2-5: level of stride node, zero for leaf
+ */
+#define LPM6_TAG_MASK    ((uintptr_t) 63)
+#define LPM6_COMPRESSED  ((uintptr_t) 2)
+
+#define lpm6_child_ptr(entry)    ((void*) ((entry) & ~LPM6_TAG_MASK))
+#define lpm6_child_level(entry)  ((unsigned) ((entry) >> 2) & 15)
+
+#define lpm6_node_entry(node, level, compressed)  \
+    (((uintptr_t) (node)) | ((uintptr_t) (level) << 2) | ((compressed)? LPM6_COMPRESSED : 0))
+
+typedef struct {
+    alignas(64) LpmKey prefix;     // upper bits of keys that reach this node
+    LpmEntry fallback;             // entry for keys that do not match prefix
+    uint8_t fallback_prefix_len;
+    alignas(64) LpmEntry entries[LPM_NODE_SIZE];
+    uint8_t prefix_len[LPM_NODE_SIZE];
+} Lpm6Node;
+
+typedef struct {
+    alignas(64) LpmKey prefix;
+    LpmEntry value;                // entry for keys that match prefix
+    LpmEntry fallback;             // entry for other keys
+    uint8_t prefix_len;
+    uint8_t value_prefix_len;      // less than prefix_len when the subnet is deleted
+    uint8_t fallback_prefix_len;
+} Lpm6Leaf;
+
+typedef struct {
+    LpmEntry* root;
+    uint8_t* root_prefix_len;
+    unsigned num_nodes;
+    unsigned num_leaves;
+    void** retired;     // IPv6 children replaced by new ones, readers may still use them
+    unsigned num_retired;
+    unsigned retired_capacity;
+    unsigned prefix_len_count[129];  // number of subnets by prefix length
+    _UwValue routes;    // Map: subnet -> value id; subnet is Unsigned IPv4subnet or IPv6 value
+    _UwValue values;    // List: value id is index + 1
+    _UwValue free_ids;  // List of value ids to reuse
+} _UwLPM;
+
+// both LPM types have the same data structure and offset
+#define get_data_ptr(value)  ((_UwLPM*) _uw_get_data_ptr((value), (value)->type_id))
+
+static inline unsigned lpm_index(LpmKey* key, unsigned level)
+/*
+ * Get index of entry for the key at the given level.
+ * Strides are aligned so that no index spans both halves of key.
+ */
+{
+    if (level == 0) {
+        return key->hi >> (64 - LPM_ROOT_BITS);
+    }
+    unsigned end = lpm_level_end(level);
+    if (end <= 64) {
+        return (key->hi >> (64 - end)) & (LPM_NODE_SIZE - 1);
+    } else {
+        return (key->lo >> (128 - end)) & (LPM_NODE_SIZE - 1);
+    }
+}
+
+/****************************************************************
+ * Basic interface methods
+ */
+
+static UwResult lpm_init(UwValuePtr self, va_list ap)
+{
+    _UwLPM* lpm = get_data_ptr(self);
+
+    lpm->root = calloc(LPM_ROOT_SIZE, sizeof(LpmEntry));
+    lpm->root_prefix_len = calloc(LPM_ROOT_SIZE, sizeof(uint8_t));
+    if (!lpm->root || !lpm->root_prefix_len) {
+        return UwOOM();
+    }
+    lpm->routes = UwMap();
+    if (uw_error(&lpm->routes)) {
+        return uw_clone(&lpm->routes);
+    }
+    lpm->values = UwList();
+    if (uw_error(&lpm->values)) {
+        return uw_clone(&lpm->values);
+    }
+    lpm->free_ids = UwList();
+    if (uw_error(&lpm->free_ids)) {
+        return uw_clone(&lpm->free_ids);
+    }
+    return UwOK();
+}
+
+static void free_node(LpmNode* node)
+{
+    for (unsigned i = 0; i < LPM_NODE_SIZE; i++) {
+        uintptr_t entry = atomic_load_explicit(&node->entries[i], memory_order_relaxed);
+        if (lpm_is_node(entry)) {
+            free_node((LpmNode*) entry);
+        }
+    }
+    free(node);
+}
+
+static void lpm6_free_child(_UwLPM* lpm, uintptr_t entry)
+{
+    if (lpm6_child_level(entry) == 0) {
+        free(lpm6_child_ptr(entry));
+        lpm->num_leaves--;
+        return;
+    }
+    Lpm6Node* node = lpm6_child_ptr(entry);
+    for (unsigned i = 0; i < LPM_NODE_SIZE; i++) {
+        uintptr_t child = atomic_load_explicit(&node->entries[i], memory_order_relaxed);
+        if (lpm_is_node(child)) {
+            lpm6_free_child(lpm, child);
+        }
+    }
+    free(node);
+    lpm->num_nodes--;
+}
+
+static void lpm_fini(UwValuePtr self)
+{
+    _UwLPM* lpm = get_data_ptr(self);
+    if (lpm->root) {
+        for (unsigned i = 0; i < LPM_ROOT_SIZE; i++) {
+            uintptr_t entry = atomic_load_explicit(&lpm->root[i], memory_order_relaxed);
+            if (lpm_is_node(entry)) {
+                if (self->type_id == UwTypeId_IPv6LPM) {
+                    lpm6_free_child(lpm, entry);
+                } else {
+                    free_node((LpmNode*) entry);
+                }
+            }
+        }
+        free(lpm->root);
+        lpm->root = nullptr;
+    }
+    // retired children share their descendants with live ones, free them alone
+    for (unsigned i = 0; i < lpm->num_retired; i++) {
+        free(lpm->retired[i]);
+    }
+    free(lpm->retired);
+    lpm->retired = nullptr;
+    free(lpm->root_prefix_len);
+    lpm->root_prefix_len = nullptr;
+    uw_destroy(&lpm->routes);
+    uw_destroy(&lpm->values);
+    uw_destroy(&lpm->free_ids);
+}
+
+static void lpm_hash(UwValuePtr self, UwHashContext* ctx)
+{
+    _uw_hash_uint64(ctx, self->type_id);
+    _uw_hash_uint64(ctx, (uint64_t) get_data_ptr(self));
+}
+
+static UwResult lpm_deepcopy(UwValuePtr self)
+{
+    return UwError(UW_ERROR_NOT_IMPLEMENTED);
+}
+
+static void lpm_dump(UwValuePtr self, FILE* fp, int first_indent, int next_indent, _UwCompoundChain* tail)
+{
+    _UwLPM* lpm = get_data_ptr(self);
+
+    _uw_dump_start(fp, self, first_indent);
+    _uw_dump_base_extra_data(fp, self->extra_data);
+    fprintf(fp, " subnets: %u, trie nodes: %u, leaves: %u\n",
+            uw_map_length(&lpm->routes), lpm->num_nodes, lpm->num_leaves);
+}
+
+static UwResult lpm_to_string(UwValuePtr self)
+{
+    return UwError(UW_ERROR_NOT_IMPLEMENTED);
+}
+
+static bool lpm_is_true(UwValuePtr self)
+{
+    return uw_map_length(&get_data_ptr(self)->routes);
+}
+
+static bool lpm_equal_sametype(UwValuePtr self, UwValuePtr other)
+{
+    return get_data_ptr(self) == get_data_ptr(other);
+}
+
+static bool lpm_equal(UwValuePtr self, UwValuePtr other)
+{
+    return self->type_id == other->type_id && lpm_equal_sametype(self, other);
+}
+
+/****************************************************************
+ * IPv4LPM and IPv6LPM types
+ */
+
+UwTypeId UwTypeId_IPv4LPM = 0;
+UwTypeId UwTypeId_IPv6LPM = 0;
+
+static UwType ipv4_lpm_type = {
+    .id              = 0,
+    .ancestor_id     = UwTypeId_Null,  // no ancestor
+    .name            = "IPv4LPM",
+    .allocator       = &default_allocator,
+    .data_offset     = sizeof(_UwExtraData),
+    .data_size       = sizeof(_UwLPM),
+    .compound        = false,
+    ._create         = _uw_default_create,
+    ._destroy        = _uw_default_destroy,
+    ._init           = lpm_init,
+    ._fini           = lpm_fini,
+    ._clone          = _uw_default_clone,
+    ._hash           = lpm_hash,
+    ._deepcopy       = lpm_deepcopy,
+    ._dump           = lpm_dump,
+    ._to_string      = lpm_to_string,
+    ._is_true        = lpm_is_true,
+    ._equal_sametype = lpm_equal_sametype,
+    ._equal          = lpm_equal
+};
+
+static UwType ipv6_lpm_type = {
+    .id              = 0,
+    .ancestor_id     = UwTypeId_Null,  // no ancestor
+    .name            = "IPv6LPM",
+    .allocator       = &default_allocator,
+    .data_offset     = sizeof(_UwExtraData),
+    .data_size       = sizeof(_UwLPM),
+    .compound        = false,
+    ._create         = _uw_default_create,
+    ._destroy        = _uw_default_destroy,
+    ._init           = lpm_init,
+    ._fini           = lpm_fini,
+    ._clone          = _uw_default_clone,
+    ._hash           = lpm_hash,
+    ._deepcopy       = lpm_deepcopy,
+    ._dump           = lpm_dump,
+    ._to_string      = lpm_to_string,
+    ._is_true        = lpm_is_true,
+    ._equal_sametype = lpm_equal_sametype,
+    ._equal          = lpm_equal
+};
+
+[[ gnu::constructor ]]
+static void init_lpm_types()
+{
+    UwTypeId_IPv4LPM = uw_add_type(&ipv4_lpm_type);
+    UwTypeId_IPv6LPM = uw_add_type(&ipv6_lpm_type);
+}
+
+/****************************************************************
+ * Trie updates
+ */
+
+static void set_entry(LpmEntry* entry, uint8_t* entry_prefix_len,
+                      unsigned prefix_len, uintptr_t new_entry, uint8_t new_prefix_len, bool deleting)
+/*
+ * When inserting, replace entry set for the same or shorter prefix.
+ * When deleting, replace entry set for the prefix being deleted with the covering one.
+ */
+{
+    if (deleting? (*entry_prefix_len == prefix_len) : (*entry_prefix_len <= prefix_len)) {
+        atomic_store_explicit(entry, new_entry, memory_order_release);
+        *entry_prefix_len = new_prefix_len;
+    }
+}
+
+static void fill_node(LpmNode* node, unsigned prefix_len, uintptr_t new_entry, uint8_t new_prefix_len, bool deleting)
+/*
+ * Update all entries of the node and its descendants.
+ */
+{
+    for (unsigned i = 0; i < LPM_NODE_SIZE; i++) {
+        uintptr_t entry = atomic_load_explicit(&node->entries[i], memory_order_relaxed);
+        if (lpm_is_node(entry)) {
+            fill_node((LpmNode*) entry, prefix_len, new_entry, new_prefix_len, deleting);
+        } else {
+            set_entry(&node->entries[i], &node->prefix_len[i], prefix_len, new_entry, new_prefix_len, deleting);
+        }
+    }
+}
+
+static bool update_level(_UwLPM* lpm, LpmEntry* entries, uint8_t* prefix_lens, unsigned level,
+                         LpmKey* key, unsigned prefix_len, uintptr_t new_entry, uint8_t new_prefix_len,
+                         bool deleting)
+{
+    unsigned index = lpm_index(key, level);
+
+    if (prefix_len > lpm_level_end(level)) {
+        // prefix ends in a deeper level
+        uintptr_t entry = atomic_load_explicit(&entries[index], memory_order_relaxed);
+        LpmNode* node;
+        if (lpm_is_node(entry)) {
+            node = (LpmNode*) entry;
+        } else if (deleting) {
+            return true;
+        } else {
+            // expand entry into new node and publish it when it's filled
+            node = malloc(sizeof(LpmNode));
+            if (!node) {
+                return false;
+            }
+            for (unsigned i = 0; i < LPM_NODE_SIZE; i++) {
+                atomic_init(&node->entries[i], entry);
+                node->prefix_len[i] = prefix_lens[index];
+            }
+            atomic_store_explicit(&entries[index], (uintptr_t) node, memory_order_release);
+            lpm->num_nodes++;
+        }
+        return update_level(lpm, node->entries, node->prefix_len, level + 1,
+                            key, prefix_len, new_entry, new_prefix_len, deleting);
+    }
+
+    // prefix covers a range of entries at this level
+    unsigned span = 1U << (lpm_level_end(level) - prefix_len);
+    index &= ~(span - 1);
+    for (unsigned i = index; i < index + span; i++) {
+        uintptr_t entry = atomic_load_explicit(&entries[i], memory_order_relaxed);
+        if (lpm_is_node(entry)) {
+            fill_node((LpmNode*) entry, prefix_len, new_entry, new_prefix_len, deleting);
+        } else {
+            set_entry(&entries[i], &prefix_lens[i], prefix_len, new_entry, new_prefix_len, deleting);
+        }
+    }
+    return true;
+}
+
+/****************************************************************
+ * IPv6 trie
+ */
+
+static inline bool lpm_key_match(LpmKey* key, LpmKey* prefix, unsigned prefix_len)
+/*
+ * Check if upper prefix_len bits of key and prefix are equal.
+ */
+{
+    uint64_t hi = key->hi ^ prefix->hi;
+    if (prefix_len <= 64) {
+        return prefix_len == 0 || (hi >> (64 - prefix_len)) == 0;
+    }
+    return hi == 0 && ((key->lo ^ prefix->lo) >> (128 - prefix_len)) == 0;
+}
+
+static unsigned lpm_common_bits(LpmKey* a, LpmKey* b)
+{
+    uint64_t diff = a->hi ^ b->hi;
+    if (diff) {
+        return __builtin_clzll(diff);
+    }
+    diff = a->lo ^ b->lo;
+    if (diff) {
+        return 64 + __builtin_clzll(diff);
+    }
+    return 128;
+}
+
+static inline uintptr_t lpm6_step(uintptr_t entry, LpmKey* key)
+/*
+ * Get next entry for the key from the child the entry points to.
+ */
+{
+    unsigned level = lpm6_child_level(entry);
+    if (level == 0) {
+        Lpm6Leaf* leaf = lpm6_child_ptr(entry);
+        if (lpm_key_match(key, &leaf->prefix, leaf->prefix_len)) {
+            return atomic_load_explicit(&leaf->value, memory_order_acquire);
+        } else {
+            return atomic_load_explicit(&leaf->fallback, memory_order_acquire);
+        }
+    }
+    Lpm6Node* node = lpm6_child_ptr(entry);
+    if ((entry & LPM6_COMPRESSED) && !lpm_key_match(key, &node->prefix, lpm_level_end(level - 1))) {
+        return atomic_load_explicit(&node->fallback, memory_order_acquire);
+    }
+    return atomic_load_explicit(&node->entries[lpm_index(key, level)], memory_order_acquire);
+}
+
+static uintptr_t lpm6_find_checked(_UwLPM* lpm, LpmKey* key)
+{
+    uintptr_t entry = atomic_load_explicit(&lpm->root[lpm_index(key, 0)], memory_order_acquire);
+    while (lpm_is_node(entry)) {
+        entry = lpm6_step(entry, key);
+    }
+    return entry;
+}
+
+static inline uintptr_t lpm6_descend(uintptr_t entry, LpmKey* key, uintptr_t* unchecked)
+/*
+ * Same as lpm6_step, but do not check prefixes of compressed nodes,
+ * this saves reading their headers. Set `unchecked` if the result
+ * depends on skipped checks.
+ *
+ * Leaf prefix includes prefixes of all nodes above the leaf,
+ * so a matching leaf proves the path.
+ */
+{
+    unsigned level = lpm6_child_level(entry);
+    if (level == 0) {
+        Lpm6Leaf* leaf = lpm6_child_ptr(entry);
+        if (lpm_key_match(key, &leaf->prefix, leaf->prefix_len)) {
+            *unchecked = 0;
+            return atomic_load_explicit(&leaf->value, memory_order_acquire);
+        } else {
+            return atomic_load_explicit(&leaf->fallback, memory_order_acquire);
+        }
+    }
+    *unchecked |= entry & LPM6_COMPRESSED;
+    Lpm6Node* node = lpm6_child_ptr(entry);
+    return atomic_load_explicit(&node->entries[lpm_index(key, level)], memory_order_acquire);
+}
+
+static inline void lpm6_prefetch(uintptr_t entry, LpmKey* key)
+/*
+ * Prefetch what lpm6_descend reads.
+ */
+{
+    unsigned level = lpm6_child_level(entry);
+    if (level == 0) {
+        __builtin_prefetch(lpm6_child_ptr(entry));
+    } else {
+        __builtin_prefetch(&((Lpm6Node*) lpm6_child_ptr(entry))->entries[lpm_index(key, level)]);
+    }
+}
+
+static inline uintptr_t lpm6_find(_UwLPM* lpm, LpmKey* key)
+{
+    uintptr_t unchecked = 0;
+    uintptr_t entry = atomic_load_explicit(&lpm->root[lpm_index(key, 0)], memory_order_acquire);
+    while (lpm_is_node(entry)) {
+        entry = lpm6_descend(entry, key, &unchecked);
+    }
+    if (unchecked) {
+        // the path is in cache now, walk it again with checks
+        return lpm6_find_checked(lpm, key);
+    }
+    return entry;
+}
+
+static Lpm6Node* lpm6_new_node(_UwLPM* lpm, LpmKey* key, unsigned level, uintptr_t entry, uint8_t prefix_len)
+/*
+ * Create stride node with all entries and fallback set to the given one.
+ */
+{
+    Lpm6Node* node = aligned_alloc(alignof(Lpm6Node), sizeof(Lpm6Node));
+    if (!node) {
+        return nullptr;
+    }
+    node->prefix = *key;
+    _uw_clear_ipv6_host_bits(&node->prefix, lpm_level_end(level - 1));
+    atomic_init(&node->fallback, entry);
+    node->fallback_prefix_len = prefix_len;
+    for (unsigned i = 0; i < LPM_NODE_SIZE; i++) {
+        atomic_init(&node->entries[i], entry);
+        node->prefix_len[i] = prefix_len;
+    }
+    lpm->num_nodes++;
+    return node;
+}
+
+static bool lpm6_reserve_retired(_UwLPM* lpm)
+/*
+ * Make sure one more child can be retired without allocating memory.
+ */
+{
+    if (lpm->num_retired < lpm->retired_capacity) {
+        return true;
+    }
+    unsigned new_capacity = lpm->retired_capacity? lpm->retired_capacity * 2 : 64;
+    void** retired = realloc(lpm->retired, new_capacity * sizeof(void*));
+    if (!retired) {
+        return false;
+    }
+    lpm->retired = retired;
+    lpm->retired_capacity = new_capacity;
+    return true;
+}
+
+static void lpm6_retire(_UwLPM* lpm, uintptr_t entry)
+{
+    uw_assert(lpm->num_retired < lpm->retired_capacity);
+    lpm->retired[lpm->num_retired++] = lpm6_child_ptr(entry);
+    if (lpm6_child_level(entry) == 0) {
+        lpm->num_leaves--;
+    } else {
+        lpm->num_nodes--;
+    }
+}
+
+static void lpm6_fill_child(uintptr_t entry, unsigned prefix_len, uintptr_t new_entry, uint8_t new_prefix_len, bool deleting)
+/*
+ * Update all entries of the child and its descendants.
+ */
+{
+    if (lpm6_child_level(entry) == 0) {
+        Lpm6Leaf* leaf = lpm6_child_ptr(entry);
+        set_entry(&leaf->value, &leaf->value_prefix_len, prefix_len, new_entry, new_prefix_len, deleting);
+        set_entry(&leaf->fallback, &leaf->fallback_prefix_len, prefix_len, new_entry, new_prefix_len, deleting);
+        return;
+    }
+    Lpm6Node* node = lpm6_child_ptr(entry);
+    set_entry(&node->fallback, &node->fallback_prefix_len, prefix_len, new_entry, new_prefix_len, deleting);
+    for (unsigned i = 0; i < LPM_NODE_SIZE; i++) {
+        uintptr_t child = atomic_load_explicit(&node->entries[i], memory_order_relaxed);
+        if (lpm_is_node(child)) {
+            lpm6_fill_child(child, prefix_len, new_entry, new_prefix_len, deleting);
+        } else {
+            set_entry(&node->entries[i], &node->prefix_len[i], prefix_len, new_entry, new_prefix_len, deleting);
+        }
+    }
+}
+
+static bool lpm6_update_child(_UwLPM* lpm, LpmEntry* slot, uint8_t* slot_prefix_len, unsigned level,
+                              LpmKey* key, unsigned prefix_len, uintptr_t new_entry, uint8_t new_prefix_len,
+                              bool deleting);
+
+static bool lpm6_update_level(_UwLPM* lpm, LpmEntry* entries, uint8_t* prefix_lens, unsigned level,
+                              LpmKey* key, unsigned prefix_len, uintptr_t new_entry, uint8_t new_prefix_len,
+                              bool deleting)
+{
+    unsigned index = lpm_index(key, level);
+
+    if (prefix_len > lpm_level_end(level)) {
+        // prefix ends below this level
+        return lpm6_update_child(lpm, &entries[index], &prefix_lens[index], level,
+                                 key, prefix_len, new_entry, new_prefix_len, deleting);
+    }
+
+    // prefix covers a range of entries at this level
+    unsigned span = 1U << (lpm_level_end(level) - prefix_len);
+    index &= ~(span - 1);
+    for (unsigned i = index; i < index + span; i++) {
+        uintptr_t entry = atomic_load_explicit(&entries[i], memory_order_relaxed);
+        if (lpm_is_node(entry)) {
+            lpm6_fill_child(entry, prefix_len, new_entry, new_prefix_len, deleting);
+        } else {
+            set_entry(&entries[i], &prefix_lens[i], prefix_len, new_entry, new_prefix_len, deleting);
+        }
+    }
+    return true;
+}
+
+static bool lpm6_split(_UwLPM* lpm, LpmEntry* slot, unsigned level, uintptr_t child,
+                       LpmKey* child_prefix, unsigned child_start,
+                       LpmKey* key, unsigned prefix_len, uintptr_t new_entry, uint8_t new_prefix_len)
+/*
+ * Insert stride node between the slot and its leaf or compressed child
+ * at the deepest level that leaves both the child and the new subnet below it.
+ * New node and its new descendants are published at once with a single store.
+ */
+{
+    unsigned limit = lpm_common_bits(key, child_prefix);
+    if (limit > prefix_len - 1) {
+        limit = prefix_len - 1;
+    }
+    if (limit > child_start - 1) {
+        limit = child_start - 1;
+    }
+    unsigned node_level = level + 1 + (limit - lpm_level_end(level)) / LPM_NODE_BITS;
+    bool compressed = node_level > level + 1;
+
+    if (!lpm6_reserve_retired(lpm)) {
+        return false;
+    }
+
+    if (lpm6_child_level(child) == 0) {
+        // move the subnet of the leaf to the new node, unless it was deleted
+        Lpm6Leaf* leaf = lpm6_child_ptr(child);
+        Lpm6Node* node = lpm6_new_node(lpm, key, node_level,
+                                       atomic_load_explicit(&leaf->fallback, memory_order_relaxed),
+                                       leaf->fallback_prefix_len);
+        if (!node) {
+            return false;
+        }
+        uintptr_t node_entry = lpm6_node_entry(node, node_level, compressed);
+        if ((leaf->value_prefix_len == leaf->prefix_len
+             && !lpm6_update_level(lpm, node->entries, node->prefix_len, node_level,
+                                   &leaf->prefix, leaf->prefix_len,
+                                   atomic_load_explicit(&leaf->value, memory_order_relaxed),
+                                   leaf->value_prefix_len, false))
+            || !lpm6_update_level(lpm, node->entries, node->prefix_len, node_level,
+                                  key, prefix_len, new_entry, new_prefix_len, false)) {
+            // the node has no descendants other than new ones
+            lpm6_free_child(lpm, node_entry);
+            return false;
+        }
+        atomic_store_explicit(slot, node_entry, memory_order_release);
+        lpm6_retire(lpm, child);
+        return true;
+    }
+
+    Lpm6Node* child_node = lpm6_child_ptr(child);
+    unsigned child_level = lpm6_child_level(child);
+    Lpm6Node* node = lpm6_new_node(lpm, key, node_level,
+                                   atomic_load_explicit(&child_node->fallback, memory_order_relaxed),
+                                   child_node->fallback_prefix_len);
+    if (!node) {
+        return false;
+    }
+    uintptr_t node_entry = lpm6_node_entry(node, node_level, compressed);
+    unsigned index = lpm_index(child_prefix, node_level);
+
+    if (prefix_len > lpm_level_end(node_level) || !lpm_key_match(child_prefix, key, prefix_len)) {
+        // the new subnet goes aside of the child
+        if (!lpm6_update_level(lpm, node->entries, node->prefix_len, node_level,
+                               key, prefix_len, new_entry, new_prefix_len, false)) {
+            lpm6_free_child(lpm, node_entry);
+            return false;
+        }
+        atomic_init(&node->entries[index],
+                    lpm6_node_entry(child_node, child_level, child_start > lpm_level_end(node_level)));
+        atomic_store_explicit(slot, node_entry, memory_order_release);
+        return true;
+    }
+
+    // The new subnet covers the child and becomes its fallback.
+    // Readers that reach the child via the slot still need the old one,
+    // so the child is replaced with a copy. Descendants are shared.
+    Lpm6Node* copy = aligned_alloc(alignof(Lpm6Node), sizeof(Lpm6Node));
+    if (!copy) {
+        free(node);
+        lpm->num_nodes--;
+        return false;
+    }
+    copy->prefix = child_node->prefix;
+    atomic_init(&copy->fallback, atomic_load_explicit(&child_node->fallback, memory_order_relaxed));
+    copy->fallback_prefix_len = child_node->fallback_prefix_len;
+    for (unsigned i = 0; i < LPM_NODE_SIZE; i++) {
+        atomic_init(&copy->entries[i], atomic_load_explicit(&child_node->entries[i], memory_order_relaxed));
+        copy->prefix_len[i] = child_node->prefix_len[i];
+    }
+    lpm->num_nodes++;
+    atomic_init(&node->entries[index],
+                lpm6_node_entry(copy, child_level, child_start > lpm_level_end(node_level)));
+
+    // the subnet ends in the new node, this does not allocate
+    bool updated = lpm6_update_level(lpm, node->entries, node->prefix_len, node_level,
+                                     key, prefix_len, new_entry, new_prefix_len, false);
+    uw_assert(updated);
+
+    atomic_store_explicit(slot, node_entry, memory_order_release);
+    lpm6_retire(lpm, child);
+    return true;
+}
+
+static bool lpm6_update_child(_UwLPM* lpm, LpmEntry* slot, uint8_t* slot_prefix_len, unsigned level,
+                              LpmKey* key, unsigned prefix_len, uintptr_t new_entry, uint8_t new_prefix_len,
+                              bool deleting)
+/*
+ * Update subnet that ends below the slot of stride node at `level`.
+ */
+{
+    uintptr_t entry = atomic_load_explicit(slot, memory_order_relaxed);
+    if (!lpm_is_node(entry)) {
+        if (deleting) {
+            return true;
+        }
+        // first subnet below the slot
+        Lpm6Leaf* leaf = aligned_alloc(alignof(Lpm6Leaf), sizeof(Lpm6Leaf));
+        if (!leaf) {
+            return false;
+        }
+        leaf->prefix = *key;
+        leaf->prefix_len = prefix_len;
+        atomic_init(&leaf->value, new_entry);
+        leaf->value_prefix_len = new_prefix_len;
+        atomic_init(&leaf->fallback, entry);
+        leaf->fallback_prefix_len = *slot_prefix_len;
+        atomic_store_explicit(slot, (uintptr_t) leaf, memory_order_release);
+        lpm->num_leaves++;
+        return true;
+    }
+
+    LpmKey* child_prefix;
+    unsigned child_start;
+    unsigned child_level = lpm6_child_level(entry);
+    if (child_level == 0) {
+        Lpm6Leaf* leaf = lpm6_child_ptr(entry);
+        if (leaf->prefix_len == prefix_len && lpm_key_match(key, &leaf->prefix, prefix_len)) {
+            set_entry(&leaf->value, &leaf->value_prefix_len, prefix_len, new_entry, new_prefix_len, deleting);
+            return true;
+        }
+        child_prefix = &leaf->prefix;
+        child_start = leaf->prefix_len;
+    } else {
+        Lpm6Node* node = lpm6_child_ptr(entry);
+        child_prefix = &node->prefix;
+        child_start = lpm_level_end(child_level - 1);
+        if (prefix_len > child_start && lpm_key_match(key, child_prefix, child_start)) {
+            return lpm6_update_level(lpm, node->entries, node->prefix_len, child_level,
+                                     key, prefix_len, new_entry, new_prefix_len, deleting);
+        }
+    }
+    if (deleting) {
+        // subnets are never deleted from the skipped bits because none end there
+        return true;
+    }
+    return lpm6_split(lpm, slot, level, entry, child_prefix, child_start,
+                      key, prefix_len, new_entry, new_prefix_len);
+}
+
+/****************************************************************
+ * Functions common for both address families
+ */
+
+typedef struct {
+    UwResult (*make_route_key)(LpmKey* key, unsigned prefix_len);
+    void (*shorten_route_key)(UwValuePtr route_key, unsigned prefix_len);
+    bool (*update)(_UwLPM* lpm, LpmKey* key, unsigned prefix_len,
+                   uintptr_t new_entry, uint8_t new_prefix_len, bool deleting);
+} LpmFamily;
+
+static bool reserve_free_id(_UwLPM* lpm)
+/*
+ * Make sure one more value id can be released without allocating memory.
+ */
+{
+    _UwList* free_ids = _uw_get_data_ptr(&lpm->free_ids, UwTypeId_List);
+    if (_uw_list_length(free_ids) < _uw_list_capacity(free_ids)) {
+        return true;
+    }
+    return uw_list_resize(&lpm->free_ids, _uw_list_capacity(free_ids) + 1);
+}
+
+static void release_value_id(_UwLPM* lpm, UwValuePtr value_id)
+/*
+ * Drop the value and put its id to the list of free ones.
+ * The caller must reserve space with reserve_free_id.
+ */
+{
+    UwValue null = UwNull();
+    UwValue status = uw_list_set_item(&lpm->values, (int) value_id->unsigned_value - 1, &null);
+    uw_assert(uw_ok(&status));
+    bool appended = uw_list_append(&lpm->free_ids, value_id);
+    uw_assert(appended);
+}
+
+static UwResult lpm_insert(UwValuePtr self, LpmKey* key, unsigned prefix_len,
+                           LpmFamily* family, UwValuePtr value)
+{
+    _UwLPM* lpm = get_data_ptr(self);
+
+    UwValue route_key = family->make_route_key(key, prefix_len);
+    if (uw_error(&route_key)) {
+        return uw_move(&route_key);
+    }
+    UwValue existing_id = uw_map_get(&lpm->routes, &route_key);
+    if (uw_ok(&existing_id)) {
+        // replace value, trie remains the same
+        return uw_list_set_item(&lpm->values, (int) existing_id.unsigned_value - 1, value);
+    }
+    if (!reserve_free_id(lpm)) {
+        return UwOOM();
+    }
+
+    // allocate value id
+    UwValue id_value = UwNull();
+    if (uw_list_length(&lpm->free_ids)) {
+        id_value = uw_list_pop(&lpm->free_ids);
+        UwValue status = uw_list_set_item(&lpm->values, (int) id_value.unsigned_value - 1, value);
+        if (uw_error(&status)) {
+            // cannot fail, the id was just popped
+            bool restored = uw_list_append(&lpm->free_ids, &id_value);
+            uw_assert(restored);
+            return uw_move(&status);
+        }
+    } else {
+        if (uw_list_length(&lpm->values) == UINT32_MAX - 1) {
+            return UwOOM();
+        }
+        if (!uw_list_append(&lpm->values, value)) {
+            return UwOOM();
+        }
+        id_value = UwUnsigned(uw_list_length(&lpm->values));
+    }
+    uint32_t value_id = (uint32_t) id_value.unsigned_value;
+
+    if (!uw_map_update(&lpm->routes, &route_key, &id_value)) {
+        release_value_id(lpm, &id_value);
+        return UwOOM();
+    }
+    // trie update allocates nodes before changing any entry,
+    // so on failure lookups still give the same results as before
+    if (!family->update(lpm, key, prefix_len, lpm_value_entry(value_id), prefix_len, false)) {
+        uw_map_del(&lpm->routes, &route_key);
+        release_value_id(lpm, &id_value);
+        return UwOOM();
+    }
+    lpm->prefix_len_count[prefix_len]++;
+    return UwOK();
+}
+
+static UwResult lpm_delete(UwValuePtr self, LpmKey* key, unsigned prefix_len, LpmFamily* family)
+{
+    _UwLPM* lpm = get_data_ptr(self);
+
+    UwValue route_key = family->make_route_key(key, prefix_len);
+    if (uw_error(&route_key)) {
+        return uw_move(&route_key);
+    }
+    UwValue value_id = uw_map_get(&lpm->routes, &route_key);
+    if (uw_error(&value_id)) {
+        return uw_move(&value_id);
+    }
+    if (!reserve_free_id(lpm)) {
+        return UwOOM();
+    }
+
+    // find the longest covering subnet to replace entries with,
+    // checking only prefix lengths the table has subnets of
+    UwValue cover_key = family->make_route_key(key, prefix_len);
+    if (uw_error(&cover_key)) {
+        return uw_move(&cover_key);
+    }
+    uintptr_t cover_entry = LPM_NO_MATCH;
+    unsigned cover_prefix_len = 0;
+    for (int len = (int) prefix_len - 1; len >= 0; len--) {
+        if (!lpm->prefix_len_count[len]) {
+            continue;
+        }
+        family->shorten_route_key(&cover_key, len);
+        UwValue cover_id = uw_map_get(&lpm->routes, &cover_key);
+        if (uw_ok(&cover_id)) {
+            cover_entry = lpm_value_entry(cover_id.unsigned_value);
+            cover_prefix_len = len;
+            break;
+        }
+    }
+    // deleting never allocates nodes
+    bool updated = family->update(lpm, key, prefix_len, cover_entry, cover_prefix_len, true);
+    uw_assert(updated);
+
+    release_value_id(lpm, &value_id);
+    uw_map_del(&lpm->routes, &route_key);
+    lpm->prefix_len_count[prefix_len]--;
+    return UwOK();
+}
+
+typedef UwResult (*LpmInsert)(UwValuePtr self, UwValuePtr subnet, UwValuePtr value);
+
+static UwResult lpm_insert_list(UwValuePtr self, UwValuePtr subnets, UwValuePtr values, LpmInsert insert)
+{
+    uw_assert_list(subnets);
+    uw_assert_list(values);
+
+    unsigned n = uw_list_length(subnets);
+    if (uw_list_length(values) != n) {
+        UwValue error = UwError(UW_ERROR_INCOMPATIBLE_TYPE);
+        _uw_set_status_desc(&error, "Lists of subnets and values have different length");
+        return uw_move(&error);
+    }
+    for (unsigned i = 0; i < n; i++) {
+        UwValue subnet = uw_list_item(subnets, i);
+        UwValue value = uw_list_item(values, i);
+        UwValue status = insert(self, &subnet, &value);
+        if (uw_error(&status)) {
+            return uw_move(&status);
+        }
+    }
+    return UwOK();
+}
+
+static UwResult lpm_value(UwValuePtr self, uint32_t value_id)
+{
+    _UwLPM* lpm = get_data_ptr(self);
+
+    if (value_id == 0 || value_id > uw_list_length(&lpm->values)) {
+        return UwError(UW_ERROR_KEY_NOT_FOUND);
+    }
+    return uw_list_item(&lpm->values, (int) value_id - 1);
+}
+
+/****************************************************************
+ * IPv4LPM functions
+ */
+
+static UwResult make_ipv4_route_key(LpmKey* key, unsigned prefix_len)
+{
+    IPv4subnet subnet;
+    subnet.netmask = prefix_len? 0xFFFFFFFF << (32 - prefix_len) : 0;
+    subnet.subnet = (uint32_t) (key->hi >> 32) & subnet.netmask;
+    return UwUnsigned(subnet.value);
+}
+
+static void shorten_ipv4_route_key(UwValuePtr route_key, unsigned prefix_len)
+{
+    IPv4subnet subnet = { .value = route_key->unsigned_value };
+    LpmKey key = { .hi = ((uint64_t) subnet.subnet) << 32 };
+    *route_key = make_ipv4_route_key(&key, prefix_len);
+}
+
+static bool update_ipv4_trie(_UwLPM* lpm, LpmKey* key, unsigned prefix_len,
+                             uintptr_t new_entry, uint8_t new_prefix_len, bool deleting)
+{
+    return update_level(lpm, lpm->root, lpm->root_prefix_len, 0,
+                        key, prefix_len, new_entry, new_prefix_len, deleting);
+}
+
+static LpmFamily ipv4_family = {
+    .make_route_key    = make_ipv4_route_key,
+    .shorten_route_key = shorten_ipv4_route_key,
+    .update            = update_ipv4_trie
+};
+
+static UwResult normalize_ipv4_subnet(UwValuePtr subnet, LpmKey* key, unsigned* prefix_len)
+{
+    UwValue parsed = UwNull();
+    if (uw_is_string(subnet)) {
+        UwValue no_netmask = UwNull();
+        parsed = uw_parse_ipv4_subnet(subnet, &no_netmask);
+        if (uw_error(&parsed)) {
+            return uw_move(&parsed);
+        }
+        subnet = &parsed;
+    }
+    if (!uw_is_unsigned(subnet)) {
+        return UwError(UW_ERROR_INCOMPATIBLE_TYPE);
+    }
+    IPv4subnet ipv4_subnet = { .value = subnet->unsigned_value };
+
+    // netmask must be contiguous, i.e. inverted netmask must be 2^n - 1
+    uint32_t hostmask = ~ipv4_subnet.netmask;
+    if (hostmask & (hostmask + 1)) {
+        UwValue error = UwError(UW_ERROR_BAD_NETMASK);
+        _uw_set_status_desc(&error, "Netmask %08x is not contiguous", ipv4_subnet.netmask);
+        return uw_move(&error);
+    }
+    key->hi = ((uint64_t) (ipv4_subnet.subnet & ipv4_subnet.netmask)) << 32;
+    key->lo = 0;
+    *prefix_len = __builtin_popcount(ipv4_subnet.netmask);
+    return UwOK();
+}
+
+UwResult uw_ipv4_lpm_insert(UwValuePtr self, UwValuePtr subnet, UwValuePtr value)
+{
+    LpmKey key;
+    unsigned prefix_len;
+    UwValue status = normalize_ipv4_subnet(subnet, &key, &prefix_len);
+    if (uw_error(&status)) {
+        return uw_move(&status);
+    }
+    return lpm_insert(self, &key, prefix_len, &ipv4_family, value);
+}
+
+UwResult uw_ipv4_lpm_insert_list(UwValuePtr self, UwValuePtr subnets, UwValuePtr values)
+{
+    return lpm_insert_list(self, subnets, values, uw_ipv4_lpm_insert);
+}
+
+UwResult uw_ipv4_lpm_delete(UwValuePtr self, UwValuePtr subnet)
+{
+    LpmKey key;
+    unsigned prefix_len;
+    UwValue status = normalize_ipv4_subnet(subnet, &key, &prefix_len);
+    if (uw_error(&status)) {
+        return uw_move(&status);
+    }
+    return lpm_delete(self, &key, prefix_len, &ipv4_family);
+}
+
+uint32_t uw_ipv4_lpm_find(UwValuePtr self, uint32_t addr)
+{
+    _UwLPM* lpm = get_data_ptr(self);
+
+    // IPv4 trie has at most three levels, lookup is unrolled
+    uintptr_t entry = atomic_load_explicit(&lpm->root[addr >> 16], memory_order_acquire);
+    if (lpm_is_node(entry)) {
+        entry = atomic_load_explicit(&((LpmNode*) entry)->entries[(addr >> 8) & 0xFF], memory_order_acquire);
+        if (lpm_is_node(entry)) {
+            entry = atomic_load_explicit(&((LpmNode*) entry)->entries[addr & 0xFF], memory_order_acquire);
+        }
+    }
+    return lpm_entry_value_id(entry);
+}
+
+void uw_ipv4_lpm_find_batch(UwValuePtr self, uint32_t* addrs, uint32_t* value_ids, unsigned n)
+{
+    _UwLPM* lpm = get_data_ptr(self);
+
+    uintptr_t entries[LPM_BATCH_SIZE];
+
+    while (n) {
+        unsigned batch_size = (n < LPM_BATCH_SIZE)? n : LPM_BATCH_SIZE;
+
+        // each stage issues prefetches for the next one so that
+        // cache misses of the whole batch are resolved in parallel
+        for (unsigned i = 0; i < batch_size; i++) {
+            __builtin_prefetch(&lpm->root[addrs[i] >> 16]);
+        }
+        for (unsigned i = 0; i < batch_size; i++) {
+            uintptr_t entry = atomic_load_explicit(&lpm->root[addrs[i] >> 16], memory_order_acquire);
+            if (lpm_is_node(entry)) {
+                __builtin_prefetch(&((LpmNode*) entry)->entries[(addrs[i] >> 8) & 0xFF]);
+            }
+            entries[i] = entry;
+        }
+        for (unsigned i = 0; i < batch_size; i++) {
+            uintptr_t entry = entries[i];
+            if (lpm_is_node(entry)) {
+                entry = atomic_load_explicit(&((LpmNode*) entry)->entries[(addrs[i] >> 8) & 0xFF], memory_order_acquire);
+                if (lpm_is_node(entry)) {
+                    __builtin_prefetch(&((LpmNode*) entry)->entries[addrs[i] & 0xFF]);
+                }
+                entries[i] = entry;
+            }
+        }
+        for (unsigned i = 0; i < batch_size; i++) {
+            uintptr_t entry = entries[i];
+            if (lpm_is_node(entry)) {
+                entry = atomic_load_explicit(&((LpmNode*) entry)->entries[addrs[i] & 0xFF], memory_order_acquire);
+            }
+            value_ids[i] = lpm_entry_value_id(entry);
+        }
+        addrs += batch_size;
+        value_ids += batch_size;
+        n -= batch_size;
+    }
+}
+
+UwResult uw_ipv4_lpm_value(UwValuePtr self, uint32_t value_id)
+{
+    return lpm_value(self, value_id);
+}
+
+unsigned uw_ipv4_lpm_length(UwValuePtr self)
+{
+    return uw_map_length(&get_data_ptr(self)->routes);
+}
+
+/****************************************************************
+ * IPv6LPM functions
+ */
+
+static UwResult make_ipv6_route_key(LpmKey* key, unsigned prefix_len)
+{
+    return uw_create_ipv6(key, prefix_len);
+}
+
+static void shorten_ipv6_route_key(UwValuePtr route_key, unsigned prefix_len)
+{
+    // route key is a temporary value that no one else refers to
+    IPv6subnet* subnet = uw_ipv6_subnet(route_key);
+    _uw_clear_ipv6_host_bits(&subnet->subnet, prefix_len);
+    subnet->prefix_len = prefix_len;
+}
+
+static bool update_ipv6_trie(_UwLPM* lpm, LpmKey* key, unsigned prefix_len,
+                             uintptr_t new_entry, uint8_t new_prefix_len, bool deleting)
+{
+    return lpm6_update_level(lpm, lpm->root, lpm->root_prefix_len, 0,
+                             key, prefix_len, new_entry, new_prefix_len, deleting);
+}
+
+static LpmFamily ipv6_family = {
+    .make_route_key    = make_ipv6_route_key,
+    .shorten_route_key = shorten_ipv6_route_key,
+    .update            = update_ipv6_trie
+};
+
+static UwResult normalize_ipv6_subnet(UwValuePtr subnet, LpmKey* key, unsigned* prefix_len)
+{
+    if (uw_is_string(subnet)) {
+        IPv6subnet parsed;
+        UwValue status = uw_parse_ipv6_subnet(subnet, &parsed);
+        if (uw_error(&status)) {
+            return uw_move(&status);
+        }
+        *key = parsed.subnet;
+        *prefix_len = parsed.prefix_len;
+        return UwOK();
+    }
+    if (!uw_is_ipv6(subnet)) {
+        return UwError(UW_ERROR_INCOMPATIBLE_TYPE);
+    }
+    // IPv6 values have host bits cleared
+    IPv6subnet* ipv6_subnet = uw_ipv6_subnet(subnet);
+    *key = ipv6_subnet->subnet;
+    *prefix_len = ipv6_subnet->prefix_len;
+    return UwOK();
+}
+
+UwResult uw_ipv6_lpm_insert(UwValuePtr self, UwValuePtr subnet, UwValuePtr value)
+{
+    LpmKey key;
+    unsigned prefix_len;
+    UwValue status = normalize_ipv6_subnet(subnet, &key, &prefix_len);
+    if (uw_error(&status)) {
+        return uw_move(&status);
+    }
+    return lpm_insert(self, &key, prefix_len, &ipv6_family, value);
+}
+
+UwResult uw_ipv6_lpm_insert_list(UwValuePtr self, UwValuePtr subnets, UwValuePtr values)
+{
+    return lpm_insert_list(self, subnets, values, uw_ipv6_lpm_insert);
+}
+
+UwResult uw_ipv6_lpm_delete(UwValuePtr self, UwValuePtr subnet)
+{
+    LpmKey key;
+    unsigned prefix_len;
+    UwValue status = normalize_ipv6_subnet(subnet, &key, &prefix_len);
+    if (uw_error(&status)) {
+        return uw_move(&status);
+    }
+    return lpm_delete(self, &key, prefix_len, &ipv6_family);
+}
+
+uint32_t uw_ipv6_lpm_find(UwValuePtr self, IPv6address* addr)
+{
+    return lpm_entry_value_id(lpm6_find(get_data_ptr(self), addr));
+}
+
+void uw_ipv6_lpm_find_batch(UwValuePtr self, IPv6address* addrs, uint32_t* value_ids, unsigned n)
+{
+    _UwLPM* lpm = get_data_ptr(self);
+
+    uintptr_t entries[LPM_BATCH_SIZE];
+    uintptr_t unchecked[LPM_BATCH_SIZE];
+
+    while (n) {
+        unsigned batch_size = (n < LPM_BATCH_SIZE)? n : LPM_BATCH_SIZE;
+
+        for (unsigned i = 0; i < batch_size; i++) {
+            __builtin_prefetch(&lpm->root[lpm_index(&addrs[i], 0)]);
+        }
+        for (unsigned i = 0; i < batch_size; i++) {
+            entries[i] = atomic_load_explicit(&lpm->root[lpm_index(&addrs[i], 0)], memory_order_acquire);
+            unchecked[i] = 0;
+            if (lpm_is_node(entries[i])) {
+                lpm6_prefetch(entries[i], &addrs[i]);
+            }
+        }
+        // descend all lookups of the batch step by step,
+        // prefetching children for the next step
+        for (bool active = true; active;) {
+            active = false;
+            for (unsigned i = 0; i < batch_size; i++) {
+                if (lpm_is_node(entries[i])) {
+                    entries[i] = lpm6_descend(entries[i], &addrs[i], &unchecked[i]);
+                    if (lpm_is_node(entries[i])) {
+                        lpm6_prefetch(entries[i], &addrs[i]);
+                        active = true;
+                    }
+                }
+            }
+        }
+        for (unsigned i = 0; i < batch_size; i++) {
+            uintptr_t entry = unchecked[i]? lpm6_find_checked(lpm, &addrs[i]) : entries[i];
+            value_ids[i] = lpm_entry_value_id(entry);
+        }
+        addrs += batch_size;
+        value_ids += batch_size;
+        n -= batch_size;
+    }
+}
+
+UwResult uw_ipv6_lpm_value(UwValuePtr self, uint32_t value_id)
+{
+    return lpm_value(self, value_id);
+}
+
+unsigned uw_ipv6_lpm_length(UwValuePtr self)
+{
+    return uw_map_length(&get_data_ptr(self)->routes);
+}
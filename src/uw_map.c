@@ -1,8 +1,10 @@
 #include <limits.h>
 
 #include "include/uw.h"
+#include "src/uw_alloc_stats_internal.h"
 #include "src/uw_charptr_internal.h"
 #include "src/uw_map_internal.h"
+#include "src/uw_trace_internal.h"
 
 #define get_data_ptr(value)  _uw_get_data_ptr((value), UwTypeId_Map)
 
@@ -100,7 +102,7 @@ static bool init_hash_table(UwTypeId type_id, struct _UwHashTable* ht,
     // reallocate items
     // if map is new, ht is initialized to all zero
     // if map is doubled, this reallocates the block
-    if (!_uw_types[type_id]->allocator->reallocate((void**) &ht->items, old_memsize, new_memsize, true, nullptr)) {
+    if (!_uw_reallocate(_uw_types[type_id]->allocator, type_id, (void**) &ht->items, old_memsize, new_memsize, true)) {
         return false;
     }
     memset(ht->items, 0, new_memsize);
@@ -136,6 +138,22 @@ static bool init_hash_table(UwTypeId type_id, struct _UwHashTable* ht,
     return true;
 }
 
+#ifdef UW_MAP_PROBE_STATS
+static void update_probe_stats(_UwMap* map, unsigned num_probes)
+/*
+ * Frozen maps and maps under a read lock are looked up by many threads
+ * at once, so the counters are updated with relaxed atomics.
+ */
+{
+    __atomic_fetch_add(&map->num_lookups, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&map->num_probes, num_probes, __ATOMIC_RELAXED);
+    unsigned max_probes = __atomic_load_n(&map->max_probes, __ATOMIC_RELAXED);
+    while (num_probes > max_probes
+           && !__atomic_compare_exchange_n(&map->max_probes, &max_probes, num_probes,
+                                           true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+#endif
+
 static unsigned lookup(_UwMap* map, UwValuePtr key, unsigned* ht_index, unsigned* ht_offset)
 /*
  * Lookup key starting from index = hash(key).
@@ -154,6 +172,9 @@ static unsigned lookup(_UwMap* map, UwValuePtr key, unsigned* ht_index, unsigned
 
         if (kv_index == 0) {
             // no entry matching key
+#           ifdef UW_MAP_PROBE_STATS
+                update_probe_stats(map, offset + 1);
+#           endif
             if (ht_index) {
                 *ht_index = index;
             }
@@ -171,6 +192,9 @@ static unsigned lookup(_UwMap* map, UwValuePtr key, unsigned* ht_index, unsigned
         // compare keys
         if (_uw_equal(k, key)) {
             // found key
+#           ifdef UW_MAP_PROBE_STATS
+                update_probe_stats(map, offset + 1);
+#           endif
             if (ht_index) {
                 *ht_index = index;
             }
@@ -206,6 +230,35 @@ static unsigned set_hash_table_item(struct _UwHashTable* hash_table, unsigned ht
     } while (true);
 }
 
+static void delete_hash_table_item(_UwMap* map, unsigned ht_index)
+/*
+ * Delete item at `ht_index` and shift back following items of the cluster
+ * which are not at their home position, so lookups never need tombstones.
+ */
+{
+    struct _UwHashTable* ht = &map->hash_table;
+    unsigned hole = ht_index;
+    unsigned index = ht_index;
+    for (;;) {
+        index = (index + 1) & ht->hash_bitmask;
+        unsigned kv_index = ht->get_item(ht, index);
+        if (kv_index == 0) {
+            break;
+        }
+        UwValuePtr key = _uw_list_item(&map->kv_pairs, (kv_index - 1) * 2);
+        unsigned home = uw_hash(key) & ht->hash_bitmask;
+
+        // the item can be moved to the hole if its home position is not in (hole, index]
+        unsigned distance_to_home = (index - home) & ht->hash_bitmask;
+        unsigned distance_to_hole = (index - hole) & ht->hash_bitmask;
+        if (distance_to_home >= distance_to_hole) {
+            ht->set_item(ht, hole, kv_index);
+            hole = index;
+        }
+    }
+    ht->set_item(ht, hole, 0);
+}
+
 static bool _uw_map_expand(UwTypeId type_id, _UwMap* map, unsigned desired_capacity, unsigned ht_offset)
 /*
  * Expand map if necessary.
@@ -235,6 +288,7 @@ static bool _uw_map_expand(UwTypeId type_id, _UwMap* map, unsigned desired_capac
         new_capacity <<= 1;
     }
 
+    _uw_trace(map_resize, map, ht->capacity, new_capacity, _uw_list_length(&map->kv_pairs) >> 1);
     if (!init_hash_table(type_id, ht, ht->capacity, new_capacity)) {
         return false;
     }
@@ -270,7 +324,10 @@ static bool update_map(UwValuePtr map, UwValuePtr key, UwValuePtr value)
         // found key, update value
         unsigned value_index = key_index + 1;
         UwValuePtr v_ptr = _uw_list_item(&__map->kv_pairs, value_index);
-        uw_destroy(v_ptr);
+        if (!_uw_embrace(map, value)) {
+            return false;
+        }
+        _uw_destroy_child((_UwCompoundData*) map->extra_data, v_ptr);
         *v_ptr = uw_move(value);
         return true;
     }
@@ -283,6 +340,7 @@ static bool update_map(UwValuePtr map, UwValuePtr key, UwValuePtr value)
     // append key and value
     unsigned kv_index = _uw_list_length(&__map->kv_pairs) >> 1;
     set_hash_table_item(&__map->hash_table, uw_hash(key), kv_index + 1);
+    __map->hash_table.items_used++;
 
     if (!_uw_list_append_item(type_id, &__map->kv_pairs, key, map)) {
         goto panic;
@@ -310,7 +368,7 @@ static void map_fini(UwValuePtr self)
     _uw_destroy_list(type_id, &map->kv_pairs, cdata);
     if (ht->items) {
         unsigned ht_memsize = get_item_size(ht->capacity) * ht->capacity;
-        _uw_types[type_id]->allocator->release((void**) &ht->items, ht_memsize);
+        _uw_release(_uw_types[type_id]->allocator, type_id, (void**) &ht->items, ht_memsize);
     }
     _uw_fini_compound_data(cdata);
 }
@@ -367,13 +425,15 @@ static UwResult map_deepcopy(UwValuePtr self)
 
     UwValuePtr kv = _uw_list_item(&src_map->kv_pairs, 0);
     for (unsigned i = 0; i < map_length; i++) {
-        UwValue key = uw_clone(kv++);  // okay to clone because keys are already deeply copied
+        // keys are immutable and could be cloned, but deep copy must not share any data,
+        // so it can be handed off to another thread
+        UwValue key = uw_deepcopy(kv++);
         if (uw_error(&key)) {
             return uw_move(&key);
         }
-        UwValue value = uw_clone(kv++);
+        UwValue value = uw_deepcopy(kv++);
         if (uw_error(&value)) {
-            return uw_move(&key);
+            return uw_move(&value);
         }
         if (!update_map(&dest, &key, &value)) {
             // XXX should not happen because the map already resized
@@ -531,6 +591,7 @@ UwType _uw_map_type = {
 bool uw_map_update(UwValuePtr map, UwValuePtr key, UwValuePtr value)
 {
     uw_assert_map(map);
+    uw_assert_mutable(map);
 
     UwValue map_key = UwNull();
     map_key = uw_deepcopy(key);  // deep copy key for immutability
@@ -558,6 +619,7 @@ UwResult _uw_map_update_va(UwValuePtr map, ...)
 UwResult uw_map_update_ap(UwValuePtr map, va_list ap)
 {
     uw_assert_map(map);
+    uw_assert_mutable(map);
     UwValue error = UwOOM();  // default error is OOM unless some arg is a status
     bool done = false;  // for special case when value is missing
     while (!done) {
@@ -636,6 +698,7 @@ UwResult _uw_map_get(UwValuePtr self, UwValuePtr key)
 bool _uw_map_del(UwValuePtr self, UwValuePtr key)
 {
     uw_assert_map(self);
+    uw_assert_mutable(self);
 
     _UwMap* map = get_data_ptr(self);
 
@@ -651,13 +714,13 @@ bool _uw_map_del(UwValuePtr self, UwValuePtr key)
     struct _UwHashTable* ht = &map->hash_table;
 
     // delete item from hash table
-    ht->set_item(ht, ht_index, 0);
+    delete_hash_table_item(map, ht_index);
     ht->items_used--;
 
     // delete key-value pair
-    _uw_list_del(&map->kv_pairs, key_index, key_index + 2);
+    _uw_list_del(&map->kv_pairs, key_index, key_index + 2, (_UwCompoundData*) self->extra_data);
 
-    if (key_index + 2 < _uw_list_length(&map->kv_pairs)) {
+    if (key_index < _uw_list_length(&map->kv_pairs)) {
         // key-value was not the last pair in the list,
         // decrement indexes in the hash table that are greater than index of the deleted pair
         unsigned threshold = (key_index + 2) >> 1;
@@ -672,6 +735,20 @@ bool _uw_map_del(UwValuePtr self, UwValuePtr key)
     return true;
 }
 
+bool uw_map_resize(UwValuePtr self, unsigned desired_capacity)
+{
+    uw_assert_map(self);
+    uw_assert_mutable(self);
+    return _uw_map_expand(self->type_id, get_data_ptr(self), desired_capacity, 0);
+}
+
+bool _uw_map_update_nocopy(UwValuePtr map, UwValuePtr key, UwValuePtr value)
+{
+    uw_assert_map(map);
+    uw_assert_mutable(map);
+    return update_map(map, key, value);
+}
+
 unsigned uw_map_length(UwValuePtr self)
 {
     uw_assert_map(self);
@@ -697,3 +774,110 @@ bool uw_map_item(UwValuePtr self, unsigned index, UwValuePtr key, UwValuePtr val
         return false;
     }
 }
+
+static unsigned get_probe_length(_UwMap* map, unsigned ht_index, unsigned kv_index)
+/*
+ * Return distance of hash table item from its home position.
+ */
+{
+    UwValuePtr key = _uw_list_item(&map->kv_pairs, (kv_index - 1) * 2);
+    return (ht_index - uw_hash(key)) & map->hash_table.hash_bitmask;
+}
+
+UwResult uw_map_stats(UwValuePtr self)
+{
+    uw_assert_map(self);
+
+    _UwMap* map = get_data_ptr(self);
+    struct _UwHashTable* ht = &map->hash_table;
+
+    // probe length of each item is the distance from its home position
+    unsigned max_probe_length = 0;
+    for (unsigned i = 0; i < ht->capacity; i++) {
+        unsigned kv_index = ht->get_item(ht, i);
+        if (kv_index) {
+            unsigned probe_length = get_probe_length(map, i, kv_index);
+            if (probe_length > max_probe_length) {
+                max_probe_length = probe_length;
+            }
+        }
+    }
+    unsigned* counts = calloc(max_probe_length + 1, sizeof(unsigned));
+    if (!counts) {
+        return UwOOM();
+    }
+    unsigned num_items = 0;
+    for (unsigned i = 0; i < ht->capacity; i++) {
+        unsigned kv_index = ht->get_item(ht, i);
+        if (kv_index) {
+            counts[get_probe_length(map, i, kv_index)]++;
+            num_items++;
+        }
+    }
+    UwValue histogram = UwList();
+    if (uw_ok(&histogram) && num_items) {
+        for (unsigned i = 0; i <= max_probe_length; i++) {
+            if (!uw_list_append(&histogram, counts[i])) {
+                uw_destroy(&histogram);
+                histogram = UwOOM();
+                break;
+            }
+        }
+    }
+    free(counts);
+    if (uw_error(&histogram)) {
+        return uw_move(&histogram);
+    }
+
+    // the longest run of occupied items, which can wrap around the end of hash table
+    unsigned longest_cluster = 0;
+    if (num_items == ht->capacity) {
+        longest_cluster = ht->capacity;
+    } else {
+        unsigned start = 0;
+        while (ht->get_item(ht, start)) {
+            start++;
+        }
+        unsigned cluster = 0;
+        for (unsigned n = 1; n <= ht->capacity; n++) {
+            if (ht->get_item(ht, (start + n) & ht->hash_bitmask)) {
+                cluster++;
+                if (cluster > longest_cluster) {
+                    longest_cluster = cluster;
+                }
+            } else {
+                cluster = 0;
+            }
+        }
+    }
+
+    UwValue result = UwMap();
+    if (uw_error(&result)) {
+        return uw_move(&result);
+    }
+    UwValue status = uw_map_update_va(&result,
+        UwCharPtr("capacity"),        UwUnsigned(ht->capacity),
+        UwCharPtr("items_used"),      UwUnsigned(ht->items_used),
+        UwCharPtr("item_size"),       UwUnsigned(ht->item_size),
+        UwCharPtr("load_factor"),     UwFloat((double) ht->items_used / ht->capacity),
+        UwCharPtr("probe_histogram"), uw_clone(&histogram),
+        UwCharPtr("longest_cluster"), UwUnsigned(longest_cluster),
+        UwCharPtr("tombstones"),      UwUnsigned(0)
+    );
+    if (uw_error(&status)) {
+        return uw_move(&status);
+    }
+#   ifdef UW_MAP_PROBE_STATS
+    {
+        UwValue status = uw_map_update_va(&result,
+            UwCharPtr("lookups"),    UwUnsigned(__atomic_load_n(&map->num_lookups, __ATOMIC_RELAXED)),
+            UwCharPtr("probes"),     UwUnsigned(__atomic_load_n(&map->num_probes, __ATOMIC_RELAXED)),
+            UwCharPtr("max_probes"), UwUnsigned(__atomic_load_n(&map->max_probes, __ATOMIC_RELAXED))
+        );
+        if (uw_error(&status)) {
+            return uw_move(&status);
+        }
+    }
+#   endif
+    return uw_move(&result);
+}
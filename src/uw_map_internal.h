@@ -31,8 +31,22 @@ struct _UwHashTable {
 typedef struct {
     _UwList kv_pairs;        // key-value pairs in the insertion order
     struct _UwHashTable hash_table;
+#ifdef UW_MAP_PROBE_STATS
+    uint64_t num_lookups;
+    uint64_t num_probes;     // hash table items examined by all lookups
+    unsigned max_probes;     // the longest lookup
+#endif
 } _UwMap;
 
+bool _uw_map_update_nocopy(UwValuePtr map, UwValuePtr key, UwValuePtr value);
+/*
+ * Move key and value to the map.
+ *
+ * Unlike uw_map_update, the key is not deep-copied,
+ * so the caller must make sure nobody else refers to it.
+ * This is for building maps from freshly created values.
+ */
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,222 @@
+#include <stdlib.h>
+
+#include "include/uw.h"
+#include "src/uw_list_internal.h"
+#include "src/uw_map_internal.h"
+#include "src/uw_string_internal.h"
+
+/****************************************************************
+ * Set of visited blocks, open addressing with linear probing
+ */
+
+typedef struct {
+    void** items;
+    unsigned capacity;  // power of two
+    unsigned length;
+} VisitedSet;
+
+static inline unsigned ptr_hash(void* ptr)
+{
+    return (unsigned) ((((uintptr_t) ptr >> 4) * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+static void insert_visited(VisitedSet* set, void* ptr)
+{
+    unsigned mask = set->capacity - 1;
+    unsigned i = ptr_hash(ptr) & mask;
+    while (set->items[i]) {
+        i = (i + 1) & mask;
+    }
+    set->items[i] = ptr;
+    set->length++;
+}
+
+static bool visit(VisitedSet* set, void* ptr)
+/*
+ * Add pointer to the set.
+ * Return false if it's already there.
+ * If OOM, return true, so the block will be counted more than once.
+ */
+{
+    if (set->capacity) {
+        unsigned mask = set->capacity - 1;
+        for (unsigned i = ptr_hash(ptr) & mask; set->items[i]; i = (i + 1) & mask) {
+            if (set->items[i] == ptr) {
+                return false;
+            }
+        }
+    }
+    if (set->length * 2 >= set->capacity) {
+        // grow
+        VisitedSet new_set = {
+            .capacity = set->capacity? set->capacity * 2 : 64,
+            .length = 0
+        };
+        new_set.items = calloc(new_set.capacity, sizeof(void*));
+        if (!new_set.items) {
+            return true;
+        }
+        for (unsigned i = 0; i < set->capacity; i++) {
+            if (set->items[i]) {
+                insert_visited(&new_set, set->items[i]);
+            }
+        }
+        free(set->items);
+        *set = new_set;
+    }
+    insert_visited(set, ptr);
+    return true;
+}
+
+/****************************************************************
+ * Walker
+ */
+
+typedef struct {
+    VisitedSet visited;
+    unsigned flags;
+    UwMemSize result;
+} MemSizeContext;
+
+static unsigned count_parents(_UwCompoundData* cdata, size_t* parents_memsize)
+/*
+ * Return the number of references from parents
+ * and write the size of allocated list of parents.
+ */
+{
+    unsigned result = 0;
+    if (cdata->using_parents_list) {
+        // clear using_parents_list flag, same as get_parents_list in uw_compound.c
+        _UwParentsChunk* chunk_ptr = (_UwParentsChunk*) ((ptrdiff_t) cdata->parents_list & ~1);
+        for (unsigned n = cdata->num_parents_chunks; n; n--, chunk_ptr++) {
+            for (unsigned i = 0; i < UW_PARENTS_CHUNK_SIZE; i++) {
+                if (chunk_ptr->parents[i]) {
+                    result += chunk_ptr->parents_refcount[i];
+                }
+            }
+        }
+        *parents_memsize = cdata->num_parents_chunks * sizeof(_UwParentsChunk);
+    } else {
+        for (unsigned i = 0; i < 2; i++) {
+            if (cdata->parents[i]) {
+                result += cdata->parents_refcount[i];
+            }
+        }
+        *parents_memsize = 0;
+    }
+    return result;
+}
+
+static bool count_block(MemSizeContext* ctx, void* block, unsigned num_refs, size_t memsize)
+/*
+ * Add block size to the result.
+ * Return false if the block is shared and was already counted.
+ */
+{
+    if (num_refs > 1) {
+        if (!visit(&ctx->visited, block)) {
+            return false;
+        }
+        ctx->result.shared += memsize;
+    } else {
+        ctx->result.exclusive += memsize;
+    }
+    return true;
+}
+
+static unsigned get_refcount(UwValuePtr value)
+/*
+ * Return refcount of extra data. Frozen data is shared by definition,
+ * its refcount is _UW_REFCOUNT_FROZEN.
+ */
+{
+    unsigned* refcount = &value->extra_data->refcount;
+    if (_uw_refcount_frozen(refcount)) {
+        return _UW_REFCOUNT_FROZEN;
+    }
+    return _uw_refcount_load(refcount);
+}
+
+static void walk(MemSizeContext* ctx, UwValuePtr value, _UwCompoundChain* tail);
+
+static void walk_items(MemSizeContext* ctx, _UwList* list, UwValuePtr parent, _UwCompoundChain* tail)
+{
+    if (ctx->flags & UW_MEMSIZE_SHALLOW) {
+        return;
+    }
+    _UwCompoundChain this_link = {
+        .prev = tail,
+        .value = parent
+    };
+    UwValuePtr item_ptr = list->items;
+    for (unsigned n = list->length; n; n--, item_ptr++) {
+        walk(ctx, item_ptr, &this_link);
+    }
+}
+
+static void walk(MemSizeContext* ctx, UwValuePtr value, _UwCompoundChain* tail)
+{
+    UwType* t = _uw_types[value->type_id];
+
+    if (uw_is_string(value)) {
+        if (!value->str_embedded) {
+            count_block(ctx, value->extra_data, get_refcount(value), _uw_string_extra_data_size(value));
+        }
+        return;
+    }
+    if (t->allocator == nullptr || value->extra_data == nullptr) {
+        // no extra data
+        return;
+    }
+    if (uw_is_status(value)) {
+        if (count_block(ctx, value->extra_data, get_refcount(value), t->data_offset + t->data_size)) {
+            UwValuePtr desc = _uw_status_desc_ptr(value);
+            if (desc) {
+                walk(ctx, desc, tail);
+            }
+        }
+        return;
+    }
+
+    unsigned num_refs = get_refcount(value);
+    size_t memsize = t->data_offset + t->data_size;
+    if (t->compound) {
+        if (_uw_on_chain(value, tail)) {
+            return;
+        }
+        size_t parents_memsize;
+        unsigned parent_refs = count_parents((_UwCompoundData*) value->extra_data, &parents_memsize);
+        if (num_refs != _UW_REFCOUNT_FROZEN) {
+            // frozen refcount must not wrap around
+            num_refs += parent_refs;
+        }
+        memsize += parents_memsize;
+    }
+
+    if (uw_is_map(value)) {
+        _UwMap* map = _uw_get_data_ptr(value, UwTypeId_Map);
+        memsize += map->hash_table.item_size * map->hash_table.capacity;
+        memsize += map->kv_pairs.capacity * sizeof(_UwValue);
+        if (count_block(ctx, value->extra_data, num_refs, memsize)) {
+            walk_items(ctx, &map->kv_pairs, value, tail);
+        }
+    } else if (uw_is_list(value)) {
+        _UwList* list = _uw_get_data_ptr(value, UwTypeId_List);
+        memsize += list->capacity * sizeof(_UwValue);
+        if (count_block(ctx, value->extra_data, num_refs, memsize)) {
+            walk_items(ctx, list, value, tail);
+        }
+    } else {
+        count_block(ctx, value->extra_data, num_refs, memsize);
+    }
+}
+
+UwMemSize uw_memsize(UwValuePtr value, unsigned flags)
+{
+    MemSizeContext ctx = {
+        .flags = flags
+    };
+    walk(&ctx, value, nullptr);
+    free(ctx.visited.items);
+    return ctx.result;
+}
@@ -1,12 +1,98 @@
 #include <uw_netutils.h>
 
-#include <arpa/inet.h>
+#include "src/uw_netutils_internal.h"
+#include "src/uw_string_internal.h"
+
+#define UW_IPV6_BUFFER_SIZE  48  // enough for full address, prefix length, and terminating zero
 
 uint16_t UW_ERROR_BAD_ADDRESS_FAMILY = 0;
 uint16_t UW_ERROR_BAD_IP_ADDRESS = 0;
 uint16_t UW_ERROR_MISSING_NETMASK = 0;
 uint16_t UW_ERROR_BAD_NETMASK = 0;
 
+/****************************************************************
+ * IPv6 type
+ */
+
+#define get_ipv6_ptr(value)  ((IPv6subnet*) _uw_get_data_ptr((value), UwTypeId_IPv6))
+
+static void ipv6_hash(UwValuePtr self, UwHashContext* ctx)
+{
+    IPv6subnet* subnet = get_ipv6_ptr(self);
+
+    _uw_hash_uint64(ctx, self->type_id);
+    _uw_hash_uint64(ctx, subnet->subnet.hi);
+    _uw_hash_uint64(ctx, subnet->subnet.lo);
+    _uw_hash_uint64(ctx, subnet->prefix_len);
+}
+
+static UwResult ipv6_deepcopy(UwValuePtr self)
+{
+    IPv6subnet* subnet = get_ipv6_ptr(self);
+    return uw_create_ipv6(&subnet->subnet, subnet->prefix_len);
+}
+
+static unsigned format_ipv6(IPv6subnet* subnet, char* buffer);
+
+static void ipv6_dump(UwValuePtr self, FILE* fp, int first_indent, int next_indent, _UwCompoundChain* tail)
+{
+    char buffer[UW_IPV6_BUFFER_SIZE];
+    format_ipv6(get_ipv6_ptr(self), buffer);
+
+    _uw_dump_start(fp, self, first_indent);
+    _uw_dump_base_extra_data(fp, self->extra_data);
+    fprintf(fp, " %s\n", buffer);
+}
+
+static UwResult ipv6_to_string(UwValuePtr self)
+{
+    char buffer[UW_IPV6_BUFFER_SIZE];
+    format_ipv6(get_ipv6_ptr(self), buffer);
+    return uw_create_string_cstr(buffer);
+}
+
+static bool ipv6_is_true(UwValuePtr self)
+{
+    IPv6subnet* subnet = get_ipv6_ptr(self);
+    return subnet->subnet.hi || subnet->subnet.lo;
+}
+
+static bool ipv6_equal_sametype(UwValuePtr self, UwValuePtr other)
+{
+    IPv6subnet* a = get_ipv6_ptr(self);
+    IPv6subnet* b = get_ipv6_ptr(other);
+    return a->subnet.hi == b->subnet.hi && a->subnet.lo == b->subnet.lo && a->prefix_len == b->prefix_len;
+}
+
+static bool ipv6_equal(UwValuePtr self, UwValuePtr other)
+{
+    return uw_is_subtype(other, UwTypeId_IPv6) && ipv6_equal_sametype(self, other);
+}
+
+UwTypeId UwTypeId_IPv6 = 0;
+
+static UwType ipv6_type = {
+    .id              = 0,
+    .ancestor_id     = UwTypeId_Null,  // no ancestor
+    .name            = "IPv6",
+    .allocator       = &default_allocator,
+    .data_offset     = sizeof(_UwExtraData),
+    .data_size       = sizeof(IPv6subnet),
+    .compound        = false,
+    ._create         = _uw_default_create,
+    ._destroy        = _uw_default_destroy,
+    ._init           = nullptr,
+    ._fini           = nullptr,
+    ._clone          = _uw_default_clone,
+    ._hash           = ipv6_hash,
+    ._deepcopy       = ipv6_deepcopy,
+    ._dump           = ipv6_dump,
+    ._to_string      = ipv6_to_string,
+    ._is_true        = ipv6_is_true,
+    ._equal_sametype = ipv6_equal_sametype,
+    ._equal          = ipv6_equal
+};
+
 [[ gnu::constructor ]]
 static void init_netutils()
 {
@@ -15,23 +101,120 @@ static void init_netutils()
     UW_ERROR_BAD_IP_ADDRESS     = uw_define_status("BAD_IP_ADDRESS");
     UW_ERROR_MISSING_NETMASK    = uw_define_status("MISSING_NETMASK");
     UW_ERROR_BAD_NETMASK        = uw_define_status("BAD_NETMASK");
+
+    UwTypeId_IPv6 = uw_add_type(&ipv6_type);
 }
 
-UwResult uw_parse_ipv4_address(UwValuePtr addr)
+/****************************************************************
+ * Parsers work directly on string storage of any char size
+ * and do not allocate memory unless an error is returned.
+ */
+
+bool _uw_parse_ipv4(UwValuePtr str, unsigned start, unsigned end, uint32_t* result)
 {
+    StrMethods* strmeth = get_str_methods(str);
+    uint8_t char_size = _uw_string_char_size(str);
+    uint8_t* ptr = _uw_string_char_ptr(str, start);
+
+    uint32_t addr = 0;
+    unsigned num_octets = 0;
+    unsigned octet = 0;
+    unsigned num_digits = 0;
+
+    for (unsigned i = start; i < end; i++, ptr += char_size) {
+        char32_t c = strmeth->get_char(ptr);
+        if (c >= '0' && c <= '9') {
+            if (num_digits && octet == 0) {
+                return false;
+            }
+            octet = octet * 10 + (c - '0');
+            if (octet > 255) {
+                return false;
+            }
+            num_digits++;
+        } else if (c == '.') {
+            if (num_digits == 0 || num_octets == 3) {
+                return false;
+            }
+            addr = (addr << 8) | octet;
+            num_octets++;
+            octet = 0;
+            num_digits = 0;
+        } else {
+            return false;
+        }
+    }
+    if (num_digits == 0 || num_octets != 3) {
+        return false;
+    }
+    *result = (addr << 8) | octet;
+    return true;
+}
+
+bool _uw_parse_cidr_prefix(UwValuePtr str, unsigned start, unsigned end, uint32_t* netmask)
+{
+    StrMethods* strmeth = get_str_methods(str);
+    uint8_t char_size = _uw_string_char_size(str);
+    uint8_t* ptr = _uw_string_char_ptr(str, start);
+
+    if (start == end || end - start > 2) {
+        return false;
+    }
+    unsigned n = 0;
+    for (unsigned i = start; i < end; i++, ptr += char_size) {
+        char32_t c = strmeth->get_char(ptr);
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        n = n * 10 + (c - '0');
+    }
+    if (n > 32) {
+        return false;
+    }
+    *netmask = n? 0xffffffff << (32 - n) : 0;
+    return true;
+}
+
+static UwResult bad_ip_address(UwValuePtr addr)
+{
+    UwValue error = UwError(UW_ERROR_BAD_IP_ADDRESS);
     UW_CSTRING_LOCAL(c_addr, addr);
-    struct in_addr ipaddr;
+    _uw_set_status_desc(&error, "Bad IPv4 address %s", c_addr);
+    return uw_move(&error);
+}
 
-    int rc = inet_pton(AF_INET, c_addr, &ipaddr);
-    if (rc == -1) {
-        return UwError(UW_ERROR_BAD_ADDRESS_FAMILY);
+UwResult uw_parse_ipv4_address(UwValuePtr addr)
+{
+    if (!uw_is_string(addr)) {
+        return UwError(UW_ERROR_BAD_IP_ADDRESS);
     }
-    if (rc != 1) {
-        UwValue error = UwError(UW_ERROR_BAD_IP_ADDRESS);
-        _uw_set_status_desc(&error, "Bad IPv4 address %s", c_addr);
-        return uw_move(&error);
+    uint32_t ipaddr;
+    if (!_uw_parse_ipv4(addr, 0, _uw_string_length(addr), &ipaddr)) {
+        return bad_ip_address(addr);
+    }
+    return UwUnsigned(ipaddr);
+}
+
+UwResult uw_parse_ipv4_addresses(UwValuePtr addrs, uint32_t* result)
+{
+    uw_assert_list(addrs);
+
+    unsigned n = uw_list_length(addrs);
+    for (unsigned i = 0; i < n; i++) {
+        UwValue addr = uw_list_item(addrs, i);
+        if (!uw_is_string(&addr)) {
+            UwValue error = UwError(UW_ERROR_BAD_IP_ADDRESS);
+            _uw_set_status_desc(&error, "Item %u is not a string", i);
+            return uw_move(&error);
+        }
+        if (!_uw_parse_ipv4(&addr, 0, _uw_string_length(&addr), &result[i])) {
+            UwValue error = UwError(UW_ERROR_BAD_IP_ADDRESS);
+            UW_CSTRING_LOCAL(c_addr, &addr);
+            _uw_set_status_desc(&error, "Bad IPv4 address %s at %u", c_addr, i);
+            return uw_move(&error);
+        }
     }
-    return UwUnsigned(ntohl(ipaddr.s_addr));
+    return UwOK();
 }
 
 UwResult uw_parse_ipv4_subnet(UwValuePtr subnet, UwValuePtr netmask)
@@ -43,50 +226,294 @@ UwResult uw_parse_ipv4_subnet(UwValuePtr subnet, UwValuePtr netmask)
     }
 
     // check CIDR notation
-    UwValue parts = uw_string_split_chr(subnet, '/');
-    if (uw_error(&parts)) {
-        return uw_move(&parts);
-    }
-    unsigned num_parts = uw_list_length(&parts);
-    if (num_parts > 1) {
-        // try CIDR netmask
-        UwValue cidr_netmask = uw_list_item(&parts, 1);
-        if (uw_error(&cidr_netmask)) {
-            return uw_move(&cidr_netmask);
-        }
-        UW_CSTRING_LOCAL(c_netmask, &cidr_netmask);
-
-        long n = strtol(c_netmask, nullptr, 10);
-        if (n == 0 || n >= 32 || num_parts > 2) {
+    unsigned length = _uw_string_length(subnet);
+    unsigned addr_end;
+    if (uw_strchr(subnet, '/', 0, &addr_end)) {
+        if (!_uw_parse_cidr_prefix(subnet, addr_end + 1, length, &ipv4_subnet.netmask)) {
             UwValue error = UwError(UW_ERROR_BAD_NETMASK);
             UW_CSTRING_LOCAL(c_subnet, subnet);
             _uw_set_status_desc(&error, "Bad netmask %s", c_subnet);
             return uw_move(&error);
         }
-        ipv4_subnet.netmask = 0xffffffff << (32 - n);
-
     } else {
         // not CIDR notation, parse netmask parameter
         if (!uw_is_string(netmask)) {
             return UwError(UW_ERROR_MISSING_NETMASK);
         }
-        UwResult parsed_netmask = uw_parse_ipv4_address(netmask);
-        if (uw_error(&parsed_netmask)) {
-            return uw_move(&parsed_netmask);
+        if (!_uw_parse_ipv4(netmask, 0, _uw_string_length(netmask), &ipv4_subnet.netmask)) {
+            return bad_ip_address(netmask);
         }
-        ipv4_subnet.netmask = parsed_netmask.unsigned_value;
+        addr_end = length;
     }
 
     // parse subnet address
-    UwValue addr = uw_list_item(&parts, 0);
-    if (uw_error(&addr)) {
-        return uw_move(&addr);
+    if (!_uw_parse_ipv4(subnet, 0, addr_end, &ipv4_subnet.subnet)) {
+        return bad_ip_address(subnet);
     }
-    UwResult parsed_subnet = uw_parse_ipv4_address(&addr);
-    if (uw_error(&parsed_subnet)) {
-        return uw_move(&parsed_subnet);
+    return UwUnsigned(ipv4_subnet.value);
+}
+
+/****************************************************************
+ * IPv6 parsing and formatting
+ */
+
+static int hex_digit(char32_t c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
     }
-    ipv4_subnet.subnet = parsed_subnet.unsigned_value;
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
 
-    return UwUnsigned(ipv4_subnet.value);
+static bool parse_ipv6(UwValuePtr str, unsigned start, unsigned end, IPv6address* result)
+{
+    StrMethods* strmeth = get_str_methods(str);
+    uint8_t char_size = _uw_string_char_size(str);
+    uint8_t* chars = _uw_string_char_ptr(str, 0);
+
+#   define char_at(pos)  strmeth->get_char(chars + (pos) * char_size)
+
+    uint16_t groups[8];
+    unsigned num_groups = 0;
+    int compress_at = -1;  // position of :: in groups
+    unsigned pos = start;
+
+    if (pos < end && char_at(pos) == ':') {
+        if (pos + 1 == end || char_at(pos + 1) != ':') {
+            return false;
+        }
+        compress_at = 0;
+        pos += 2;
+    }
+    while (pos < end) {
+        if (num_groups == 8) {
+            return false;
+        }
+        unsigned group_start = pos;
+        unsigned value = 0;
+        unsigned num_digits = 0;
+        while (pos < end && num_digits <= 4) {
+            int d = hex_digit(char_at(pos));
+            if (d < 0) {
+                break;
+            }
+            value = (value << 4) | d;
+            num_digits++;
+            pos++;
+        }
+        if (num_digits == 0 || num_digits > 4) {
+            return false;
+        }
+        if (pos < end && char_at(pos) == '.') {
+            // embedded IPv4 address must take the last 32 bits
+            uint32_t ipv4;
+            if (num_groups > 6 || !_uw_parse_ipv4(str, group_start, end, &ipv4)) {
+                return false;
+            }
+            groups[num_groups++] = ipv4 >> 16;
+            groups[num_groups++] = ipv4 & 0xFFFF;
+            break;
+        }
+        groups[num_groups++] = value;
+        if (pos == end) {
+            break;
+        }
+        if (char_at(pos) != ':') {
+            return false;
+        }
+        pos++;
+        if (pos == end) {
+            // trailing single colon
+            return false;
+        }
+        if (char_at(pos) == ':') {
+            if (compress_at >= 0) {
+                return false;
+            }
+            compress_at = num_groups;
+            pos++;
+        }
+    }
+
+#   undef char_at
+
+    if (compress_at >= 0) {
+        // :: replaces one or more zero groups
+        if (num_groups == 8) {
+            return false;
+        }
+        unsigned tail = num_groups - compress_at;
+        unsigned gap = 8 - num_groups;
+        for (unsigned i = 0; i < tail; i++) {
+            groups[7 - i] = groups[num_groups - 1 - i];
+        }
+        for (unsigned i = 0; i < gap; i++) {
+            groups[compress_at + i] = 0;
+        }
+    } else if (num_groups != 8) {
+        return false;
+    }
+    result->hi = ((uint64_t) groups[0] << 48) | ((uint64_t) groups[1] << 32) | ((uint64_t) groups[2] << 16) | groups[3];
+    result->lo = ((uint64_t) groups[4] << 48) | ((uint64_t) groups[5] << 32) | ((uint64_t) groups[6] << 16) | groups[7];
+    return true;
+}
+
+static unsigned format_ipv6(IPv6subnet* subnet, char* buffer)
+/*
+ * Format address according to RFC 5952: lowercase hex digits without
+ * leading zeros, the longest run of two or more zero groups is replaced with ::
+ *
+ * Return length of the result.
+ */
+{
+    static char hex_digits[] = "0123456789abcdef";
+
+    uint16_t groups[8];
+    for (unsigned i = 0; i < 4; i++) {
+        groups[i]     = subnet->subnet.hi >> (48 - i * 16);
+        groups[i + 4] = subnet->subnet.lo >> (48 - i * 16);
+    }
+    // find the longest run of zero groups, the first one if there are several
+    int best_start = -1;
+    unsigned best_len = 1;
+    for (unsigned i = 0; i < 8; ) {
+        if (groups[i]) {
+            i++;
+            continue;
+        }
+        unsigned run_start = i;
+        while (i < 8 && groups[i] == 0) {
+            i++;
+        }
+        if (i - run_start > best_len) {
+            best_start = run_start;
+            best_len = i - run_start;
+        }
+    }
+    char* p = buffer;
+    for (unsigned i = 0; i < 8; i++) {
+        if ((int) i == best_start) {
+            *p++ = ':';
+            if (i == 0) {
+                *p++ = ':';
+            }
+            i += best_len - 1;
+            continue;
+        }
+        uint16_t g = groups[i];
+        bool started = false;
+        for (int shift = 12; shift >= 0; shift -= 4) {
+            unsigned d = (g >> shift) & 15;
+            if (d || started || shift == 0) {
+                *p++ = hex_digits[d];
+                started = true;
+            }
+        }
+        if (i < 7) {
+            *p++ = ':';
+        }
+    }
+    if (subnet->prefix_len < 128) {
+        p += sprintf(p, "/%u", subnet->prefix_len);
+    }
+    *p = 0;
+    return p - buffer;
+}
+
+static UwResult bad_ipv6_address(UwValuePtr addr)
+{
+    UwValue error = UwError(UW_ERROR_BAD_IP_ADDRESS);
+    UW_CSTRING_LOCAL(c_addr, addr);
+    _uw_set_status_desc(&error, "Bad IPv6 address %s", c_addr);
+    return uw_move(&error);
+}
+
+UwResult uw_parse_ipv6_address(UwValuePtr addr, IPv6address* result)
+{
+    if (!uw_is_string(addr)) {
+        return UwError(UW_ERROR_BAD_IP_ADDRESS);
+    }
+    if (!parse_ipv6(addr, 0, _uw_string_length(addr), result)) {
+        return bad_ipv6_address(addr);
+    }
+    return UwOK();
+}
+
+UwResult uw_parse_ipv6_subnet(UwValuePtr subnet, IPv6subnet* result)
+{
+    if (!uw_is_string(subnet)) {
+        return UwError(UW_ERROR_BAD_IP_ADDRESS);
+    }
+    unsigned length = _uw_string_length(subnet);
+    unsigned addr_end;
+    if (!uw_strchr(subnet, '/', 0, &addr_end)) {
+        return UwError(UW_ERROR_MISSING_NETMASK);
+    }
+    StrMethods* strmeth = get_str_methods(subnet);
+    uint8_t char_size = _uw_string_char_size(subnet);
+    uint8_t* ptr = _uw_string_char_ptr(subnet, addr_end + 1);
+    unsigned prefix_len = 0;
+    unsigned num_digits = length - addr_end - 1;
+    bool bad_prefix = num_digits == 0 || num_digits > 3;
+    for (unsigned i = 0; i < num_digits && !bad_prefix; i++, ptr += char_size) {
+        char32_t c = strmeth->get_char(ptr);
+        if (c < '0' || c > '9') {
+            bad_prefix = true;
+        }
+        prefix_len = prefix_len * 10 + (c - '0');
+    }
+    if (bad_prefix || prefix_len > 128) {
+        UwValue error = UwError(UW_ERROR_BAD_NETMASK);
+        UW_CSTRING_LOCAL(c_subnet, subnet);
+        _uw_set_status_desc(&error, "Bad prefix length %s", c_subnet);
+        return uw_move(&error);
+    }
+    if (!parse_ipv6(subnet, 0, addr_end, &result->subnet)) {
+        return bad_ipv6_address(subnet);
+    }
+    _uw_clear_ipv6_host_bits(&result->subnet, prefix_len);
+    result->prefix_len = prefix_len;
+    return UwOK();
+}
+
+UwResult uw_create_ipv6(IPv6address* addr, unsigned prefix_len)
+{
+    uw_assert(prefix_len <= 128);
+
+    UwValue result = _uw_create(UwTypeId_IPv6);
+    if (uw_error(&result)) {
+        return uw_move(&result);
+    }
+    IPv6subnet* subnet = get_ipv6_ptr(&result);
+    subnet->subnet = *addr;
+    subnet->prefix_len = prefix_len;
+    _uw_clear_ipv6_host_bits(&subnet->subnet, prefix_len);
+    return uw_move(&result);
+}
+
+UwResult uw_create_ipv6_from_string(UwValuePtr str)
+{
+    if (!uw_is_string(str)) {
+        return UwError(UW_ERROR_BAD_IP_ADDRESS);
+    }
+    unsigned slash_pos;
+    if (uw_strchr(str, '/', 0, &slash_pos)) {
+        IPv6subnet subnet;
+        UwValue status = uw_parse_ipv6_subnet(str, &subnet);
+        if (uw_error(&status)) {
+            return uw_move(&status);
+        }
+        return uw_create_ipv6(&subnet.subnet, subnet.prefix_len);
+    } else {
+        IPv6address addr;
+        UwValue status = uw_parse_ipv6_address(str, &addr);
+        if (uw_error(&status)) {
+            return uw_move(&status);
+        }
+        return uw_create_ipv6(&addr, 128);
+    }
 }
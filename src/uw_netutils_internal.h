@@ -0,0 +1,42 @@
+#pragma once
+
+/*
+ * Network utilities internals.
+ */
+
+#include "include/uw_netutils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool _uw_parse_ipv4(UwValuePtr str, unsigned start, unsigned end, uint32_t* result);
+/*
+ * Parse dotted-quad IPv4 address in the range of characters.
+ * Same as inet_pton, leading zeros in octets are not allowed.
+ */
+
+bool _uw_parse_cidr_prefix(UwValuePtr str, unsigned start, unsigned end, uint32_t* netmask);
+/*
+ * Parse CIDR prefix length from 0 to 32 in the range of characters
+ * and convert it to netmask.
+ */
+
+static inline void _uw_clear_ipv6_host_bits(IPv6address* addr, unsigned prefix_len)
+{
+    if (prefix_len == 0) {
+        addr->hi = 0;
+        addr->lo = 0;
+    } else if (prefix_len < 64) {
+        addr->hi &= 0xFFFF'FFFF'FFFF'FFFFULL << (64 - prefix_len);
+        addr->lo = 0;
+    } else if (prefix_len == 64) {
+        addr->lo = 0;
+    } else if (prefix_len < 128) {
+        addr->lo &= 0xFFFF'FFFF'FFFF'FFFFULL << (128 - prefix_len);
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
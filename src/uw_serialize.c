@@ -0,0 +1,611 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/uw_serialize.h"
+#include "src/uw_list_internal.h"
+#include "src/uw_map_internal.h"
+#include "src/uw_serialize_internal.h"
+#include "src/uw_string_internal.h"
+
+/*
+ * XXX raw storage of Floats and 2- and 4-byte characters
+ * is written as is, i.e. this assumes little-endian host.
+ */
+
+uint16_t UW_ERROR_BAD_SERIALIZED_DATA = 0;
+
+[[ gnu::constructor ]]
+static void init_serialize()
+{
+    // init statuses
+    UW_ERROR_BAD_SERIALIZED_DATA = uw_define_status("BAD_SERIALIZED_DATA");
+}
+
+static uint8_t header[4] = { 'U', 'W', 'B', UW_SERIALIZE_VERSION };
+
+/****************************************************************
+ * Serializer
+ */
+
+#define SERIALIZE_BUFFER_SIZE       4096
+#define REF_TABLE_INITIAL_CAPACITY  64  // must be power of two
+
+typedef struct {
+    void* extra_data;  // nullptr if slot is free
+    unsigned index;
+} RefTableItem;
+
+typedef struct {
+    UwValuePtr writer;
+    unsigned length;         // of data in the buffer
+    uint64_t bytes_written;  // total, flushed
+    unsigned next_index;     // index of the next String, List, or Map
+    unsigned num_refs;
+    unsigned refs_capacity;  // power of two
+    RefTableItem* refs;      // open addressing hash table of written values
+    uint8_t buffer[SERIALIZE_BUFFER_SIZE];
+} Serializer;
+
+static inline unsigned ref_slot(void* extra_data, unsigned capacity)
+{
+    return (unsigned) ((((uintptr_t) extra_data) * 0x9E37'79B9'7F4A'7C15ULL) >> 32) & (capacity - 1);
+}
+
+static unsigned find_ref(Serializer* s, void* extra_data)
+/*
+ * Return index of previously written value or UINT_MAX.
+ */
+{
+    if (s->num_refs == 0) {
+        return UINT_MAX;
+    }
+    unsigned mask = s->refs_capacity - 1;
+    for (unsigned slot = ref_slot(extra_data, s->refs_capacity);; slot = (slot + 1) & mask) {
+        RefTableItem* item = &s->refs[slot];
+        if (item->extra_data == extra_data) {
+            return item->index;
+        }
+        if (item->extra_data == nullptr) {
+            return UINT_MAX;
+        }
+    }
+}
+
+static void insert_ref(RefTableItem* refs, unsigned capacity, void* extra_data, unsigned index)
+{
+    unsigned slot = ref_slot(extra_data, capacity);
+    while (refs[slot].extra_data) {
+        slot = (slot + 1) & (capacity - 1);
+    }
+    refs[slot].extra_data = extra_data;
+    refs[slot].index = index;
+}
+
+static bool add_ref(Serializer* s, void* extra_data, unsigned index)
+{
+    // keep load factor below 1/2
+    if (s->num_refs * 2 >= s->refs_capacity) {
+        unsigned new_capacity = s->refs_capacity? s->refs_capacity * 2 : REF_TABLE_INITIAL_CAPACITY;
+        RefTableItem* new_refs = calloc(new_capacity, sizeof(RefTableItem));
+        if (!new_refs) {
+            return false;
+        }
+        for (unsigned i = 0; i < s->refs_capacity; i++) {
+            if (s->refs[i].extra_data) {
+                insert_ref(new_refs, new_capacity, s->refs[i].extra_data, s->refs[i].index);
+            }
+        }
+        free(s->refs);
+        s->refs = new_refs;
+        s->refs_capacity = new_capacity;
+    }
+    insert_ref(s->refs, s->refs_capacity, extra_data, index);
+    s->num_refs++;
+    return true;
+}
+
+static UwResult flush(Serializer* s)
+{
+    UwValue status = uw_file_write_all(s->writer, s->buffer, s->length);
+    if (uw_error(&status)) {
+        return uw_move(&status);
+    }
+    s->bytes_written += s->length;
+    s->length = 0;
+    return UwOK();
+}
+
+#define RESERVE(s, n)  \
+    if ((s)->length + (n) > SERIALIZE_BUFFER_SIZE) {  \
+        UwValue status = flush(s);  \
+        if (uw_error(&status)) {  \
+            return uw_move(&status);  \
+        }  \
+    }
+
+static UwResult write_bytes(Serializer* s, void* data, unsigned size)
+{
+    uint8_t* ptr = data;
+    while (size) {
+        RESERVE(s, 1)
+        unsigned n = SERIALIZE_BUFFER_SIZE - s->length;
+        if (n > size) {
+            n = size;
+        }
+        memcpy(s->buffer + s->length, ptr, n);
+        s->length += n;
+        ptr += n;
+        size -= n;
+    }
+    return UwOK();
+}
+
+static UwResult write_tag_varint(Serializer* s, uint8_t tag, uint64_t n)
+/*
+ * Write tag followed by LEB128 varint.
+ */
+{
+    RESERVE(s, 11)
+    uint8_t* out = s->buffer + s->length;
+    *out++ = tag;
+    while (n >= 0x80) {
+        *out++ = ((uint8_t) n) | 0x80;
+        n >>= 7;
+    }
+    *out++ = (uint8_t) n;
+    s->length = out - s->buffer;
+    return UwOK();
+}
+
+static bool is_written(Serializer* s, UwValuePtr value, bool track, UwValuePtr status)
+/*
+ * If value was written already, write back reference and return true.
+ * Otherwise assign the next index to value and return false.
+ *
+ * On error write status and return true.
+ */
+{
+    if (!track) {
+        return false;
+    }
+    if (value->extra_data) {
+        unsigned index = find_ref(s, value->extra_data);
+        if (index != UINT_MAX) {
+            *status = write_tag_varint(s, UW_SERIALIZE_BACKREF, index);
+            return true;
+        }
+        if (!add_ref(s, value->extra_data, s->next_index)) {
+            *status = UwOOM();
+            return true;
+        }
+    }
+    // embedded strings have no extra data but still take an index
+    s->next_index++;
+    return false;
+}
+
+static UwResult serialize_value(Serializer* s, UwValuePtr value, bool track);
+
+static UwResult serialize_string(Serializer* s, UwValuePtr str, bool track)
+{
+    UwValue status = UwOK();
+    if (is_written(s, str, track, &status)) {
+        return uw_move(&status);
+    }
+    uint8_t char_size = _uw_string_char_size(str);
+    unsigned length = _uw_string_length(str);
+
+    RESERVE(s, 1)
+    s->buffer[s->length++] = UwTypeId_String;
+    status = write_tag_varint(s, char_size, length);
+    if (uw_error(&status)) {
+        return uw_move(&status);
+    }
+    return write_bytes(s, _uw_string_char_ptr(str, 0), length * char_size);
+}
+
+static UwResult serialize_list(Serializer* s, UwValuePtr value, bool track)
+{
+    UwValue status = UwOK();
+    if (is_written(s, value, track, &status)) {
+        return uw_move(&status);
+    }
+    _UwList* list = _uw_get_data_ptr(value, UwTypeId_List);
+    unsigned length = _uw_list_length(list);
+
+    status = write_tag_varint(s, UwTypeId_List, length);
+    if (uw_error(&status)) {
+        return uw_move(&status);
+    }
+    for (unsigned i = 0; i < length; i++) {
+        status = serialize_value(s, _uw_list_item(list, i), track);
+        if (uw_error(&status)) {
+            return uw_move(&status);
+        }
+    }
+    return UwOK();
+}
+
+static UwResult serialize_map(Serializer* s, UwValuePtr value, bool track)
+{
+    UwValue status = UwOK();
+    if (is_written(s, value, track, &status)) {
+        return uw_move(&status);
+    }
+    _UwMap* map = _uw_get_data_ptr(value, UwTypeId_Map);
+    unsigned length = _uw_list_length(&map->kv_pairs);
+
+    status = write_tag_varint(s, UwTypeId_Map, length / 2);
+    if (uw_error(&status)) {
+        return uw_move(&status);
+    }
+    for (unsigned i = 0; i < length; i += 2) {
+        // keys are owned by the map, never refer to them
+        status = serialize_value(s, _uw_list_item(&map->kv_pairs, i), false);
+        if (uw_error(&status)) {
+            return uw_move(&status);
+        }
+        status = serialize_value(s, _uw_list_item(&map->kv_pairs, i + 1), track);
+        if (uw_error(&status)) {
+            return uw_move(&status);
+        }
+    }
+    return UwOK();
+}
+
+static UwResult serialize_value(Serializer* s, UwValuePtr value, bool track)
+{
+    if (uw_is_null(value)) {
+        RESERVE(s, 1)
+        s->buffer[s->length++] = UwTypeId_Null;
+        return UwOK();
+    }
+    if (uw_is_bool(value)) {
+        RESERVE(s, 2)
+        s->buffer[s->length++] = UwTypeId_Bool;
+        s->buffer[s->length++] = value->bool_value;
+        return UwOK();
+    }
+    if (uw_is_signed(value)) {
+        // zigzag encoding
+        UwType_Signed n = value->signed_value;
+        return write_tag_varint(s, UwTypeId_Signed, (((uint64_t) n) << 1) ^ (uint64_t) (n >> 63));
+    }
+    if (uw_is_unsigned(value)) {
+        return write_tag_varint(s, UwTypeId_Unsigned, value->unsigned_value);
+    }
+    if (uw_is_float(value)) {
+        RESERVE(s, 1 + sizeof(UwType_Float))
+        s->buffer[s->length++] = UwTypeId_Float;
+        memcpy(s->buffer + s->length, &value->float_value, sizeof(UwType_Float));
+        s->length += sizeof(UwType_Float);
+        return UwOK();
+    }
+    if (uw_is_string(value)) {
+        return serialize_string(s, value, track);
+    }
+    if (uw_is_list(value)) {
+        return serialize_list(s, value, track);
+    }
+    if (uw_is_map(value)) {
+        return serialize_map(s, value, track);
+    }
+    UwValue error = UwError(UW_ERROR_INCOMPATIBLE_TYPE);
+    _uw_set_status_desc(&error, "%s cannot be serialized", _uw_types[value->type_id]->name);
+    return uw_move(&error);
+}
+
+static UwResult serialize(UwValuePtr value, UwValuePtr writer, bool with_header, uint64_t* bytes_written)
+{
+    if (!_uw_get_interface(_uw_types[writer->type_id], UwInterfaceId_FileWriter)) {
+        return UwErrorNoInterface(writer, FileWriter);
+    }
+    Serializer s;
+    s.writer = writer;
+    s.length = 0;
+    s.bytes_written = 0;
+    s.next_index = 0;
+    s.num_refs = 0;
+    s.refs_capacity = 0;
+    s.refs = nullptr;
+
+    UwValue status = with_header? write_bytes(&s, header, sizeof(header)) : UwOK();
+    if (uw_ok(&status)) {
+        uw_destroy(&status);
+        status = serialize_value(&s, value, true);
+        if (uw_ok(&status)) {
+            uw_destroy(&status);
+            status = flush(&s);
+        }
+    }
+    free(s.refs);
+    if (bytes_written) {
+        *bytes_written += s.bytes_written;
+    }
+    return uw_move(&status);
+}
+
+UwResult uw_serialize(UwValuePtr value, UwValuePtr writer)
+{
+    return serialize(value, writer, true, nullptr);
+}
+
+UwResult _uw_serialize_value(UwValuePtr value, UwValuePtr writer, uint64_t* bytes_written)
+{
+    return serialize(value, writer, false, bytes_written);
+}
+
+/****************************************************************
+ * Deserializer
+ */
+
+#define DESERIALIZE_REFS_INITIAL_CAPACITY  64
+
+typedef struct {
+    uint8_t* buffer;
+    unsigned size;
+    unsigned position;
+    unsigned num_refs;
+    unsigned refs_capacity;
+    _UwValue* refs;  // clones of values that can be referred to
+} Deserializer;
+
+static UwResult data_error(unsigned position, char* message)
+{
+    UwValue error = UwError(UW_ERROR_BAD_SERIALIZED_DATA);
+    _uw_set_status_desc(&error, "%s at position %u", message, position);
+    return uw_move(&error);
+}
+
+static inline unsigned bytes_remaining(Deserializer* d)
+{
+    return d->size - d->position;
+}
+
+static bool read_varint(Deserializer* d, uint64_t* result)
+{
+    uint64_t n = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (d->position >= d->size) {
+            return false;
+        }
+        uint8_t b = d->buffer[d->position++];
+        n |= ((uint64_t) (b & 0x7F)) << shift;
+        if ((b & 0x80) == 0) {
+            *result = n;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool register_value(Deserializer* d, UwValuePtr value)
+/*
+ * Save clone of value for back references.
+ * The value may be destroyed before the tree is built,
+ * e.g. when it is replaced by the value of a duplicate map key.
+ */
+{
+    if (d->num_refs == d->refs_capacity) {
+        unsigned new_capacity = d->refs_capacity? d->refs_capacity * 2 : DESERIALIZE_REFS_INITIAL_CAPACITY;
+        _UwValue* new_refs = realloc(d->refs, new_capacity * sizeof(_UwValue));
+        if (!new_refs) {
+            return false;
+        }
+        d->refs = new_refs;
+        d->refs_capacity = new_capacity;
+    }
+    d->refs[d->num_refs++] = uw_clone(value);
+    return true;
+}
+
+static UwResult deserialize_value(Deserializer* d, unsigned depth, bool track);
+
+static UwResult deserialize_string(Deserializer* d, bool track)
+{
+    unsigned start = d->position;
+    if (d->position >= d->size) {
+        return data_error(start, "Unexpected end of data");
+    }
+    uint8_t char_size = d->buffer[d->position++];
+    if (char_size < 1 || char_size > 4) {
+        return data_error(start, "Bad char size");
+    }
+    uint64_t length;
+    if (!read_varint(d, &length)) {
+        return data_error(start, "Bad string length");
+    }
+    if (length > bytes_remaining(d) / char_size) {
+        return data_error(start, "String length exceeds data size");
+    }
+    UwValue result = uw_create_empty_string((unsigned) length, char_size);
+    if (uw_error(&result)) {
+        return uw_move(&result);
+    }
+    unsigned size = (unsigned) length * char_size;
+    memcpy(_uw_string_char_ptr(&result, 0), d->buffer + d->position, size);
+    _uw_string_set_length(&result, (unsigned) length);
+    d->position += size;
+
+    if (track && !register_value(d, &result)) {
+        return UwOOM();
+    }
+    return uw_move(&result);
+}
+
+static UwResult deserialize_list(Deserializer* d, unsigned depth, bool track)
+{
+    unsigned start = d->position;
+    uint64_t length;
+    if (!read_varint(d, &length)) {
+        return data_error(start, "Bad list length");
+    }
+    // each item takes at least one byte
+    if (length > bytes_remaining(d)) {
+        return data_error(start, "List length exceeds data size");
+    }
+    UwValue result = UwList();
+    if (uw_error(&result)) {
+        return uw_move(&result);
+    }
+    if (length && !uw_list_resize(&result, (unsigned) length)) {
+        return UwOOM();
+    }
+    if (track && !register_value(d, &result)) {
+        return UwOOM();
+    }
+    _UwList* list = _uw_get_data_ptr(&result, UwTypeId_List);
+    for (unsigned i = 0; i < length; i++) {
+        UwValue item = deserialize_value(d, depth + 1, track);
+        if (uw_error(&item)) {
+            return uw_move(&item);
+        }
+        if (!_uw_list_append_item(result.type_id, list, &item, &result)) {
+            return UwOOM();
+        }
+    }
+    return uw_move(&result);
+}
+
+static UwResult deserialize_map(Deserializer* d, unsigned depth, bool track)
+{
+    unsigned start = d->position;
+    uint64_t length;
+    if (!read_varint(d, &length)) {
+        return data_error(start, "Bad map length");
+    }
+    // each key and value take at least one byte
+    if (length > bytes_remaining(d) / 2) {
+        return data_error(start, "Map length exceeds data size");
+    }
+    UwValue result = UwMap();
+    if (uw_error(&result)) {
+        return uw_move(&result);
+    }
+    if (length && !uw_map_resize(&result, (unsigned) length)) {
+        return UwOOM();
+    }
+    if (track && !register_value(d, &result)) {
+        return UwOOM();
+    }
+    for (unsigned i = 0; i < length; i++) {
+        UwValue key = deserialize_value(d, depth + 1, false);
+        if (uw_error(&key)) {
+            return uw_move(&key);
+        }
+        UwValue value = deserialize_value(d, depth + 1, track);
+        if (uw_error(&value)) {
+            return uw_move(&value);
+        }
+        // keys are never referred to, no need to make deep copy
+        if (!_uw_map_update_nocopy(&result, &key, &value)) {
+            return UwOOM();
+        }
+    }
+    return uw_move(&result);
+}
+
+static UwResult deserialize_value(Deserializer* d, unsigned depth, bool track)
+/*
+ * `track` is false for map keys and their items.
+ */
+{
+    unsigned start = d->position;
+    if (d->position >= d->size) {
+        return data_error(start, "Unexpected end of data");
+    }
+    uint8_t tag = d->buffer[d->position++];
+    switch (tag) {
+        case UwTypeId_Null:
+            return UwNull();
+
+        case UwTypeId_Bool: {
+            if (d->position >= d->size || d->buffer[d->position] > 1) {
+                return data_error(start, "Bad Bool value");
+            }
+            return UwBool(d->buffer[d->position++]);
+        }
+        case UwTypeId_Signed: {
+            uint64_t n;
+            if (!read_varint(d, &n)) {
+                return data_error(start, "Bad Signed value");
+            }
+            return UwSigned((UwType_Signed) (n >> 1) ^ -(UwType_Signed) (n & 1));
+        }
+        case UwTypeId_Unsigned: {
+            uint64_t n;
+            if (!read_varint(d, &n)) {
+                return data_error(start, "Bad Unsigned value");
+            }
+            return UwUnsigned(n);
+        }
+        case UwTypeId_Float: {
+            if (bytes_remaining(d) < sizeof(UwType_Float)) {
+                return data_error(start, "Bad Float value");
+            }
+            UwType_Float f;
+            memcpy(&f, d->buffer + d->position, sizeof(UwType_Float));
+            d->position += sizeof(UwType_Float);
+            return UwFloat(f);
+        }
+        case UwTypeId_String:
+            return deserialize_string(d, track);
+
+        case UwTypeId_List:
+        case UwTypeId_Map:
+            if (depth >= UW_SERIALIZE_MAX_DEPTH) {
+                return data_error(start, "Nesting is too deep");
+            }
+            if (tag == UwTypeId_List) {
+                return deserialize_list(d, depth, track);
+            } else {
+                return deserialize_map(d, depth, track);
+            }
+
+        case UW_SERIALIZE_BACKREF: {
+            uint64_t index;
+            if (!read_varint(d, &index)) {
+                return data_error(start, "Bad back reference");
+            }
+            if (!track) {
+                return data_error(start, "Back reference in map key");
+            }
+            if (index >= d->num_refs) {
+                return data_error(start, "Back reference to nonexistent value");
+            }
+            return uw_clone(&d->refs[index]);
+        }
+        default:
+            return data_error(start, "Bad tag");
+    }
+}
+
+UwResult uw_deserialize(uint8_t* buffer, unsigned size)
+{
+    if (size < sizeof(header) || memcmp(buffer, header, sizeof(header)) != 0) {
+        return data_error(0, "Bad header");
+    }
+    unsigned position = sizeof(header);
+    UwValue result = _uw_deserialize_value(buffer, size, &position);
+    if (uw_ok(&result) && position != size) {
+        uw_destroy(&result);
+        result = data_error(position, "Extra data after value");
+    }
+    return uw_move(&result);
+}
+
+UwResult _uw_deserialize_value(uint8_t* buffer, unsigned size, unsigned* position)
+{
+    Deserializer d = {
+        .buffer   = buffer,
+        .size     = size,
+        .position = *position
+    };
+    UwValue result = deserialize_value(&d, 0, true);
+    for (unsigned i = 0; i < d.num_refs; i++) {
+        uw_destroy(&d.refs[i]);
+    }
+    free(d.refs);
+    *position = d.position;
+    return uw_move(&result);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+/*
+ * Serialization internals.
+ */
+
+#include "include/uw_serialize.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+UwResult _uw_serialize_value(UwValuePtr value, UwValuePtr writer, uint64_t* bytes_written);
+/*
+ * Serialize value without header, with its own set of back references.
+ * Add the number of bytes written to `*bytes_written`.
+ */
+
+UwResult _uw_deserialize_value(uint8_t* buffer, unsigned size, unsigned* position);
+/*
+ * Deserialize single value written by _uw_serialize_value
+ * starting at `*position` and update `*position`.
+ */
+
+#ifdef __cplusplus
+}
+#endif
@@ -9,6 +9,7 @@
 
 #include "include/uw_base.h"
 #include "include/uw_string.h"
+#include "src/uw_trace_internal.h"
 
 typedef struct {
     _UwValue description;  // string
@@ -31,7 +32,10 @@ static char* basic_statuses[] = {
     [UW_ERROR_FILE_ALREADY_OPENED] = "FILE_ALREADY_OPENED",
     [UW_ERROR_CANNOT_SET_FILENAME] = "CANNOT_SET_FILENAME",
     [UW_ERROR_FD_ALREADY_SET]      = "FD_ALREADY_SET",
-    [UW_ERROR_PUSHBACK_FAILED]     = "PUSHBACK_FAILED"
+    [UW_ERROR_PUSHBACK_FAILED]     = "PUSHBACK_FAILED",
+    [UW_ERROR_WOULD_BLOCK]         = "WOULD_BLOCK",
+    [UW_ERROR_BAD_NUMBER]          = "BAD_NUMBER",
+    [UW_ERROR_SHORT_WRITE]         = "SHORT_WRITE"
 };
 
 static char** statuses = nullptr;
@@ -120,6 +124,17 @@ UwResult uw_status_desc(UwValuePtr status)
     return UwString_1_12(6, '(', 'n', 'o', 'n', 'e', ')', 0, 0, 0, 0, 0, 0);
 }
 
+UwValuePtr _uw_status_desc_ptr(UwValuePtr status)
+{
+    uw_assert_status(status);
+
+    _UwStatusData* status_data = get_data_ptr(status);
+    if (status_data) {
+        return &status_data->description;
+    }
+    return nullptr;
+}
+
 void _uw_set_status_desc(UwValuePtr status, char* fmt, ...)
 {
     va_list ap;
@@ -145,6 +160,7 @@ void _uw_set_status_desc_ap(UwValuePtr status, char* fmt, va_list ap)
     if (vasprintf(&desc, fmt, ap) == -1) {
         return;
     }
+    _uw_trace(status_desc, status->status_code, desc);
     status_data->description = uw_create_string(desc);
     if (uw_error(&status_data->description)) {
         uw_destroy(&status_data->description);
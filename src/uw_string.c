@@ -3,8 +3,11 @@
 #include <libpussy/dump.h>
 
 #include "include/uw.h"
+#include "src/uw_alloc_stats_internal.h"
 #include "src/uw_charptr_internal.h"
+#include "src/uw_cpu_internal.h"
 #include "src/uw_string_internal.h"
+#include "src/uw_trace_internal.h"
 
 // lookup table to validate capacity
 
@@ -17,6 +20,81 @@ static unsigned _max_capacity[4] = {
     (UINT_MAX - _header_size) / 4
 };
 
+/****************************************************************
+ * Copy statistics
+ */
+
+static bool string_copy_stats_enabled = false;
+static UwStringCopyStats string_copy_stats = {};
+static UwStringCopyHook string_copy_hook = nullptr;
+static unsigned string_copy_sample_period = 1;
+static unsigned string_copy_sample_counter = 0;
+
+static void count_string_copy(bool cow, uint8_t char_size, uint8_t new_char_size, unsigned length)
+{
+    if (cow) {
+        string_copy_stats.cow_copies++;
+    } else if (new_char_size == char_size) {
+        string_copy_stats.growth_copies++;
+    }
+    if (new_char_size > char_size) {
+        string_copy_stats.promotions[char_size - 1][new_char_size - 1]++;
+    }
+    string_copy_stats.bytes_copied += (uint64_t) length * new_char_size;
+
+    if (string_copy_hook && (cow || new_char_size > char_size)) {
+        if (++string_copy_sample_counter >= string_copy_sample_period) {
+            string_copy_sample_counter = 0;
+            UwStringCopyEvent event = {
+                .cow = cow,
+                .old_char_size = char_size,
+                .new_char_size = new_char_size,
+                .length = length
+            };
+            string_copy_hook(&event);
+        }
+    }
+}
+
+void uw_enable_string_copy_stats(bool enable)
+{
+    string_copy_stats_enabled = enable;
+}
+
+void uw_reset_string_copy_stats()
+{
+    memset(&string_copy_stats, 0, sizeof(string_copy_stats));
+    string_copy_sample_counter = 0;
+}
+
+UwStringCopyStats uw_string_copy_stats()
+{
+    return string_copy_stats;
+}
+
+void uw_set_string_copy_hook(UwStringCopyHook hook, unsigned sample_period)
+{
+    string_copy_hook = hook;
+    string_copy_sample_period = sample_period? sample_period : 1;
+    string_copy_sample_counter = 0;
+}
+
+void uw_dump_string_copy_stats(FILE* fp)
+{
+    fprintf(fp, "COW copies: %llu, growth copies: %llu, bytes copied: %llu\n",
+            (unsigned long long) string_copy_stats.cow_copies,
+            (unsigned long long) string_copy_stats.growth_copies,
+            (unsigned long long) string_copy_stats.bytes_copied);
+    for (unsigned from = 0; from < 4; from++) {
+        for (unsigned to = from + 1; to < 4; to++) {
+            uint64_t n = string_copy_stats.promotions[from][to];
+            if (n) {
+                fprintf(fp, "promotions %u->%u: %llu\n", from + 1, to + 1, (unsigned long long) n);
+            }
+        }
+    }
+}
+
 /****************************************************************
  * Basic functions
  */
@@ -120,6 +198,11 @@ static inline unsigned get_extra_data_size(UwValuePtr str)
     return calc_extra_data_size(_uw_string_char_size(str), _uw_string_capacity(str), nullptr);
 }
 
+unsigned _uw_string_extra_data_size(UwValuePtr str)
+{
+    return get_extra_data_size(str);
+}
+
 static bool make_empty_string(UwValuePtr result, unsigned capacity, uint8_t char_size)
 /*
  * Create empty string with desired parameters.
@@ -140,7 +223,7 @@ static bool make_empty_string(UwValuePtr result, unsigned capacity, uint8_t char
         return true;
     }
 
-    if(capacity > _max_capacity[char_size]) {
+    if(capacity > _max_capacity[char_size - 1]) {
         return false;
     }
 
@@ -153,7 +236,7 @@ static bool make_empty_string(UwValuePtr result, unsigned capacity, uint8_t char
 
     UwType* t = _uw_types[result->type_id];
 
-    result->extra_data = t->allocator->allocate(memsize, true);
+    result->extra_data = _uw_allocate(t->allocator, result->type_id, memsize, true);
     if (!result->extra_data) {
         return false;
     }
@@ -175,17 +258,14 @@ static bool expand_string(UwValuePtr str, unsigned increment, uint8_t new_char_s
  */
 {
     uw_assert_string(str);
+    bool cow = false;
     uint8_t char_size = _uw_string_char_size(str);
+    if (new_char_size < char_size) {
+        // current char_size is greater than new one, use current as new:
+        new_char_size = char_size;
+    }
     if (str->str_embedded) {
-        if (new_char_size < char_size) {
-            if (increment == 0) {
-                // no need to expand
-                return true;
-            }
-            // current char_size is greater than new one, use current as new:
-            new_char_size = char_size;
-        }
-        if (increment > _max_capacity[new_char_size] - str->str_embedded_length) {
+        if (increment > _max_capacity[new_char_size - 1] - str->str_embedded_length) {
             return false;
         }
         unsigned new_length = str->str_embedded_length + increment;
@@ -193,6 +273,10 @@ static bool expand_string(UwValuePtr str, unsigned increment, uint8_t new_char_s
             // no need to expand
             if (new_char_size > char_size) {
                 // but need to make existing chars wider
+                _uw_trace(string_widen, str, char_size, new_char_size, str->str_embedded_length);
+                if (_unlikely_(string_copy_stats_enabled)) {
+                    count_string_copy(false, char_size, new_char_size, str->str_embedded_length);
+                }
                 _UwValue orig_str = *str;
                 str->str_embedded_char_size = new_char_size - 1;  // char_size is stored as 0-based
                 get_str_methods(&orig_str)->copy_to(
@@ -205,26 +289,22 @@ static bool expand_string(UwValuePtr str, unsigned increment, uint8_t new_char_s
         goto copy_string;
     }
 
-    if (str->extra_data->refcount > 1) {
+    if (_uw_refcount_load(&str->extra_data->refcount) > 1) {
         // always make a copy before modification of shared string data
-        // XXX handling refcount this way is extremely not thread safe
-        str->extra_data->refcount--;
+        cow = true;
         goto copy_string;
 
     } else {
-        uw_assert(str->extra_data->refcount == 1);
-
-        // refcount is 1, check if string needs expanding
+        // refcount is 1, nobody else can take a reference, check if string needs expanding
 
         if (new_char_size > char_size) {
             // copy string if char size needs to increase
-            str->extra_data->refcount = 0; // make refcount zero to free original data after copy
             goto copy_string;
         }
 
         unsigned length = _uw_string_length(str);
 
-        if (increment > _max_capacity[new_char_size] - length) {
+        if (increment > _max_capacity[new_char_size - 1] - length) {
             return false;
         }
 
@@ -244,14 +324,14 @@ static bool expand_string(UwValuePtr str, unsigned increment, uint8_t new_char_s
         if (new_cap_size > string_struct(str).cap_size) {
             // when cap_size changes, reallocating would require data move
             // it's easier and less error-prone to copy string
-            str->extra_data->refcount = 0; // make refcount zero to free original data after copy
             goto copy_string;
         }
 
         // reallocate data
 
-        if (!_uw_types[str->type_id]->allocator->reallocate((void**) &str->extra_data,
-                                                            orig_memsize, new_memsize, true, nullptr)) {
+        _uw_trace(string_realloc, str, orig_memsize, new_memsize);
+        if (!_uw_reallocate(_uw_types[str->type_id]->allocator, str->type_id, (void**) &str->extra_data,
+                            orig_memsize, new_memsize, true)) {
             return false;
         }
         _uw_string_set_caplen(str, new_capacity, length);
@@ -264,12 +344,8 @@ copy_string: {
         unsigned length = _uw_string_length(str);
         unsigned capacity = _uw_string_capacity(str);
 
-        if (increment > _max_capacity[new_char_size] - length) {
+        if (increment > _max_capacity[new_char_size - 1] - length) {
             // cannot expand
-            // restore refcount of the original string
-            if (!str->str_embedded) {
-                str->extra_data->refcount++;
-            }
             return false;
         }
 
@@ -278,25 +354,29 @@ copy_string: {
             new_capacity = capacity;
         }
 
-        if (new_char_size < char_size) {
-            new_char_size = char_size;
-        }
-
         // allocate string
         if (!make_empty_string(str, new_capacity, new_char_size)) {
-            // restore refcount of the original string
-            if (!str->str_embedded) {
-                str->extra_data->refcount++;
-            }
+            *str = orig_str;
             return false;
         }
+        _uw_trace(string_copy, str, length, new_capacity, new_char_size);
+        if (new_char_size > char_size) {
+            _uw_trace(string_widen, str, char_size, new_char_size, length);
+        }
         // copy original string to new string
         get_str_methods(&orig_str)->copy_to(_uw_string_char_ptr(&orig_str, 0), str, 0, length);
         _uw_string_set_length(str, length);
+        if (_unlikely_(string_copy_stats_enabled)) {
+            count_string_copy(cow, char_size, new_char_size, length);
+        }
 
-        // free saved string if not embedded and reference count is zero
-        if (!orig_str.str_embedded && orig_str.extra_data->refcount == 0) {
-            _uw_types[orig_str.type_id]->allocator->release((void**) &orig_str.extra_data, get_extra_data_size(&orig_str));
+        // drop reference to the original data only after copying,
+        // other owners may release it as soon as the reference is dropped
+        if (!orig_str.str_embedded) {
+            if (_uw_refcount_dec(&orig_str.extra_data->refcount) == 0) {
+                _uw_release(_uw_types[orig_str.type_id]->allocator, orig_str.type_id,
+                            (void**) &orig_str.extra_data, get_extra_data_size(&orig_str));
+            }
         }
         return true;
     }
@@ -322,10 +402,10 @@ static void string_destroy(UwValuePtr self)
     if (self->str_embedded) {
         return;
     }
-    if (0 == --self->extra_data->refcount) {
+    if (0 == _uw_refcount_dec(&self->extra_data->refcount)) {
 
         UwType* t = _uw_types[self->type_id];
-        t->allocator->release((void**) &self->extra_data, get_extra_data_size(self));
+        _uw_release(t->allocator, self->type_id, (void**) &self->extra_data, get_extra_data_size(self));
     }
 }
 
@@ -334,7 +414,7 @@ static UwResult string_clone(UwValuePtr self)
     UwValue result = *self;
     if (!result.str_embedded) {
         if (result.extra_data) {
-            result.extra_data->refcount++;
+            _uw_refcount_inc(&result.extra_data->refcount);
         }
     }
     return uw_move(&result);
@@ -564,6 +644,7 @@ static inline bool read_utf8_buffer(char8_t** ptr, unsigned* bytes_remaining, ch
             APPEND_NEXT
             *bytes_remaining = remaining;
         } else if ((c & 0b1111'1000) == 0b1111'0000) {
+            result = c & 0b0000'0111;
             if (_unlikely_(remaining < 3)) return false;
             APPEND_NEXT
             APPEND_NEXT
@@ -619,6 +700,18 @@ unsigned utf8_strlen2_buf(char8_t* buffer, unsigned* size, uint8_t* char_size)
     uint8_t  width = 0;
 
     while (_likely_(bytes_remaining)) {
+
+        // fast path: skip ASCII characters, they don't change width
+        if (_likely_(*ptr < 0x80)) {
+            unsigned n = _uw_kernels.ascii_prefix(ptr, bytes_remaining);
+            ptr += n;
+            bytes_remaining -= n;
+            length += n;
+            if (_unlikely_(!bytes_remaining)) {
+                break;
+            }
+        }
+
         char32_t c;
         if (_unlikely_(!read_utf8_buffer(&ptr, &bytes_remaining, &c))) {
             break;
@@ -914,44 +1007,23 @@ static uint8_t _max_char_size_uint8_t(uint8_t* self_ptr, unsigned length)
 
 static uint8_t _max_char_size_uint16_t(uint8_t* self_ptr, unsigned length)
 {
-    uint16_t* ptr = (uint16_t*) self_ptr;
-    while (_likely_(length--)) {
-        uint16_t c = *ptr++;
-        if (_unlikely_(c >= 256)) {
-            return 2;
-        }
-    }
-    return 1;
+    // bitwise OR of all chars has the same char size as the widest char
+    return calc_char_size(_uw_kernels.or_u16((uint16_t*) self_ptr, length));
 }
 
 static uint8_t _max_char_size_uint24_t(uint8_t* self_ptr, unsigned length)
 {
     uint24_t* ptr = (uint24_t*) self_ptr;
+    char32_t all_chars = 0;
     while (_likely_(length--)) {
-        char32_t c = get_char_uint24_t(&ptr);
-        if (_unlikely_(c >= 65536)) {
-            return 3;
-        } else if (_unlikely_(c >= 256)) {
-            return 2;
-        }
+        all_chars |= get_char_uint24_t(&ptr);
     }
-    return 1;
+    return calc_char_size(all_chars);
 }
 
 static uint8_t _max_char_size_uint32_t(uint8_t* self_ptr, unsigned length)
 {
-    uint32_t* ptr = (uint32_t*) self_ptr;
-    while (_likely_(length--)) {
-        uint32_t c = *ptr++;
-        if (_unlikely_(c >= 16777216)) {
-            return 4;
-        } else if (_unlikely_(c >= 65536)) {
-            return 3;
-        } else if (_unlikely_(c >= 256)) {
-            return 2;
-        }
-    }
-    return 1;
+    return calc_char_size(_uw_kernels.or_u32((uint32_t*) self_ptr, length));
 }
 
 /*
@@ -1170,13 +1242,23 @@ STR_COPY_TO_MEMCPY_HELPER_IMPL(uint32_t)
         }  \
     }
 
-STR_COPY_TO_HELPER_IMPL(uint8_t,  uint16_t)
-STR_COPY_TO_HELPER_IMPL(uint8_t,  uint32_t)
 STR_COPY_TO_HELPER_IMPL(uint16_t, uint8_t)
 STR_COPY_TO_HELPER_IMPL(uint16_t, uint32_t)
 STR_COPY_TO_HELPER_IMPL(uint32_t, uint8_t)
 STR_COPY_TO_HELPER_IMPL(uint32_t, uint16_t)
 
+// widening 1-byte chars, SIMD kernels:
+
+static inline void cp_uint8_t_uint16_t(uint8_t* self_ptr, uint16_t* dest_ptr, unsigned length)
+{
+    _uw_kernels.widen_u8_u16(self_ptr, dest_ptr, length);
+}
+
+static inline void cp_uint8_t_uint32_t(uint8_t* self_ptr, uint32_t* dest_ptr, unsigned length)
+{
+    _uw_kernels.widen_u8_u32(self_ptr, dest_ptr, length);
+}
+
 // uint24_t as source type:
 
 #define STR_COPY_TO_S24_HELPER_IMPL(type_name_dest)  \
@@ -1863,6 +1945,21 @@ bool uw_strchr(UwValuePtr str, char32_t chr, unsigned start_pos, unsigned* resul
     uint8_t* ptr = _uw_string_char_ptr(str, start_pos);
     uint8_t char_size = _uw_string_char_size(str);
 
+    if (char_size == 1) {
+        // memchr is way faster than char by char loop
+        if (chr > 255 || start_pos >= length) {
+            return false;
+        }
+        uint8_t* found = memchr(ptr, (int) chr, length - start_pos);
+        if (!found) {
+            return false;
+        }
+        if (result) {
+            *result = start_pos + (found - ptr);
+        }
+        return true;
+    }
+
     for (unsigned i = start_pos; i < length; i++) {
         char32_t codepoint = strmeth->get_char(ptr);
         if (codepoint == chr) {
@@ -2180,3 +2277,127 @@ unsigned uw_string_skip_chars(UwValuePtr str, unsigned position, char32_t* skipc
     }
     return length;
 }
+
+/****************************************************************
+ * Conversion to numbers
+ */
+
+static unsigned number_bounds(UwValuePtr str, unsigned* end_pos)
+/*
+ * Return position of the first non-space character and
+ * write position after the last non-space character to `end_pos`.
+ */
+{
+    unsigned start = uw_string_skip_spaces(str, 0);
+    unsigned end = _uw_string_length(str);
+    StrMethods* strmeth = get_str_methods(str);
+    while (end > start && uw_isspace(strmeth->get_char(_uw_string_char_ptr(str, end - 1)))) {
+        end--;
+    }
+    *end_pos = end;
+    return start;
+}
+
+static UwResult bad_number(char* message, unsigned position)
+{
+    UwValue error = UwError(UW_ERROR_BAD_NUMBER);
+    _uw_set_status_desc(&error, "%s at position %u", message, position);
+    return uw_move(&error);
+}
+
+UwResult uw_string_to_int(UwValuePtr str)
+{
+    uw_assert_string(str);
+
+    unsigned end;
+    unsigned start = number_bounds(str, &end);
+    unsigned pos = start;
+    StrMethods* strmeth = get_str_methods(str);
+    uint8_t char_size = _uw_string_char_size(str);
+    uint8_t* ptr = _uw_string_char_ptr(str, pos);
+
+    bool negative = false;
+    if (pos < end) {
+        char32_t c = strmeth->get_char(ptr);
+        if (c == '-' || c == '+') {
+            negative = (c == '-');
+            pos++;
+            ptr += char_size;
+        }
+    }
+    if (pos == end) {
+        return bad_number("Missing digits", pos);
+    }
+    uint64_t n = 0;
+    for (; pos < end; pos++, ptr += char_size) {
+        char32_t c = strmeth->get_char(ptr);
+        if (c < '0' || c > '9') {
+            return bad_number("Bad digit", pos);
+        }
+        unsigned digit = c - '0';
+        if (n > (UINT64_MAX - digit) / 10) {
+            return bad_number("Integer overflow", start);
+        }
+        n = n * 10 + digit;
+    }
+    if (negative) {
+        if (n > (uint64_t) UW_SIGNED_MAX + 1) {
+            return bad_number("Integer overflow", start);
+        }
+        return UwSigned((UwType_Signed) (0 - n));
+    }
+    if (n > (uint64_t) UW_SIGNED_MAX) {
+        return UwUnsigned(n);
+    }
+    return UwSigned((UwType_Signed) n);
+}
+
+UwResult uw_string_to_float(UwValuePtr str)
+{
+    uw_assert_string(str);
+
+    unsigned end;
+    unsigned start = number_bounds(str, &end);
+    unsigned length = end - start;
+    if (length == 0) {
+        return bad_number("Missing digits", start);
+    }
+
+    // strtod needs null-terminated ASCII string, use stack buffer if possible
+    char local_buffer[64];
+    char* buffer = local_buffer;
+    if (length >= sizeof(local_buffer)) {
+        buffer = malloc(length + 1);
+        if (!buffer) {
+            return UwOOM();
+        }
+    }
+    StrMethods* strmeth = get_str_methods(str);
+    uint8_t char_size = _uw_string_char_size(str);
+    uint8_t* ptr = _uw_string_char_ptr(str, start);
+    unsigned bad_position = UINT_MAX;
+    for (unsigned i = 0; i < length; i++, ptr += char_size) {
+        char32_t c = strmeth->get_char(ptr);
+        if (c == 0 || c >= 0x80) {
+            bad_position = start + i;
+            break;
+        }
+        buffer[i] = (char) c;
+    }
+    UwType_Float value = 0.0;
+    if (bad_position == UINT_MAX) {
+        buffer[length] = 0;
+        char* endptr;
+        value = strtod(buffer, &endptr);
+        if (endptr != buffer + length) {
+            bad_position = start + (endptr - buffer);
+        }
+    }
+    if (buffer != local_buffer) {
+        free(buffer);
+    }
+    if (bad_position != UINT_MAX) {
+        return bad_number("Bad number", bad_position);
+    }
+    return UwFloat(value);
+}
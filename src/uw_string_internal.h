@@ -301,6 +301,7 @@ static inline char32_t read_utf8_char(char8_t** str)
         APPEND_NEXT
         APPEND_NEXT
     } else if ((c & 0b1111'1000) == 0b1111'0000) {
+        codepoint = c & 0b0000'0111;
         APPEND_NEXT
         APPEND_NEXT
         APPEND_NEXT
@@ -322,6 +323,37 @@ bool _uw_string_append_charptr(UwValuePtr dest, UwValuePtr charptr, unsigned len
  * Append one of CharPtr types to dest. `char_size` must be correct maximal size of character in charptr.
  */
 
+unsigned _uw_string_extra_data_size(UwValuePtr str);
+/*
+ * Return memory size occupied by extra data of allocated string.
+ */
+
+/****************************************************************
+ * Number formatting, implemented in uw_base.c
+ */
+
+#define UW_INT_BUFFER_SIZE    24  // enough for sign and 20 digits
+#define UW_FLOAT_BUFFER_SIZE  32
+
+char* _uw_format_unsigned(uint64_t n, char* end);
+char* _uw_format_signed(int64_t n, char* end);
+/*
+ * Write decimal digits from right to left, two at a time, ending at `end`.
+ * Return pointer to the first character.
+ */
+
+unsigned _uw_format_float(double value, char* buffer);
+/*
+ * Write the value with 15, 16, or 17 significant digits, whichever
+ * is the first to read back to the same value. Trailing zeros are dropped,
+ * so values that need 15 digits or less are written with as few digits
+ * as they need, except subnormals: 5e-324 is written as 4.94065645841247e-324.
+ * Finite values always contain decimal point or exponent.
+ * `buffer` must be at least UW_FLOAT_BUFFER_SIZE long.
+ *
+ * Return length of null-terminated result.
+ */
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,24 @@
+#pragma once
+
+/*
+ * Statically defined tracepoints.
+ *
+ * When UW_WITH_USDT is defined, tracepoints are emitted as USDT probes
+ * with provider name `uw`, using <sys/sdt.h> from systemtap.
+ * Probes are nops until attached, e.g. with bpftrace:
+ *
+ *   bpftrace -e 'usdt:./binary:uw:map_resize { @[arg2] = count(); }'
+ *
+ * Otherwise tracepoints are compiled out and their arguments
+ * are not evaluated.
+ *
+ * Arguments must be integers or pointers.
+ * Example scripts are in tools/bpftrace.
+ */
+
+#ifdef UW_WITH_USDT
+#   include <sys/sdt.h>
+#   define _uw_trace(name, ...)  STAP_PROBEV(uw, name __VA_OPT__(,) __VA_ARGS__)
+#else
+#   define _uw_trace(name, ...)  ((void) 0)
+#endif
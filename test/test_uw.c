@@ -1,10 +1,23 @@
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
 
 #include "include/uw.h"
+#include "include/uw_csv.h"
+#include "include/uw_frozen_map.h"
+#include "include/uw_ipset.h"
+#include "include/uw_json.h"
+#include "include/uw_line_poller.h"
+#include "include/uw_lpm.h"
 #include "include/uw_netutils.h"
+#include "include/uw_serialize.h"
+#include "src/uw_map_internal.h"
 #include "src/uw_string_internal.h"
 
 int num_tests = 0;
@@ -653,6 +666,130 @@ void test_string()
         TEST(_uw_string_length(&str) == 2500);
         //uw_dump(stderr, &str);
     }
+
+    { // test number to string
+        UwValue v = UwSigned(INT64_MIN);
+        UwValue s = uw_to_string(&v);
+        TEST(uw_equal(&s, "-9223372036854775808"));
+    }
+    {
+        UwValue v = UwSigned(-42);
+        UwValue s = uw_to_string(&v);
+        TEST(uw_equal(&s, "-42"));
+        TEST(_uw_string_length(&s) == 3);
+        TEST(_uw_string_capacity(&s) == 12);  // embedded
+    }
+    {
+        UwValue v = UwUnsigned(UINT64_MAX);
+        UwValue s = uw_to_string(&v);
+        TEST(uw_equal(&s, "18446744073709551615"));
+    }
+    {
+        UwValue v = UwUnsigned(0);
+        UwValue s = uw_to_string(&v);
+        TEST(uw_equal(&s, "0"));
+    }
+    {
+        UwValue v = UwFloat(0.1);
+        UwValue s = uw_to_string(&v);
+        TEST(uw_equal(&s, "0.1"));
+    }
+    {
+        UwValue v = UwFloat(1.0);
+        UwValue s = uw_to_string(&v);
+        TEST(uw_equal(&s, "1.0"));
+    }
+    {
+        UwValue v = UwFloat(-1.5e300);
+        UwValue s = uw_to_string(&v);
+        TEST(uw_equal(&s, "-1.5e+300"));
+    }
+    {
+        // 17 digits when fewer do not read back
+        UwValue v = UwFloat(0.1 + 0.2);
+        UwValue s = uw_to_string(&v);
+        TEST(uw_equal(&s, "0.30000000000000004"));
+    }
+    {
+        // subnormals are not written with the shortest representation
+        UwValue v = UwFloat(5e-324);
+        UwValue s = uw_to_string(&v);
+        TEST(uw_equal(&s, "4.94065645841247e-324"));
+    }
+
+    { // test string to number
+        UwValue str = uw_create("  -9223372036854775808 ");
+        UwValue v = uw_string_to_int(&str);
+        TEST(uw_is_signed(&v));
+        TEST(v.signed_value == INT64_MIN);
+    }
+    {
+        UwValue str = uw_create("18446744073709551615");
+        UwValue v = uw_string_to_int(&str);
+        TEST(uw_is_unsigned(&v));
+        TEST(v.unsigned_value == UINT64_MAX);
+    }
+    {
+        UwValue str = uw_create_empty_string(0, 2);
+        uw_string_append(&str, "\t+123");
+        TEST(_uw_string_char_size(&str) == 2);
+        UwValue v = uw_string_to_int(&str);
+        TEST(uw_is_signed(&v));
+        TEST(v.signed_value == 123);
+    }
+    {
+        UwValue str = uw_create(U"12\u0663");
+        UwValue v = uw_string_to_int(&str);
+        TEST(uw_error(&v));
+        TEST(v.status_code == UW_ERROR_BAD_NUMBER);
+    }
+    {
+        char* bad[] = { "", "  ", "-", "1 2", "0x10", "18446744073709551616", "-9223372036854775809" };
+        for (unsigned i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+            UwValue str = uw_create(bad[i]);
+            UwValue v = uw_string_to_int(&str);
+            TEST(uw_error(&v));
+            TEST(v.status_code == UW_ERROR_BAD_NUMBER);
+        }
+    }
+    {
+        UwValue str = uw_create(" 2.5e-3\t");
+        UwValue v = uw_string_to_float(&str);
+        TEST(uw_is_float(&v));
+        TEST(v.float_value == 2.5e-3);
+    }
+    {
+        UwValue str = uw_create_empty_string(0, 4);
+        uw_string_append(&str, " -0.125");
+        TEST(_uw_string_char_size(&str) == 4);
+        UwValue v = uw_string_to_float(&str);
+        TEST(uw_is_float(&v));
+        TEST(v.float_value == -0.125);
+    }
+    {
+        UwValue str = uw_create("");
+        for (unsigned i = 0; i < 100; i++) {
+            uw_string_append(&str, '0');
+        }
+        uw_string_append(&str, "1.5");
+        UwValue v = uw_string_to_float(&str);
+        TEST(uw_is_float(&v));
+        TEST(v.float_value == 1.5);
+    }
+    {
+        char* bad[] = { "", "1.5x", "1.5 2", "e" };
+        for (unsigned i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+            UwValue str = uw_create(bad[i]);
+            UwValue v = uw_string_to_float(&str);
+            TEST(uw_error(&v));
+            TEST(v.status_code == UW_ERROR_BAD_NUMBER);
+        }
+    }
+    {
+        UwValue str = uw_create(U"1.5\u0663");
+        UwValue v = uw_string_to_float(&str);
+        TEST(uw_error(&v));
+    }
 }
 
 void test_list()
@@ -796,6 +933,67 @@ void test_map()
         TEST(uw_map_length(&map) == 9);
         //uw_dump(stderr, &map);
     }
+
+    { // delete keys with colliding hashes
+        UwValue map = UwMap();
+        for (int i = 0; i < 1000; i++) {
+            UwValue key = uw_create(i);
+            UwValue value = uw_create(i * 3);
+            uw_map_update(&map, &key, &value);
+        }
+        unsigned deleted = 0;
+        for (int i = 0; i < 1000; i += 2) {
+            deleted += uw_map_del(&map, i);
+        }
+        TEST(deleted == 500);
+        TEST(uw_map_length(&map) == 500);
+        unsigned found = 0;
+        for (int i = 1; i < 1000; i += 2) {
+            UwValue value = uw_map_get(&map, i);
+            found += uw_equal(&value, i * 3);
+        }
+        TEST(found == 500);
+        // delete the last but one pair
+        UwValue key = UwNull();
+        UwValue value = UwNull();
+        TEST(uw_map_item(&map, 498, &key, &value));
+        TEST(uw_map_del(&map, &key));
+        UwValue last = uw_map_get(&map, 999);
+        TEST(uw_equal(&last, 999 * 3));
+
+        UwValue stats = uw_map_stats(&map);
+        TEST(uw_is_map(&stats));
+        UwValue items_used = uw_map_get(&stats, "items_used");
+        TEST(uw_equal(&items_used, 499));
+        UwValue capacity = uw_map_get(&stats, "capacity");
+        UwValue load_factor = uw_map_get(&stats, "load_factor");
+        TEST(load_factor.float_value == 499.0 / capacity.unsigned_value);
+        UwValue histogram = uw_map_get(&stats, "probe_histogram");
+        unsigned total = 0;
+        for (unsigned i = 0, n = uw_list_length(&histogram); i < n; i++) {
+            UwValue count = uw_list_item(&histogram, i);
+            total += count.unsigned_value;
+        }
+        TEST(total == 499);
+        UwValue longest_cluster = uw_map_get(&stats, "longest_cluster");
+        TEST(longest_cluster.unsigned_value >= 1);
+        TEST(longest_cluster.unsigned_value < capacity.unsigned_value);
+    }
+    {
+        // deep copy does not share data
+        char long_str[] = "a string long enough not to be embedded in the value itself";
+        UwValue map = UwMap(UwCharPtr(long_str), UwCharPtr(long_str));
+        UwValue copy = uw_deepcopy(&map);
+        TEST(uw_equal(&map, &copy));
+        UwValue key = UwNull();
+        UwValue value = UwNull();
+        UwValue copy_key = UwNull();
+        UwValue copy_value = UwNull();
+        TEST(uw_map_item(&map, 0, &key, &value));
+        TEST(uw_map_item(&copy, 0, &copy_key, &copy_value));
+        TEST(key.extra_data != copy_key.extra_data);
+        TEST(value.extra_data != copy_value.extra_data);
+    }
 }
 
 void test_file()
@@ -806,6 +1004,177 @@ void test_file()
 
     char8_t data_filename[] = u8"./test/data/utf8-crossing-buffer-boundary";
 
+    { // write strings of various char sizes to pipe
+        int fds[2];
+        TEST(pipe(fds) == 0);
+        UwValue writer = uw_create_file();
+        UwValue status = uw_file_set_fd(&writer, fds[1]);
+        TEST(uw_ok(&status));
+
+        UwValue strings = UwList();
+        uw_list_append(&strings, "hello, world! ");
+        uw_list_append(&strings, u8"¡olé! ");
+        uw_list_append(&strings, c);
+        uw_list_append(&strings, U"\U0001F600");
+
+        UwValue long_thai = uw_create("");
+        for (unsigned i = 0; i < 1000; i++) {
+            uw_string_append(&long_thai, c);
+        }
+        {
+            UwValue status = uw_file_write_strings(&writer, &strings);
+            TEST(uw_ok(&status));
+        }
+        {
+            UwValue status = uw_file_write_string(&writer, &long_thai);
+            TEST(uw_ok(&status));
+        }
+        close(fds[1]);
+
+        char expected[] = u8"hello, world! ¡olé! สบาย\n\U0001F600";
+        unsigned expected_len = strlen(expected) + 1000 * strlen((char*) c);
+        char buffer[expected_len + 1];
+        ssize_t n = 0;
+        for (;;) {
+            ssize_t r = read(fds[0], buffer + n, sizeof(buffer) - n);
+            if (r <= 0) {
+                break;
+            }
+            n += r;
+        }
+        close(fds[0]);
+        TEST(n == expected_len);
+        TEST(memcmp(buffer, expected, strlen(expected)) == 0);
+        TEST(memcmp(buffer + expected_len - strlen((char*) c), c, strlen((char*) c)) == 0);
+
+        uw_list_append(&strings, 1);
+        {
+            UwValue status = uw_file_write_strings(&writer, &strings);
+            TEST(uw_error(&status));
+        }
+    }
+
+    { // positional I/O, seek, tell, size
+        char temp_filename[] = "/tmp/test-uw-XXXXXX";
+        int fd = mkstemp(temp_filename);
+        TEST(fd != -1);
+        UwValue file = uw_create_file();
+        UwValue status = uw_file_set_fd(&file, fd);
+        TEST(uw_ok(&status));
+
+        unsigned n;
+        {
+            UwValue status = uw_file_pwrite(&file, "world\n", 6, 6, &n);
+            TEST(uw_ok(&status));
+            TEST(n == 6);
+        }
+        {
+            UwValue status = uw_file_pwrite(&file, "hello ", 6, 0, &n);
+            TEST(uw_ok(&status));
+            TEST(n == 6);
+        }
+        {
+            UwValue position = uw_file_tell(&file);
+            TEST(uw_is_unsigned(&position));
+            TEST(position.unsigned_value == 0);
+        }
+        {
+            UwValue size = uw_file_size(&file);
+            TEST(uw_is_unsigned(&size));
+            TEST(size.unsigned_value == 12);
+        }
+        {
+            UwValue status = uw_file_fadvise(&file, 0, 0, POSIX_FADV_SEQUENTIAL);
+            TEST(uw_ok(&status));
+        }
+        char buffer[32];
+        {
+            UwValue status = uw_file_pread(&file, buffer, sizeof(buffer), 6, &n);
+            TEST(uw_ok(&status));
+            TEST(n == 6);
+            TEST(memcmp(buffer, "world\n", 6) == 0);
+        }
+        {
+            // seek discards data buffered by line reader
+            UwValue status = uw_start_read_lines(&file);
+            TEST(uw_ok(&status));
+            UwValue position = uw_file_seek(&file, -6, SEEK_END);
+            TEST(position.unsigned_value == 6);
+            UwValue line = uw_read_line(&file);
+            TEST(uw_equal(&line, "world\n"));
+        }
+        {
+            UwValue position = uw_file_seek(&file, 0, SEEK_SET);
+            TEST(position.unsigned_value == 0);
+            UwValue status = uw_file_read(&file, buffer, 5, &n);
+            TEST(uw_ok(&status));
+            TEST(memcmp(buffer, "hello", 5) == 0);
+            UwValue position2 = uw_file_tell(&file);
+            TEST(position2.unsigned_value == 5);
+        }
+        {
+            // copy file range to another file
+            char dest_filename[] = "/tmp/test-uw-XXXXXX";
+            int dest_fd = mkstemp(dest_filename);
+            TEST(dest_fd != -1);
+            UwValue dest = uw_create_file();
+            UwValue status = uw_file_set_fd(&dest, dest_fd);
+            TEST(uw_ok(&status));
+            UwValue n = uw_file_copy(&dest, &file, 6, 5);
+            TEST(uw_is_unsigned(&n));
+            TEST(n.unsigned_value == 5);
+            UwValue n2 = uw_file_copy(&dest, &file, 0, 0);
+            TEST(n2.unsigned_value == 12);
+            unsigned bytes_read;
+            UwValue status2 = uw_file_pread(&dest, buffer, sizeof(buffer), 0, &bytes_read);
+            TEST(uw_ok(&status2));
+            TEST(bytes_read == 17);
+            TEST(memcmp(buffer, "worldhello world\n", 17) == 0);
+            close(dest_fd);
+            unlink(dest_filename);
+        }
+        {
+            // copy to pipe
+            int fds[2];
+            TEST(pipe(fds) == 0);
+            UwValue dest = uw_create_file();
+            UwValue status = uw_file_set_fd(&dest, fds[1]);
+            TEST(uw_ok(&status));
+            UwValue n = uw_file_copy(&dest, &file, 0, 0);
+            TEST(n.unsigned_value == 12);
+            TEST(read(fds[0], buffer, sizeof(buffer)) == 12);
+            TEST(memcmp(buffer, "hello world\n", 12) == 0);
+            close(fds[0]);
+            close(fds[1]);
+        }
+        {
+            // copy from pipe
+            int fds[2];
+            TEST(pipe(fds) == 0);
+            TEST(write(fds[1], "hello pipe\n", 11) == 11);
+            close(fds[1]);
+            UwValue src = uw_create_file();
+            UwValue status = uw_file_set_fd(&src, fds[0]);
+            TEST(uw_ok(&status));
+
+            UwValue error = uw_file_copy(&file, &src, 1, 0);
+            TEST(error.status_code == UW_ERROR_ERRNO && error.uw_errno == ESPIPE);
+
+            UwValue position = uw_file_seek(&file, 0, SEEK_END);
+            UwValue n = uw_file_copy(&file, &src, 0, 0);
+            TEST(uw_is_unsigned(&n));
+            TEST(n.unsigned_value == 11);
+            unsigned bytes_read;
+            UwValue status2 = uw_file_pread(&file, buffer, sizeof(buffer), position.unsigned_value, &bytes_read);
+            TEST(uw_ok(&status2));
+            TEST(bytes_read == 11);
+            TEST(memcmp(buffer, "hello pipe\n", 11) == 0);
+            close(fds[0]);
+        }
+        close(fd);
+        unlink(temp_filename);
+    }
+
     UwValue file = uw_file_open(data_filename, O_RDONLY, 0);
     UwValue status = uw_start_read_lines(&file);
     TEST(uw_ok(&status));
@@ -828,6 +1197,25 @@ void test_file()
         TEST(uw_ok(&status));
     }
     TEST(uw_equal(&line, c));
+
+    { // read entire file and compare with lines
+        UwValue status = uw_start_read_lines(&file);
+        TEST(uw_ok(&status));
+        UwValue expected = uw_create("");
+        for (;;) {
+            UwValue line = uw_read_line(&file);
+            if (uw_error(&line)) {
+                break;
+            }
+            uw_string_append(&expected, &line);
+        }
+        UwValue fresh_file = uw_file_open(data_filename, O_RDONLY, 0);
+        UwValue content = uw_file_read_all(&fresh_file);
+        TEST(uw_is_string(&content));
+        TEST(uw_strlen(&content) == uw_strlen(&expected));
+        TEST(uw_string_char_size(&content) == 2);
+        TEST(uw_equal(&content, &expected));
+    }
 }
 
 void test_string_io()
@@ -877,6 +1265,508 @@ void test_string_io()
     }
 }
 
+void test_csv()
+{
+    UwValue sio = uw_create_string_io(
+        "a,b,c\n"
+        "\"quoted, with comma\",\"say \"\"hi\"\"\",x\r\n"
+        "\"multi\nline\",,\n"
+        "\n"
+        u8"один,два\n"
+        "\"unterminated\n"
+    );
+    UwValue reader = uw_create_csv_reader(&sio, ',');
+    TEST(uw_is_subtype(&reader, UwTypeId_CsvReader));
+
+    UwValue row = UwList();
+    {
+        UwValue status = uw_csv_read_row(&reader, &row);
+        TEST(uw_ok(&status));
+        TEST(uw_list_length(&row) == 3);
+        UwValue c = uw_list_item(&row, 2);
+        TEST(uw_equal(&c, "c"));
+    }
+    {
+        UwValue status = uw_csv_read_row(&reader, &row);
+        TEST(uw_ok(&status));
+        TEST(uw_list_length(&row) == 3);
+        UwValue a = uw_list_item(&row, 0);
+        UwValue b = uw_list_item(&row, 1);
+        UwValue c = uw_list_item(&row, 2);
+        TEST(uw_equal(&a, "quoted, with comma"));
+        TEST(uw_equal(&b, "say \"hi\""));
+        TEST(uw_equal(&c, "x"));
+    }
+    {
+        UwValue status = uw_csv_read_row(&reader, &row);
+        TEST(uw_ok(&status));
+        TEST(uw_list_length(&row) == 3);
+        UwValue a = uw_list_item(&row, 0);
+        UwValue b = uw_list_item(&row, 1);
+        TEST(uw_equal(&a, "multi\nline"));
+        TEST(uw_equal(&b, ""));
+    }
+    {
+        UwValue status = uw_csv_read_row(&reader, &row);
+        TEST(uw_ok(&status));
+        TEST(uw_list_length(&row) == 0);
+    }
+    {
+        UwValue status = uw_csv_read_row(&reader, &row);
+        TEST(uw_ok(&status));
+        TEST(uw_list_length(&row) == 2);
+        UwValue b = uw_list_item(&row, 1);
+        TEST(uw_equal(&b, u8"два"));
+    }
+    {
+        UwValue status = uw_csv_read_row(&reader, &row);
+        TEST(uw_error(&status));
+        TEST(status.status_code == UW_ERROR_UNTERMINATED_QUOTE);
+    }
+    {
+        UwValue status = uw_csv_read_row(&reader, &row);
+        TEST(uw_eof(&status));
+    }
+}
+
+void test_json()
+{
+    {
+        char8_t* text = (char8_t*) u8" { \"a\": [1, -2, 18446744073709551615, 1.5e3, true, false, null, [], {}],"
+                        u8"   \"b\": \"plain\", \"c\": \"esc\\n\\\"\\u00e9\\u0e2a\\ud83d\\ude00\", \"d\": \"широкий\","
+                        u8"   \"a\": {\"nested\": [[[\"deep\"]]]} } ";
+        UwValue result = uw_json_parse(text, strlen((char*) text));
+        TEST(uw_is_map(&result));
+        TEST(uw_map_length(&result) == 4);
+
+        UwValue a = uw_map_get(&result, "a");
+        TEST(uw_is_map(&a));
+        UwValue nested = uw_map_get(&a, "nested");
+        TEST(uw_is_list(&nested));
+        TEST(uw_list_length(&nested) == 1);
+
+        UwValue b = uw_map_get(&result, "b");
+        TEST(uw_equal(&b, "plain"));
+        TEST(uw_string_char_size(&b) == 1);
+
+        UwValue c = uw_map_get(&result, "c");
+        TEST(uw_equal(&c, u8"esc\n\"éส😀"));
+        TEST(uw_strlen(&c) == 8);
+        TEST(uw_string_char_size(&c) == 3);
+
+        UwValue d = uw_map_get(&result, "d");
+        TEST(uw_equal(&d, u8"широкий"));
+        TEST(uw_string_char_size(&d) == 2);
+    }
+    {
+        char8_t* text = (char8_t*) u8"[1, -9223372036854775808, 18446744073709551615, 18446744073709551616, 0.25, []]";
+        UwValue result = uw_json_parse(text, strlen((char*) text));
+        TEST(uw_is_list(&result));
+        TEST(uw_list_length(&result) == 6);
+        UwValue i0 = uw_list_item(&result, 0);
+        UwValue i1 = uw_list_item(&result, 1);
+        UwValue i2 = uw_list_item(&result, 2);
+        UwValue i3 = uw_list_item(&result, 3);
+        UwValue i4 = uw_list_item(&result, 4);
+        UwValue i5 = uw_list_item(&result, 5);
+        TEST(uw_is_signed(&i0) && i0.signed_value == 1);
+        TEST(uw_is_signed(&i1) && i1.signed_value == INT64_MIN);
+        TEST(uw_is_unsigned(&i2) && i2.unsigned_value == UINT64_MAX);
+        TEST(uw_is_float(&i3));
+        TEST(uw_is_float(&i4) && i4.float_value == 0.25);
+        TEST(uw_is_list(&i5) && uw_list_length(&i5) == 0);
+    }
+    {
+        // not null-terminated
+        char8_t text[] = { '"', 'x', '"', '1' };
+        UwValue result = uw_json_parse(text, 3);
+        TEST(uw_equal(&result, "x"));
+    }
+    {
+        // raw UTF-8 and escapes produce the same string
+        char8_t* text = (char8_t*) u8"[\"\\ud83d\\ude00\", \"😀\"]";
+        UwValue result = uw_json_parse(text, strlen((char*) text));
+        UwValue escaped = uw_list_item(&result, 0);
+        UwValue raw = uw_list_item(&result, 1);
+        TEST(uw_equal(&escaped, &raw));
+        TEST(uw_char_at(&raw, 0) == 0x1F600);
+    }
+    {
+        char* bad[] = {
+            "",
+            "[1, 2",
+            "[1, 2}",
+            "{\"a\" 1}",
+            "{1: 2}",
+            "[1,]",
+            "[01]",
+            "[1.]",
+            "\"unterminated",
+            "\"bad \\x escape\"",
+            "\"raw\ttab\"",
+            "[\"raw\nnewline\"]",
+            "tru",
+            "[] []",
+            "nul"
+        };
+        for (unsigned i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+            UwValue result = uw_json_parse((char8_t*) bad[i], strlen(bad[i]));
+            TEST(uw_error(&result));
+            TEST(result.status_code == UW_ERROR_BAD_JSON);
+        }
+    }
+    {
+        // too deep
+        char8_t text[UW_JSON_MAX_DEPTH + 1];
+        memset(text, '[', sizeof(text));
+        UwValue result = uw_json_parse(text, sizeof(text));
+        TEST(uw_error(&result));
+        TEST(result.status_code == UW_ERROR_BAD_JSON);
+    }
+    {
+        // compact and pretty output
+        char8_t* text = (char8_t*) u8"{\"a\": [1, -2, 18446744073709551615, 0.1, 1.0, true, null, [], {}], \"s\": \"q\\\"\\u0001\u00e9ส\"}";
+        UwValue value = uw_json_parse(text, strlen((char*) text));
+        TEST(uw_is_map(&value));
+
+        UwValue compact = UwString();
+        UwValue status = uw_json_write(&value, &compact, 0);
+        TEST(uw_ok(&status));
+        TEST(uw_equal(&compact, u8"{\"a\":[1,-2,18446744073709551615,0.1,1.0,true,null,[],{}],\"s\":\"q\\\"\\u0001éส\"}"));
+
+        UwValue pretty = UwString();
+        UwValue status2 = uw_json_write(&value, &pretty, 2);
+        TEST(uw_ok(&status2));
+        TEST(uw_equal(&pretty, u8"{\n  \"a\": [\n    1,\n    -2,\n    18446744073709551615,\n    0.1,\n    1.0,\n"
+                               u8"    true,\n    null,\n    [],\n    {}\n  ],\n  \"s\": \"q\\\"\\u0001éส\"\n}"));
+    }
+    {
+        // round trip through pipe
+        UwValue value = UwList();
+        uw_list_append(&value, 1e300);
+        uw_list_append(&value, -1.0/3.0);
+        uw_list_append(&value, (UwType_Signed) INT64_MIN);
+        UwValue long_string = uw_create("");
+        for (unsigned i = 0; i < 1000; i++) {
+            uw_string_append(&long_string, "tab\t");
+        }
+        uw_list_append(&value, &long_string);
+
+        int fds[2];
+        TEST(pipe(fds) == 0);
+        UwValue writer = uw_create_file();
+        UwValue status = uw_file_set_fd(&writer, fds[1]);
+        TEST(uw_ok(&status));
+        UwValue status2 = uw_json_write(&value, &writer, 0);
+        TEST(uw_ok(&status2));
+        close(fds[1]);
+
+        char8_t buffer[8192];
+        ssize_t n = read(fds[0], buffer, sizeof(buffer));
+        TEST(n > 5000);
+        close(fds[0]);
+
+        UwValue copy = uw_json_parse(buffer, n);
+        TEST(uw_equal(&copy, &value));
+    }
+    {
+        // errors
+        UwValue map = UwMap(UwSigned(1), UwSigned(2));
+        UwValue output = UwString();
+        UwValue status = uw_json_write(&map, &output, 0);
+        TEST(status.status_code == UW_ERROR_INCOMPATIBLE_TYPE);
+
+        UwValue list = UwList();
+        uw_list_append(&list, &list);
+        UwValue status2 = uw_json_write(&list, &output, 0);
+        TEST(status2.status_code == UW_ERROR_CYCLIC_REFERENCE);
+    }
+}
+
+void test_serialize()
+{
+    UwValue shared_str = uw_create(u8"shared string ส");
+    UwValue shared_list = UwList();
+    uw_list_append(&shared_list, "x");
+    uw_list_append(&shared_list, 2.5);
+
+    UwValue value = UwMap(
+        UwCharPtr("null"),     UwNull(),
+        UwCharPtr("bool"),     UwBool(true),
+        UwCharPtr("signed"),   UwSigned(-123456789),
+        UwCharPtr("min"),      UwSigned(INT64_MIN),
+        UwCharPtr("unsigned"), UwUnsigned(UINT64_MAX),
+        UwCharPtr("string1"),  uw_clone(&shared_str),
+        UwCharPtr("string2"),  uw_clone(&shared_str),
+        UwCharPtr("list1"),    uw_clone(&shared_list),
+        UwCharPtr("list2"),    uw_clone(&shared_list),
+        UwCharPtr("wide"),     UwChar32Ptr(U"\U0001F600 wide")
+    );
+    uint8_t buffer[4096];
+    ssize_t size;
+    {
+        int fds[2];
+        TEST(pipe(fds) == 0);
+        UwValue writer = uw_create_file();
+        UwValue status = uw_file_set_fd(&writer, fds[1]);
+        TEST(uw_ok(&status));
+        UwValue status2 = uw_serialize(&value, &writer);
+        TEST(uw_ok(&status2));
+        close(fds[1]);
+        size = read(fds[0], buffer, sizeof(buffer));
+        TEST(size > 0);
+        close(fds[0]);
+    }
+    {
+        UwValue copy = uw_deserialize(buffer, size);
+        TEST(uw_is_map(&copy));
+        TEST(uw_equal(&copy, &value));
+
+        // shared values are still shared
+        UwValue s1 = uw_map_get(&copy, "string1");
+        UwValue s2 = uw_map_get(&copy, "string2");
+        TEST(s1.extra_data == s2.extra_data);
+        UwValue l1 = uw_map_get(&copy, "list1");
+        UwValue l2 = uw_map_get(&copy, "list2");
+        TEST(l1.extra_data == l2.extra_data);
+
+        UwValue wide = uw_map_get(&copy, "wide");
+        TEST(uw_string_char_size(&wide) == 3);
+    }
+    {
+        // truncated and corrupted data
+        for (ssize_t n = 0; n < size; n++) {
+            UwValue copy = uw_deserialize(buffer, n);
+            TEST(uw_error(&copy));
+        }
+        uint8_t bad_list[] = { 'U', 'W', 'B', UW_SERIALIZE_VERSION, UwTypeId_List, 0xFF, 0xFF, 0xFF, 0xFF, 0x0F };
+        UwValue status = uw_deserialize(bad_list, sizeof(bad_list));
+        TEST(status.status_code == UW_ERROR_BAD_SERIALIZED_DATA);
+
+        uint8_t bad_ref[] = { 'U', 'W', 'B', UW_SERIALIZE_VERSION, UwTypeId_List, 1, UW_SERIALIZE_BACKREF, 1 };
+        UwValue status2 = uw_deserialize(bad_ref, sizeof(bad_ref));
+        TEST(status2.status_code == UW_ERROR_BAD_SERIALIZED_DATA);
+    }
+    {
+        // back reference to the value replaced by duplicate key
+        uint8_t data[] = {
+            'U', 'W', 'B', UW_SERIALIZE_VERSION, UwTypeId_Map, 3,
+            UwTypeId_String, 1, 1, 'a', UwTypeId_List, 0,
+            UwTypeId_String, 1, 1, 'a', UwTypeId_Null,
+            UwTypeId_String, 1, 1, 'b', UW_SERIALIZE_BACKREF, 1
+        };
+        UwValue map = uw_deserialize(data, sizeof(data));
+        TEST(uw_is_map(&map));
+        UwValue b = uw_map_get(&map, "b");
+        TEST(uw_is_list(&b));
+        TEST(uw_list_length(&b) == 0);
+    }
+    {
+        // cyclic reference
+        uint8_t data[] = { 'U', 'W', 'B', UW_SERIALIZE_VERSION, UwTypeId_List, 2, UW_SERIALIZE_BACKREF, 0, UwTypeId_Null };
+        UwValue list = uw_deserialize(data, sizeof(data));
+        TEST(uw_is_list(&list));
+        UwValue item = uw_list_item(&list, 0);
+        TEST(item.extra_data == list.extra_data);
+    }
+}
+
+void test_frozen_map()
+{
+    UwValue map = UwMap();
+    for (int i = 0; i < 1000; i++) {
+        char key[16];
+        sprintf(key, "key%d", i);
+        UwValue k = uw_create(key);
+        UwValue v = UwList(UwSigned(i), UwCharPtr("value"));
+        TEST(uw_map_update(&map, &k, &v));
+    }
+    {
+        UwValue k = uw_create("ключ");
+        UwValue v = uw_create("значение, достаточно длинное, чтобы не быть встроенным");
+        TEST(uw_map_update(&map, &k, &v));
+        UwValue k2 = UwSigned(-5);
+        UwValue v2 = uw_create("short");
+        TEST(uw_map_update(&map, &k2, &v2));
+        UwValue k3 = uw_create("empty");
+        UwValue v3 = UwString();
+        TEST(uw_map_update(&map, &k3, &v3));
+    }
+    char temp_filename[] = "/tmp/test-uw-XXXXXX";
+    int fd = mkstemp(temp_filename);
+    TEST(fd != -1);
+    unlink(temp_filename);
+    UwValue file = uw_create_file();
+    UwValue status = uw_file_set_fd(&file, fd);
+    TEST(uw_ok(&status));
+    {
+        UwValue status = uw_freeze_map(&map, &file);
+        TEST(uw_ok(&status));
+    }
+    UwValue frozen_map = uw_open_frozen_map(&file);
+    TEST(uw_is_subtype(&frozen_map, UwTypeId_FrozenMap));
+    TEST(uw_frozen_map_length(&frozen_map) == 1003);
+    {
+        UwValue key = uw_create("key777");
+        UwValue value = uw_frozen_map_get(&frozen_map, &key);
+        UwValue expected = uw_map_get(&map, &key);
+        TEST(uw_equal(&value, &expected));
+    }
+    {
+        // strings refer to the image
+        UwValue key = uw_create("ключ");
+        UwValue value = uw_frozen_map_get(&frozen_map, &key);
+        UwValue expected = uw_map_get(&map, &key);
+        TEST(uw_equal(&value, &expected));
+        TEST(uw_is_frozen(&value));
+        TEST(_uw_string_char_size(&value) == 2);
+
+        // modification makes a copy
+        UwValue copy = uw_clone(&value);
+        TEST(uw_string_append(&copy, "!"));
+        TEST(!uw_is_frozen(&copy));
+        TEST(uw_strlen(&copy) == uw_strlen(&value) + 1);
+        TEST(uw_equal(&value, &expected));
+
+        // freezing them again does not write to the image
+        TEST(uw_freeze(&value));
+
+        UwValue key2 = UwSigned(-5);
+        UwValue value2 = uw_frozen_map_get(&frozen_map, &key2);
+        TEST(uw_equal(&value2, "short"));
+
+        UwValue key3 = UwCharPtr("empty");
+        UwValue value3 = uw_frozen_map_get(&frozen_map, &key3);
+        TEST(uw_is_string(&value3));
+        TEST(uw_strlen(&value3) == 0);
+    }
+    {
+        UwValue key = uw_create("nonexistent");
+        UwValue value = uw_frozen_map_get(&frozen_map, &key);
+        TEST(value.status_code == UW_ERROR_KEY_NOT_FOUND);
+    }
+    {
+        // not an image
+        unsigned n;
+        UwValue status = uw_file_pwrite(&file, "XXXX", 4, 0, &n);
+        TEST(uw_ok(&status));
+        UwValue bad = uw_open_frozen_map(&file);
+        TEST(bad.status_code == UW_ERROR_BAD_FROZEN_MAP);
+    }
+}
+
+UwResult collect_line(UwValuePtr file, UwValuePtr line, void* context)
+{
+    UwValuePtr lines = context;
+    if (uw_is_string(line)) {
+        UwValue copy = uw_substr(line, 0, UINT_MAX);
+        if (!uw_list_append(lines, &copy)) {
+            return UwOOM();
+        }
+    } else {
+        // end of file or error
+        if (!uw_list_append(lines, uw_eof(line)? "EOF" : "ERROR")) {
+            return UwOOM();
+        }
+    }
+    return UwOK();
+}
+
+void test_line_poller()
+{
+    int sv[2];
+    TEST(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    int fds[2];
+    TEST(pipe(fds) == 0);
+
+    UwValue poller = uw_create_line_poller();
+    TEST(uw_is_subtype(&poller, UwTypeId_LinePoller));
+
+    UwValue socket_lines = UwList();
+    UwValue pipe_lines = UwList();
+
+    UwValue socket_file = uw_create_file();
+    UwValue pipe_file = uw_create_file();
+    {
+        UwValue status1 = uw_file_set_fd(&socket_file, sv[0]);
+        UwValue status2 = uw_file_set_fd(&pipe_file, fds[0]);
+        UwValue status3 = uw_line_poller_add(&poller, &socket_file, collect_line, &socket_lines);
+        UwValue status4 = uw_line_poller_add(&poller, &pipe_file, collect_line, &pipe_lines);
+        TEST(uw_ok(&status1) && uw_ok(&status2) && uw_ok(&status3) && uw_ok(&status4));
+        TEST(uw_line_poller_count(&poller) == 2);
+    }
+    {
+        // nothing to read
+        UwValue n = uw_line_poller_wait(&poller, 0);
+        TEST(n.unsigned_value == 0);
+    }
+    {
+        // partial line is kept until the rest arrives
+        TEST(write(sv[1], "one\ntw", 6) == 6);
+        UwValue n = uw_line_poller_wait(&poller, 1000);
+        TEST(n.unsigned_value == 1);
+        TEST(uw_list_length(&socket_lines) == 1);
+
+        TEST(write(sv[1], u8"o\nสบาย\n", 15) == 15);
+        UwValue n2 = uw_line_poller_wait(&poller, 1000);
+        TEST(n2.unsigned_value == 2);
+        TEST(uw_list_length(&socket_lines) == 3);
+        UwValue line = uw_list_item(&socket_lines, 1);
+        TEST(uw_equal(&line, "two\n"));
+        UwValue line2 = uw_list_item(&socket_lines, 2);
+        TEST(uw_equal(&line2, u8"สบาย\n"));
+    }
+    {
+        // UTF-8 sequence split between reads
+        TEST(write(sv[1], "\xE0\xB8", 2) == 2);
+        UwValue n = uw_line_poller_wait(&poller, 1000);
+        TEST(n.unsigned_value == 0);
+        TEST(write(sv[1], "\xAA\n", 2) == 2);
+        UwValue n2 = uw_line_poller_wait(&poller, 1000);
+        TEST(n2.unsigned_value == 1);
+        UwValue line = uw_list_item(&socket_lines, 3);
+        TEST(uw_equal(&line, u8"ส\n"));
+    }
+    {
+        // line arriving in many chunks is kept by the file and continued in place
+        UwValue line = UwString();
+        for (unsigned i = 0; i < 100; i++) {
+            TEST(write(sv[1], "0123456789", 10) == 10);
+            UwValue status = uw_read_line_inplace(&socket_file, &line);
+            TEST(uw_would_block(&status));
+            TEST(uw_strlen(&line) == 0);
+        }
+        TEST(write(sv[1], "\n", 1) == 1);
+        UwValue status = uw_read_line_inplace(&socket_file, &line);
+        TEST(uw_ok(&status));
+        TEST(uw_strlen(&line) == 1001);
+        TEST(uw_char_at(&line, 999) == '9' && uw_char_at(&line, 1000) == '\n');
+    }
+    {
+        // last line without newline and end of file
+        TEST(write(fds[1], "x\ny", 3) == 3);
+        close(fds[1]);
+        UwValue status = uw_line_poller_wait(&poller, 1000);
+        TEST(uw_ok(&status));
+        TEST(uw_list_length(&pipe_lines) == 3);
+        UwValue line = uw_list_item(&pipe_lines, 1);
+        TEST(uw_equal(&line, "y"));
+        UwValue eof = uw_list_item(&pipe_lines, 2);
+        TEST(uw_equal(&eof, "EOF"));
+        TEST(uw_line_poller_count(&poller) == 1);
+    }
+    {
+        UwValue status = uw_line_poller_remove(&poller, &socket_file);
+        TEST(uw_ok(&status));
+        TEST(uw_line_poller_count(&poller) == 0);
+        UwValue status2 = uw_line_poller_run(&poller);
+        TEST(uw_ok(&status2));
+    }
+    close(sv[0]);
+    close(sv[1]);
+    close(fds[0]);
+}
+
 void test_netutils()
 {
     {
@@ -935,6 +1825,1118 @@ void test_netutils()
         TEST(parsed_subnet.status_code == UW_ERROR_BAD_NETMASK);
         //uw_dump(stderr, &parsed_subnet);
     }
+    {
+        // host and default routes
+        UwValue subnet = uw_create_string("10.1.2.3/32");
+        UwValue netmask = UwNull();
+        UwValue parsed_subnet = uw_parse_ipv4_subnet(&subnet, &netmask);
+        TEST(uw_ipv4_subnet(&parsed_subnet) == 0x0A010203);
+        TEST(uw_ipv4_netmask(&parsed_subnet) == 0xFFFFFFFF);
+
+        UwValue default_route = uw_create_string("0.0.0.0/0");
+        UwValue parsed_default = uw_parse_ipv4_subnet(&default_route, &netmask);
+        TEST(uw_ipv4_subnet(&parsed_default) == 0);
+        TEST(uw_ipv4_netmask(&parsed_default) == 0);
+    }
+    {
+        // wide string
+        UwValue addr = uw_create(U"192.168.1.255");
+        uw_string_append(&addr, U"\u0663");
+        uw_string_truncate(&addr, 13);
+        TEST(_uw_string_char_size(&addr) == 2);
+        UwValue parsed_addr = uw_parse_ipv4_address(&addr);
+        TEST(uw_ipv4_address(&parsed_addr) == 0xC0A801FF);
+    }
+    {
+        char* bad[] = { "", "1.2.3", "1.2.3.4.5", "1.2.3.256", "1.2..3", ".1.2.3", "1.2.3.", "01.2.3.4", "1.2.3.4 " };
+        for (unsigned i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+            UwValue addr = uw_create(bad[i]);
+            UwValue parsed_addr = uw_parse_ipv4_address(&addr);
+            TEST(parsed_addr.status_code == UW_ERROR_BAD_IP_ADDRESS);
+        }
+    }
+    {
+        // batch parsing
+        UwValue addrs = UwList(UwCharPtr("0.0.0.0"), UwCharPtr("127.0.0.1"), UwCharPtr("255.255.255.255"));
+        uint32_t result[3];
+        UwValue status = uw_parse_ipv4_addresses(&addrs, result);
+        TEST(uw_ok(&status));
+        TEST(result[0] == 0);
+        TEST(result[1] == 0x7F000001);
+        TEST(result[2] == 0xFFFFFFFF);
+
+        uw_list_append(&addrs, "1.2.3");
+        uint32_t result2[4];
+        UwValue status2 = uw_parse_ipv4_addresses(&addrs, result2);
+        TEST(status2.status_code == UW_ERROR_BAD_IP_ADDRESS);
+    }
+}
+
+void test_ipv6()
+{
+    struct {
+        char* str;
+        uint64_t hi;
+        uint64_t lo;
+        char* formatted;
+    } good[] = {
+        { "::",                       0, 0, "::" },
+        { "::1",                      0, 1, "::1" },
+        { "1::",                      0x0001'0000'0000'0000, 0, "1::" },
+        { "2001:DB8::8:800:200C:417A", 0x2001'0db8'0000'0000, 0x0008'0800'200c'417a, "2001:db8::8:800:200c:417a" },
+        { "2001:db8:0:0:1:0:0:1",     0x2001'0db8'0000'0000, 0x0001'0000'0000'0001, "2001:db8::1:0:0:1" },
+        { "2001:db8:0:1:1:1:1:1",     0x2001'0db8'0000'0001, 0x0001'0001'0001'0001, "2001:db8:0:1:1:1:1:1" },
+        { "::ffff:192.168.1.2",       0, 0x0000'ffff'c0a8'0102, "::ffff:c0a8:102" },
+        { "1:2:3:4:5:6:1.2.3.4",      0x0001'0002'0003'0004, 0x0005'0006'0102'0304, "1:2:3:4:5:6:102:304" },
+        { "1:2:3:4:5:6:7::",          0x0001'0002'0003'0004, 0x0005'0006'0007'0000, "1:2:3:4:5:6:7:0" }
+    };
+    for (unsigned i = 0; i < sizeof(good) / sizeof(good[0]); i++) {
+        UwValue str = uw_create(good[i].str);
+        IPv6address addr;
+        UwValue status = uw_parse_ipv6_address(&str, &addr);
+        TEST(uw_ok(&status));
+        TEST(addr.hi == good[i].hi);
+        TEST(addr.lo == good[i].lo);
+
+        UwValue v = uw_create_ipv6(&addr, 128);
+        UwValue formatted = uw_to_string(&v);
+        TEST(uw_equal(&formatted, good[i].formatted));
+    }
+    char* bad[] = {
+        "", ":", ":::", "1:", ":1", "1:2:3:4:5:6:7:8:9", "1:2:3:4:5:6:7", "1::2::3",
+        "12345::", "g::", "1:2:3:4:5:6:7:1.2.3.4", "::1.2.3", "1:2:3:4:5:6:7:8::"
+    };
+    for (unsigned i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        UwValue str = uw_create(bad[i]);
+        IPv6address addr;
+        UwValue status = uw_parse_ipv6_address(&str, &addr);
+        TEST(status.status_code == UW_ERROR_BAD_IP_ADDRESS);
+    }
+    { // wide string
+        UwValue str = uw_create_empty_string(0, 4);
+        uw_string_append(&str, "fe80::1");
+        IPv6address addr;
+        UwValue status = uw_parse_ipv6_address(&str, &addr);
+        TEST(uw_ok(&status));
+        TEST(addr.hi == 0xfe80'0000'0000'0000);
+        TEST(addr.lo == 1);
+    }
+    { // subnets
+        UwValue str = uw_create("2001:db8:1234:5678::1/33");
+        IPv6subnet subnet;
+        UwValue status = uw_parse_ipv6_subnet(&str, &subnet);
+        TEST(uw_ok(&status));
+        TEST(subnet.subnet.hi == 0x2001'0db8'0000'0000);
+        TEST(subnet.subnet.lo == 0);
+        TEST(subnet.prefix_len == 33);
+
+        UwValue v = uw_create_ipv6_from_string(&str);
+        UwValue formatted = uw_to_string(&v);
+        TEST(uw_equal(&formatted, "2001:db8::/33"));
+
+        // IPv6 values as map keys
+        UwValue map = UwMap();
+        UwValue value = UwSigned(1);
+        uw_map_update(&map, &v, &value);
+        UwValue str2 = uw_create("2001:db8::/33");
+        UwValue v2 = uw_create_ipv6_from_string(&str2);
+        UwValue found = uw_map_get(&map, &v2);
+        TEST(uw_equal(&found, 1));
+
+        char* bad_subnets[] = { "::/129", "::/", "::/1x", "::" };
+        for (unsigned i = 0; i < sizeof(bad_subnets) / sizeof(bad_subnets[0]); i++) {
+            UwValue str = uw_create(bad_subnets[i]);
+            UwValue status = uw_parse_ipv6_subnet(&str, &subnet);
+            TEST(uw_error(&status));
+        }
+    }
+}
+
+typedef struct {
+    UwValuePtr lpm;
+    pthread_rwlock_t lock;
+    atomic_uint readers_running;
+} LpmShared;
+
+static void* lpm_reader_thread(void* arg)
+{
+    LpmShared* shared = arg;
+    bool* ok = malloc(sizeof(bool));
+    *ok = true;
+    uint32_t addrs[2] = { 0x0A010203, 0x0A020304 };  // 10.1.2.3, 10.2.3.4
+    uint32_t value_ids[2];
+    for (unsigned i = 0; i < 10000; i++) {
+        // lock-free lookups always see 10.0.0.0/8 or a longer subnet
+        *ok &= uw_ipv4_lpm_find(shared->lpm, addrs[0]) != 0;
+        uw_ipv4_lpm_find_batch(shared->lpm, addrs, value_ids, 2);
+        *ok &= value_ids[0] != 0 && value_ids[1] != 0;
+
+        // values need the lock
+        pthread_rwlock_rdlock(&shared->lock);
+        UwValue v = uw_ipv4_lpm_lookup(shared->lpm, addrs[0]);
+        *ok &= uw_equal(&v, 8) || uw_equal(&v, 16) || uw_equal(&v, 24);
+        UwValue v2 = uw_ipv4_lpm_lookup(shared->lpm, addrs[1]);
+        *ok &= uw_equal(&v2, 8);
+        pthread_rwlock_unlock(&shared->lock);
+    }
+    atomic_fetch_sub(&shared->readers_running, 1);
+    return ok;
+}
+
+static void test_lpm_concurrency()
+{
+    UwValue lpm = uw_create_ipv4_lpm();
+    TEST(uw_ok(&lpm));
+    UwValue subnet8 = uw_create("10.0.0.0/8");
+    UwValue subnet16 = uw_create("10.1.0.0/16");
+    UwValue subnet24 = uw_create("10.1.2.0/24");
+    UwValue value8 = UwSigned(8);
+    UwValue value16 = UwSigned(16);
+    UwValue value24 = UwSigned(24);
+    UwValue status = uw_ipv4_lpm_insert(&lpm, &subnet8, &value8);
+    TEST(uw_ok(&status));
+
+    LpmShared shared = { .lpm = &lpm };
+    TEST(pthread_rwlock_init(&shared.lock, nullptr) == 0);
+    pthread_t threads[4];
+    atomic_init(&shared.readers_running, _UWC_LENGTH_OF(threads));
+    for (unsigned i = 0; i < _UWC_LENGTH_OF(threads); i++) {
+        TEST(pthread_create(&threads[i], nullptr, lpm_reader_thread, &shared) == 0);
+    }
+    // single writer inserts and deletes longer subnets, reusing value ids
+    bool writer_ok = true;
+    while (atomic_load(&shared.readers_running)) {
+        pthread_rwlock_wrlock(&shared.lock);
+        UwValue s1 = uw_ipv4_lpm_insert(&lpm, &subnet16, &value16);
+        UwValue s2 = uw_ipv4_lpm_insert(&lpm, &subnet24, &value24);
+        pthread_rwlock_unlock(&shared.lock);
+
+        pthread_rwlock_wrlock(&shared.lock);
+        UwValue s3 = uw_ipv4_lpm_delete(&lpm, &subnet24);
+        UwValue s4 = uw_ipv4_lpm_delete(&lpm, &subnet16);
+        pthread_rwlock_unlock(&shared.lock);
+
+        writer_ok &= uw_ok(&s1) && uw_ok(&s2) && uw_ok(&s3) && uw_ok(&s4);
+    }
+    for (unsigned i = 0; i < _UWC_LENGTH_OF(threads); i++) {
+        bool* ok;
+        TEST(pthread_join(threads[i], (void**) &ok) == 0);
+        TEST(*ok);
+        free(ok);
+    }
+    TEST(writer_ok);
+    TEST(uw_ipv4_lpm_length(&lpm) == 1);
+    pthread_rwlock_destroy(&shared.lock);
+}
+
+static uint64_t lpm_random(uint64_t* state)
+{
+    // xorshift64, tests must be reproducible
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static bool ipv6_in_subnet(IPv6address* addr, IPv6subnet* subnet)
+{
+    unsigned len = subnet->prefix_len;
+    if (len == 0) {
+        return true;
+    }
+    if (len <= 64) {
+        return ((addr->hi ^ subnet->subnet.hi) >> (64 - len)) == 0;
+    }
+    if (addr->hi != subnet->subnet.hi) {
+        return false;
+    }
+    return len == 64 || ((addr->lo ^ subnet->subnet.lo) >> (128 - len)) == 0;
+}
+
+#define LPM6_NUM_ROUTES  400
+#define LPM6_NUM_ADDRS   2000
+
+static void check_lpm6(UwValuePtr lpm, IPv6subnet* routes, bool* active, IPv6address* addrs)
+/*
+ * Compare lookups with linear search.
+ */
+{
+    static uint32_t value_ids[LPM6_NUM_ADDRS];
+    uw_ipv6_lpm_find_batch(lpm, addrs, value_ids, LPM6_NUM_ADDRS);
+
+    unsigned num_ok = 0;
+    for (unsigned i = 0; i < LPM6_NUM_ADDRS; i++) {
+        int expected = -1;
+        for (unsigned r = 0; r < LPM6_NUM_ROUTES; r++) {
+            if (active[r] && ipv6_in_subnet(&addrs[i], &routes[r])
+                && (expected < 0 || routes[r].prefix_len > routes[expected].prefix_len)) {
+                expected = r;
+            }
+        }
+        uint32_t value_id = uw_ipv6_lpm_find(lpm, &addrs[i]);
+        UwValue v = uw_ipv6_lpm_value(lpm, value_id);
+        bool ok = value_id == value_ids[i];
+        if (expected < 0) {
+            ok = ok && value_id == 0 && uw_error(&v);
+        } else {
+            ok = ok && uw_equal(&v, expected);
+        }
+        num_ok += ok;
+    }
+    TEST(num_ok == LPM6_NUM_ADDRS);
+}
+
+static IPv6address lpm6_random_address(uint64_t bits)
+/*
+ * Return address that differs from others in few bits
+ * so that subnets share and split trie nodes at all levels.
+ */
+{
+    return (IPv6address) {
+        .hi = 0x20010DB800000000ULL | ((bits & 3) << 54) | (((bits >> 2) & 3) << 30)
+              | (((bits >> 4) & 3) << 22) | (((bits >> 6) & 3) << 14) | (((bits >> 8) & 3) << 1),
+        .lo = (((bits >> 10) & 3) << 62) | (((bits >> 12) & 3) << 40) | ((bits >> 14) & 3)
+    };
+}
+
+static void test_lpm6_random()
+{
+    static unsigned prefix_lens[] = { 0, 8, 16, 17, 24, 31, 32, 33, 40, 47, 48, 56, 64, 65, 72, 96, 120, 127, 128 };
+    static IPv6subnet routes[LPM6_NUM_ROUTES];
+    static bool active[LPM6_NUM_ROUTES];
+    static IPv6address addrs[LPM6_NUM_ADDRS];
+
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+
+    UwValue lpm = uw_create_ipv6_lpm();
+    TEST(uw_ok(&lpm));
+
+    for (unsigned r = 0; r < LPM6_NUM_ROUTES; r++) {
+    again:
+        uint64_t bits = lpm_random(&state);
+        IPv6address a = lpm6_random_address(bits);
+        unsigned len = prefix_lens[(bits >> 16) % (sizeof(prefix_lens) / sizeof(prefix_lens[0]))];
+        UwValue subnet = uw_create_ipv6(&a, len);
+        TEST(uw_ok(&subnet));
+        routes[r] = *uw_ipv6_subnet(&subnet);
+        for (unsigned i = 0; i < r; i++) {
+            if (routes[i].prefix_len == len && routes[i].subnet.hi == routes[r].subnet.hi
+                && routes[i].subnet.lo == routes[r].subnet.lo) {
+                goto again;
+            }
+        }
+        UwValue value = UwSigned(r);
+        UwValue status = uw_ipv6_lpm_insert(&lpm, &subnet, &value);
+        TEST(uw_ok(&status));
+        active[r] = true;
+    }
+    TEST(uw_ipv6_lpm_length(&lpm) == LPM6_NUM_ROUTES);
+
+    // half of addresses are within routes, with random host bits,
+    // others are near them and may diverge from compressed trie nodes
+    for (unsigned i = 0; i < LPM6_NUM_ADDRS; i++) {
+        if (i & 1) {
+            addrs[i] = lpm6_random_address(lpm_random(&state));
+            continue;
+        }
+        IPv6subnet* route = &routes[lpm_random(&state) % LPM6_NUM_ROUTES];
+        uint64_t host = lpm_random(&state) & lpm_random(&state);
+        addrs[i] = route->subnet;
+        if (route->prefix_len < 64) {
+            addrs[i].hi |= host >> route->prefix_len;
+            addrs[i].lo = lpm_random(&state);
+        } else if (route->prefix_len < 128) {
+            addrs[i].lo |= host >> (route->prefix_len - 64);
+        }
+    }
+    check_lpm6(&lpm, routes, active, addrs);
+
+    // delete every other route
+    for (unsigned r = 0; r < LPM6_NUM_ROUTES; r += 2) {
+        UwValue subnet = uw_create_ipv6(&routes[r].subnet, routes[r].prefix_len);
+        UwValue status = uw_ipv6_lpm_delete(&lpm, &subnet);
+        TEST(uw_ok(&status));
+        active[r] = false;
+    }
+    TEST(uw_ipv6_lpm_length(&lpm) == LPM6_NUM_ROUTES / 2);
+    check_lpm6(&lpm, routes, active, addrs);
+
+    // insert them back in reverse order
+    for (unsigned r = LPM6_NUM_ROUTES; r > 0; r -= 2) {
+        unsigned n = r - 2;
+        UwValue subnet = uw_create_ipv6(&routes[n].subnet, routes[n].prefix_len);
+        UwValue value = UwSigned(n);
+        UwValue status = uw_ipv6_lpm_insert(&lpm, &subnet, &value);
+        TEST(uw_ok(&status));
+        active[n] = true;
+    }
+    check_lpm6(&lpm, routes, active, addrs);
+
+    // delete all but few
+    for (unsigned r = 0; r < LPM6_NUM_ROUTES; r++) {
+        if (r % 50) {
+            UwValue subnet = uw_create_ipv6(&routes[r].subnet, routes[r].prefix_len);
+            UwValue status = uw_ipv6_lpm_delete(&lpm, &subnet);
+            TEST(uw_ok(&status));
+            active[r] = false;
+        }
+    }
+    check_lpm6(&lpm, routes, active, addrs);
+}
+
+void test_lpm()
+{
+    UwValue lpm = uw_create_ipv4_lpm();
+    TEST(uw_ok(&lpm));
+
+    UwValue subnets = UwList(
+        UwCharPtr("0.0.0.0/0"),
+        UwCharPtr("10.0.0.0/8"),
+        UwCharPtr("10.1.0.0/16"),
+        UwCharPtr("10.1.2.0/24"),
+        UwCharPtr("10.1.2.128/25"),
+        UwCharPtr("10.1.2.3/32"),
+        UwCharPtr("192.168.0.0/20")
+    );
+    UwValue values = UwList(
+        UwCharPtr("default"),
+        UwCharPtr("a"),
+        UwCharPtr("b"),
+        UwCharPtr("c"),
+        UwCharPtr("d"),
+        UwCharPtr("e"),
+        UwCharPtr("f")
+    );
+    UwValue status = uw_ipv4_lpm_insert_list(&lpm, &subnets, &values);
+    TEST(uw_ok(&status));
+    TEST(uw_ipv4_lpm_length(&lpm) == 7);
+
+    uint32_t addrs[] = {
+        0x01020304,  // 1.2.3.4
+        0x0A020304,  // 10.2.3.4
+        0x0A010304,  // 10.1.3.4
+        0x0A010204,  // 10.1.2.4
+        0x0A0102FF,  // 10.1.2.255
+        0x0A010203,  // 10.1.2.3
+        0xC0A80F01,  // 192.168.15.1
+        0xC0A81001   // 192.168.16.1
+    };
+    char* expected[] = { "default", "a", "b", "c", "d", "e", "f", "default" };
+    unsigned n = sizeof(addrs) / sizeof(addrs[0]);
+    for (unsigned i = 0; i < n; i++) {
+        UwValue v = uw_ipv4_lpm_lookup(&lpm, addrs[i]);
+        TEST(uw_equal(&v, expected[i]));
+    }
+    uint32_t value_ids[sizeof(addrs) / sizeof(addrs[0])];
+    uw_ipv4_lpm_find_batch(&lpm, addrs, value_ids, n);
+    for (unsigned i = 0; i < n; i++) {
+        TEST(value_ids[i] == uw_ipv4_lpm_find(&lpm, addrs[i]));
+    }
+
+    { // delete restores covering subnets
+        UwValue subnet = uw_create("10.1.2.0/24");
+        UwValue status = uw_ipv4_lpm_delete(&lpm, &subnet);
+        TEST(uw_ok(&status));
+        UwValue v = uw_ipv4_lpm_lookup(&lpm, 0x0A010204);
+        TEST(uw_equal(&v, "b"));
+        UwValue v2 = uw_ipv4_lpm_lookup(&lpm, 0x0A0102FF);
+        TEST(uw_equal(&v2, "d"));
+        UwValue v3 = uw_ipv4_lpm_lookup(&lpm, 0x0A010203);
+        TEST(uw_equal(&v3, "e"));
+
+        UwValue status2 = uw_ipv4_lpm_delete(&lpm, &subnet);
+        TEST(status2.status_code == UW_ERROR_KEY_NOT_FOUND);
+    }
+    { // delete default route
+        UwValue subnet = uw_create("0.0.0.0/0");
+        UwValue status = uw_ipv4_lpm_delete(&lpm, &subnet);
+        TEST(uw_ok(&status));
+        TEST(uw_ipv4_lpm_find(&lpm, 0x01020304) == 0);
+        UwValue v = uw_ipv4_lpm_lookup(&lpm, 0x01020304);
+        TEST(v.status_code == UW_ERROR_KEY_NOT_FOUND);
+    }
+    { // replace value and reuse value id
+        UwValue subnet = uw_create("10.0.0.0/8");
+        UwValue value = UwSigned(42);
+        UwValue status = uw_ipv4_lpm_insert(&lpm, &subnet, &value);
+        TEST(uw_ok(&status));
+        UwValue v = uw_ipv4_lpm_lookup(&lpm, 0x0A020304);
+        TEST(uw_equal(&v, 42));
+
+        UwValue subnet2 = uw_create("172.16.0.0/12");
+        UwValue status2 = uw_ipv4_lpm_insert(&lpm, &subnet2, &value);
+        TEST(uw_ok(&status2));
+        TEST(uw_ipv4_lpm_find(&lpm, 0xAC1F0001) == 1);  // id of deleted default route
+        TEST(uw_ipv4_lpm_length(&lpm) == 6);
+    }
+    { // non-contiguous netmask
+        IPv4subnet bad = { .subnet = 0x0A000000, .netmask = 0xFF00FF00 };
+        UwValue subnet = UwUnsigned(bad.value);
+        UwValue value = UwNull();
+        UwValue status = uw_ipv4_lpm_insert(&lpm, &subnet, &value);
+        TEST(status.status_code == UW_ERROR_BAD_NETMASK);
+    }
+
+    UwValue lpm6 = uw_create_ipv6_lpm();
+    TEST(uw_ok(&lpm6));
+    UwValue subnets6 = UwList(
+        UwCharPtr("::/0"),
+        UwCharPtr("2001:db8::/32"),
+        UwCharPtr("2001:db8:1::/48"),
+        UwCharPtr("2001:db8:1:2::/64"),
+        UwCharPtr("2001:db8:1:2::1/128")
+    );
+    UwValue values6 = UwList(UwSigned(0), UwSigned(32), UwSigned(48), UwSigned(64), UwSigned(128));
+    UwValue status6 = uw_ipv6_lpm_insert_list(&lpm6, &subnets6, &values6);
+    TEST(uw_ok(&status6));
+    TEST(uw_ipv6_lpm_length(&lpm6) == 5);
+
+    char* addrs6[] = { "fe80::1", "2001:db8:2::1", "2001:db8:1:3::1", "2001:db8:1:2::2", "2001:db8:1:2::1" };
+    int expected6[] = { 0, 32, 48, 64, 128 };
+    IPv6address parsed6[5];
+    for (unsigned i = 0; i < 5; i++) {
+        UwValue str = uw_create(addrs6[i]);
+        UwValue status = uw_parse_ipv6_address(&str, &parsed6[i]);
+        TEST(uw_ok(&status));
+        UwValue v = uw_ipv6_lpm_lookup(&lpm6, &parsed6[i]);
+        TEST(uw_equal(&v, expected6[i]));
+    }
+    uint32_t value_ids6[5];
+    uw_ipv6_lpm_find_batch(&lpm6, parsed6, value_ids6, 5);
+    for (unsigned i = 0; i < 5; i++) {
+        TEST(value_ids6[i] == uw_ipv6_lpm_find(&lpm6, &parsed6[i]));
+    }
+    {
+        UwValue str = uw_create("2001:db8:1::/48");
+        UwValue subnet = uw_create_ipv6_from_string(&str);
+        UwValue status = uw_ipv6_lpm_delete(&lpm6, &subnet);
+        TEST(uw_ok(&status));
+        UwValue v = uw_ipv6_lpm_lookup(&lpm6, &parsed6[2]);
+        TEST(uw_equal(&v, 32));
+        UwValue v2 = uw_ipv6_lpm_lookup(&lpm6, &parsed6[3]);
+        TEST(uw_equal(&v2, 64));
+    }
+
+    test_lpm6_random();
+    test_lpm_concurrency();
+}
+
+static bool ipset_has(UwValuePtr ipset, char* addr)
+{
+    UwValue str = uw_create(addr);
+    UwValue a = uw_parse_ipv4_address(&str);
+    return uw_ok(&a) && uw_ipset_contains(ipset, uw_ipv4_address(&a));
+}
+
+static bool ipset_range_is(UwValuePtr ipset, unsigned index, uint32_t start, uint32_t end)
+{
+    uint32_t s, e;
+    uw_ipset_range(ipset, index, &s, &e);
+    return s == start && e == end;
+}
+
+void test_cpu_kernels()
+{
+    // UTF-8 decoder: ASCII fast path followed by a non-ASCII char at every position
+    for (unsigned pos = 0; pos < 70; pos++) {
+        char8_t buf[72];
+        memset(buf, 'a', sizeof(buf));
+        buf[pos] = 0xC4;  // U+0100
+        buf[pos + 1] = 0x80;
+        unsigned size = sizeof(buf);
+        uint8_t char_size;
+        TEST(utf8_strlen2_buf(buf, &size, &char_size) == sizeof(buf) - 1);
+        TEST(size == sizeof(buf));
+        TEST(char_size == 2);
+    }
+
+    for (unsigned len = 1; len < 70; len++) {
+        char32_t chars[72];
+        for (unsigned i = 0; i < len; i++) {
+            chars[i] = 32 + (i * 7) % 224;  // 1-byte chars
+        }
+        chars[len] = 0;
+
+        // widening copies
+        char32_t wide_chars[] = { 0x100, 0x10000, 0x1000000 };
+        for (unsigned w = 0; w < _UWC_LENGTH_OF(wide_chars); w++) {
+            UwValue s = uw_create_string(chars);
+            TEST(uw_string_char_size(&s) == 1);
+            TEST(uw_string_append(&s, wide_chars[w]));
+            TEST(uw_string_char_size(&s) == w + 2);
+            TEST(uw_strlen(&s) == len + 1);
+            bool chars_ok = true;
+            for (unsigned i = 0; i < len; i++) {
+                chars_ok &= uw_char_at(&s, i) == chars[i];
+            }
+            TEST(chars_ok);
+            TEST(uw_char_at(&s, len) == wide_chars[w]);
+
+            // max char size of substrings
+            UwValue sub1 = uw_substr(&s, 0, len);
+            TEST(uw_string_char_size(&sub1) == 1);
+            TEST(uw_equal(&sub1, chars));
+            UwValue sub2 = uw_substr(&s, 0, len + 1);
+            TEST(uw_string_char_size(&sub2) == w + 2);
+            TEST(uw_equal(&sub2, &s));
+        }
+    }
+
+    // substring starting with narrower char
+    {
+        UwValue s = uw_create_string(U"aĀ\U00010000");
+        UwValue sub = uw_substr(&s, 0, 3);
+        TEST(uw_string_char_size(&sub) == 3);
+        TEST(uw_equal(&sub, &s));
+    }
+
+    // search window of IPSet
+    for (unsigned n = 1; n < 40; n++) {
+        UwValue ipset = uw_create_ipset();
+        for (unsigned i = 0; i < n; i++) {
+            UwValue status = uw_ipset_add_range(&ipset, 0x80000000 + i * 4, 0x80000001 + i * 4);
+            TEST(uw_ok(&status));
+        }
+        bool lookups_ok = true;
+        for (unsigned i = 0; i < n * 4 + 4; i++) {
+            uint32_t addr = 0x80000000 - 2 + i;
+            bool expected = (addr >= 0x80000000) && ((addr - 0x80000000) % 4 < 2) && (addr < 0x80000000 + n * 4);
+            lookups_ok &= uw_ipset_contains(&ipset, addr) == expected;
+        }
+        TEST(lookups_ok);
+    }
+}
+
+void test_cpu_dispatch()
+{
+    UwCpuLevel saved_level = uw_cpu_level();
+    for (UwCpuLevel level = UW_CPU_SCALAR; level <= uw_cpu_max_level(); level++) {
+        TEST(uw_set_cpu_level(level) == level);
+        TEST(uw_cpu_level() == level);
+        test_cpu_kernels();
+    }
+    TEST(uw_set_cpu_level(UW_CPU_AVX2) == uw_cpu_max_level());
+    TEST(strcmp(uw_cpu_level_name(UW_CPU_SSE42), "sse4.2") == 0);
+    uw_set_cpu_level(saved_level);
+}
+
+#ifdef UW_ATOMIC_REFCOUNT
+
+static void* cow_thread(void* arg)
+{
+    UwValuePtr shared = arg;
+    bool* ok = malloc(sizeof(bool));
+    *ok = true;
+    for (unsigned i = 0; i < 1000; i++) {
+        UwValue s = uw_clone(shared);
+        // modification of shared data makes a private copy
+        *ok &= uw_string_append(&s, 'x');
+        *ok &= uw_strlen(&s) == uw_strlen(shared) + 1;
+        UwValue s2 = uw_clone(&s);
+        *ok &= uw_string_append(&s2, U'Ā');
+        *ok &= uw_char_at(&s, uw_strlen(&s) - 1) == 'x';
+    }
+    return ok;
+}
+
+void test_atomic_refcount()
+{
+    UwValue shared = uw_create_string("a string long enough not to be embedded in the value itself");
+    pthread_t threads[4];
+    for (unsigned i = 0; i < _UWC_LENGTH_OF(threads); i++) {
+        TEST(pthread_create(&threads[i], nullptr, cow_thread, &shared) == 0);
+    }
+    for (unsigned i = 0; i < _UWC_LENGTH_OF(threads); i++) {
+        bool* ok;
+        TEST(pthread_join(threads[i], (void**) &ok) == 0);
+        TEST(*ok);
+        free(ok);
+    }
+    TEST(shared.extra_data->refcount == 1);
+    TEST(uw_equal(&shared, "a string long enough not to be embedded in the value itself"));
+}
+
+#endif
+
+void test_alloc_stats()
+{
+    uw_reset_alloc_stats();
+    uw_enable_alloc_stats(true);
+    {
+        UwValue list = UwList();
+        for (unsigned i = 0; i < 100; i++) {
+            uw_list_append(&list, i);
+        }
+        UwAllocStats stats = uw_alloc_stats(UwTypeId_List);
+        TEST(stats.allocs == 2);  // extra data and items
+        TEST(stats.reallocs > 0);
+        TEST(stats.frees == 0);
+        TEST(stats.live_bytes > 0);
+        TEST(stats.peak_bytes == stats.live_bytes);
+
+        // the third parent makes list of parents allocated
+        UwValue child = UwList();
+        UwValue parent1 = UwList();
+        UwValue parent2 = UwList();
+        UwValue parent3 = UwList();
+        uw_list_append(&parent1, &child);
+        uw_list_append(&parent2, &child);
+        TEST(uw_alloc_stats(UW_PARENTS_ALLOC_STATS).allocs == 0);
+        uw_list_append(&parent3, &child);
+        TEST(uw_alloc_stats(UW_PARENTS_ALLOC_STATS).allocs == 1);
+        TEST(uw_alloc_stats(UW_PARENTS_ALLOC_STATS).live_bytes > 0);
+
+        UwValue str = uw_create_string("a string long enough not to be embedded in the value itself");
+        TEST(uw_alloc_stats(UwTypeId_String).allocs == 1);
+    }
+    UwAllocStats stats = uw_alloc_stats(UwTypeId_List);
+    TEST(stats.frees == stats.allocs);
+    TEST(stats.live_bytes == 0);
+    TEST(stats.peak_bytes > 0);
+    TEST(uw_alloc_stats(UW_PARENTS_ALLOC_STATS).live_bytes == 0);
+    TEST(uw_alloc_stats(UwTypeId_String).live_bytes == 0);
+
+    uw_enable_alloc_stats(false);
+    {
+        UwValue list = UwList(UwSigned(1));
+    }
+    TEST(uw_alloc_stats(UwTypeId_List).allocs == stats.allocs);
+
+    uw_reset_alloc_stats();
+    TEST(uw_alloc_stats(UwTypeId_List).allocs == 0);
+}
+
+static unsigned string_copy_hook_calls = 0;
+
+static void string_copy_hook(UwStringCopyEvent* event)
+{
+    string_copy_hook_calls++;
+}
+
+void test_string_copy_stats()
+{
+    uw_reset_string_copy_stats();
+    uw_enable_string_copy_stats(true);
+    uw_set_string_copy_hook(string_copy_hook, 2);
+    {
+        UwValue s1 = uw_create_string("a string long enough not to be embedded in the value itself");
+        UwValue s2 = uw_clone(&s1);
+        TEST(uw_string_copy_stats().cow_copies == 0);
+
+        // modification of shared data makes a copy
+        TEST(uw_string_append(&s2, "!"));
+        UwStringCopyStats stats = uw_string_copy_stats();
+        TEST(stats.cow_copies == 1);
+        TEST(stats.bytes_copied == uw_strlen(&s1));
+
+        // emoji promotes 1-byte string to 3-byte one
+        TEST(uw_string_append(&s2, U"\U0001F600"));
+        stats = uw_string_copy_stats();
+        TEST(stats.cow_copies == 1);
+        TEST(stats.promotions[0][2] == 1);
+        TEST(stats.bytes_copied == uw_strlen(&s1) + (uw_strlen(&s1) + 1) * 3);
+        TEST(string_copy_hook_calls == 1);
+
+        // embedded string is promoted in place
+        UwValue s3 = uw_create_string("abc");
+        TEST(uw_string_append(&s3, U"\u0100"));
+        TEST(uw_string_copy_stats().promotions[0][1] == 1);
+        TEST(string_copy_hook_calls == 1);
+    }
+    uw_enable_string_copy_stats(false);
+    uw_set_string_copy_hook(nullptr, 0);
+    {
+        UwValue s = uw_create_string("abc");
+        TEST(uw_string_append(&s, U"\u0100"));
+    }
+    TEST(uw_string_copy_stats().promotions[0][1] == 1);
+
+    uw_reset_string_copy_stats();
+    TEST(uw_string_copy_stats().promotions[0][1] == 0);
+}
+
+void test_memsize()
+{
+    char long_str[] = "a string long enough not to be embedded in the value itself";
+    {
+        UwValue s = uw_create_string("short");
+        UwMemSize m = uw_memsize(&s, 0);
+        TEST(m.exclusive == 0 && m.shared == 0);
+
+        UwValue n = UwSigned(1);
+        m = uw_memsize(&n, 0);
+        TEST(m.exclusive == 0 && m.shared == 0);
+    }
+    {
+        UwValue s = uw_create_string(long_str);
+        UwMemSize m = uw_memsize(&s, 0);
+        TEST(m.exclusive >= sizeof(long_str) - 1);
+        TEST(m.shared == 0);
+        size_t str_size = m.exclusive;
+
+        UwValue list = UwList();
+        UwMemSize empty_list = uw_memsize(&list, 0);
+        TEST(empty_list.exclusive > 0);
+
+        // string is shared between the list and `s`, and counted once
+        uw_list_append(&list, &s);
+        uw_list_append(&list, &s);
+        m = uw_memsize(&list, 0);
+        TEST(m.exclusive == empty_list.exclusive);
+        TEST(m.shared == str_size);
+
+        m = uw_memsize(&list, UW_MEMSIZE_SHALLOW);
+        TEST(m.exclusive == empty_list.exclusive);
+        TEST(m.shared == 0);
+
+        // nested list referenced only by parent is exclusive
+        UwValue map = UwMap();
+        {
+            UwValue key = uw_create_string("nested");
+            UwValue nested = UwList();
+            uw_map_update(&map, &key, &nested);
+        }
+        m = uw_memsize(&map, 0);
+        TEST(m.shared == 0);
+        TEST(m.exclusive > empty_list.exclusive);
+
+        // cyclic reference
+        uw_list_append(&list, &list);
+        m = uw_memsize(&list, 0);
+        TEST(m.exclusive >= empty_list.exclusive);
+        TEST(m.shared == str_size);
+    }
+    {
+        UwValue status = UwError(UW_ERROR_OOM);
+        UwMemSize m = uw_memsize(&status, 0);
+        TEST(m.exclusive == 0);
+        _uw_set_status_desc(&status, "%s", long_str);
+        m = uw_memsize(&status, 0);
+        TEST(m.exclusive > sizeof(long_str));
+    }
+    {
+        // frozen data is shared no matter how many references it has
+        UwValue arena = uw_create_freeze_arena();
+        UwValue list = UwList(UwCharPtr(long_str));
+        UwMemSize before = uw_memsize(&list, 0);
+        UwValue status = uw_freeze_into(&arena, &list);
+        TEST(uw_ok(&status));
+        UwMemSize m = uw_memsize(&list, 0);
+        TEST(m.exclusive == 0);
+        TEST(m.shared == before.exclusive);
+    }
+}
+
+void test_ipset()
+{
+    UwValue a = uw_create_ipset();
+    TEST(uw_ok(&a));
+    TEST(!uw_is_true(&a));
+    TEST(!ipset_has(&a, "0.0.0.0"));
+
+    {
+        UwValue items = UwList(
+            UwCharPtr("10.0.0.0/24"),
+            UwCharPtr("10.0.1.0/24"),      // adjacent, merged
+            UwCharPtr("192.168.1.10-192.168.1.20"),
+            UwCharPtr("192.168.1.15"),     // inside, merged
+            UwCharPtr("172.16.0.1")
+        );
+        UwValue status = uw_ipset_add_list(&a, &items);
+        TEST(uw_ok(&status));
+    }
+    TEST(uw_ipset_length(&a) == 3);
+    TEST(ipset_range_is(&a, 0, 0x0A000000, 0x0A0001FF));
+    TEST(ipset_range_is(&a, 1, 0xAC100001, 0xAC100001));
+    TEST(ipset_range_is(&a, 2, 0xC0A8010A, 0xC0A80114));
+
+    TEST(ipset_has(&a, "10.0.0.0"));
+    TEST(ipset_has(&a, "10.0.1.255"));
+    TEST(!ipset_has(&a, "10.0.2.0"));
+    TEST(ipset_has(&a, "172.16.0.1"));
+    TEST(!ipset_has(&a, "172.16.0.2"));
+    TEST(!ipset_has(&a, "192.168.1.9"));
+    TEST(ipset_has(&a, "192.168.1.20"));
+    TEST(!ipset_has(&a, "0.0.0.0"));
+    TEST(!ipset_has(&a, "255.255.255.255"));
+
+    {
+        // bridge two ranges
+        UwValue status = uw_ipset_add_range(&a, 0x0A000200, 0xAC100000);
+        TEST(uw_ok(&status));
+        TEST(uw_ipset_length(&a) == 2);
+        TEST(ipset_range_is(&a, 0, 0x0A000000, 0xAC100001));
+
+        UwValue str = uw_create("192.168.1.21");
+        UwValue status2 = uw_ipset_add(&a, &str);
+        TEST(uw_ok(&status2));
+        TEST(ipset_range_is(&a, 1, 0xC0A8010A, 0xC0A80115));
+
+        UwValue str2 = uw_create("255.255.255.255/32");
+        UwValue netmask = UwNull();
+        UwValue subnet = uw_parse_ipv4_subnet(&str2, &netmask);
+        UwValue status3 = uw_ipset_add(&a, &subnet);
+        TEST(uw_ok(&status3));
+        TEST(uw_ipset_length(&a) == 3);
+        TEST(ipset_has(&a, "255.255.255.255"));
+    }
+    {
+        char* bad_items[] = { "10.0.0.0/33", "10.0.0.2-10.0.0.1", "10.0.0", "10.0.0.1-" };
+        for (unsigned i = 0; i < sizeof(bad_items) / sizeof(bad_items[0]); i++) {
+            UwValue str = uw_create(bad_items[i]);
+            UwValue status = uw_ipset_add(&a, &str);
+            TEST(uw_error(&status));
+        }
+        TEST(uw_ipset_length(&a) == 3);
+    }
+
+    UwValue b = uw_create_ipset();
+    {
+        UwValue items = UwList(
+            UwCharPtr("0.0.0.0/8"),
+            UwCharPtr("10.0.0.128/25"),
+            UwCharPtr("192.168.1.0/24")
+        );
+        UwValue status = uw_ipset_add_list(&b, &items);
+        TEST(uw_ok(&status));
+        TEST(uw_ipset_length(&b) == 3);
+    }
+    {
+        UwValue u = uw_ipset_union(&a, &b);
+        TEST(uw_ok(&u));
+        TEST(uw_ipset_length(&u) == 4);
+        TEST(ipset_range_is(&u, 0, 0x00000000, 0x00FFFFFF));
+        TEST(ipset_range_is(&u, 1, 0x0A000000, 0xAC100001));
+        TEST(ipset_range_is(&u, 2, 0xC0A80100, 0xC0A801FF));
+        TEST(ipset_range_is(&u, 3, 0xFFFFFFFF, 0xFFFFFFFF));
+
+        UwValue i = uw_ipset_intersection(&a, &b);
+        TEST(uw_ok(&i));
+        TEST(uw_ipset_length(&i) == 2);
+        TEST(ipset_range_is(&i, 0, 0x0A000080, 0x0A0000FF));
+        TEST(ipset_range_is(&i, 1, 0xC0A8010A, 0xC0A80115));
+
+        UwValue d = uw_ipset_difference(&a, &b);
+        TEST(uw_ok(&d));
+        TEST(uw_ipset_length(&d) == 3);
+        TEST(ipset_range_is(&d, 0, 0x0A000000, 0x0A00007F));
+        TEST(ipset_range_is(&d, 1, 0x0A000100, 0xAC100001));
+        TEST(ipset_range_is(&d, 2, 0xFFFFFFFF, 0xFFFFFFFF));
+
+        // (a - b) | (a & b) == a
+        UwValue r = uw_ipset_union(&d, &i);
+        TEST(uw_equal(&r, &a));
+
+        UwValue c = uw_deepcopy(&a);
+        TEST(uw_equal(&c, &a));
+        TEST(!uw_equal(&c, &b));
+    }
+    {
+        // many ranges to exercise binary search
+        UwValue big = uw_create_ipset();
+        for (uint32_t n = 0; n < 1000; n++) {
+            UwValue status = uw_ipset_add_range(&big, n * 16, n * 16 + 7);
+            TEST(uw_ok(&status));
+        }
+        TEST(uw_ipset_length(&big) == 1000);
+        unsigned errors = 0;
+        for (uint32_t addr = 0; addr < 16 * 1000 + 32; addr++) {
+            bool expected = addr < 16 * 1000 && (addr & 15) < 8;
+            errors += uw_ipset_contains(&big, addr) != expected;
+        }
+        TEST(errors == 0);
+    }
+}
+
+static void* frozen_reader_thread(void* arg)
+{
+    UwValuePtr config = arg;
+    bool* ok = malloc(sizeof(bool));
+    *ok = true;
+    for (unsigned i = 0; i < 1000; i++) {
+        UwValue c = uw_clone(config);
+        UwValue servers = uw_map_get(&c, "servers");
+        *ok &= uw_list_length(&servers) == 2;
+        UwValue server = uw_list_item(&servers, 1);
+        *ok &= uw_equal(&server, "second server with a long enough name");
+        *ok &= config->extra_data->refcount == _UW_REFCOUNT_FROZEN;
+    }
+    return ok;
+}
+
+void test_freeze()
+{
+    char long_str[] = "a string long enough not to be embedded in the value itself";
+    {
+        // embedded string is a plain value, there's nothing to freeze
+        UwValue s = uw_create_string("short");
+        TEST(uw_freeze(&s));
+        TEST(!uw_is_frozen(&s));
+
+        UwValue n = UwSigned(1);
+        TEST(uw_freeze(&n));
+        TEST(!uw_is_frozen(&n));
+    }
+    {
+        // the arena is destroyed after values it owns
+        UwValue arena = uw_create_freeze_arena();
+        TEST(uw_ok(&arena));
+        UwValue s = uw_create_string(long_str);
+        TEST(!uw_is_frozen(&s));
+        UwValue status = uw_freeze_into(&arena, &s);
+        TEST(uw_ok(&status));
+        TEST(uw_is_frozen(&s));
+
+        // clone does not touch refcount
+        UwValue c = uw_clone(&s);
+        TEST(c.extra_data == s.extra_data);
+        TEST(s.extra_data->refcount == _UW_REFCOUNT_FROZEN);
+        uw_destroy(&c);
+        TEST(s.extra_data->refcount == _UW_REFCOUNT_FROZEN);
+
+        // modification makes a copy
+        c = uw_clone(&s);
+        TEST(uw_string_append(&c, 'x'));
+        TEST(c.extra_data != s.extra_data);
+        TEST(!uw_is_frozen(&c));
+        TEST(c.extra_data->refcount == 1);
+        TEST(uw_equal(&s, long_str));
+        TEST(uw_strlen(&c) == uw_strlen(&s) + 1);
+    }
+    {
+        UwValue arena = uw_create_freeze_arena();
+        UwValue config = UwMap(
+            UwCharPtr("name"), UwCharPtr(long_str),
+            UwCharPtr("servers"), UwList(
+                UwCharPtr("first server with a long enough name"),
+                UwCharPtr("second server with a long enough name")
+            )
+        );
+        UwValue status = uw_freeze_into(&arena, &config);
+        TEST(uw_ok(&status));
+        TEST(uw_is_frozen(&config));
+        {
+            UwValue name = uw_map_get(&config, "name");
+            TEST(uw_is_frozen(&name));
+            UwValue servers = uw_map_get(&config, "servers");
+            TEST(uw_is_frozen(&servers));
+            UwValue server = uw_list_item(&servers, 0);
+            TEST(uw_is_frozen(&server));
+
+            // frozen list added to mutable one keeps no link to its parent
+            UwValue list = UwList();
+            TEST(uw_list_append(&list, &servers));
+            TEST(uw_list_append(&list, &servers));
+            TEST(!_uw_is_embraced((_UwCompoundData*) servers.extra_data));
+            uw_destroy(&list);
+            TEST(uw_is_frozen(&servers));
+            TEST(uw_list_length(&servers) == 2);
+
+            // deep copy is mutable
+            UwValue copy = uw_deepcopy(&config);
+            TEST(!uw_is_frozen(&copy));
+            TEST(uw_equal(&copy, &config));
+            UwValue status = uw_map_update_va(&copy, UwCharPtr("name"), UwCharPtr("new name"));
+            TEST(uw_ok(&status));
+        }
+
+        // readers in other threads, no matter UW_ATOMIC_REFCOUNT is defined or not
+        pthread_t threads[4];
+        for (unsigned i = 0; i < _UWC_LENGTH_OF(threads); i++) {
+            TEST(pthread_create(&threads[i], nullptr, frozen_reader_thread, &config) == 0);
+        }
+        for (unsigned i = 0; i < _UWC_LENGTH_OF(threads); i++) {
+            bool* ok;
+            TEST(pthread_join(threads[i], (void**) &ok) == 0);
+            TEST(*ok);
+            free(ok);
+        }
+    }
+    {
+        // compound values lose their parents when frozen
+        UwValue arena = uw_create_freeze_arena();
+        UwValue nested = UwList(UwSigned(1), UwSigned(2));
+        UwValue list = UwList(uw_clone(&nested));
+        TEST(_uw_is_embraced((_UwCompoundData*) nested.extra_data));
+        UwValue status = uw_freeze_into(&arena, &nested);
+        TEST(uw_ok(&status));
+        TEST(!_uw_is_embraced((_UwCompoundData*) nested.extra_data));
+        TEST(!uw_is_frozen(&list));
+        uw_destroy(&list);
+    }
+    {
+        // cyclic references
+        UwValue arena = uw_create_freeze_arena();
+        UwValue list = UwList(UwSigned(1));
+        TEST(uw_list_append(&list, &list));
+        UwValue status = uw_freeze_into(&arena, &list);
+        TEST(uw_ok(&status));
+        TEST(uw_is_frozen(&list));
+    }
+    {
+        // data frozen already is not taken by the arena
+        UwValue arena = uw_create_freeze_arena();
+        UwValue arena2 = uw_create_freeze_arena();
+        UwValue shared = UwList(UwCharPtr(long_str));
+        UwValue status = uw_freeze_into(&arena, &shared);
+        TEST(uw_ok(&status));
+        UwValue map = UwMap(UwCharPtr("shared"), uw_clone(&shared), UwCharPtr("own"), UwCharPtr(long_str));
+        UwValue status2 = uw_freeze_into(&arena2, &map);
+        TEST(uw_ok(&status2));
+        uw_destroy(&map);
+        uw_destroy(&arena2);
+        TEST(uw_is_frozen(&shared));
+        UwValue item = uw_list_item(&shared, 0);
+        TEST(uw_equal(&item, long_str));
+    }
+    {
+        // shared sub-lists are frozen once: each of 25 levels
+        // refers to the next one twice, i.e. 2^25 paths to the bottom
+        UwValue arena = uw_create_freeze_arena();
+        UwValue root = UwList(UwCharPtr(long_str));
+        for (unsigned i = 0; i < 25; i++) {
+            UwValue parent = UwList(uw_clone(&root), uw_clone(&root));
+            uw_destroy(&root);
+            root = uw_move(&parent);
+        }
+        UwValue status = uw_freeze_into(&arena, &root);
+        TEST(uw_ok(&status));
+        UwValue item = uw_clone(&root);
+        for (unsigned i = 0; i < 25; i++) {
+            TEST(uw_is_frozen(&item));
+            UwValue next = uw_list_item(&item, 1);
+            uw_destroy(&item);
+            item = uw_move(&next);
+        }
+        UwValue bottom = uw_list_item(&item, 0);
+        TEST(uw_is_frozen(&bottom));
+        TEST(uw_equal(&bottom, long_str));
+    }
+    {
+        // shared sub-lists are restored when freezing fails
+        UwValue shared = UwList(UwCharPtr(long_str));
+        UwValue list = UwList(uw_clone(&shared), uw_clone(&shared), uw_create_file());
+        unsigned refcount = shared.extra_data->refcount;
+        TEST(!uw_freeze(&list));
+        TEST(!uw_is_frozen(&list));
+        TEST(!uw_is_frozen(&shared));
+        TEST(shared.extra_data->refcount == refcount);
+        TEST(uw_list_append(&shared, 1));
+    }
+    {
+        // values with other extra data cannot be frozen
+        UwValue file = uw_create_file();
+        UwValue list = UwList(UwCharPtr(long_str), uw_clone(&file));
+        TEST(!uw_freeze(&list));
+        TEST(!uw_is_frozen(&list));
+        UwValue arena = uw_create_freeze_arena();
+        UwValue status = uw_freeze_into(&arena, &list);
+        TEST(status.status_code == UW_ERROR_INCOMPATIBLE_TYPE);
+        TEST(!uw_is_frozen(&list));
+        UwValue item = uw_list_item(&list, 0);
+        TEST(!uw_is_frozen(&item));
+        TEST(uw_list_append(&list, 1));
+    }
 }
 
 int main(int argc, char* argv[])
@@ -958,7 +2960,23 @@ int main(int argc, char* argv[])
     test_map();
     test_file();
     test_string_io();
+    test_csv();
+    test_json();
+    test_serialize();
+    test_frozen_map();
+    test_line_poller();
     test_netutils();
+    test_ipv6();
+    test_lpm();
+    test_ipset();
+    test_cpu_dispatch();
+#ifdef UW_ATOMIC_REFCOUNT
+    test_atomic_refcount();
+#endif
+    test_alloc_stats();
+    test_string_copy_stats();
+    test_memsize();
+    test_freeze();
 
     clock_gettime(CLOCK_MONOTONIC, &end_time);
     print_timediff(stderr, "time elapsed:", &start_time, &end_time);